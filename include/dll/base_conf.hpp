@@ -18,10 +18,12 @@
 #include "version.hpp"
 #include "unit_type.hpp"
 #include "updater_type.hpp"
+#include "conv_algorithm.hpp"
 #include "strategy.hpp"
 #include "function.hpp"
 #include "loss.hpp"
 #include "decay_type.hpp"
+#include "precision_type.hpp"
 #include "sparsity_method.hpp"
 #include "bias_mode.hpp"
 #include "initializer.hpp"
@@ -148,6 +150,7 @@ struct horizontal_mirroring_id;
 struct vertical_mirroring_id;
 struct categorical_id;
 struct threaded_id;
+struct workers_id;
 struct nop_id;
 struct no_bias_id;
 struct elastic_distortion_id;
@@ -160,6 +163,15 @@ struct updater_id;
 struct early_stopping_id;
 struct early_training_id;
 struct truncate_id;
+struct parallel_shards_id;
+struct memory_plan_id;
+struct checkpoint_id;
+struct pretrain_pipeline_id;
+struct pretrain_cache_id;
+struct conv_algo_id;
+struct lazy_gradients_id;
+struct stateful_id;
+struct mixed_precision_id;
 
 /*!
  * \brief Sets the minibatch size
@@ -201,6 +213,13 @@ struct padding : value_pair_conf_elt<padding_id, size_t, S1, S2> {};
 template <updater_type UT>
 struct updater : value_conf_elt<updater_id, updater_type, UT> {};
 
+/*!
+ * \brief Sets the algorithm of the forward convolutions of a layer
+ * \tparam A The convolution algorithm
+ */
+template <conv_algorithm A>
+struct conv_algo : value_conf_elt<conv_algo_id, conv_algorithm, A> {};
+
 /*!
  * \brief Sets the strategy type for early stopping
  * \tparam UT The strategy type
@@ -411,6 +430,14 @@ struct categorical : basic_conf_elt<categorical_id> {};
  */
 struct threaded : basic_conf_elt<threaded_id> {};
 
+/*!
+ * \brief Sets the number of worker threads used by the data generators to
+ * read and augment the batches ahead of the training.
+ * \tparam N The number of workers
+ */
+template <size_t N>
+struct workers : value_conf_elt<workers_id, size_t, N> {};
+
 /*!
  * \brief Sets the elastic distortion kernel
  * \tparam K The elastic distortion kernel
@@ -516,6 +543,99 @@ struct batch_mode : basic_conf_elt<batch_mode_id> {};
 template <size_t T>
 struct truncate : value_conf_elt<truncate_id, size_t, T> {};
 
+/*!
+ * \brief Split each fine-tuning batch into S shards trained in parallel
+ *
+ * Each shard is forwarded and backpropagated on its own replica of the
+ * training context and the gradients are summed before the update.
+ *
+ * \tparam S The number of shards
+ */
+template <size_t S>
+struct parallel_shards : value_conf_elt<parallel_shards_id, size_t, S> {};
+
+/*!
+ * \brief Plan the memory of the fine-tuning contexts by liveness.
+ *
+ * The batch buffers of the layers are allocated in a shared arena and
+ * the buffers that are never live at the same time share memory.
+ */
+struct memory_plan : basic_conf_elt<memory_plan_id> {};
+
+/*!
+ * \brief Keep the fine-tuning activations of only one layer out of K.
+ *
+ * The layers are split in segments of K layers and only the output of the
+ * last layer of each segment is kept during the forward pass. The other
+ * activations are recomputed from the segment input during the backward
+ * pass. This implies memory_plan.
+ *
+ * \tparam K The number of layers of each segment
+ */
+template <size_t K>
+struct checkpoint : value_conf_elt<checkpoint_id, size_t, K> {};
+
+/*!
+ * \brief Pretrain the layers of a DBN in a pipeline.
+ *
+ * Each layer trains alone for its first E epochs. Its activations are then
+ * streamed batch by batch to the next layer, which trains concurrently,
+ * instead of being materialized for the whole dataset.
+ *
+ * \tparam E The number of epochs before a layer feeds the next one
+ */
+template <size_t E>
+struct pretrain_pipeline : value_conf_elt<pretrain_pipeline_id, size_t, E> {};
+
+/*!
+ * \brief Cache the activations of the lower layers in batch mode pretraining.
+ *
+ * In batch mode, the input of each layer is recomputed from the input of
+ * the network for each batch of each epoch. This keeps up to C batches of
+ * these inputs in a bounded LRU cache. The batches are indexed by their
+ * position in the epoch, the cache cannot be used with shuffle_pre or with
+ * an augmented generator.
+ *
+ * \tparam C The maximum number of cached batches
+ */
+template <size_t C>
+struct pretrain_cache : value_conf_elt<pretrain_cache_id, size_t, C> {};
+
+/*!
+ * \brief Accumulate the gradients of an embedding layer only on the rows
+ * used by the batch and only update these rows.
+ *
+ * The decay and the state of the updater of a row are only updated when
+ * the row is used.
+ */
+struct lazy_gradients : basic_conf_elt<lazy_gradients_id> {};
+
+/*!
+ * \brief Carry the state of a recurrent layer from one batch to the next.
+ *
+ * The sample at position i of a batch must be the continuation of the
+ * sample at position i of the previous batch, the network must therefore
+ * not shuffle. The errors are not backpropagated across batches. The
+ * training batches and the test batches carry separate states.
+ */
+struct stateful : basic_conf_elt<stateful_id> {};
+
+/*!
+ * \brief Train with the activations and the errors in reduced precision.
+ *
+ * The outputs of the layers are stored in the given precision between the
+ * forward and the backward passes, the full precision buffers are only
+ * used at the layer boundaries and are shared by memory_plan, which is
+ * required. The errors are converted at the layer boundaries. The weights
+ * and the state of the updater are kept in full precision. The loss is
+ * scaled dynamically to keep the errors in the range of the reduced
+ * precision.
+ *
+ * \tparam P The precision of the activations and errors
+ */
+template <precision_type P = precision_type::BF16>
+struct mixed_precision : value_conf_elt<mixed_precision_id, precision_type, P> {};
+
 /*!
  * \brief Conditional shuffle (shuffle if Cond = true)
  */
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 
 #include "cpp_utils/assert.hpp" //Assertions
@@ -17,6 +19,9 @@
 #include "layer.hpp"
 #include "layer_traits.hpp"
 #include "util/tmp.hpp"
+#include "util/sequences.hpp" // for carried_state
+#include "util/timers.hpp" // for auto_timer
+#include "util/layer_cost.hpp"
 
 namespace dll {
 
@@ -32,6 +37,44 @@ struct base_lstm_layer : layer<Derived> {
     using base_type = layer<Derived>;                          ///< The base type
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr bool stateful            = desc::Stateful;             ///< Indicates if the state is carried between batches
+
+    static constexpr size_t gate_i = 0; ///< The position of the input gate in the packed matrices
+    static constexpr size_t gate_g = 1; ///< The position of the input modulation gate in the packed matrices
+    static constexpr size_t gate_f = 2; ///< The position of the forget gate in the packed matrices
+    static constexpr size_t gate_o = 3; ///< The position of the output gate in the packed matrices
+
+    mutable etl::dyn_matrix<weight, 3> g_t; ///< The input modulation gate at each time step
+    mutable etl::dyn_matrix<weight, 3> i_t; ///< The input gate at each time step
+    mutable etl::dyn_matrix<weight, 3> f_t; ///< The forget gate at each time step
+    mutable etl::dyn_matrix<weight, 3> o_t; ///< The output gate at each time step
+
+    mutable etl::dyn_matrix<weight, 3> x_t; ///< The input at each time step
+    mutable etl::dyn_matrix<weight, 3> s_t; ///< The cell state at each time step
+    mutable etl::dyn_matrix<weight, 3> h_t; ///< The output at each time step
+    mutable etl::dyn_matrix<weight, 3> z_t; ///< The packed pre-activations of the gates at each time step
+
+    mutable etl::dyn_matrix<weight, 3> d_h_t; ///< The errors of the output at each time step
+    mutable etl::dyn_matrix<weight, 3> d_c_t; ///< The errors of the cell state at each time step
+    mutable etl::dyn_matrix<weight, 3> d_x_t; ///< The errors of the input at each time step
+    mutable etl::dyn_matrix<weight, 2> dz_t;  ///< The packed errors of the gates of one time step
+
+    mutable etl::dyn_matrix<weight, 2> u_all; ///< The packed U weights of the four gates
+    mutable etl::dyn_matrix<weight, 2> w_all; ///< The packed W weights of the four gates
+    mutable etl::dyn_matrix<weight, 1> b_all; ///< The packed biases of the four gates
+
+    mutable bool packed_dirty = true; ///< Indicates that the packed weights are older than the weights of the gates
+
+    mutable etl::dyn_matrix<weight, 2> u_all_grad; ///< The packed gradients of the U weights
+    mutable etl::dyn_matrix<weight, 2> w_all_grad; ///< The packed gradients of the W weights
+    mutable etl::dyn_matrix<weight, 1> b_all_grad; ///< The packed gradients of the biases
+
+    mutable etl::dyn_matrix<weight, 2> h_0;          ///< The initial output of the current batch (stateful only)
+    mutable etl::dyn_matrix<weight, 2> c_0;          ///< The initial cell state of the current batch (stateful only)
+    mutable etl::dyn_matrix<weight, 2> h_state;      ///< The output carried to the next training batch (stateful only)
+    mutable etl::dyn_matrix<weight, 2> c_state;      ///< The cell state carried to the next training batch (stateful only)
+    mutable etl::dyn_matrix<weight, 2> h_test_state; ///< The output carried to the next test batch (stateful only)
+    mutable etl::dyn_matrix<weight, 2> c_test_state; ///< The cell state carried to the next test batch (stateful only)
 
     /*!
      * \brief Initialize the neural layer
@@ -81,6 +124,8 @@ struct base_lstm_layer : layer<Derived> {
         as_derived().w_o = *as_derived().bak_w_o;
         as_derived().u_o = *as_derived().bak_u_o;
         as_derived().b_o = *as_derived().bak_b_o;
+
+        invalidate_packed_weights();
     }
 
     /*!
@@ -117,6 +162,8 @@ struct base_lstm_layer : layer<Derived> {
         cpp::binary_load_all(is, as_derived().w_o);
         cpp::binary_load_all(is, as_derived().u_o);
         cpp::binary_load_all(is, as_derived().b_o);
+
+        invalidate_packed_weights();
     }
 
     /*!
@@ -135,11 +182,28 @@ struct base_lstm_layer : layer<Derived> {
         load(is);
     }
 
+    /*!
+     * \brief Indicates that the weights of the gates have been modified and
+     * must be packed again before the next forward pass.
+     *
+     * This is done by the updaters, the loaders and restore_weights(). It
+     * must only be called after modifying the weights directly.
+     */
+    void invalidate_packed_weights() {
+        packed_dirty = true;
+    }
+
     /*!
      * \brief Returns the trainable variables of this layer.
+     *
+     * Since the variables may be modified through the references, the packed
+     * weights are invalidated.
+     *
      * \return a tuple containing references to the variables of this layer
      */
     decltype(auto) trainable_parameters() {
+        invalidate_packed_weights();
+
         return std::make_tuple(
             std::ref(as_derived().w_i), std::ref(as_derived().u_i), std::ref(as_derived().b_i),
             std::ref(as_derived().w_g), std::ref(as_derived().u_g), std::ref(as_derived().b_g),
@@ -159,7 +223,545 @@ struct base_lstm_layer : layer<Derived> {
             std::cref(as_derived().w_o), std::cref(as_derived().u_o), std::cref(as_derived().b_o));
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return recurrent_cost(batch, as_derived().time_steps, as_derived().sequence_length, as_derived().hidden_units, 4, as_derived().bptt_steps,
+                              desc::parameters::template contains<last_only>(), sizeof(weight),
+                              {"lstm:forward_batch", "lstm:backward_batch", "lstm:compute_gradients"});
+    }
+
+    /*!
+     * \brief Reset the states carried between batches, for instance at the
+     * start of new sequences.
+     */
+    void reset_state() {
+        h_state = 0;
+        c_state = 0;
+
+        reset_test_state();
+    }
+
+    /*!
+     * \brief Reset the state carried between test batches, leaving the
+     * training state untouched.
+     */
+    void reset_test_state() {
+        h_test_state = 0;
+        c_test_state = 0;
+    }
+
+    /*!
+     * \brief Prepare the caches for the given batch size
+     */
+    void prepare_cache(size_t Batch) const {
+        if (cpp_unlikely(!i_t.memory_start())) {
+            const size_t T = as_derived().time_steps;
+            const size_t S = as_derived().sequence_length;
+            const size_t H = as_derived().hidden_units;
+
+            g_t.resize(T, Batch, H);
+            i_t.resize(T, Batch, H);
+            f_t.resize(T, Batch, H);
+            o_t.resize(T, Batch, H);
+
+            x_t.resize(T, Batch, S);
+            s_t.resize(T, Batch, H);
+            h_t.resize(T, Batch, H);
+            z_t.resize(T, Batch, 4 * H);
+
+            d_h_t.resize(T, Batch, H);
+            d_c_t.resize(T, Batch, H);
+            d_x_t.resize(T, Batch, S);
+            dz_t.resize(Batch, 4 * H);
+
+            u_all.resize(S, 4 * H);
+            w_all.resize(H, 4 * H);
+            b_all.resize(4 * H);
+
+            u_all_grad.resize(S, 4 * H);
+            w_all_grad.resize(H, 4 * H);
+            b_all_grad.resize(4 * H);
+
+#ifdef ETL_GPU
+            // Note: these matrices are only accessed through sub views
+            // So, the base CPU/GPU is never fully updated.
+            // Starting with valid GPU status ensures that we never copy between
+            // CPU and GPU
+            x_t.ensure_gpu_up_to_date();
+            h_t.ensure_gpu_up_to_date();
+            z_t.ensure_gpu_up_to_date();
+
+            d_h_t.ensure_gpu_up_to_date();
+            d_x_t.ensure_gpu_up_to_date();
+#endif
+        }
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * The four gates are computed together: the input contributions of
+     * all the time steps are computed with a single product, each time
+     * step then needs a single product for the recurrent contributions and
+     * one pass over the gates for the activations and the cell update.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename HH, typename V>
+    void forward_batch(HH&& output, const V& x) const {
+        forward_batch_impl(output, x, false);
+    }
+
+    using base_type::train_forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input, in training.
+     *
+     * A stateful layer carries a separate state in training, the test
+     * batches do not change it.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename HH, typename V>
+    void train_forward_batch(HH&& output, const V& x) const {
+        forward_batch_impl(output, x, true);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param train Indicates if the training state or the test state is carried
+     */
+    template <typename HH, typename V>
+    void forward_batch_impl(HH&& output, const V& x, [[maybe_unused]] bool train) const {
+        dll::auto_timer timer("lstm:forward_batch", etl::dim<0>(x));
+
+        const size_t Batch = etl::dim<0>(x);
+        const size_t T     = as_derived().time_steps;
+        const size_t S     = as_derived().sequence_length;
+        const size_t H     = as_derived().hidden_units;
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+
+        prepare_cache(Batch);
+
+        // 1. Rearrange input and pack the weights
+
+        x_t = transpose_front(x);
+
+        pack_weights();
+
+        // 2. Input contributions of all the time steps
+
+        etl::reshape(z_t, T * Batch, 4 * H) = bias_add_2d(etl::reshape(x_t, T * Batch, S) * u_all, b_all);
+
+        // 3. Forward propagation through time
+
+        if constexpr (stateful) {
+            auto& c_carried = train ? c_state : c_test_state;
+
+            h_0 = carried_state(train ? h_state : h_test_state, Batch, H);
+
+            // The cell state is reset together with the output
+            if (etl::size(c_carried) != Batch * H) {
+                c_carried.resize(Batch, H);
+                c_carried = 0;
+            }
+
+            c_0 = c_carried;
+        }
+
+        for (size_t t = 0; t < T; ++t) {
+            if (t > 0) {
+                z_t(t) += h_t(t - 1) * w_all;
+            } else if constexpr (stateful) {
+                z_t(t) += h_0 * w_all;
+            }
+
+            forward_step(t, Batch);
+        }
+
+        // 4. Carry the state to the next batch
+
+        if constexpr (stateful) {
+            (train ? h_state : h_test_state) = h_t(T - 1);
+            (train ? c_state : c_test_state) = s_t(T - 1);
+        }
+
+        // 5. Rearrange the output
+
+        output = transpose_front(h_t);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template <typename C>
+    void adapt_errors([[maybe_unused]] C& context) const {
+        // Nothing to do here (done in BPTT)
+    }
+
+    /*!
+     * \brief Backpropagation through time
+     *
+     * The errors of the four gates are packed together so that the errors
+     * of the input and of the previous output, as well as the gradients of
+     * the weights, are each computed with a single product per time step.
+     *
+     * \param output The ETL expression into which write the errors of the input
+     * \param context The training context
+     * \param direct Indicates if the errors of the input must be written to output
+     */
+    template <typename Output, typename C>
+    void backward_pass(Output& output, C& context, bool direct = true) const {
+        const size_t Batch      = etl::dim<0>(context.errors);
+        const size_t T          = as_derived().time_steps;
+        const size_t H          = as_derived().hidden_units;
+        const size_t bptt_steps = as_derived().bptt_steps;
+
+        // 1. Rearrange input/errors
+
+        etl::dyn_matrix<weight, 3> delta_t(T, Batch, H);
+
+        delta_t = transpose_front(context.errors);
+
+        // 2. Reset the packed gradients
+
+        u_all_grad = 0;
+        w_all_grad = 0;
+        b_all_grad = 0;
+
+        // 3. Backpropagation through time
+
+        size_t ttt = T - 1;
+
+        do {
+            const size_t last_step = std::max(int(T) - int(bptt_steps), 0);
+
+            // Backpropagation through time
+            for (int tt = ttt; tt >= int(last_step); --tt) {
+                const size_t t = tt;
+
+                backward_step(delta_t, t, Batch);
+
+                b_all_grad += bias_batch_sum_2d(dz_t);
+                u_all_grad += batch_outer(x_t(t), dz_t);
+
+                if (t > 0) {
+                    w_all_grad += batch_outer(h_t(t - 1), dz_t);
+                } else if constexpr (stateful) {
+                    // The carried state is a constant, the errors stop here
+                    w_all_grad += batch_outer(h_0, dz_t);
+                }
+
+                // The part going back to x
+                d_x_t(t) = dz_t * trans(u_all);
+
+                // The part going back to h
+                d_h_t(t) = dz_t * trans(w_all);
+            }
+
+            --ttt;
+
+            // If only the last time step is used, no need to use the other errors
+            if constexpr (desc::parameters::template contains<last_only>()) {
+                break;
+            }
+        } while (ttt != 0);
+
+        // 4. Unpack the gradients into the context
+
+        unpack_gate(std::get<0>(context.up.context)->grad, w_all_grad, gate_i, H);
+        unpack_gate(std::get<1>(context.up.context)->grad, u_all_grad, gate_i, H);
+        unpack_gate(std::get<2>(context.up.context)->grad, b_all_grad, gate_i, H);
+        unpack_gate(std::get<3>(context.up.context)->grad, w_all_grad, gate_g, H);
+        unpack_gate(std::get<4>(context.up.context)->grad, u_all_grad, gate_g, H);
+        unpack_gate(std::get<5>(context.up.context)->grad, b_all_grad, gate_g, H);
+        unpack_gate(std::get<6>(context.up.context)->grad, w_all_grad, gate_f, H);
+        unpack_gate(std::get<7>(context.up.context)->grad, u_all_grad, gate_f, H);
+        unpack_gate(std::get<8>(context.up.context)->grad, b_all_grad, gate_f, H);
+        unpack_gate(std::get<9>(context.up.context)->grad, w_all_grad, gate_o, H);
+        unpack_gate(std::get<10>(context.up.context)->grad, u_all_grad, gate_o, H);
+        unpack_gate(std::get<11>(context.up.context)->grad, b_all_grad, gate_o, H);
+
+        // 5. Rearrange for the output
+
+        if (direct) {
+            output = transpose_front(d_x_t);
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template <typename HH, typename C>
+    void backward_batch(HH&& output, C& context) const {
+        dll::auto_timer timer("lstm:backward_batch", etl::dim<0>(context.errors));
+
+        backward_pass(output, context, true);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template <typename C>
+    void compute_gradients(C& context) const {
+        if constexpr (!C::layer) {
+            dll::auto_timer timer("lstm:compute_gradients", etl::dim<0>(context.errors));
+            backward_pass(x_t, context, false);
+        }
+    }
+
 private:
+    /*!
+     * \brief Returns the logistic sigmoid of the given value
+     */
+    static weight sigmoid(weight x) {
+        return weight(1) / (weight(1) + std::exp(-x));
+    }
+
+    /*!
+     * \brief Returns the activation function of the layer applied to the given value
+     */
+    static weight activate(weight x) {
+        static_assert(activation_function != function::SOFTMAX, "SOFTMAX is not supported as LSTM activation");
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return x;
+        } else if constexpr (activation_function == function::SIGMOID) {
+            return sigmoid(x);
+        } else if constexpr (activation_function == function::TANH) {
+            return std::tanh(x);
+        } else {
+            return x > weight(0) ? x : weight(0);
+        }
+    }
+
+    /*!
+     * \brief Returns the derivative of the activation function of the layer from its output
+     */
+    static weight derivative(weight y) {
+        if constexpr (activation_function == function::IDENTITY) {
+            return weight(1);
+        } else if constexpr (activation_function == function::SIGMOID) {
+            return y * (weight(1) - y);
+        } else if constexpr (activation_function == function::TANH) {
+            return weight(1) - y * y;
+        } else {
+            return y > weight(0) ? weight(1) : weight(0);
+        }
+    }
+
+    /*!
+     * \brief Copy the weights of one gate into its columns of a packed matrix
+     * \param packed The packed (R, 4H) matrix
+     * \param m The (R, H) weights of the gate
+     * \param gate The position of the gate
+     * \param H The number of hidden units
+     */
+    template <typename P, typename M>
+    static void pack_gate(P& packed, const M& m, size_t gate, size_t H) {
+        const size_t R = etl::size(m) / H;
+
+        m.ensure_cpu_up_to_date();
+
+        for (size_t r = 0; r < R; ++r) {
+            std::copy_n(m.memory_start() + r * H, H, packed.memory_start() + r * 4 * H + gate * H);
+        }
+    }
+
+    /*!
+     * \brief Copy the columns of one gate of a packed matrix into its weights
+     * \param m The (R, H) weights of the gate
+     * \param packed The packed (R, 4H) matrix
+     * \param gate The position of the gate
+     * \param H The number of hidden units
+     */
+    template <typename M, typename P>
+    static void unpack_gate(M& m, const P& packed, size_t gate, size_t H) {
+        const size_t R = etl::size(m) / H;
+
+        packed.ensure_cpu_up_to_date();
+
+        for (size_t r = 0; r < R; ++r) {
+            std::copy_n(packed.memory_start() + r * 4 * H + gate * H, H, m.memory_start() + r * H);
+        }
+
+        m.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Pack the weights of the four gates, if they have been modified
+     * since they were last packed.
+     */
+    void pack_weights() const {
+        if (!packed_dirty) {
+            return;
+        }
+
+        const size_t H = as_derived().hidden_units;
+
+        auto& d = as_derived();
+
+        pack_gate(u_all, d.u_i, gate_i, H);
+        pack_gate(u_all, d.u_g, gate_g, H);
+        pack_gate(u_all, d.u_f, gate_f, H);
+        pack_gate(u_all, d.u_o, gate_o, H);
+
+        pack_gate(w_all, d.w_i, gate_i, H);
+        pack_gate(w_all, d.w_g, gate_g, H);
+        pack_gate(w_all, d.w_f, gate_f, H);
+        pack_gate(w_all, d.w_o, gate_o, H);
+
+        pack_gate(b_all, d.b_i, gate_i, H);
+        pack_gate(b_all, d.b_g, gate_g, H);
+        pack_gate(b_all, d.b_f, gate_f, H);
+        pack_gate(b_all, d.b_o, gate_o, H);
+
+        u_all.invalidate_gpu();
+        w_all.invalidate_gpu();
+        b_all.invalidate_gpu();
+
+        packed_dirty = false;
+    }
+
+    /*!
+     * \brief Returns a pointer to the cell state preceding the given time step
+     */
+    const weight* previous_cell_state(size_t t, size_t N) const {
+        if (t > 0) {
+            return s_t.memory_start() + (t - 1) * N;
+        } else if constexpr (stateful) {
+            c_0.ensure_cpu_up_to_date();
+            return c_0.memory_start();
+        } else {
+            // Not used by the first step
+            return s_t.memory_start();
+        }
+    }
+
+    /*!
+     * \brief Compute the gates, the cell state and the output of one time
+     * step from the packed pre-activations, in a single pass.
+     */
+    void forward_step(size_t t, size_t Batch) const {
+        const size_t H = as_derived().hidden_units;
+        const size_t N = Batch * H;
+
+        z_t.ensure_cpu_up_to_date();
+        s_t.ensure_cpu_up_to_date();
+
+        // With a carried state, the first step is like any other one
+        const bool first = t == 0 && !stateful;
+
+        const weight* z      = z_t.memory_start() + t * Batch * 4 * H;
+        const weight* s_prev = previous_cell_state(t, N);
+
+        weight* g = g_t.memory_start() + t * N;
+        weight* i = i_t.memory_start() + t * N;
+        weight* f = f_t.memory_start() + t * N;
+        weight* o = o_t.memory_start() + t * N;
+        weight* s = s_t.memory_start() + t * N;
+        weight* h = h_t.memory_start() + t * N;
+
+        for (size_t b = 0; b < Batch; ++b) {
+            const weight* zb = z + b * 4 * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                const size_t k = b * H + j;
+
+                g[k] = std::tanh(zb[gate_g * H + j]);
+                i[k] = sigmoid(zb[gate_i * H + j]);
+                f[k] = sigmoid(zb[gate_f * H + j]);
+                o[k] = sigmoid(zb[gate_o * H + j]);
+
+                if (first) {
+                    s[k] = g[k] * i[k];
+                    h[k] = activate(s[k]) * o[k];
+                } else {
+                    s[k] = activate(g[k] * i[k] + s_prev[k] * f[k]);
+                    h[k] = s[k] * o[k];
+                }
+            }
+        }
+
+        g_t.invalidate_gpu();
+        i_t.invalidate_gpu();
+        f_t.invalidate_gpu();
+        o_t.invalidate_gpu();
+        s_t.invalidate_gpu();
+        h_t.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the packed errors of the gates of one time step and
+     * propagate the errors of the cell state, in a single pass.
+     */
+    template <typename D>
+    void backward_step(const D& delta_t, size_t t, size_t Batch) const {
+        const size_t T = as_derived().time_steps;
+        const size_t H = as_derived().hidden_units;
+        const size_t N = Batch * H;
+
+        const bool last = t == T - 1;
+
+        delta_t.ensure_cpu_up_to_date();
+        d_h_t.ensure_cpu_up_to_date();
+        d_c_t.ensure_cpu_up_to_date();
+
+        const weight* delta   = delta_t.memory_start() + t * N;
+        const weight* dh_next = d_h_t.memory_start() + (last ? t : t + 1) * N;
+        const weight* dc_next = d_c_t.memory_start() + (last ? t : t + 1) * N;
+
+        const weight* g      = g_t.memory_start() + t * N;
+        const weight* i      = i_t.memory_start() + t * N;
+        const weight* f      = f_t.memory_start() + t * N;
+        const weight* o      = o_t.memory_start() + t * N;
+        const weight* s      = s_t.memory_start() + t * N;
+        const weight* s_prev = previous_cell_state(t, N);
+
+        const bool forget = t > 0 || stateful;
+
+        weight* dc = d_c_t.memory_start() + t * N;
+        weight* dz = dz_t.memory_start();
+
+        for (size_t b = 0; b < Batch; ++b) {
+            weight* dzb = dz + b * 4 * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                const size_t k = b * H + j;
+
+                const weight d_h = last ? delta[k] : delta[k] + dh_next[k];
+                const weight d_c = last ? o[k] * d_h * derivative(s[k]) : o[k] * d_h * derivative(s[k]) + dc_next[k];
+
+                dzb[gate_i * H + j] = i[k] * (weight(1) - i[k]) * g[k] * d_c;
+                dzb[gate_g * H + j] = (weight(1) - g[k] * g[k]) * i[k] * d_c;
+                dzb[gate_f * H + j] = forget ? f[k] * (weight(1) - f[k]) * s_prev[k] * d_c : weight(0);
+                dzb[gate_o * H + j] = o[k] * (weight(1) - o[k]) * s[k] * d_h;
+
+                // Update for the next step
+                dc[k] = f[k] * d_c;
+            }
+        }
+
+        d_c_t.invalidate_gpu();
+        dz_t.invalidate_gpu();
+    }
+
     //CRTP Deduction
 
     /*!
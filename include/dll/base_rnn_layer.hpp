@@ -17,6 +17,7 @@
 #include "layer.hpp"
 #include "layer_traits.hpp"
 #include "util/tmp.hpp"
+#include "util/sequences.hpp" // for carried_state
 
 namespace dll {
 
@@ -32,6 +33,7 @@ struct base_rnn_layer : layer<Derived> {
     using base_type = layer<Derived>;                  ///< The base type
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr bool stateful            = desc::Stateful;             ///< Indicates if the state is carried between batches
 
     /*!
      * \brief Initialize the neural layer
@@ -54,6 +56,27 @@ struct base_rnn_layer : layer<Derived> {
     mutable etl::dyn_matrix<float, 3> d_h_t;
     mutable etl::dyn_matrix<float, 3> d_x_t;
 
+    mutable etl::dyn_matrix<float, 2> s_0;          ///< The initial state of the current batch (stateful only)
+    mutable etl::dyn_matrix<float, 2> s_state;      ///< The state carried to the next training batch (stateful only)
+    mutable etl::dyn_matrix<float, 2> s_test_state; ///< The state carried to the next test batch (stateful only)
+
+    /*!
+     * \brief Reset the states carried between batches, for instance at the
+     * start of new sequences.
+     */
+    void reset_state() {
+        s_state      = 0;
+        s_test_state = 0;
+    }
+
+    /*!
+     * \brief Reset the state carried between test batches, leaving the
+     * training state untouched.
+     */
+    void reset_test_state() {
+        s_test_state = 0;
+    }
+
     void prepare_cache(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
         if (cpp_unlikely(!x_t.memory_start())) {
             // Forward cache
@@ -85,9 +108,10 @@ struct base_rnn_layer : layer<Derived> {
      * \param output A batch of output that will be filled
      * \param w The W weights matrix
      * \param u The U weights matrix
+     * \param train Indicates if the training state or the test state is carried
      */
     template <typename H, typename V, typename W, typename U, typename B>
-    void forward_batch_impl(H&& output, const V& x, const W& w, const U& u, const B& b, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
+    void forward_batch_impl(H&& output, const V& x, const W& w, const U& u, const B& b, size_t time_steps, size_t sequence_length, size_t hidden_units, [[maybe_unused]] bool train) const {
         const auto Batch = etl::dim<0>(x);
 
         prepare_cache(Batch, time_steps, sequence_length, hidden_units);
@@ -99,13 +123,25 @@ struct base_rnn_layer : layer<Derived> {
 
         // t == 0
 
-        s_t(0) = f_activate<activation_function>(bias_add_2d(x_t(0) * u, b));
+        if constexpr (stateful) {
+            s_0 = carried_state(train ? s_state : s_test_state, Batch, hidden_units);
+
+            s_t(0) = f_activate<activation_function>(bias_add_2d(x_t(0) * u + s_0 * w, b));
+        } else {
+            s_t(0) = f_activate<activation_function>(bias_add_2d(x_t(0) * u, b));
+        }
 
         for (size_t t = 1; t < time_steps; ++t) {
             s_t(t) = f_activate<activation_function>(bias_add_2d(x_t(t) * u + s_t(t - 1) * w, b));
         }
 
-        // 3. Rearrange the output
+        // 3. Carry the state to the next batch
+
+        if constexpr (stateful) {
+            (train ? s_state : s_test_state) = s_t(time_steps - 1);
+        }
+
+        // 4. Rearrange the output
 
         output = transpose_front(s_t);
     }
@@ -150,6 +186,9 @@ struct base_rnn_layer : layer<Derived> {
 
                 if (t > 0) {
                     w_grad += etl::batch_outer(s_t(t - 1), d_h_t(t));
+                } else if constexpr (stateful) {
+                    // The carried state is a constant, the errors stop here
+                    w_grad += etl::batch_outer(s_0, d_h_t(t));
                 }
 
                 u_grad += etl::batch_outer(x_t(t), d_h_t(t));
@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <cmath>
+#include <random>
+
 #include "cpp_utils/assert.hpp"         //Assertions
 #include "cpp_utils/maybe_parallel.hpp" //conditional parallel loops
 #include "cpp_utils/static_if.hpp"      //static_if for compile-time reduction
@@ -24,9 +27,12 @@
 
 #include "util/batch.hpp"
 #include "util/timers.hpp"
+#include "util/random.hpp"
 #include "decay_type.hpp"
+#include "unit_type.hpp"
 #include "layer_traits.hpp"
 #include "util/blas.hpp"
+#include "util/csr.hpp"
 
 namespace dll {
 
@@ -242,6 +248,33 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 
 /* The training procedures */
 
+/*!
+ * \brief Run the Gibbs chain of a fully-connected RBM, from the hidden
+ * units of the first step to the hidden units of the step K.
+ */
+template <bool Persistent, size_t K, typename RBM, typename Trainer>
+void run_chain_normal(RBM& rbm, Trainer& t) {
+    if (Persistent && t.init) {
+        t.p_h_a = t.h1_a;
+        t.p_h_s = t.h1_s;
+    }
+
+    //CD-1
+    if constexpr (Persistent) {
+        rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+    } else {
+        rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+    }
+
+    //CD-k
+    for (size_t k = 1; k < K; ++k) {
+        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+    }
+}
+
 /*!
  * \brief Compute the gradients for a fully-connected RBM
  */
@@ -275,25 +308,8 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
     //First step
     rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
 
-    if (Persistent && t.init) {
-        t.p_h_a = t.h1_a;
-        t.p_h_s = t.h1_s;
-    }
-
-    //CD-1
-    if constexpr (Persistent) {
-        rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-    } else {
-        rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-    }
-
     //CD-k
-    for (size_t k = 1; k < K; ++k) {
-        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-    }
+    run_chain_normal<Persistent, K>(rbm, t);
 
     //Compute the gradients
 
@@ -308,18 +324,50 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
 }
 
 /*!
- * \brief Train a fully-connected RBM.
+ * \brief Compute the gradients for a fully-connected RBM from a batch of
+ * sparse input.
+ *
+ * The positive phase uses sparse-dense products, the negative phase works
+ * on the dense reconstructions.
  */
-template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
-void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t) {
-    dll::auto_timer timer("cd:train:normal");
+template <bool Persistent, size_t K, typename RBM, typename Trainer>
+void compute_gradients_sparse(const csr_batch<typename RBM::weight>& input_batch, RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("cd:gradients:sparse:batch");
+
+    cpp_assert(etl::dim<0>(t.v1) >= input_batch.rows, "Invalid batch sizes");
 
+    //The dense input is only used for the visible biases and the error
+    csr_to_dense(t.vf, input_batch);
+
+    //First step
+    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, input_batch);
+
+    //CD-k
+    run_chain_normal<Persistent, K>(rbm, t);
+
+    //Compute the gradients
+
+    {
+        dll::auto_timer timer("cd:batch_compute_gradients:sparse");
+
+        csr_transpose_mul(t.w_grad, input_batch, t.h1_a);
+
+        t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+
+        t.b_grad = bias_batch_sum_2d(t.h1_a - t.h2_a);
+        t.c_grad = bias_batch_sum_2d(t.vf - t.v2_a);
+    }
+}
+
+/*!
+ * \brief Apply the gradients of a fully-connected RBM
+ */
+template <bool Persistent, typename RBM, typename Trainer>
+void apply_gradients_normal(rbm_training_context& context, RBM& rbm, Trainer& t) {
     using namespace etl;
 
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
 
-    compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t);
-
     if (Persistent) {
         t.p_h_a = t.h2_a;
         t.p_h_s = t.h2_s;
@@ -344,6 +392,30 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
     t.update(rbm);
 }
 
+/*!
+ * \brief Train a fully-connected RBM.
+ */
+template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
+void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("cd:train:normal");
+
+    compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t);
+
+    apply_gradients_normal<Persistent>(context, rbm, t);
+}
+
+/*!
+ * \brief Train a fully-connected RBM on a batch of sparse input.
+ */
+template <bool Persistent, size_t K, typename RBM, typename Trainer>
+void train_sparse(const csr_batch<typename RBM::weight>& input_batch, rbm_training_context& context, RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("cd:train:sparse");
+
+    compute_gradients_sparse<Persistent, K>(input_batch, rbm, t);
+
+    apply_gradients_normal<Persistent>(context, rbm, t);
+}
+
 /*!
  * \brief Compute the gradients for a Convolutional RBM
  */
@@ -534,6 +606,13 @@ struct base_cd_trainer : base_trainer<RBM> {
         train_normal<Persistent, N>(input_batch, expected_batch, context, rbm, *this);
     }
 
+    /*!
+     * \brief Train the RBM with one batch of sparse data
+     */
+    void train_batch(const csr_batch<weight>& input_batch, rbm_training_context& context) {
+        train_sparse<Persistent, N>(input_batch, context, rbm, *this);
+    }
+
     /*!
      * \brief The name of the trainer
      */
@@ -655,6 +734,13 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
         train_normal<Persistent, N>(input_batch, expected_batch, context, rbm, *this);
     }
 
+    /*!
+     * \brief Train the RBM with one batch of sparse data
+     */
+    void train_batch(const csr_batch<weight>& input_batch, rbm_training_context& context) {
+        train_sparse<Persistent, N>(input_batch, context, rbm, *this);
+    }
+
     /*!
      * \brief Return the name of the trainer
      */
@@ -923,4 +1009,349 @@ using cd1_trainer_t = cd_trainer<1, RBM>;
 template <typename RBM>
 using pcd1_trainer_t = persistent_cd_trainer<1, RBM>;
 
+/*!
+ * \brief Persistent Contrastive Divergence trainer with several chains of
+ * fantasy particles.
+ *
+ * Each chain holds one batch of fantasy particles and its own random
+ * engine, the chains are advanced in parallel and their negative statistics
+ * are averaged. With tempering, chain c samples at the inverse temperature
+ * 1 - c / Chains and neighbouring chains exchange their particles with the
+ * Metropolis criterion after each batch, based on the energy of their
+ * sampled visible and hidden states. Only the chain at temperature one
+ * contributes to the gradients in that case.
+ *
+ * \tparam N The number of Gibbs steps per batch
+ * \tparam RBM The type of RBM being trained
+ * \tparam Chains The number of chains
+ * \tparam Tempering Enable the parallel tempering swaps between the chains
+ */
+template <size_t N, typename RBM, size_t Chains, bool Tempering = false>
+struct parallel_pcd_trainer : base_trainer<RBM> {
+    static_assert(N > 0, "PCD-0 is not a valid training method");
+    static_assert(Chains > 0, "parallel_pcd_trainer needs at least one chain");
+    static_assert(!layer_traits<RBM>::is_convolutional_rbm_layer(), "parallel_pcd_trainer only supports dense RBM");
+    static_assert(RBM::hidden_unit == unit_type::BINARY, "parallel_pcd_trainer only supports binary hidden units");
+    static_assert(!Tempering || RBM::visible_unit == unit_type::BINARY, "parallel tempering only supports binary visible units");
+
+    using rbm_t  = RBM;                    ///< The type of RBM being trained
+    using weight = typename rbm_t::weight; ///< The data type for this layer
+
+    static constexpr auto batch_size = rbm_t::batch_size; ///< The batch size of the RBM
+
+    /*!
+     * \brief The number of chains contributing to the gradients
+     */
+    static constexpr size_t sampling_chains = Tempering ? 1 : Chains;
+
+    /*!
+     * \brief A chain of fantasy particles
+     */
+    struct chain_t {
+        dll::random_engine engine; ///< The random engine of the chain
+        weight beta;               ///< The inverse temperature of the chain
+
+        etl::dyn_matrix<weight> h_a; ///< The hidden activations of the particles
+        etl::dyn_matrix<weight> h_s; ///< The hidden samples of the particles, the persistent state
+        etl::dyn_matrix<weight> v_a; ///< The visible activations of the particles
+        etl::dyn_matrix<weight> v_s; ///< The visible samples of the particles
+
+        etl::dyn_matrix<weight> w_neg; ///< The negative statistics of the weights
+        etl::dyn_vector<weight> b_neg; ///< The negative statistics of the hidden biases
+        etl::dyn_vector<weight> c_neg; ///< The negative statistics of the visible biases
+
+        etl::dyn_vector<weight> energy; ///< The energy of each particle
+
+        chain_t(size_t seed, weight beta, size_t num_visible, size_t num_hidden)
+                : engine(seed),
+                  beta(beta),
+                  h_a(batch_size, num_hidden),
+                  h_s(batch_size, num_hidden),
+                  v_a(batch_size, num_visible),
+                  v_s(batch_size, num_visible),
+                  w_neg(num_visible, num_hidden),
+                  b_neg(num_hidden),
+                  c_neg(num_visible),
+                  energy(batch_size) {}
+    };
+
+    rbm_t& rbm; ///< The RBM being trained
+
+    etl::dyn_matrix<weight> v1; ///< The Input
+    etl::dyn_matrix<weight> vf; ///< The Expected Output
+
+    etl::dyn_matrix<weight> h1_a; ///< The hidden activation probabilites of the data
+
+    //Gradients
+    etl::dyn_matrix<weight> w_grad; ///< The gradients of the weights
+    etl::dyn_vector<weight> b_grad; ///< The gradients of the hidden biases
+    etl::dyn_vector<weight> c_grad; ///< The gradients of the visible biases
+
+    //{{{ Momentum
+
+    etl::dyn_matrix<weight> w_inc; ///< The gradients of the weights at the previous step, for momentum
+    etl::dyn_vector<weight> b_inc; ///< The gradients of the hidden biases at the previous step, for momentum
+    etl::dyn_vector<weight> c_inc; ///< The gradients of the visible biases at the previous step, for momentum
+
+    //}}} Momentum end
+
+    //{{{ Sparsity
+
+    weight q_global_batch; ///< The global sparsity on the batch
+    weight q_global_t;     ///< The global sparsity penalty
+
+    etl::dyn_vector<weight> q_local_batch; ///< The local sparsity on the batch
+    etl::dyn_vector<weight> q_local_t;     ///< The local sparsity penalty
+
+    //}}} Sparsity end
+
+    std::vector<chain_t> chains; ///< The chains of fantasy particles
+
+    dll::random_engine engine; ///< The random engine of the swaps
+
+    size_t swaps_attempted = 0; ///< The number of attempted swaps
+    size_t swaps_accepted  = 0; ///< The number of accepted swaps
+
+    cpp::thread_pool<true> pool; ///< The pool advancing the chains
+
+    explicit parallel_pcd_trainer(rbm_t& rbm)
+            : rbm(rbm),
+              v1(batch_size, rbm.num_visible),
+              vf(batch_size, rbm.num_visible),
+              h1_a(batch_size, rbm.num_hidden),
+              w_grad(rbm.num_visible, rbm.num_hidden),
+              b_grad(rbm.num_hidden),
+              c_grad(rbm.num_visible),
+              w_inc(rbm.num_visible, rbm.num_hidden, static_cast<weight>(0.0)),
+              b_inc(rbm.num_hidden, static_cast<weight>(0.0)),
+              c_inc(rbm.num_visible, static_cast<weight>(0.0)),
+              q_global_t(0.0),
+              q_local_batch(rbm.num_hidden),
+              q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
+              engine(dll::seed()) {
+        chains.reserve(Chains);
+
+        for (size_t c = 0; c < Chains; ++c) {
+            const weight beta = Tempering ? weight(1.0) - weight(c) / weight(Chains) : weight(1.0);
+
+            chains.emplace_back(dll::seed() + c + 1, beta, rbm.num_visible, rbm.num_hidden);
+        }
+    }
+
+    parallel_pcd_trainer(const parallel_pcd_trainer& rhs) = delete;
+    parallel_pcd_trainer& operator=(const parallel_pcd_trainer& rhs) = delete;
+
+    /*!
+     * \brief Sample binary states from the given activation probabilities
+     */
+    static void sample(etl::dyn_matrix<weight>& states, const etl::dyn_matrix<weight>& probabilities, dll::random_engine& g) {
+        std::uniform_real_distribution<weight> dist(0.0, 1.0);
+
+        for (size_t i = 0; i < etl::size(probabilities); ++i) {
+            states[i] = dist(g) < probabilities[i] ? weight(1.0) : weight(0.0);
+        }
+    }
+
+    /*!
+     * \brief Advance the given chain by one Gibbs step
+     */
+    void gibbs_step(chain_t& chain) const {
+        if constexpr (Tempering) {
+            chain.v_a = etl::sigmoid(chain.beta * bias_add_2d(chain.h_s * etl::transpose(rbm.w), rbm.c));
+
+            sample(chain.v_s, chain.v_a, chain.engine);
+
+            chain.h_a = etl::sigmoid(chain.beta * bias_add_2d(chain.v_s * rbm.w, rbm.b));
+        } else {
+            rbm.template batch_activate_visible<true, false>(chain.h_a, chain.h_s, chain.v_a, chain.v_s);
+            rbm.template batch_activate_hidden<true, false>(chain.h_a, chain.h_a, chain.v_a, chain.v_a);
+        }
+
+        sample(chain.h_s, chain.h_a, chain.engine);
+    }
+
+    /*!
+     * \brief Advance the given chain for one batch and compute its
+     * statistics
+     */
+    void advance(chain_t& chain, bool sampling) const {
+        for (size_t k = 0; k < N; ++k) {
+            gibbs_step(chain);
+        }
+
+        if (sampling) {
+            if constexpr (Tempering) {
+                chain.w_neg = batch_outer(chain.v_s, chain.h_a);
+                chain.b_neg = bias_batch_sum_2d(chain.h_a);
+                chain.c_neg = bias_batch_sum_2d(chain.v_s);
+            } else {
+                chain.w_neg = batch_outer(chain.v_a, chain.h_a);
+                chain.b_neg = bias_batch_sum_2d(chain.h_a);
+                chain.c_neg = bias_batch_sum_2d(chain.v_a);
+            }
+        }
+
+        // The swaps need the energy of the sampled state E(v_s, h_s)
+        if constexpr (Tempering) {
+            chain.energy = -(chain.v_s * rbm.c + chain.h_s * rbm.b + etl::sum_r((chain.v_s * rbm.w) >> chain.h_s));
+        }
+    }
+
+    /*!
+     * \brief Exchange the particles of neighbouring chains with the
+     * Metropolis criterion
+     */
+    void swap_chains() {
+        dll::auto_timer timer("cd:parallel_pcd:swap");
+
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+        for (size_t c = 0; c + 1 < Chains; ++c) {
+            auto& cold = chains[c];
+            auto& hot  = chains[c + 1];
+
+            for (size_t i = 0; i < batch_size; ++i) {
+                const double delta = double(cold.beta - hot.beta) * double(cold.energy[i] - hot.energy[i]);
+
+                ++swaps_attempted;
+
+                if (delta >= 0.0 || dist(engine) < std::exp(delta)) {
+                    for (size_t j = 0; j < etl::dim<1>(cold.v_s); ++j) {
+                        std::swap(cold.v_s(i, j), hot.v_s(i, j));
+                    }
+
+                    for (size_t j = 0; j < etl::dim<1>(cold.h_s); ++j) {
+                        std::swap(cold.h_s(i, j), hot.h_s(i, j));
+                    }
+
+                    std::swap(cold.energy[i], hot.energy[i]);
+
+                    ++swaps_accepted;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the rate of accepted swaps between the chains
+     */
+    double swap_rate() const {
+        return swaps_attempted ? swaps_accepted / double(swaps_attempted) : 0.0;
+    }
+
+    /*!
+     * \brief Update the given RBM
+     */
+    void update(RBM& rbm) {
+        update_normal(rbm, *this);
+    }
+
+    /*!
+     * \brief Train the RBM with one batch of data
+     */
+    template <typename InputBatch, typename ExpectedBatch>
+    void train_batch(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context) {
+        dll::auto_timer timer("cd:train:parallel_pcd");
+
+        cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
+
+        const size_t IB = etl::dim<0>(input_batch);
+
+        //Copy input/expected for computations
+        if (cpp_likely(IB == batch_size)) {
+            v1 = input_batch;
+            vf = expected_batch;
+        } else {
+            v1 = 0;
+            vf = 0;
+
+            etl::slice(v1, 0, IB) = input_batch;
+            etl::slice(vf, 0, IB) = expected_batch;
+        }
+
+        //Positive phase
+        rbm.template batch_activate_hidden<true, false>(h1_a, h1_a, v1, v1);
+
+        //The chains start from the first batch
+        if (this->init) {
+            for (auto& chain : chains) {
+                sample(chain.h_s, h1_a, chain.engine);
+            }
+
+            this->init = false;
+        }
+
+        //Negative phase, each chain in parallel
+        {
+            dll::auto_timer timer("cd:parallel_pcd:chains");
+
+            for (size_t c = 0; c < Chains; ++c) {
+                pool.do_task([this, c]() {
+                    // The parallelism is done at the chain level
+                    SERIAL_SECTION {
+                        advance(chains[c], c < sampling_chains);
+                    }
+                });
+            }
+
+            pool.wait();
+        }
+
+        //Compute the gradients with the statistics averaged over the chains
+
+        {
+            dll::auto_timer timer("cd:batch_compute_gradients:parallel_pcd");
+
+            w_grad = batch_outer(vf, h1_a);
+            b_grad = bias_batch_sum_2d(h1_a);
+            c_grad = bias_batch_sum_2d(vf);
+
+            const weight scale = weight(1.0) / weight(sampling_chains);
+
+            double error = 0.0;
+
+            q_global_batch = 0.0;
+
+            if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
+                q_local_batch = 0;
+            }
+
+            for (size_t c = 0; c < sampling_chains; ++c) {
+                auto& chain = chains[c];
+
+                w_grad -= scale * chain.w_neg;
+                b_grad -= scale * chain.b_neg;
+                c_grad -= scale * chain.c_neg;
+
+                error += etl::mean((vf - chain.v_a) >> (vf - chain.v_a));
+
+                q_global_batch += scale * etl::mean(chain.h_a);
+
+                if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
+                    q_local_batch += scale * bias_batch_mean_2d(chain.h_a);
+                }
+            }
+
+            context.batch_error    = error / sampling_chains;
+            context.batch_sparsity = q_global_batch;
+        }
+
+        nan_check_deep_3(w_grad, b_grad, c_grad);
+
+        if constexpr (Tempering) {
+            swap_chains();
+        }
+
+        //Update the weights and biases based on the gradients
+        update(rbm);
+    }
+
+    /*!
+     * \brief Return the name of the trainer
+     */
+    static std::string name() {
+        return std::string("Parallel Persistent Contrastive Divergence (") + std::to_string(Chains) + (Tempering ? " tempered chains)" : " chains)");
+    }
+};
+
 } //end of dll namespace
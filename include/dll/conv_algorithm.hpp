@@ -0,0 +1,47 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+namespace dll {
+
+/*!
+ * \brief The algorithm used for the forward convolutions of a layer
+ */
+enum class conv_algorithm {
+    DIRECT,   ///< The convolution kernels of ETL
+    IM2COL,   ///< Unroll the input patches and use a single GEMM per image
+    FFT,      ///< Pointwise products in the frequency domain
+    WINOGRAD, ///< Winograd F(2x2, 3x3), only for 3x3 kernels
+    AUTO      ///< Time the candidates on the first use of a shape and keep the fastest
+};
+
+/*!
+ * \brief Returns a string representation of a convolution algorithm
+ * \param a The convolution algorithm to transform to string
+ * \return a string representation of a convolution algorithm
+ */
+inline std::string to_string(conv_algorithm a) {
+    switch (a) {
+        case conv_algorithm::DIRECT:
+            return "DIRECT";
+        case conv_algorithm::IM2COL:
+            return "IM2COL";
+        case conv_algorithm::FFT:
+            return "FFT";
+        case conv_algorithm::WINOGRAD:
+            return "WINOGRAD";
+        case conv_algorithm::AUTO:
+            return "AUTO";
+    }
+
+    cpp_unreachable("Unreachable code");
+
+    return "UNDEFINED";
+}
+
+} //end of dll namespace
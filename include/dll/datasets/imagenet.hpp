@@ -7,15 +7,23 @@
 
 #pragma once
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 #include <unordered_map>
 #include <utility>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 
 #include <dirent.h>
 
 // Only for image loading...
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 
 namespace dll {
 
@@ -58,21 +66,267 @@ inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unord
     }
 }
 
+/*!
+ * \brief Returns the path of an image of the dataset
+ * \param imagenet_path The path to the dataset
+ * \param image_file The label and the number of the image
+ */
+inline std::string image_path(const std::string& imagenet_path, const std::pair<size_t, size_t>& image_file) {
+    auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
+
+    return imagenet_path + "/train" + label + label + "_" + std::to_string(image_file.second) + ".JPEG";
+}
+
+/*!
+ * \brief Decode an image, resized and center cropped to the output shape.
+ *
+ * The image is stored in (c, x, y) order.
+ *
+ * \param path The path of the image
+ * \param image The output image, of shape CxWxH
+ */
+template <size_t C, size_t H, size_t W, typename Image>
+void decode_image(const std::string& path, Image& image) {
+    auto mat = cv::imread(path.c_str(), C == 1 ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+
+    if (!mat.data || mat.empty()) {
+        std::cerr << "ERROR: Failed to read image: " << path << std::endl;
+        image = 0;
+        return;
+    }
+
+    // Resize the smallest side to the output shape and crop the center
+
+    if (size_t(mat.rows) != H || size_t(mat.cols) != W) {
+        const double scale = std::max(double(H) / mat.rows, double(W) / mat.cols);
+
+        cv::Mat resized;
+        cv::resize(mat, resized, cv::Size(std::max(int(W), int(std::ceil(mat.cols * scale))), std::max(int(H), int(std::ceil(mat.rows * scale)))), 0, 0, cv::INTER_AREA);
+
+        mat = resized(cv::Rect((resized.cols - W) / 2, (resized.rows - H) / 2, W, H));
+    }
+
+    for (size_t x = 0; x < W; ++x) {
+        for (size_t y = 0; y < H; ++y) {
+            if constexpr (C == 1) {
+                image(0, x, y) = mat.at<unsigned char>(y, x);
+            } else {
+                auto pixel = mat.at<cv::Vec3b>(y, x);
+
+                for (size_t c = 0; c < C; ++c) {
+                    image(c, x, y) = pixel.val[c];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief A parallel decoding stage for the images of the dataset.
+ *
+ * Several threads decode the images ahead of the reader into a bounded
+ * window of slots. The images are always handed out in the order of the
+ * files, independently of the decoding threads, so that the output is
+ * deterministic. The threads are only started when the first image is
+ * requested.
+ *
+ * \tparam T The type of the decoded images
+ */
+template <typename T>
+struct parallel_decoder {
+    using value_type      = T;                                            ///< The type of the decoded images
+    using decode_function = std::function<void(size_t index, value_type&)>; ///< The function decoding one image
+
+    /*!
+     * \brief The state of a slot of the window
+     */
+    enum class slot_state {
+        FREE,  ///< The slot can be used for decoding
+        BUSY,  ///< The slot is being decoded
+        READY  ///< The slot holds a decoded image
+    };
+
+    /*!
+     * \brief A slot of the decoding window
+     */
+    struct slot {
+        size_t index      = std::numeric_limits<size_t>::max(); ///< The index of the image in the slot
+        size_t generation = 0;                                  ///< The generation of the window when the slot was claimed
+        slot_state state  = slot_state::FREE;                   ///< The state of the slot
+        value_type image;                                        ///< The decoded image
+    };
+
+    decode_function decode; ///< The function decoding one image
+    size_t n;               ///< The number of images
+    size_t n_threads;       ///< The number of decoding threads
+
+    std::vector<slot> slots;          ///< The window of slots
+    std::vector<std::thread> threads; ///< The decoding threads
+
+    std::mutex lock;                        ///< The lock protecting the window
+    std::condition_variable work_condition;  ///< The condition for the threads to wait for space
+    std::condition_variable ready_condition; ///< The condition for the reader to wait for an image
+
+    size_t next_decode  = 0;     ///< The index of the next image to decode
+    size_t window_start = 0;     ///< The index of the first image not consumed yet
+    size_t generation   = 0;     ///< The generation of the window, incremented when it is moved back
+    bool stop_flag      = false; ///< Indicates to the threads to stop
+
+    /*!
+     * \brief Create a decoding stage
+     * \param decode The function decoding one image
+     * \param n The number of images
+     * \param n_threads The number of decoding threads (0 for one per hardware thread)
+     * \param depth The maximum number of images decoded ahead
+     */
+    parallel_decoder(decode_function decode, size_t n, size_t n_threads, size_t depth)
+            : decode(std::move(decode)), n(n), n_threads(n_threads ? n_threads : std::max(size_t(1), size_t(std::thread::hardware_concurrency()))), slots(depth) {
+        // The threads are started lazily
+    }
+
+    parallel_decoder(const parallel_decoder& rhs) = delete;
+    parallel_decoder& operator=(const parallel_decoder& rhs) = delete;
+
+    /*!
+     * \brief Stop the decoding threads
+     */
+    ~parallel_decoder() {
+        cpp::with_lock(lock, [this] { stop_flag = true; });
+
+        work_condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief The main function of a decoding thread
+     */
+    void decode_loop() {
+        while (true) {
+            size_t index = 0;
+            size_t s     = 0;
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                // Back-pressure: only decode inside the window
+                work_condition.wait(ulock, [this] {
+                    return stop_flag || (next_decode < n && next_decode < window_start + slots.size() && slots[next_decode % slots.size()].state == slot_state::FREE);
+                });
+
+                if (stop_flag) {
+                    return;
+                }
+
+                index = next_decode++;
+                s     = index % slots.size();
+
+                slots[s].index      = index;
+                slots[s].generation = generation;
+                slots[s].state      = slot_state::BUSY;
+            }
+
+            decode(index, slots[s].image);
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                // The window may have been moved back during decoding
+                if (slots[s].generation == generation) {
+                    slots[s].state = slot_state::READY;
+                } else {
+                    slots[s].index = std::numeric_limits<size_t>::max();
+                    slots[s].state = slot_state::FREE;
+                }
+            }
+
+            ready_condition.notify_all();
+            work_condition.notify_all();
+        }
+    }
+
+    /*!
+     * \brief Returns the image at the given index.
+     *
+     * Requesting an image before the current window (for instance when the
+     * reader starts a new epoch) moves the window back.
+     *
+     * \param index The index of the image
+     * \return The decoded image
+     */
+    value_type get(size_t index) {
+        std::unique_lock<std::mutex> ulock(lock);
+
+        if (threads.empty()) {
+            for (size_t t = 0; t < n_threads; ++t) {
+                threads.emplace_back([this] { decode_loop(); });
+            }
+        }
+
+        if (index < window_start) {
+            window_start = index;
+            next_decode  = index;
+
+            ++generation;
+
+            // The slots being decoded are released by their thread
+            for (auto& slot : slots) {
+                if (slot.state != slot_state::BUSY) {
+                    slot.index = std::numeric_limits<size_t>::max();
+                    slot.state = slot_state::FREE;
+                }
+            }
+
+            work_condition.notify_all();
+        }
+
+        auto& slot = slots[index % slots.size()];
+
+        ready_condition.wait(ulock, [&slot, index] {
+            return slot.index == index && slot.state == slot_state::READY;
+        });
+
+        value_type image = slot.image;
+
+        slot.state = slot_state::FREE;
+
+        // Advance the window over the consumed images
+        while (window_start < next_decode && slots[window_start % slots.size()].index == window_start && slots[window_start % slots.size()].state == slot_state::FREE) {
+            ++window_start;
+        }
+
+        ulock.unlock();
+
+        work_condition.notify_all();
+
+        return image;
+    }
+};
+
+/*!
+ * \brief Iterator over the images of the dataset.
+ *
+ * The images are decoded by the parallel decoding stage shared by the
+ * copies of the iterator. The decoding stage hands out the images in
+ * order, the iterator is therefore single-pass and an out-of-memory
+ * generator can only read it with one worker.
+ */
+template <size_t C, size_t H, size_t W>
 struct image_iterator {
     using iterator_category = std::input_iterator_tag;
-    using value_type        = etl::fast_dyn_matrix<float, 3, 256, 256>;
+    using value_type        = etl::fast_dyn_matrix<float, C, W, H>;
     using difference_type   = ptrdiff_t;
     using pointer           = value_type *;
     using reference         = value_type &;
 
-    std::string imagenet_path;
-    std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files;
-    std::shared_ptr<std::unordered_map<size_t, float>> labels;
+    std::shared_ptr<parallel_decoder<etl::fast_dyn_matrix<float, C, W, H>>> decoder;
 
     size_t index;
 
-    image_iterator(const std::string& imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, std::shared_ptr<std::unordered_map<size_t, float>> labels, size_t index) :
-        imagenet_path(imagenet_path), files(files), labels(labels), index(index)
+    image_iterator(std::shared_ptr<parallel_decoder<etl::fast_dyn_matrix<float, C, W, H>>> decoder, size_t index) :
+        decoder(decoder), index(index)
     {
         // Nothing else to init
     }
@@ -97,52 +351,7 @@ struct image_iterator {
     }
 
     value_type operator*() {
-        auto& image_file = (*files)[index];
-
-        auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
-
-        auto image_path =
-            std::string(imagenet_path) + "/train" + label + label +
-            "_" + std::to_string(image_file.second) + ".JPEG";
-
-        auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
-
-        value_type image;
-
-        if (!mat.data || mat.empty()) {
-            std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (mat.cols != 256 || mat.rows != 256) {
-            std::cerr << "ERROR: Image of invalid size: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (cpp_likely(mat.channels() == 3)) {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    auto pixel = mat.at<cv::Vec3b>(y, x);
-
-                    image(0, x, y) = pixel.val[0];
-                    image(1, x, y) = pixel.val[1];
-                    image(2, x, y) = pixel.val[2];
-                }
-            }
-        } else {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    image(0, x, y) = mat.at<unsigned char>(y, x);
-                }
-            }
-
-            image(1) = 0;
-            image(2) = 0;
-        }
-
-        return image;
+        return decoder->get(index);
     }
 
     bool operator==(const image_iterator& rhs) const {
@@ -205,26 +414,45 @@ struct label_iterator {
 } // end of namespace imagenet
 
 /*!
- * \brief Creates a dataset around CIFAR-10
- * \param folder The folder in which the CIFAR-10 files are
+ * \brief Creates a dataset around ImageNet
+ *
+ * The images are decoded in parallel, resized and center cropped. They are
+ * stored in (c, x, y) order, their shape is CxWxH.
+ *
+ * \param folder The folder in which the ImageNet files are
+ * \param threads The number of decoding threads of each generator (0 for one per hardware thread)
  * \param parameters The parameters of the generator
- * \return The CIFAR-10 dataset
+ * \return The ImageNet dataset
  */
-template<typename... Parameters>
-auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*parameters*/){
+template<size_t C = 3, size_t H = 256, size_t W = 256, typename... Parameters>
+auto make_imagenet_dataset(const std::string& folder, size_t threads, Parameters&&... /*parameters*/){
     auto train_files = std::make_shared<std::vector<std::pair<size_t, size_t>>>();
     auto labels      = std::make_shared<std::unordered_map<size_t, float>>();
 
     imagenet::read_files(*train_files, *labels, std::string(folder) + "train");
 
-    // Initial shuffle
-    std::random_device rd;
-    std::default_random_engine engine(rd());
-    std::shuffle(train_files->begin(), train_files->end(), engine);
+    // Initial shuffle (reproducible with the DLL seed)
+    std::sort(train_files->begin(), train_files->end());
+    std::shuffle(train_files->begin(), train_files->end(), dll::rand_engine());
+
+    // The decoding stages, decoding several batches ahead
+    constexpr size_t batch = detail::get_value_v<batch_size<1>, std::decay_t<Parameters>...>;
+
+    using image_t = etl::fast_dyn_matrix<float, C, W, H>;
+
+    auto decode = [folder, train_files](size_t index, image_t& image) {
+        imagenet::decode_image<C, H, W>(imagenet::image_path(folder, (*train_files)[index]), image);
+    };
+
+    auto train_decoder = std::make_shared<imagenet::parallel_decoder<image_t>>(decode, train_files->size(), threads, 4 * batch);
+    auto test_decoder  = std::make_shared<imagenet::parallel_decoder<image_t>>(decode, train_files->size(), threads, 4 * batch);
 
     // The image iterators
-    imagenet::image_iterator iit(folder, train_files, labels, 0);
-    imagenet::image_iterator iend(folder, train_files, labels, train_files->size());
+    imagenet::image_iterator<C, H, W> train_iit(train_decoder, 0);
+    imagenet::image_iterator<C, H, W> train_iend(train_decoder, train_files->size());
+
+    imagenet::image_iterator<C, H, W> test_iit(test_decoder, 0);
+    imagenet::image_iterator<C, H, W> test_iend(test_decoder, train_files->size());
 
     // The label iterators
     imagenet::label_iterator lit(train_files, labels, 0);
@@ -232,8 +460,22 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
 
     return make_dataset_holder(
         "imagenet",
-        make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}),
-        make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
+        make_generator(train_iit, train_iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}),
+        make_generator(test_iit, test_iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
+}
+
+/*!
+ * \brief Creates a dataset around ImageNet, with one decoding thread per
+ * hardware thread.
+ *
+ * \param folder The folder in which the ImageNet files are
+ * \param parameters The parameters of the generator
+ * \return The ImageNet dataset
+ */
+template<size_t C = 3, size_t H = 256, size_t W = 256, typename... Parameters>
+requires (!std::is_arithmetic_v<std::decay_t<Parameters>> && ...)
+auto make_imagenet_dataset(const std::string& folder, Parameters&&... parameters){
+    return make_imagenet_dataset<C, H, W>(folder, 0, std::forward<Parameters>(parameters)...);
 }
 
 } // end of namespace dll
@@ -0,0 +1,382 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file fused_network.hpp
+ * \brief Inference compilation of a trained network with layer fusion.
+ *
+ * A dense or convolutional layer (or their dynamic versions) without
+ * activation function that is followed by a batch normalization layer
+ * gets the normalization folded in its weights and biases. An
+ * activation layer that follows (directly or after the normalization) is
+ * applied in the same pass as the biases. Each fused chain then costs a
+ * single product (or convolution) and a single element-wise pass instead
+ * of up to five passes over the output.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <tuple>
+#include <vector>
+
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/function.hpp"
+#include "dll/util/timers.hpp" // for auto_timer
+
+namespace dll {
+
+namespace fusion_detail {
+
+template <typename Layer>
+concept dense_c = cpp::is_specialization_of_v<dll::dense_layer_impl, Layer> || cpp::is_specialization_of_v<dll::dyn_dense_layer_impl, Layer>;
+
+template <typename Layer>
+concept conv_c = cpp::is_specialization_of_v<dll::conv_layer_impl, Layer> || cpp::is_specialization_of_v<dll::dyn_conv_layer_impl, Layer>;
+
+template <typename Layer>
+concept bn_2d_c = cpp::is_specialization_of_v<dll::batch_normalization_2d_layer_impl, Layer> || cpp::is_specialization_of_v<dll::dyn_batch_normalization_2d_layer_impl, Layer>;
+
+template <typename Layer>
+concept bn_4d_c = cpp::is_specialization_of_v<dll::batch_normalization_4d_layer_impl, Layer> || cpp::is_specialization_of_v<dll::dyn_batch_normalization_4d_layer_impl, Layer>;
+
+template <typename Layer>
+concept activation_c = cpp::is_specialization_of_v<dll::activation_layer_impl, Layer>;
+
+/*!
+ * \brief Returns the type of the Ith layer of the network, or void if
+ * the layer is not part of the forward pass
+ */
+template <typename Network, size_t I, typename Enable = void>
+struct layer_or_void {
+    using type = void;
+};
+
+template <typename Network, size_t I>
+struct layer_or_void<Network, I, std::enable_if_t<(I <= Network::output_layer_n)>> {
+    using type = typename Network::template layer_type<I>;
+};
+
+template <typename Network, size_t I>
+using layer_or_void_t = typename layer_or_void<Network, I>::type;
+
+/*!
+ * \brief The fusion decision for the chain starting at the Ith layer
+ */
+template <typename Network, size_t I>
+struct plan {
+    using layer_t = layer_or_void_t<Network, I>; ///< The head layer
+
+    static constexpr bool linear = dense_c<layer_t> || conv_c<layer_t>;
+
+    static constexpr bool identity = [] {
+        if constexpr (linear) {
+            return layer_t::activation_function == function::IDENTITY;
+        } else {
+            return false;
+        }
+    }();
+
+    using next_t = layer_or_void_t<Network, I + 1>;
+
+    static constexpr bool bn = identity && ((dense_c<layer_t> && bn_2d_c<next_t>) || (conv_c<layer_t> && bn_4d_c<next_t>));
+
+    using act_t = layer_or_void_t<Network, I + 1 + bn>;
+
+    static constexpr bool act = identity && activation_c<act_t>;
+
+    static constexpr bool fused = bn || act; ///< Indicates if layers are fused with the head
+
+    static constexpr size_t next = I + 1 + bn + act; ///< The index of the layer after the chain
+
+    /*!
+     * \brief The activation function applied at the end of the chain
+     */
+    static constexpr function activation_function = [] {
+        if constexpr (act) {
+            return act_t::activation_function;
+        } else {
+            return function::IDENTITY;
+        }
+    }();
+};
+
+} //end of namespace fusion_detail
+
+/*!
+ * \brief A layer of the fused network that is forwarded as is to the
+ * original layer.
+ */
+template <typename Network, size_t I, typename Enable = void>
+struct fused_layer {
+    using layer_t = typename Network::template layer_type<I>; ///< The original layer
+
+    const layer_t& layer; ///< The original layer
+
+    /*!
+     * \brief Create the wrapper around the Ith layer of the network
+     */
+    explicit fused_layer(Network& net) : layer(net.template layer_get<I>()) {}
+
+    /*!
+     * \brief Returns a short description of the layer
+     */
+    std::string to_short_string() const {
+        return layer.to_short_string();
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     *
+     * \return A batch of output
+     */
+    template <typename Input>
+    auto test_forward_batch(const Input& input) const {
+        return layer.test_forward_batch(input);
+    }
+};
+
+/*!
+ * \brief A dense or convolutional layer with the following batch
+ * normalization folded in its weights and the following activation
+ * applied with the biases.
+ */
+template <typename Network, size_t I>
+struct fused_layer<Network, I, std::enable_if_t<fusion_detail::plan<Network, I>::fused>> {
+    using plan_t  = fusion_detail::plan<Network, I>;                ///< The fusion plan
+    using layer_t = typename Network::template layer_type<I>;       ///< The head layer
+    using weight  = typename layer_t::weight;                       ///< The data type of the layer
+    using w_type  = typename layer_t::w_type;                       ///< The type of the folded weights
+    using b_type  = etl::dyn_matrix<weight, 1>;                     ///< The type of the folded biases
+
+    static constexpr bool is_conv = fusion_detail::conv_c<layer_t>; ///< Indicates if the head is convolutional
+
+    const layer_t& layer; ///< The head layer
+
+    w_type w; ///< The folded weights
+    b_type b; ///< The folded biases
+
+    /*!
+     * \brief Fold the chain starting at the Ith layer of the network
+     */
+    explicit fused_layer(Network& net) : layer(net.template layer_get<I>()), w(layer.w), b(etl::dim<is_conv ? 0 : 1>(layer.w)) {
+        if constexpr (layer_t::no_bias) {
+            b = 0;
+        } else {
+            b = layer.b;
+        }
+
+        if constexpr (plan_t::bn) {
+            auto& bn = net.template layer_get<I + 1>();
+
+            // y = gamma * (x - mean) / sqrt(var + e) + beta
+            etl::dyn_matrix<weight, 1> scale(etl::size(b));
+            scale = bn.gamma >> (1.0 / etl::sqrt(bn.var + bn.e));
+
+            b = (scale >> (b - bn.mean)) + bn.beta;
+
+            if constexpr (is_conv) {
+                for (size_t k = 0; k < etl::dim<0>(w); ++k) {
+                    w(k) = scale(k) * w(k);
+                }
+            } else {
+                for (size_t i = 0; i < etl::dim<0>(w); ++i) {
+                    w(i) = scale >> w(i);
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the fused chain
+     */
+    std::string to_short_string() const {
+        std::string str = layer.to_short_string();
+
+        if constexpr (plan_t::bn) {
+            str += "+BN";
+        }
+
+        if constexpr (plan_t::act) {
+            str += "+" + to_string(plan_t::activation_function);
+        }
+
+        return str;
+    }
+
+    /*!
+     * \brief Apply the fused chain to the given batch of input.
+     *
+     * \param input A batch of input
+     *
+     * \return A batch of output
+     */
+    template <typename Input>
+    auto test_forward_batch(const Input& input) const {
+        const size_t B = etl::dim<0>(input);
+
+        if constexpr (is_conv) {
+            dll::auto_timer timer("fused:conv:forward_batch");
+
+            if constexpr (cpp::is_specialization_of_v<dll::conv_layer_impl, layer_t>) {
+                constexpr size_t S1 = layer_t::S1;
+                constexpr size_t S2 = layer_t::S2;
+                constexpr size_t P1 = layer_t::P1;
+                constexpr size_t P2 = layer_t::P2;
+
+                etl::dyn_matrix<weight, 4> output(B, layer_t::K, layer_t::NH1, layer_t::NH2);
+                output = etl::ml::convolution_forward<S1, S2, P1, P2>(etl::reshape(input, B, layer_t::NC, layer_t::NV1, layer_t::NV2), w);
+                output = f_activate<plan_t::activation_function>(bias_add_4d(output, b));
+                return output;
+            } else {
+                etl::dyn_matrix<weight, 4> output(B, layer.k, layer.nh1, layer.nh2);
+                output = etl::ml::convolution_forward(etl::reshape(input, B, layer.nc, layer.nv1, layer.nv2), w, layer.s1, layer.s2, layer.p1, layer.p2);
+                output = f_activate<plan_t::activation_function>(bias_add_4d(output, b));
+                return output;
+            }
+        } else {
+            dll::auto_timer timer("fused:dense:forward_batch");
+
+            etl::dyn_matrix<weight, 2> output(B, layer.output_size());
+            output = etl::reshape(input, B, layer.input_size()) * w;
+            output = f_activate<plan_t::activation_function>(bias_add_2d(output, b));
+            return output;
+        }
+    }
+};
+
+namespace fusion_detail {
+
+template <typename Network, typename Sequence>
+struct layers_tuple;
+
+template <typename Network, size_t... I>
+struct layers_tuple<Network, std::index_sequence<I...>> {
+    using type = std::tuple<fused_layer<Network, I>...>;
+};
+
+} //end of namespace fusion_detail
+
+/*!
+ * \brief A frozen, inference-only, version of a trained network with
+ * the batch normalization and activation layers fused into the
+ * preceding dense and convolutional layers.
+ *
+ * The folded weights are copied, but the layers that are not fused are
+ * used directly from the network, which must outlive the fused network.
+ */
+template <typename Network>
+struct fused_network {
+    using network_t = Network;                                                                                              ///< The original network
+    using layers_t  = typename fusion_detail::layers_tuple<network_t, std::make_index_sequence<network_t::output_layer_n + 1>>::type; ///< The fused layers
+
+    network_t& net;  ///< The original network
+    layers_t layers; ///< The fused layers (only the heads of the chains are used)
+
+    /*!
+     * \brief Fuse the layers of the given network
+     */
+    explicit fused_network(network_t& net) : net(net), layers(make_layers(net, std::make_index_sequence<network_t::output_layer_n + 1>{})) {}
+
+    /*!
+     * \brief Returns the number of layers of the fused network
+     */
+    static constexpr size_t fused_layers() noexcept {
+        return fused_layers_impl<0>();
+    }
+
+    /*!
+     * \brief Display a description of the fused network
+     */
+    void display() const {
+        std::cout << "Fused network: " << (network_t::output_layer_n + 1) << " -> " << fused_layers() << " layers" << std::endl;
+        display_impl<0>();
+    }
+
+    /*!
+     * \brief Compute the output of the network for the given batch of input
+     * \param input A batch of input
+     * \return A batch of output
+     */
+    template <typename Input>
+    auto forward_batch(const Input& input) const {
+        return forward_batch_impl<0>(input);
+    }
+
+    /*!
+     * \brief Evaluate the fused network on the given classification task
+     * and return the classification error.
+     *
+     * \param generator The data generator
+     *
+     * \return The classification error
+     */
+    template <typename Generator>
+    double evaluate_error(Generator& generator) const {
+        auto forward_helper = [this](auto&& input_batch) {
+            return this->forward_batch(input_batch);
+        };
+
+        auto [error, loss] = net.evaluate_metrics(generator, forward_helper);
+        return error;
+    }
+
+private:
+    template <size_t... I>
+    static layers_t make_layers(network_t& net, std::index_sequence<I...> /*seq*/) {
+        return layers_t{fused_layer<network_t, I>(net)...};
+    }
+
+    template <size_t L>
+    static constexpr size_t fused_layers_impl() noexcept {
+        if constexpr (L > network_t::output_layer_n) {
+            return 0;
+        } else {
+            return 1 + fused_layers_impl<fusion_detail::plan<network_t, L>::next>();
+        }
+    }
+
+    template <size_t L>
+    void display_impl() const {
+        if constexpr (L <= network_t::output_layer_n) {
+            std::cout << "    " << std::get<L>(layers).to_short_string() << std::endl;
+            display_impl<fusion_detail::plan<network_t, L>::next>();
+        }
+    }
+
+    template <size_t L, typename Input>
+    auto forward_batch_impl(const Input& input) const {
+        constexpr size_t next = fusion_detail::plan<network_t, L>::next;
+
+        if constexpr (next <= network_t::output_layer_n) {
+            auto output = std::get<L>(layers).test_forward_batch(input);
+            return forward_batch_impl<next>(output);
+        } else {
+            return std::get<L>(layers).test_forward_batch(input);
+        }
+    }
+};
+
+/*!
+ * \brief Compile the given trained network for inference, fusing the
+ * batch normalization and activation layers into the preceding dense
+ * and convolutional layers.
+ *
+ * \param net The trained network
+ *
+ * \return The fused network
+ */
+template <typename Network>
+fused_network<Network> fuse_inference(Network& net) {
+    return fused_network<Network>(net);
+}
+
+} //end of dll namespace
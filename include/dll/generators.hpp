@@ -68,3 +68,4 @@ concept special_generator = augmented_generator<Desc> || threaded_generator<Desc
 #include "dll/generators/inmemory_data_generator.hpp"
 #include "dll/generators/inmemory_single_data_generator.hpp"
 #include "dll/generators/outmemory_data_generator.hpp"
+#include "dll/generators/mmap_data_generator.hpp"
@@ -67,9 +67,23 @@ struct random_cropper {
      */
     template <typename O, typename T>
     void transform_first(O && target, const T & image) {
+        transform_first(target, image, dll::rand_engine());
+    }
+
+    /*!
+     * \brief Transform an image using the given random generator.
+     *
+     * This is used as the first step for data augmentation.
+     *
+     * \param target The target output
+     * \param image The input image
+     * \param g The random generator
+     */
+    template <typename O, typename T, typename G>
+    void transform_first(O && target, const T & image, G& g) {
         if constexpr (random_crop_x && random_crop_y) {
-            const size_t y_offset = dist_y(dll::rand_engine());
-            const size_t x_offset = dist_x(dll::rand_engine());
+            const size_t y_offset = dist_y(g);
+            const size_t x_offset = dist_x(g);
 
             for (size_t c = 0; c < etl::dim<0>(image); ++c) {
                 for (size_t y = 0; y < random_crop_y; ++y) {
@@ -153,8 +167,18 @@ struct random_mirrorer {
      */
     template <typename O>
     void transform(O && target) {
+        transform(target, dll::rand_engine());
+    }
+
+    /*!
+     * \brief Apply the transform on the input using the given random generator
+     * \param target The input to transform
+     * \param g The random generator
+     */
+    template <typename O, typename G>
+    void transform(O && target, G& g) {
         if constexpr (horizontal || vertical) {
-            auto choice = dist(dll::rand_engine());
+            auto choice = dist(g);
 
             if (horizontal && vertical && choice == 1) {
                 for (size_t c = 0; c < etl::dim<0>(target); ++c) {
@@ -211,9 +235,17 @@ struct random_noise {
      */
     template <typename O>
     void transform(O && target) {
-        if constexpr (N) {
-            auto & g = dll::rand_engine();
+        transform(target, dll::rand_engine());
+    }
 
+    /*!
+     * \brief Apply the transform on the input using the given random generator
+     * \param target The input to transform
+     * \param g The random generator
+     */
+    template <typename O, typename G>
+    void transform(O && target, G& g) {
+        if constexpr (N) {
             for (auto & v : target) {
                 v *= dist(g) < N * 10 ? 0.0 : 1.0;
             }
@@ -275,6 +307,16 @@ struct elastic_distorter {
      */
     template <typename O>
     void transform(O&& target) {
+        transform(target, dll::rand_engine());
+    }
+
+    /*!
+     * \brief Apply the transform on the input using the given random generator
+     * \param target The input to transform
+     * \param g The random generator
+     */
+    template <typename O, typename G>
+    void transform(O&& target, G& g) {
         if constexpr (K) {
             const size_t width  = etl::dim<1>(target);
             const size_t height = etl::dim<2>(target);
@@ -284,8 +326,8 @@ struct elastic_distorter {
             etl::dyn_matrix<weight> d_x(width, height);
             etl::dyn_matrix<weight> d_y(width, height);
 
-            d_x = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
-            d_y = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
+            d_x = etl::uniform_generator(g, -1.0, 1.0);
+            d_y = etl::uniform_generator(g, -1.0, 1.0);
 
             // 1. Gaussian blur the displacement fields
 
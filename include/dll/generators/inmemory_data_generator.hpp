@@ -14,6 +14,7 @@
 
 #include <atomic>
 #include <thread>
+#include <vector>
 #include "dll/generators.hpp"
 
 namespace dll {
@@ -325,26 +326,54 @@ struct inmemory_data_generator<Iterator, LIterator, Desc> {
     big_cache_type batch_cache;   ///< The data batch cache
     label_cache_type label_cache; ///< The label cache
 
+    static constexpr inline size_t n_workers = desc::Workers; ///< The number of augmentation workers
+
+    /*!
+     * \brief The state of a slot of the batch cache
+     */
+    enum class slot_state : size_t {
+        FREE,  ///< The slot is waiting to be filled
+        BUSY,  ///< The slot is being filled
+        READY  ///< The slot is ready to be consumed
+    };
+
+    /*!
+     * \brief The augmenters used by one worker
+     */
+    struct worker_augmenters {
+        random_cropper<Desc> cropper;              ///< The random cropper
+        random_mirrorer<Desc> mirrorer;            ///< The random mirrorer
+        elastic_distorter<weight, Desc> distorter; ///< The elastic distorter
+        random_noise<Desc> noiser;                 ///< The random noiser
+
+        /*!
+         * \brief Construct the augmenters for the given example image
+         */
+        template <typename T>
+        explicit worker_augmenters(const T& image) : cropper(image), mirrorer(image), distorter(image), noiser(image) {}
+    };
+
     random_cropper<Desc> cropper;      ///< The random cropper
     random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
     elastic_distorter<weight, Desc> distorter; ///< The elastic distorter
     random_noise<Desc> noiser;         ///< The random noiser
 
-
     size_t current = 0;     ///< The current index
     bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
+    mutable std::atomic<slot_state> status[big_batch_size]; ///< Status of each slot of the batch cache
+    mutable std::atomic<size_t> indices[big_batch_size];    ///< Batch index held by each slot of the batch cache
 
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
+    std::atomic<size_t> generation{0}; ///< The current generation (used to seed the random streams)
+
+    mutable std::mutex main_lock;                    ///< The lock protecting the sleeping of the threads
+    mutable std::condition_variable condition;       ///< The condition variable for the workers to wait for some space
     mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
+    std::atomic<bool> stop_flag{false}; ///< Boolean flag indicating to the workers to stop
 
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    std::vector<std::thread> worker_threads; ///< The augmentation workers
+    std::atomic<bool> train_mode{false};     ///< The train mode status
 
     /*!
      * \brief Construct an inmemory data generator
@@ -385,91 +414,117 @@ struct inmemory_data_generator<Iterator, LIterator, Desc> {
         }
 
         for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
+            indices[b].store(b, std::memory_order_relaxed);
+            status[b].store(slot_state::FREE, std::memory_order_release);
         }
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
+        worker_threads.reserve(n_workers);
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+        for (size_t w = 0; w < n_workers; ++w) {
+            worker_threads.emplace_back([this] { worker_loop(); });
+        }
+    }
 
-                    bool found = false;
+    /*!
+     * \brief Indicates if the given slot can be filled by a worker
+     */
+    bool fillable(size_t b) const {
+        return status[b].load(std::memory_order_acquire) == slot_state::FREE && indices[b].load(std::memory_order_relaxed) * batch_size < size();
+    }
 
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < size()) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
+    /*!
+     * \brief Try to take the ownership of a slot to fill
+     * \param index The index of the slot that has been claimed
+     * \return true if a slot has been claimed, false otherwise
+     */
+    bool claim_slot(size_t& index) {
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            auto expected = slot_state::FREE;
 
-                    // if not found, wait for a ready to compute batch
+            if (indices[b].load(std::memory_order_relaxed) * batch_size < size() && status[b].compare_exchange_strong(expected, slot_state::BUSY, std::memory_order_acq_rel)) {
+                // The index may have been changed before the claim
+                if (indices[b].load(std::memory_order_relaxed) * batch_size < size()) {
+                    index = b;
+                    return true;
+                }
 
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
+                status[b].store(slot_state::FREE, std::memory_order_release);
+            }
+        }
 
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < size()) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
+        return false;
+    }
 
-                            return false;
-                        });
+    /*!
+     * \brief The main function of an augmentation worker
+     */
+    void worker_loop() {
+        worker_augmenters augmenters(input_cache(0));
+
+        while (true) {
+            // The index of the batch inside the batch cache
+            size_t index = 0;
+
+            while (!claim_slot(index)) {
+                std::unique_lock<std::mutex> ulock(main_lock);
 
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
+                // Wait for the end or for some work
+                condition.wait(ulock, [this] {
+                    if (stop_flag) {
+                        return true;
+                    }
+
+                    for (size_t b = 0; b < big_batch_size; ++b) {
+                        if (fillable(b)) {
+                            return true;
                         }
                     }
+
+                    return false;
+                });
+
+                // If there is no more work for the thread, exit
+                if (stop_flag) {
+                    return;
                 }
+            }
 
-                // Get the batch that needs to be read
-                const size_t batch = indices[index];
+            // Get the batch that needs to be read
+            const size_t batch = indices[index].load(std::memory_order_relaxed);
 
-                // Get the index from where to read inside the input cache
-                const size_t input_n = batch * batch_size;
+            // Get the index from where to read inside the input cache
+            const size_t input_n = batch * batch_size;
 
-                for (size_t i = 0; i < batch_size && input_n + i < size(); ++i) {
-                    if (train_mode) {
-                        // Random crop the image
-                        cropper.transform_first(batch_cache(index)(i), input_cache(input_n + i));
+            // The random stream only depends on the batch, not on the worker
+            dll::random_engine g(dll::seed() + generation.load(std::memory_order_relaxed) * batches() + batch);
 
-                        // Mirror the image
-                        mirrorer.transform(batch_cache(index)(i));
+            for (size_t i = 0; i < batch_size && input_n + i < size(); ++i) {
+                if (train_mode) {
+                    // Random crop the image
+                    augmenters.cropper.transform_first(batch_cache(index)(i), input_cache(input_n + i), g);
 
-                        // Distort the image
-                        distorter.transform(batch_cache(index)(i));
+                    // Mirror the image
+                    augmenters.mirrorer.transform(batch_cache(index)(i), g);
 
-                        // Noise the image
-                        noiser.transform(batch_cache(index)(i));
-                    } else {
-                        // Center crop the image
-                        cropper.transform_first_test(batch_cache(index)(i), input_cache(input_n + i));
-                    }
+                    // Distort the image
+                    augmenters.distorter.transform(batch_cache(index)(i), g);
+
+                    // Noise the image
+                    augmenters.noiser.transform(batch_cache(index)(i), g);
+                } else {
+                    // Center crop the image
+                    augmenters.cropper.transform_first_test(batch_cache(index)(i), input_cache(input_n + i));
                 }
+            }
 
-                // Notify a waiter that one batch is ready
+            // Notify a waiter that one batch is ready
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+            status[index].store(slot_state::READY, std::memory_order_release);
 
-                    status[index] = true;
+            cpp::with_lock(main_lock, [] {});
 
-                    ready_condition.notify_one();
-                }
-            }
-        });
+            ready_condition.notify_all();
+        }
     }
 
     inmemory_data_generator(const inmemory_data_generator& rhs) = delete;
@@ -545,21 +600,43 @@ struct inmemory_data_generator<Iterator, LIterator, Desc> {
 
         condition.notify_all();
 
-        main_thread.join();
+        for (auto& worker : worker_threads) {
+            worker.join();
+        }
     }
 
     /*!
      * \brief Reset the generation to its beginning
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
+        // Take the ownership of every slot, waiting for the workers to finish their batches
 
         for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
+            while (true) {
+                auto expected = status[b].load(std::memory_order_acquire);
+
+                if (expected != slot_state::BUSY && status[b].compare_exchange_strong(expected, slot_state::BUSY, std::memory_order_acq_rel)) {
+                    break;
+                }
+
+                std::unique_lock<std::mutex> ulock(main_lock);
+
+                ready_condition.wait(ulock, [this, b] {
+                    return status[b].load(std::memory_order_acquire) != slot_state::BUSY;
+                });
+            }
         }
 
-        condition.notify_one();
+        ++generation;
+
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            indices[b].store(b, std::memory_order_relaxed);
+            status[b].store(slot_state::FREE, std::memory_order_release);
+        }
+
+        cpp::with_lock(main_lock, [] {});
+
+        condition.notify_all();
     }
 
     /*!
@@ -651,14 +728,14 @@ struct inmemory_data_generator<Iterator, LIterator, Desc> {
         const auto batch = current / batch_size;
         const auto b     = batch % big_batch_size;
 
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
+        // Give back the slot to the workers
 
-            status[b] = false;
-            indices[b] += big_batch_size;
+        indices[b].fetch_add(big_batch_size, std::memory_order_relaxed);
+        status[b].store(slot_state::FREE, std::memory_order_release);
 
-            condition.notify_one();
-        }
+        cpp::with_lock(main_lock, [] {});
+
+        condition.notify_one();
 
         current += batch_size;
     }
@@ -668,26 +745,18 @@ struct inmemory_data_generator<Iterator, LIterator, Desc> {
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
         const auto b     = batch % big_batch_size;
 
-        if (status[b]) {
-            const auto input_n = indices[b] * batch_size + batch_size;
+        if (status[b].load(std::memory_order_acquire) != slot_state::READY) {
+            std::unique_lock<std::mutex> ulock(main_lock);
 
-            if (input_n > size()) {
-                return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
-            } else {
-                return etl::slice(batch_cache(b), 0, batch_size);
-            }
+            ready_condition.wait(ulock, [this, b] {
+                return status[b].load(std::memory_order_acquire) == slot_state::READY;
+            });
         }
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
-
-        const auto input_n = indices[b] * batch_size + batch_size;
+        const auto input_n = indices[b].load(std::memory_order_relaxed) * batch_size + batch_size;
 
         if (input_n > size()) {
             return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
@@ -744,6 +813,11 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of threads used for data augmentation
+     */
+    static constexpr size_t Workers = detail::get_value_v<workers<1>, Parameters...>;
+
     /*!
      * \brief Indicates if the generators must make the labels categorical
      */
@@ -801,6 +875,7 @@ struct inmemory_data_generator_desc {
 
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(Workers > 0, "There must be at least one augmentation worker");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
 
     //Make sure only valid types are passed to the configuration list
@@ -808,7 +883,7 @@ struct inmemory_data_generator_desc {
         detail::is_valid_v<
             cpp::type_list<
                 batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
-                categorical_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                categorical_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, workers_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
@@ -0,0 +1,774 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Memory-mapped binary dataset format and its data generator
+ *
+ * A dataset file is made of a fixed-size header followed by the samples and
+ * then by the labels. Both sections are contiguous, in row-major order, and
+ * aligned on 64 bytes. The samples are served directly from the mapped
+ * pages, the dataset is never copied into memory and the page cache is
+ * shared between all the processes mapping the same file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dll/generators.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The type of the values stored in a memory-mapped dataset
+ */
+enum class mmap_dtype : uint32_t {
+    FLOAT  = 0, ///< 32 bits floating point
+    DOUBLE = 1  ///< 64 bits floating point
+};
+
+/*!
+ * \brief Returns the mmap_dtype of the given type
+ */
+template <typename T>
+constexpr mmap_dtype mmap_dtype_of() {
+    static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "Memory-mapped datasets only support float and double");
+
+    return std::is_same_v<T, float> ? mmap_dtype::FLOAT : mmap_dtype::DOUBLE;
+}
+
+/*!
+ * \brief The header of a memory-mapped dataset file
+ */
+struct mmap_dataset_header {
+    static constexpr uint32_t current_version = 1;  ///< The current version of the format
+    static constexpr size_t max_rank          = 8;  ///< The maximum number of dimensions of a sample
+    static constexpr size_t alignment         = 64; ///< The alignment of the sections
+
+    char magic[8];               ///< The magic identifier ("DLLMMAP")
+    uint32_t version;            ///< The version of the format
+    mmap_dtype dtype;            ///< The type of the values
+    uint64_t n;                  ///< The number of samples
+    uint64_t rank;               ///< The number of dimensions of a sample
+    uint64_t dims[max_rank];     ///< The dimensions of a sample
+    uint64_t label_size;         ///< The number of values of one label (1 for flat labels)
+    uint64_t data_offset;        ///< The offset of the samples section, in bytes
+    uint64_t label_offset;       ///< The offset of the labels section, in bytes
+
+    /*!
+     * \brief Returns the number of values in one sample
+     */
+    uint64_t sample_size() const {
+        uint64_t size = 1;
+
+        for (size_t d = 0; d < rank; ++d) {
+            size *= dims[d];
+        }
+
+        return size;
+    }
+
+    /*!
+     * \brief Returns the size of one value, 0 for an unknown type
+     */
+    uint64_t value_size() const {
+        switch (dtype) {
+            case mmap_dtype::FLOAT:
+                return sizeof(float);
+            case mmap_dtype::DOUBLE:
+                return sizeof(double);
+        }
+
+        return 0;
+    }
+
+    /*!
+     * \brief Indicates if the header is a valid header
+     */
+    bool valid() const {
+        return std::strncmp(magic, "DLLMMAP", 8) == 0 && version == current_version && rank <= max_rank && value_size();
+    }
+
+    /*!
+     * \brief Indicates if the sections described by the header fit in a file
+     * of the given length, without overlapping each other or the header.
+     */
+    bool fits(uint64_t length) const {
+        uint64_t sample = value_size();
+
+        for (size_t d = 0; d < rank; ++d) {
+            if (__builtin_mul_overflow(sample, dims[d], &sample)) {
+                return false;
+            }
+        }
+
+        uint64_t data_end;
+        uint64_t label_end;
+        uint64_t label_bytes;
+
+        if (__builtin_mul_overflow(sample, n, &data_end) || __builtin_add_overflow(data_end, data_offset, &data_end)) {
+            return false;
+        }
+
+        if (__builtin_mul_overflow(value_size(), label_size, &label_bytes) || __builtin_mul_overflow(label_bytes, n, &label_end)
+            || __builtin_add_overflow(label_end, label_offset, &label_end)) {
+            return false;
+        }
+
+        return data_offset >= sizeof(mmap_dataset_header) && data_end <= label_offset && label_end <= length;
+    }
+};
+
+namespace mmap_detail {
+
+/*!
+ * \brief Align the given offset on the alignment of the format
+ */
+inline uint64_t align(uint64_t offset) {
+    return (offset + mmap_dataset_header::alignment - 1) & ~uint64_t(mmap_dataset_header::alignment - 1);
+}
+
+/*!
+ * \brief Write zero bytes to the stream until the given offset
+ */
+inline void pad(std::ofstream& os, uint64_t offset) {
+    static constexpr char zeroes[mmap_dataset_header::alignment] = {};
+
+    const auto position = uint64_t(os.tellp());
+
+    if (offset > position) {
+        os.write(zeroes, offset - position);
+    }
+}
+
+/*!
+ * \brief Write the values of a sample to the stream
+ */
+template <typename T, typename Sample>
+void write_values(std::ofstream& os, std::vector<T>& buffer, const Sample& sample) {
+    buffer.clear();
+
+    for (auto v : sample) {
+        buffer.push_back(T(v));
+    }
+
+    os.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(T));
+}
+
+} // end of namespace mmap_detail
+
+/*!
+ * \brief Write a memory-mapped dataset file from iterators
+ *
+ * If n_classes is not zero, the labels are stored as categorical vectors,
+ * otherwise flat labels are stored as such and ETL labels (auto-encoders)
+ * are stored as vectors.
+ *
+ * \param path The path of the file to write
+ * \param first Iterator to the first sample
+ * \param last Iterator to the end of the samples
+ * \param lfirst Iterator to the first label
+ * \param n_classes The number of classes for categorical labels (0 for no conversion)
+ *
+ * \return true if the file was written successfully, false otherwise
+ */
+template <typename Iterator, typename LIterator>
+bool write_mmap_dataset(const std::string& path, Iterator first, Iterator last, LIterator lfirst, size_t n_classes = 0) {
+    using sample_t = typename std::iterator_traits<Iterator>::value_type;
+    using label_t  = typename std::iterator_traits<LIterator>::value_type;
+    using weight   = etl::value_t<sample_t>;
+
+    const size_t n = std::distance(first, last);
+
+    mmap_dataset_header header{};
+
+    std::strncpy(header.magic, "DLLMMAP", 8);
+    header.version = mmap_dataset_header::current_version;
+    header.dtype   = mmap_dtype_of<weight>();
+    header.n       = n;
+
+    if (n) {
+        header.rank = etl::dimensions(*first);
+
+        for (size_t d = 0; d < header.rank; ++d) {
+            header.dims[d] = etl::dim(*first, d);
+        }
+    }
+
+    if constexpr (etl::is_etl_expr<label_t>) {
+        header.label_size = n ? etl::size(*lfirst) : 0;
+    } else {
+        header.label_size = n_classes ? n_classes : 1;
+    }
+
+    header.data_offset  = mmap_detail::align(sizeof(mmap_dataset_header));
+    header.label_offset = mmap_detail::align(header.data_offset + n * header.sample_size() * sizeof(weight));
+
+    std::ofstream os(path, std::ofstream::binary | std::ofstream::trunc);
+
+    if (!os) {
+        std::cerr << "ERROR: Impossible to open dataset file for writing: " << path << std::endl;
+        return false;
+    }
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<weight> buffer;
+
+    // Write the samples
+
+    mmap_detail::pad(os, header.data_offset);
+
+    for (auto it = first; it != last; ++it) {
+        mmap_detail::write_values(os, buffer, *it);
+    }
+
+    // Write the labels
+
+    mmap_detail::pad(os, header.label_offset);
+
+    for (size_t i = 0; i < n; ++i, ++lfirst) {
+        if constexpr (etl::is_etl_expr<label_t>) {
+            mmap_detail::write_values(os, buffer, *lfirst);
+        } else if (n_classes) {
+            buffer.assign(n_classes, weight(0));
+            buffer[size_t(*lfirst)] = weight(1);
+
+            os.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(weight));
+        } else {
+            const weight label = weight(*lfirst);
+
+            os.write(reinterpret_cast<const char*>(&label), sizeof(weight));
+        }
+    }
+
+    return bool(os);
+}
+
+/*!
+ * \brief Write a memory-mapped dataset file from containers
+ * \param path The path of the file to write
+ * \param container The container of samples
+ * \param lcontainer The container of labels
+ * \param n_classes The number of classes for categorical labels (0 for no conversion)
+ * \return true if the file was written successfully, false otherwise
+ */
+template <typename Container, typename LContainer>
+bool write_mmap_dataset(const std::string& path, const Container& container, const LContainer& lcontainer, size_t n_classes = 0) {
+    return write_mmap_dataset(path, container.begin(), container.end(), lcontainer.begin(), n_classes);
+}
+
+/*!
+ * \brief A read-only memory mapping of a dataset file.
+ */
+struct mmap_dataset_file {
+    mmap_dataset_header header{}; ///< The header of the file
+
+    char* memory = nullptr;      ///< The mapped memory
+    size_t length = 0;           ///< The length of the mapping
+    int access    = MADV_NORMAL; ///< The access pattern advised to the kernel for the whole mapping
+
+    /*!
+     * \brief Map the given file in memory.
+     *
+     * If the file is not a valid dataset file, nothing is mapped and the
+     * header is left empty.
+     *
+     * \param path The path to the dataset file
+     */
+    explicit mmap_dataset_file(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open dataset file: " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+
+        if (::fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(mmap_dataset_header)) {
+            std::cerr << "ERROR: Invalid dataset file: " << path << std::endl;
+            ::close(fd);
+            return;
+        }
+
+        // A shared read-only mapping shares the page cache between processes
+        void* ptr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        // The mapping stays valid after the file descriptor is closed
+        ::close(fd);
+
+        if (ptr == MAP_FAILED) {
+            std::cerr << "ERROR: Impossible to map dataset file: " << path << std::endl;
+            return;
+        }
+
+        std::memcpy(&header, ptr, sizeof(mmap_dataset_header));
+
+        if (!header.valid()) {
+            std::cerr << "ERROR: Invalid dataset header: " << path << std::endl;
+            ::munmap(ptr, st.st_size);
+            header = mmap_dataset_header{};
+            return;
+        }
+
+        // A truncated file would fault when reading the missing pages
+        if (!header.fits(st.st_size)) {
+            std::cerr << "ERROR: Truncated or corrupted dataset file: " << path << std::endl;
+            ::munmap(ptr, st.st_size);
+            header = mmap_dataset_header{};
+            return;
+        }
+
+        memory = static_cast<char*>(ptr);
+        length = st.st_size;
+    }
+
+    /*!
+     * \brief Map the given file in memory, checking the type of its values,
+     * the rank of its samples and the format of its labels.
+     *
+     * If the file does not match, nothing is mapped and the header is left
+     * empty.
+     *
+     * \param path The path to the dataset file
+     * \param dtype The expected type of the values
+     * \param rank The expected number of dimensions of a sample
+     * \param categorical Indicates if the labels are expected as categorical vectors
+     */
+    mmap_dataset_file(const std::string& path, mmap_dtype dtype, size_t rank, bool categorical) : mmap_dataset_file(path) {
+        if (!memory) {
+            return;
+        }
+
+        if (header.dtype != dtype || header.rank != rank) {
+            std::cerr << "ERROR: Dataset file does not match the generator type: " << path << std::endl;
+            unmap();
+        } else if (categorical == (header.label_size <= 1)) {
+            std::cerr << "ERROR: Dataset labels do not match the categorical setting of the generator: " << path << std::endl;
+            unmap();
+        }
+    }
+
+    mmap_dataset_file(const mmap_dataset_file& rhs) = delete;
+    mmap_dataset_file& operator=(const mmap_dataset_file& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~mmap_dataset_file() {
+        unmap();
+    }
+
+    /*!
+     * \brief Unmap the file and empty the header
+     */
+    void unmap() {
+        if (memory) {
+            ::munmap(memory, length);
+        }
+
+        memory = nullptr;
+        length = 0;
+        header = mmap_dataset_header{};
+    }
+
+    /*!
+     * \brief Returns a pointer to the values at the given byte offset
+     */
+    template <typename T>
+    T* values(size_t offset) const {
+        // The mapping is read-only, the pointer is only used for reading
+        return memory ? reinterpret_cast<T*>(memory + offset) : nullptr;
+    }
+
+    /*!
+     * \brief Advise the kernel of the access pattern of the whole mapping
+     * \param advice MADV_SEQUENTIAL to keep the readahead or MADV_RANDOM to disable it
+     */
+    void advise(int advice) {
+        if (memory && advice != access) {
+            ::madvise(memory, length, advice);
+            access = advice;
+        }
+    }
+
+    /*!
+     * \brief Advise the kernel that the given range will be needed soon
+     * \param offset The byte offset of the start of the range
+     * \param bytes The number of bytes of the range
+     */
+    void will_need(size_t offset, size_t bytes) const {
+        if (memory && bytes) {
+            static const size_t page = ::sysconf(_SC_PAGESIZE);
+
+            const size_t start = offset & ~(page - 1);
+
+            ::madvise(memory + start, std::min(offset + bytes, length) - start, MADV_WILLNEED);
+        }
+    }
+};
+
+/*!
+ * \brief A data generator serving batches directly from a memory-mapped dataset file.
+ *
+ * Shuffling permutes the order of the batches, but not the samples inside
+ * a batch, in order to keep reading contiguous pages.
+ *
+ * The pages of the current batch and of the next one are advised to the
+ * kernel ahead of their use. The whole mapping is advised as sequential,
+ * to keep the kernel readahead, until the batches are shuffled.
+ *
+ * \tparam T The type of the values
+ * \tparam D The number of dimensions of one sample
+ * \tparam Desc The generator descriptor
+ */
+template <typename T, size_t D, typename Desc>
+struct mmap_data_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    using data_cache_type  = etl::custom_dyn_matrix<T, D + 1>; ///< The type of the data view
+
+    /*!
+     * \brief The type of the label view
+     */
+    using label_cache_type = std::conditional_t<desc::Categorical, etl::custom_dyn_matrix<T, 2>, etl::custom_dyn_matrix<T, 1>>;
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static inline constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    mmap_dataset_file file; ///< The memory-mapped file
+
+    data_cache_type input_cache;  ///< The view of the samples
+    label_cache_type label_cache; ///< The view of the labels
+
+    std::vector<size_t> order; ///< The order of the batches
+
+    size_t current    = 0; ///< The current index
+    size_t prefetched = 0; ///< The number of batches of the order already advised to the kernel
+
+    /*!
+     * \brief Construct a mmap_data_generator around the given dataset file.
+     *
+     * If the file is invalid, truncated or does not match the generator, the
+     * generator is left empty and valid() returns false.
+     *
+     * \param path The path to the dataset file
+     */
+    explicit mmap_data_generator(const std::string& path)
+            : file(path, mmap_dtype_of<T>(), D, desc::Categorical), input_cache(make_input_view(std::make_index_sequence<D>())), label_cache(make_label_view()) {
+        order.resize(batches());
+        std::iota(order.begin(), order.end(), 0);
+
+        // The batches are read in order, the kernel readahead is kept
+        file.advise(MADV_SEQUENTIAL);
+
+        prefetch_ahead();
+    }
+
+    mmap_data_generator(const mmap_data_generator& rhs) = delete;
+    mmap_data_generator operator=(const mmap_data_generator& rhs) = delete;
+
+    mmap_data_generator(mmap_data_generator&& rhs) = delete;
+    mmap_data_generator operator=(mmap_data_generator&& rhs) = delete;
+
+private:
+    template <size_t... I>
+    data_cache_type make_input_view(std::index_sequence<I...> /*seq*/) {
+        return data_cache_type(file.values<T>(file.header.data_offset), size_t(file.header.n), size_t(file.header.dims[I])...);
+    }
+
+    label_cache_type make_label_view() {
+        if constexpr (desc::Categorical) {
+            return label_cache_type(file.values<T>(file.header.label_offset), size_t(file.header.n), size_t(file.header.label_size));
+        } else {
+            return label_cache_type(file.values<T>(file.header.label_offset), size_t(file.header.n));
+        }
+    }
+
+    /*!
+     * \brief Advise the kernel to read the pages of the given batch ahead
+     * \param batch The index of the batch in the order
+     */
+    void prefetch(size_t batch) const {
+        if (batch < order.size()) {
+            const size_t first = order[batch] * batch_size;
+            const size_t n     = std::min(first + batch_size, size()) - first;
+
+            const size_t sample_bytes = file.header.sample_size() * sizeof(T);
+            const size_t label_bytes  = file.header.label_size * sizeof(T);
+
+            file.will_need(file.header.data_offset + first * sample_bytes, n * sample_bytes);
+            file.will_need(file.header.label_offset + first * label_bytes, n * label_bytes);
+        }
+    }
+
+    /*!
+     * \brief Advise the kernel to read the current batch and the next one
+     * ahead, if not already done.
+     */
+    void prefetch_ahead() {
+        const size_t last = std::min(current / batch_size + 2, order.size());
+
+        for (; prefetched < last; ++prefetched) {
+            prefetch(prefetched);
+        }
+    }
+
+    /*!
+     * \brief Returns the index of the first sample of the current batch
+     */
+    size_t batch_start() const {
+        return order[current / batch_size] * batch_size;
+    }
+
+public:
+    /*!
+     * \brief Indicates if the dataset file was mapped successfully
+     */
+    bool valid() const {
+        return file.memory != nullptr;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Memory-Mapped Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing to do, the memory is owned by the page cache
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing to do, the memory is owned by the page cache
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current    = 0;
+        prefetched = 0;
+        prefetch_ahead();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of batches
+     */
+    void reset_shuffle() {
+        current    = 0;
+        prefetched = 0;
+        shuffle();
+        prefetch_ahead();
+    }
+
+    /*!
+     * \brief Shuffle the order of the batches.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
+
+        // The batches are now read out of order, the kernel readahead would be wasted
+        file.advise(MADV_RANDOM);
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch(){
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return file.header.n;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+
+        // Read the following batch ahead while this one is used
+        prefetch_ahead();
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        const size_t first = batch_start();
+        return etl::slice(input_cache, first, std::min(first + batch_size, size()));
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        const size_t first = batch_start();
+        return etl::slice(label_cache, first, std::min(first + batch_size, size()));
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename T, size_t D, typename Desc>
+std::ostream& operator<<(std::ostream& os, mmap_data_generator<T, D, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Descriptor for a mmap_data_generator
+ */
+template <typename... Parameters>
+struct mmap_data_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the labels are stored as categorical
+     */
+    static constexpr bool Categorical = parameters::template contains<categorical>();
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<batch_size_id, categorical_id>, Parameters...>,
+        "Invalid parameters type for mmap_data_generator_desc (preprocessing must be done before writing the dataset)");
+
+    /*!
+     * The generator type
+     */
+    template <typename T, size_t D>
+    using generator_t = mmap_data_generator<T, D, mmap_data_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a memory-mapped data generator around the given dataset file
+ * \tparam T The type of the values
+ * \tparam D The number of dimensions of one sample
+ * \param path The path to the dataset file
+ */
+template <typename T, size_t D, typename... Parameters>
+auto make_mmap_generator(const std::string& path, const mmap_data_generator_desc<Parameters...>& /*desc*/) {
+    using generator_t = typename mmap_data_generator_desc<Parameters...>::template generator_t<T, D>;
+    return std::make_unique<generator_t>(path);
+}
+
+} //end of dll namespace
@@ -13,7 +13,10 @@
 #pragma once
 
 #include <atomic>
+#include <iterator>
+#include <optional>
 #include <thread>
+#include <vector>
 
 namespace dll {
 
@@ -309,21 +312,67 @@ struct outmemory_data_generator<Iterator, LIterator, Desc> {
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
 
-    size_t current      = 0;     ///< The current index
-    size_t current_read = 0;     ///< The current index read
-    bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
+    /*!
+     * \brief Indicates if the iterators can be copied and read at several
+     * positions at once.
+     */
+    static constexpr bool multi_pass =
+        std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>
+        && std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<LIterator>::iterator_category>;
+
+    /*!
+     * \brief The number of reader workers.
+     *
+     * Single-pass (input) iterators can only be read by one worker, directly
+     * from the shared iterators.
+     */
+    static constexpr inline size_t n_workers = desc::Workers;
+
+    static_assert(multi_pass || n_workers == 1, "Several reader workers need multi-pass (forward) iterators, single-pass iterators can only be read by workers<1>");
+
+    /*!
+     * \brief The state of a slot of the batch cache
+     */
+    enum class slot_state : size_t {
+        FREE,  ///< The slot is waiting to be filled
+        BUSY,  ///< The slot is being filled
+        READY  ///< The slot is ready to be consumed
+    };
+
+    /*!
+     * \brief The augmenters used by one worker
+     */
+    struct worker_augmenters {
+        random_cropper<Desc> cropper;              ///< The random cropper
+        random_mirrorer<Desc> mirrorer;            ///< The random mirrorer
+        elastic_distorter<weight, Desc> distorter; ///< The elastic distorter
+        random_noise<Desc> noiser;                 ///< The random noiser
+
+        /*!
+         * \brief Construct the augmenters for the given example image
+         */
+        template <typename T>
+        explicit worker_augmenters(const T& image) : cropper(image), mirrorer(image), distorter(image), noiser(image) {}
+    };
+
+    size_t current = 0;     ///< The current index
+    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    mutable std::atomic<slot_state> status[big_batch_size]; ///< Status of each slot of the batch cache
+    mutable std::atomic<size_t> indices[big_batch_size];    ///< Batch index held by each slot of the batch cache
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
+    std::atomic<size_t> next_read{0};  ///< The index of the next batch to read
+    std::atomic<size_t> generation{0}; ///< The current generation (used to seed the random streams)
 
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
+    std::mutex read_lock;                            ///< The lock protecting the shared iterators
+    mutable std::mutex main_lock;                    ///< The lock protecting the sleeping of the threads
+    mutable std::condition_variable condition;       ///< The condition variable for the workers to wait for some space
     mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
+    std::atomic<bool> stop_flag{false}; ///< Boolean flag indicating to the workers to stop
 
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    std::vector<std::thread> worker_threads; ///< The reader workers
+    std::atomic<bool> train_mode{false};     ///< The train mode status
 
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
@@ -350,106 +399,160 @@ struct outmemory_data_generator<Iterator, LIterator, Desc> {
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            indices[b].store(b, std::memory_order_relaxed);
+            status[b].store(slot_state::FREE, std::memory_order_release);
+        }
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+        worker_threads.reserve(n_workers);
 
-                    bool found = false;
+        for (size_t w = 0; w < n_workers; ++w) {
+            worker_threads.emplace_back([this] { worker_loop(); });
+        }
+    }
 
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < _size) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
+    /*!
+     * \brief Indicates if the next batch to read can be claimed by a worker
+     */
+    bool claimable() const {
+        const size_t batch = next_read.load(std::memory_order_acquire);
+        const size_t b     = batch % big_batch_size;
 
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < _size) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
-                }
+        return batch * batch_size < _size && status[b].load(std::memory_order_acquire) == slot_state::FREE && indices[b].load(std::memory_order_relaxed) == batch;
+    }
 
-                SERIAL_SECTION {
-                    for (size_t i = 0; i < batch_size && current_read < _size; ++i) {
-                        auto sub = batch_cache(index)(i);
+    /*!
+     * \brief Try to claim the next batch to read.
+     *
+     * The batches are claimed in order since the iterators can only be
+     * advanced sequentially. Only the iterators are advanced under the lock,
+     * the samples are then read outside of the lock. Single-pass iterators
+     * are not copied, the only worker reads them directly.
+     *
+     * \param index The slot of the claimed batch
+     * \param batch_it The iterator on the data of the claimed batch
+     * \param batch_lit The iterator on the labels of the claimed batch
+     * \return the number of samples of the claimed batch (0 if nothing was claimed)
+     */
+    size_t claim_batch(size_t& index, std::optional<Iterator>& batch_it, std::optional<LIterator>& batch_lit) {
+        std::unique_lock<std::mutex> ulock(read_lock);
 
-                        if (train_mode) {
-                            // Random crop the image
-                            cropper.transform_first(sub, *it);
+        if (!claimable()) {
+            return 0;
+        }
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
+        const size_t batch = next_read.load(std::memory_order_relaxed);
 
-                            // Mirror the image
-                            mirrorer.transform(sub);
+        index = batch % big_batch_size;
+        status[index].store(slot_state::BUSY, std::memory_order_release);
 
-                            // Distort the image
-                            distorter.transform(sub);
+        const size_t n = std::min(batch_size, _size - batch * batch_size);
 
-                            // Noise the image
-                            noiser.transform(sub);
-                        } else {
-                            // Center crop the image
-                            cropper.transform_first_test(sub, *it);
+        if constexpr (multi_pass) {
+            batch_it.emplace(it);
+            batch_lit.emplace(lit);
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
-                        }
+            for (size_t i = 0; i < n; ++i) {
+                ++it;
+                ++lit;
+            }
+        }
 
-                        label_cache_helper_t::set(i, lit, label_cache(index));
+        next_read.store(batch + 1, std::memory_order_release);
 
-                        // In case of auto-encoders, the label images also need to be transformed
-                        if constexpr (desc::AutoEncoder){
-                            pre_scaler<desc>::transform(label_cache(index)(i));
-                            pre_normalizer<desc>::transform(label_cache(index)(i));
-                            pre_binarizer<desc>::transform(label_cache(index)(i));
-                        }
+        return n;
+    }
 
-                        ++it;
-                        ++lit;
-                        ++current_read;
-                    }
+    /*!
+     * \brief The main function of a reader worker
+     */
+    void worker_loop() {
+        worker_augmenters augmenters(*orig_it);
+
+        std::optional<Iterator> batch_it;
+        std::optional<LIterator> batch_lit;
+
+        while (true) {
+            // The index of the batch inside the batch cache
+            size_t index = 0;
+            size_t n     = 0;
+
+            while (!(n = claim_batch(index, batch_it, batch_lit))) {
+                std::unique_lock<std::mutex> ulock(main_lock);
+
+                // Wait for the end or for some work
+                condition.wait(ulock, [this] { return stop_flag || claimable(); });
+
+                // If there is no more work for the thread, exit
+                if (stop_flag) {
+                    return;
                 }
+            }
+
+            // The following batch may be claimable by another worker
+            cpp::with_lock(main_lock, [] {});
+            condition.notify_one();
+
+            // The random stream only depends on the batch, not on the worker
+            const size_t batch = indices[index].load(std::memory_order_relaxed);
+            dll::random_engine g(dll::seed() + generation.load(std::memory_order_relaxed) * batches() + batch);
+
+            // The parallelism is done at the level of the workers
+            SERIAL_SECTION {
+                // The slot is busy, the shared iterators cannot be reset meanwhile
+                auto& bit  = multi_pass ? *batch_it : it;
+                auto& blit = multi_pass ? *batch_lit : lit;
+
+                for (size_t i = 0; i < n; ++i) {
+                    auto sub = batch_cache(index)(i);
 
-                // Notify a waiter that one batch is ready
+                    if (train_mode) {
+                        // Random crop the image
+                        augmenters.cropper.transform_first(sub, *bit, g);
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+                        pre_scaler<desc>::transform(sub);
+                        pre_normalizer<desc>::transform(sub);
+                        pre_binarizer<desc>::transform(sub);
 
-                    status[index] = true;
+                        // Mirror the image
+                        augmenters.mirrorer.transform(sub, g);
 
-                    ready_condition.notify_one();
+                        // Distort the image
+                        augmenters.distorter.transform(sub, g);
+
+                        // Noise the image
+                        augmenters.noiser.transform(sub, g);
+                    } else {
+                        // Center crop the image
+                        augmenters.cropper.transform_first_test(sub, *bit);
+
+                        pre_scaler<desc>::transform(sub);
+                        pre_normalizer<desc>::transform(sub);
+                        pre_binarizer<desc>::transform(sub);
+                    }
+
+                    label_cache_helper_t::set(i, blit, label_cache(index));
+
+                    // In case of auto-encoders, the label images also need to be transformed
+                    if constexpr (desc::AutoEncoder){
+                        pre_scaler<desc>::transform(label_cache(index)(i));
+                        pre_normalizer<desc>::transform(label_cache(index)(i));
+                        pre_binarizer<desc>::transform(label_cache(index)(i));
+                    }
+
+                    ++bit;
+                    ++blit;
                 }
             }
-        });
+
+            // Notify a waiter that one batch is ready
+
+            status[index].store(slot_state::READY, std::memory_order_release);
+
+            cpp::with_lock(main_lock, [] {});
+
+            ready_condition.notify_all();
+        }
     }
 
     outmemory_data_generator(const outmemory_data_generator& rhs) = delete;
@@ -466,7 +569,9 @@ struct outmemory_data_generator<Iterator, LIterator, Desc> {
 
         condition.notify_all();
 
-        main_thread.join();
+        for (auto& worker : worker_threads) {
+            worker.join();
+        }
     }
 
     /*!
@@ -531,18 +636,43 @@ struct outmemory_data_generator<Iterator, LIterator, Desc> {
      * \brief Reset the generation
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        current_read = 0;
-        it           = orig_it;
-        lit          = orig_lit;
+        // Take the ownership of every slot, waiting for the workers to finish their batches
 
         for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
+            while (true) {
+                auto expected = status[b].load(std::memory_order_acquire);
+
+                if (expected != slot_state::BUSY && status[b].compare_exchange_strong(expected, slot_state::BUSY, std::memory_order_acq_rel)) {
+                    break;
+                }
+
+                std::unique_lock<std::mutex> ulock(main_lock);
+
+                ready_condition.wait(ulock, [this, b] {
+                    return status[b].load(std::memory_order_acquire) != slot_state::BUSY;
+                });
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> ulock(read_lock);
+
+            it  = orig_it;
+            lit = orig_lit;
+
+            next_read.store(0, std::memory_order_relaxed);
+
+            ++generation;
+
+            for (size_t b = 0; b < big_batch_size; ++b) {
+                indices[b].store(b, std::memory_order_relaxed);
+                status[b].store(slot_state::FREE, std::memory_order_release);
+            }
         }
 
-        condition.notify_one();
+        cpp::with_lock(main_lock, [] {});
+
+        condition.notify_all();
     }
 
     /*!
@@ -630,35 +760,43 @@ struct outmemory_data_generator<Iterator, LIterator, Desc> {
         const auto batch = current / batch_size;
         const auto b     = batch % big_batch_size;
 
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
+        // Give back the slot to the workers
 
-            status[b] = false;
-            indices[b] += big_batch_size;
+        indices[b].fetch_add(big_batch_size, std::memory_order_relaxed);
+        status[b].store(slot_state::FREE, std::memory_order_release);
 
-            condition.notify_one();
-        }
+        cpp::with_lock(main_lock, [] {});
+
+        condition.notify_all();
 
         current += batch_size;
     }
 
     /*!
-     * \brief Returns the current data batch
-     * \return a a batch of data.
+     * \brief Wait for the current batch to be ready
+     * \return the slot of the current batch in the batch cache
      */
-    auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
+    size_t wait_ready() const {
         const auto batch = current / batch_size;
         const auto b     = batch % big_batch_size;
 
-        if (status[b]) {
-            return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
+        if (status[b].load(std::memory_order_acquire) != slot_state::READY) {
+            std::unique_lock<std::mutex> ulock(main_lock);
+
+            ready_condition.wait(ulock, [this, b] {
+                return status[b].load(std::memory_order_acquire) == slot_state::READY;
+            });
         }
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        return b;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        const auto b = wait_ready();
 
         return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -668,18 +806,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc> {
      * \return a a batch of label.
      */
     auto label_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
-        }
-
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        const auto b = wait_ready();
 
         return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -739,10 +866,15 @@ struct outmemory_data_generator_desc {
      */
     static constexpr bool VerticalMirroring = parameters::template contains<vertical_mirroring>();
 
+    /*!
+     * \brief The number of reader workers
+     */
+    static constexpr size_t Workers = detail::get_value_v<workers<1>, Parameters...>;
+
     /*!
      * \brief Indicates if the generator is threaded
      */
-    static constexpr bool Threaded = parameters::template contains<threaded>();
+    static constexpr bool Threaded = parameters::template contains<threaded>() || Workers > 1;
 
     /*!
      * \brief The random cropping X
@@ -786,6 +918,7 @@ struct outmemory_data_generator_desc {
 
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(Workers > 0, "There must be at least one reader worker");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
 
     //Make sure only valid types are passed to the configuration list
@@ -793,7 +926,7 @@ struct outmemory_data_generator_desc {
         detail::is_valid_v<
             cpp::type_list<
                 batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
-                elastic_distortion_id, categorical_id, noise_id, threaded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                elastic_distortion_id, categorical_id, noise_id, threaded_id, workers_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
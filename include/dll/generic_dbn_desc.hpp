@@ -48,6 +48,31 @@ struct generic_dbn_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of shards each batch is split into for parallel fine-tuning
+     */
+    static constexpr size_t Shards = detail::get_value_v<parallel_shards<1>, Parameters...>;
+
+    /*!
+     * \brief The number of layers of each gradient checkpointing segment
+     */
+    static constexpr size_t Checkpoint = detail::get_value_v<checkpoint<1>, Parameters...>;
+
+    /*!
+     * \brief The number of epochs of a layer before it feeds the next one in pipelined pretraining (0 to disable)
+     */
+    static constexpr size_t PretrainPipeline = detail::get_value_v<pretrain_pipeline<0>, Parameters...>;
+
+    /*!
+     * \brief The number of batches of activations cached for batch mode pretraining
+     */
+    static constexpr size_t PretrainCache = detail::get_value_v<pretrain_cache<0>, Parameters...>;
+
+    /*!
+     * \brief The precision of the activations and errors during fine-tuning
+     */
+    static constexpr precision_type Precision = detail::get_value_v<mixed_precision<precision_type::FLOAT>, Parameters...>;
+
     /*!
      * \brief The pre scaling factor
      */
@@ -106,6 +131,9 @@ struct generic_dbn_desc {
 
     static_assert(BatchSize > 0, "Batch size must be at least 1");
     static_assert(BigBatchSize > 0, "Big Batch size must be at least 1");
+    static_assert(Shards > 0, "The number of shards must be at least 1");
+    static_assert(BatchSize % Shards == 0, "The batch size must be divisible by the number of shards");
+    static_assert(Checkpoint > 0, "The checkpointing segments must contain at least 1 layer");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
@@ -115,7 +143,8 @@ struct generic_dbn_desc {
                 no_batch_display_id, no_epoch_error_id,
                 batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, shuffle_id, shuffle_pre_id, loss_id,
                 normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, noise_id, updater_id,
-                early_stopping_id, early_training_id, clip_gradients_id, output_policy_id>,
+                early_stopping_id, early_training_id, clip_gradients_id, output_policy_id, parallel_shards_id, memory_plan_id,
+                checkpoint_id, pretrain_pipeline_id, pretrain_cache_id, mixed_precision_id>,
             Parameters...>,
         "Invalid parameters type");
 };
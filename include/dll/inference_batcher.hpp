@@ -0,0 +1,233 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file inference_batcher.hpp
+ * \brief Dynamic micro-batching of single inference requests.
+ *
+ * Scoring requests one sample at a time cannot use the batched kernels
+ * of the layers. The batcher queues the incoming samples and a dispatcher
+ * thread flushes them as a single forward pass when either the maximum
+ * batch size is reached or the oldest request has waited for the maximum
+ * delay. The results are returned through futures.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dll/inference_workspace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Batch single inference requests into forward passes of the
+ * network.
+ *
+ * \tparam Network The type of network
+ * \tparam Sample The type of one input sample
+ */
+template <typename Network, typename Sample>
+struct inference_batcher {
+    using network_t   = Network;                            ///< The type of network
+    using weight      = typename network_t::weight;         ///< The data type of the network
+    using workspace_t = inference_workspace<Network, Sample>; ///< The type of the workspace of the dispatcher
+    using clock       = std::chrono::steady_clock;          ///< The clock used for the deadlines
+
+    static constexpr size_t dimensions = etl::dimensions<Sample>() + 1; ///< The number of dimensions of an input batch
+
+    using input_t  = etl::dyn_matrix<weight, dimensions>; ///< The type of the input batch
+    using output_t = etl::dyn_matrix<weight, etl::dimensions<decltype(std::declval<workspace_t&>().forward_one(std::declval<const Sample&>()))>()>; ///< The type of one result
+
+private:
+    /*!
+     * \brief A queued request
+     */
+    struct request {
+        Sample sample;                    ///< The input sample
+        std::promise<output_t> promise;   ///< The promise of the result
+        clock::time_point arrival;        ///< The time the request was queued
+    };
+
+    const size_t max_batch;               ///< The maximum number of samples per forward pass
+    const std::chrono::microseconds max_delay; ///< The maximum time a request waits for a batch
+
+    workspace_t workspace; ///< The workspace of the dispatcher
+    input_t batch;         ///< The input batch
+
+    std::deque<request> queue;          ///< The pending requests
+    std::mutex lock;                    ///< The lock protecting the queue
+    std::condition_variable condition;  ///< The condition the dispatcher waits on
+    bool stop = false;                  ///< Indicates that the batcher is being destroyed
+
+    std::atomic<size_t> flushed_batches{0}; ///< The number of forward passes
+    std::atomic<size_t> flushed_samples{0}; ///< The number of samples forwarded
+
+    std::thread dispatcher; ///< The dispatcher thread
+
+    /*!
+     * \brief Create the input batch for samples of the dimensions of the given sample
+     */
+    template <size_t... I>
+    static input_t make_batch(const Sample& sample, size_t capacity, std::index_sequence<I...> /*seq*/) {
+        return input_t(capacity, etl::dim(sample, I)...);
+    }
+
+    /*!
+     * \brief Forward the given requests as a single batch and fulfill
+     * their promises.
+     *
+     * If the forward pass throws, the exception is given to every promise
+     * not fulfilled yet and the dispatcher keeps running.
+     */
+    void flush(std::vector<request>& requests) {
+        dll::auto_timer timer("batcher:flush");
+
+        const size_t n = requests.size();
+
+        size_t fulfilled = 0;
+
+        try {
+            for (size_t i = 0; i < n; ++i) {
+                batch(i) = requests[i].sample;
+            }
+
+            auto output = workspace.forward_batch(workspace_detail::batch_view(batch, n));
+
+            for (; fulfilled < n; ++fulfilled) {
+                requests[fulfilled].promise.set_value(output_t(output(fulfilled)));
+            }
+        } catch (...) {
+            auto error = std::current_exception();
+
+            for (size_t i = fulfilled; i < n; ++i) {
+                requests[i].promise.set_exception(error);
+            }
+        }
+
+        ++flushed_batches;
+        flushed_samples += n;
+    }
+
+    /*!
+     * \brief The loop of the dispatcher thread
+     */
+    void dispatch() {
+        std::vector<request> requests;
+        requests.reserve(max_batch);
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                condition.wait(l, [this] { return stop || !queue.empty(); });
+
+                if (queue.empty()) {
+                    return;
+                }
+
+                // Wait for a full batch or for the deadline of the oldest request
+
+                auto deadline = queue.front().arrival + max_delay;
+
+                condition.wait_until(l, deadline, [this] { return stop || queue.size() >= max_batch; });
+
+                const size_t n = std::min(queue.size(), max_batch);
+
+                for (size_t i = 0; i < n; ++i) {
+                    requests.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+
+            flush(requests);
+
+            requests.clear();
+        }
+    }
+
+public:
+    /*!
+     * \brief Create a batcher and start its dispatcher thread
+     * \param network The network to score with, it must not be trained while the batcher is running
+     * \param sample One sample, giving the dimensions of the inputs
+     * \param max_batch The maximum number of samples per forward pass
+     * \param max_delay The maximum time a request waits for its batch to be full
+     */
+    inference_batcher(const network_t& network, const Sample& sample, size_t max_batch, std::chrono::microseconds max_delay)
+            : max_batch(max_batch),
+              max_delay(max_delay),
+              workspace(network, sample, max_batch),
+              batch(make_batch(sample, max_batch, std::make_index_sequence<dimensions - 1>())) {
+        dispatcher = std::thread([this] { dispatch(); });
+    }
+
+    inference_batcher(const inference_batcher& rhs) = delete;
+    inference_batcher& operator=(const inference_batcher& rhs) = delete;
+
+    /*!
+     * \brief Flush the pending requests and stop the dispatcher thread
+     */
+    ~inference_batcher() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+
+        condition.notify_all();
+
+        dispatcher.join();
+    }
+
+    /*!
+     * \brief Queue a sample to be scored
+     * \param sample The sample
+     * \return a future to the output of the network for this sample
+     */
+    std::future<output_t> submit(const Sample& sample) {
+        std::future<output_t> result;
+
+        bool wake;
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            queue.push_back(request{sample, {}, clock::now()});
+
+            result = queue.back().promise.get_future();
+
+            wake = queue.size() == 1 || queue.size() >= max_batch;
+        }
+
+        // The dispatcher only needs to wake up for a new batch or a full batch
+        if (wake) {
+            condition.notify_one();
+        }
+
+        return result;
+    }
+
+    /*!
+     * \brief Returns the average number of samples per forward pass
+     */
+    double average_batch() const {
+        const size_t batches = flushed_batches;
+
+        return batches ? flushed_samples / double(batches) : 0.0;
+    }
+};
+
+} //end of dll namespace
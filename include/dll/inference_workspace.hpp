@@ -0,0 +1,383 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file inference_workspace.hpp
+ * \brief Reentrant inference on a shared network.
+ *
+ * The forward functions of the network allocate a new output for each
+ * layer on each call. An inference workspace instead holds preallocated
+ * buffers for all the intermediate outputs of the network (including the
+ * outputs of the layers inside group and merge layers). The layers are
+ * only accessed through their const test forward functions, which do not
+ * modify the layers.
+ *
+ * Several threads can therefore score against the same network at the
+ * same time, as long as each thread uses its own workspace and the
+ * network is not trained during that time. The calls do not allocate
+ * nor lock in DLL. Some ETL kernels (the convolutions for instance) may
+ * still use temporary storage internally.
+ *
+ * The recurrent layers (RNN and LSTM) keep their time steps inside the
+ * layer and are not supported.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/util/batch_extend.hpp"
+#include "dll/util/ready.hpp"
+
+namespace dll {
+
+namespace workspace_detail {
+
+template <typename Layer>
+concept group_c = cpp::is_specialization_of_v<dll::group_layer_impl, Layer> || cpp::is_specialization_of_v<dll::dyn_group_layer_impl, Layer>;
+
+template <typename Layer>
+concept merge_c = cpp::is_specialization_of_v<dll::merge_layer_impl, Layer> || cpp::is_specialization_of_v<dll::dyn_merge_layer_impl, Layer>;
+
+/*!
+ * \brief Indicates if the test forward of a layer can be run
+ * concurrently from several threads.
+ */
+template <typename Layer>
+struct reentrant : std::bool_constant<!(
+        cpp::is_specialization_of_v<dll::rnn_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::dyn_rnn_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::lstm_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::dyn_lstm_layer_impl, Layer>)> {};
+
+template <typename... Layers>
+struct reentrant<group_layer_impl<group_layer_desc<Layers...>>> : std::bool_constant<(reentrant<Layers>::value && ...)> {};
+
+template <typename... Layers>
+struct reentrant<dyn_group_layer_impl<dyn_group_layer_desc<Layers...>>> : std::bool_constant<(reentrant<Layers>::value && ...)> {};
+
+template <size_t D, typename... Layers>
+struct reentrant<merge_layer_impl<merge_layer_desc<D, Layers...>>> : std::bool_constant<(reentrant<Layers>::value && ...)> {};
+
+template <size_t D, typename... Layers>
+struct reentrant<dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>> : std::bool_constant<(reentrant<Layers>::value && ...)> {};
+
+/*!
+ * \brief Returns a view of the n first samples of a batch buffer
+ */
+template <typename Buffer, size_t... I>
+auto batch_view(Buffer& buffer, size_t n, std::index_sequence<I...> /*seq*/) {
+    return etl::custom_dyn_matrix<etl::value_t<Buffer>, sizeof...(I) + 1>(buffer.memory_start(), n, etl::dim(buffer, I + 1)...);
+}
+
+/*!
+ * \brief Returns a view of the n first samples of a batch buffer
+ */
+template <typename Buffer>
+auto batch_view(Buffer& buffer, size_t n) {
+    return batch_view(buffer, n, std::make_index_sequence<etl::dimensions<Buffer>() - 1>());
+}
+
+/*!
+ * \brief Returns a view of the first sample of a batch buffer
+ */
+template <typename Buffer, size_t... I>
+auto sample_view(Buffer& buffer, std::index_sequence<I...> /*seq*/) {
+    return etl::custom_dyn_matrix<etl::value_t<Buffer>, sizeof...(I)>(buffer.memory_start(), etl::dim(buffer, I + 1)...);
+}
+
+/*!
+ * \brief The buffers of a layer
+ *
+ * \tparam Output The type of the output batch
+ * \tparam Subs The buffers of the sub layers (merge layers)
+ */
+template <typename Output, typename Subs = std::tuple<>>
+struct slot {
+    Output output; ///< The output batch
+    Subs subs;     ///< The buffers of the sub layers
+};
+
+/*!
+ * \brief The buffers of a group layer, its output is the output of its
+ * last sub layer
+ */
+template <typename Subs>
+struct group_slot {
+    Subs subs; ///< The buffers of the sub layers
+};
+
+template <typename Output, typename Subs>
+auto& slot_output(slot<Output, Subs>& s) {
+    return s.output;
+}
+
+template <typename Subs>
+auto& slot_output(group_slot<Subs>& s) {
+    return slot_output(std::get<std::tuple_size_v<Subs> - 1>(s.subs));
+}
+
+template <typename Layer, typename Input>
+auto make_slot(const Layer& layer, const Input& input);
+
+/*!
+ * \brief Create the buffers of the chain of layers starting at L, for
+ * the given input buffer
+ */
+template <size_t L, typename Layers, typename Input>
+auto make_chain_slots(const Layers& layers, const Input& input) {
+    auto head = make_slot(std::get<L>(layers), input);
+
+    if constexpr (L + 1 < std::tuple_size_v<Layers>) {
+        auto tail = make_chain_slots<L + 1>(layers, slot_output(head));
+
+        return std::tuple_cat(std::make_tuple(std::move(head)), std::move(tail));
+    } else {
+        return std::make_tuple(std::move(head));
+    }
+}
+
+/*!
+ * \brief Create the buffers of the given layer, for the given input buffer
+ */
+template <typename Layer, typename Input>
+auto make_slot(const Layer& layer, const Input& input) {
+    if constexpr (group_c<Layer>) {
+        auto subs = make_chain_slots<0>(layer.layers, input);
+
+        return group_slot<decltype(subs)>{std::move(subs)};
+    } else {
+        auto output = batch_extend(input, prepare_one_ready_output(layer, input(0)));
+
+        if constexpr (merge_c<Layer>) {
+            auto subs = std::apply([&input](auto&... sub_layers) { return std::make_tuple(make_slot(sub_layers, input)...); }, layer.layers);
+
+            return slot<decltype(output), decltype(subs)>{std::move(output), std::move(subs)};
+        } else {
+            return slot<decltype(output)>{std::move(output), {}};
+        }
+    }
+}
+
+/*!
+ * \brief Create the buffers of the layers [L, output layer] of a network,
+ * for the given input buffer
+ */
+template <size_t L, typename Network, typename Input>
+auto make_network_slots(const Network& network, const Input& input) {
+    auto head = make_slot(network.template layer_get<L>(), input);
+
+    if constexpr (L < Network::output_layer_n) {
+        auto tail = make_network_slots<L + 1>(network, slot_output(head));
+
+        return std::tuple_cat(std::make_tuple(std::move(head)), std::move(tail));
+    } else {
+        return std::make_tuple(std::move(head));
+    }
+}
+
+template <typename Layer, typename Slot, typename Input>
+void forward(const Layer& layer, Slot& s, const Input& input, size_t n);
+
+/*!
+ * \brief Forward the n samples of input through the sub layers [L, end[
+ * of a group layer
+ */
+template <size_t L, typename Layer, typename Slot, typename Input>
+void forward_group(const Layer& layer, Slot& s, const Input& input, size_t n) {
+    auto& sub_slot = std::get<L>(s.subs);
+
+    forward(std::get<L>(layer.layers), sub_slot, input, n);
+
+    if constexpr (L + 1 < Layer::n_layers) {
+        auto next = batch_view(slot_output(sub_slot), n);
+
+        forward_group<L + 1>(layer, s, next, n);
+    }
+}
+
+/*!
+ * \brief Forward the n samples of input through the given layer, into
+ * its buffers
+ */
+template <typename Layer, typename Slot, typename Input>
+void forward(const Layer& layer, Slot& s, const Input& input, size_t n) {
+    if constexpr (group_c<Layer>) {
+        forward_group<0>(layer, s, input, n);
+    } else if constexpr (merge_c<Layer>) {
+        auto output = batch_view(s.output, n);
+
+        cpp::for_each_i(layer.layers, s.subs, [&input, &output, n](size_t i, auto& sub_layer, auto& sub_slot) {
+            forward(sub_layer, sub_slot, input, n);
+
+            auto sub_output = batch_view(slot_output(sub_slot), n);
+
+            etl::batch_merge(output, sub_output, i);
+        });
+    } else {
+        auto output = batch_view(s.output, n);
+
+        layer.test_forward_batch(output, input);
+    }
+}
+
+} // end of namespace workspace_detail
+
+/*!
+ * \brief A per-thread workspace for reentrant inference on a shared
+ * network.
+ *
+ * The results returned by the forward functions are views of the
+ * workspace, they are valid until the next call on the same workspace.
+ *
+ * \tparam Network The type of network
+ * \tparam Sample The type of one input sample
+ */
+template <typename Network, typename Sample>
+struct inference_workspace {
+    using network_t = Network;                     ///< The type of network
+    using weight    = typename network_t::weight;  ///< The data type of the network
+    using this_type = inference_workspace<Network, Sample>; ///< The type of this workspace
+
+    static constexpr size_t output_layer = network_t::output_layer_n;         ///< The index of the output layer
+    static constexpr size_t dimensions   = etl::dimensions<Sample>() + 1;     ///< The number of dimensions of an input batch
+
+    using input_t = etl::dyn_matrix<weight, dimensions>; ///< The type of the input batch buffer
+
+    template <size_t... I>
+    static constexpr bool is_reentrant(std::index_sequence<I...> /*seq*/) {
+        return (workspace_detail::reentrant<typename network_t::template layer_type<I>>::value && ...);
+    }
+
+    static_assert(is_reentrant(std::make_index_sequence<output_layer + 1>()),
+                  "inference_workspace does not support recurrent layers");
+
+private:
+    template <size_t... I>
+    static input_t make_input(const Sample& sample, size_t capacity, std::index_sequence<I...> /*seq*/) {
+        return input_t(capacity, etl::dim(sample, I)...);
+    }
+
+    using slots_t = decltype(workspace_detail::make_network_slots<0>(std::declval<const network_t&>(), std::declval<const input_t&>())); ///< The buffers of the layers
+
+    const network_t& network; ///< The shared network
+    input_t input;            ///< The input buffer, for single samples
+    slots_t slots;            ///< The buffers of all the layers
+
+    template <size_t L, typename Input>
+    void forward_impl(const Input& inputs, size_t n) {
+        auto& s = std::get<L>(slots);
+
+        workspace_detail::forward(network.template layer_get<L>(), s, inputs, n);
+
+        if constexpr (L < output_layer) {
+            auto next = workspace_detail::batch_view(workspace_detail::slot_output(s), n);
+
+            forward_impl<L + 1>(next, n);
+        }
+    }
+
+public:
+    /*!
+     * \brief Create a workspace for batches of at most capacity samples
+     * \param network The network to score with
+     * \param sample One sample, giving the dimensions of the inputs
+     * \param capacity The maximum number of samples of a batch
+     */
+    inference_workspace(const network_t& network, const Sample& sample, size_t capacity)
+            : network(network),
+              input(make_input(sample, capacity, std::make_index_sequence<dimensions - 1>())),
+              slots(workspace_detail::make_network_slots<0>(network, input)) {
+        // Run one sample through the network to register the timers of
+        // the layers (which locks once) and touch the buffers
+
+        input = 0;
+        forward_impl<0>(workspace_detail::batch_view(input, 1), 1);
+    }
+
+    inference_workspace(const inference_workspace& rhs) = delete;
+    inference_workspace& operator=(const inference_workspace& rhs) = delete;
+
+    inference_workspace(inference_workspace&& rhs) = default;
+    inference_workspace& operator=(inference_workspace&& rhs) = delete;
+
+    /*!
+     * \brief Returns the maximum number of samples of a batch
+     */
+    size_t capacity() const noexcept {
+        return etl::dim<0>(input);
+    }
+
+    /*!
+     * \brief Forward a batch of inputs through the network.
+     *
+     * \param inputs The batch of inputs, at most capacity() samples
+     *
+     * \return A view of the batch of outputs, valid until the next call
+     */
+    template <typename Input>
+    auto forward_batch(const Input& inputs) {
+        const size_t n = etl::dim<0>(inputs);
+
+        cpp_assert(n <= capacity(), "The batch is larger than the workspace");
+
+        forward_impl<0>(inputs, n);
+
+        return workspace_detail::batch_view(workspace_detail::slot_output(std::get<output_layer>(slots)), n);
+    }
+
+    /*!
+     * \brief Forward one sample through the network.
+     *
+     * \param sample The sample
+     *
+     * \return A view of the output, valid until the next call
+     */
+    template <typename Input>
+    auto forward_one(const Input& sample) {
+        input(0) = sample;
+
+        forward_impl<0>(workspace_detail::batch_view(input, 1), 1);
+
+        auto& output = workspace_detail::slot_output(std::get<output_layer>(slots));
+
+        return workspace_detail::sample_view(output, std::make_index_sequence<etl::dimensions<std::decay_t<decltype(output)>>() - 1>());
+    }
+
+    /*!
+     * \brief Returns the predicted label of the given sample
+     */
+    template <typename Input>
+    size_t predict(const Input& sample) {
+        auto result = forward_one(sample);
+        return std::distance(result.begin(), std::max_element(result.begin(), result.end()));
+    }
+};
+
+/*!
+ * \brief Create a workspace to score against the given network from one
+ * thread.
+ *
+ * \param network The shared network
+ * \param sample One sample, giving the dimensions of the inputs
+ * \param capacity The maximum number of samples of a batch
+ *
+ * \return The workspace
+ */
+template <typename Network, typename Sample>
+inference_workspace<Network, Sample> make_inference_workspace(const Network& network, const Sample& sample, size_t capacity = Network::batch_size) {
+    return inference_workspace<Network, Sample>(network, sample, capacity);
+}
+
+} //end of dll namespace
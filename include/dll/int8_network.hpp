@@ -0,0 +1,604 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file int8_network.hpp
+ * \brief Post-training int8 quantization of a trained network for inference.
+ *
+ * The dense and convolutional layers (and their dynamic versions) are
+ * quantized with symmetric int8 weights (one scale per output) and a
+ * per-layer input scale obtained by calibration on a generator. The
+ * products are accumulated in 32-bit integers and dequantized before
+ * the bias and the activation function, which are kept in floating
+ * point. Every other layer is forwarded to the floating point network.
+ *
+ * The products are computed as int8 matrix-matrix products over the
+ * whole batch (see int8_gemm), into buffers kept in the layers and reused
+ * from one batch to the next.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <tuple>
+#include <vector>
+
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/function.hpp"
+#include "dll/util/int8.hpp"
+#include "dll/util/timers.hpp" // for auto_timer
+
+namespace dll {
+
+namespace int8_detail {
+
+template <typename Layer>
+concept dense_c = cpp::is_specialization_of_v<dll::dense_layer_impl, Layer> || cpp::is_specialization_of_v<dll::dyn_dense_layer_impl, Layer>;
+
+template <typename Layer>
+concept conv_c = cpp::is_specialization_of_v<dll::conv_layer_impl, Layer> || cpp::is_specialization_of_v<dll::dyn_conv_layer_impl, Layer>;
+
+template <typename Layer>
+concept quantizable_c = dense_c<Layer> || conv_c<Layer>;
+
+/*!
+ * \brief Quantize the rows of the given batch of input into the given buffer.
+ *
+ * \param input The batch of input
+ * \param x The buffer of the input, when it cannot be read directly
+ * \param B The number of samples of the batch
+ * \param n The number of values of a sample
+ * \param xq The quantized input
+ * \param ld The distance between two samples in the quantized input
+ * \param scale The scale of the input
+ */
+template <typename Input, typename Buffer>
+void quantize_batch(const Input& input, Buffer& x, size_t B, size_t n, std::vector<int8_t>& xq, size_t ld, float scale) {
+    if constexpr (etl::is_dma<Input>) {
+        input.ensure_cpu_up_to_date();
+
+        for (size_t b = 0; b < B; ++b) {
+            int8_quantize(input.memory_start() + b * n, &xq[b * ld], n, scale);
+        }
+    } else {
+        if (etl::dim<0>(x) != B) {
+            x.resize(B, n);
+        }
+
+        x = etl::reshape(input, B, n);
+
+        for (size_t b = 0; b < B; ++b) {
+            int8_quantize(x.memory_start() + b * n, &xq[b * ld], n, scale);
+        }
+    }
+}
+
+/*!
+ * \brief Apply the activation function of the layer on its dequantized output
+ */
+template <typename Layer, typename Output>
+void activate(Output& output) {
+    if constexpr (Layer::activation_function != function::IDENTITY) {
+        output = f_activate<Layer::activation_function>(output);
+    }
+}
+
+} //end of namespace int8_detail
+
+/*!
+ * \brief Inference wrapper for a layer that is not quantized.
+ *
+ * The input is simply forwarded to the floating point layer.
+ */
+template <typename Layer>
+struct int8_layer {
+    static constexpr bool quantized = false; ///< Indicates if the layer is quantized
+
+    const Layer& layer; ///< The floating point layer
+
+    /*!
+     * \brief Create the wrapper around the given layer
+     */
+    int8_layer(const Layer& layer, [[maybe_unused]] float max_abs) : layer(layer) {}
+
+    /*!
+     * \brief Returns the memory used by the weights, in bytes
+     */
+    size_t weight_memory() const noexcept {
+        return 0;
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     *
+     * \return A batch of output
+     */
+    template <typename Input>
+    auto test_forward_batch(const Input& input) const {
+        return layer.test_forward_batch(input);
+    }
+};
+
+/*!
+ * \brief Int8 inference for a dense layer.
+ *
+ * The weights are packed for int8_gemm, so that the whole batch is
+ * computed with a single int8 matrix-matrix product.
+ */
+template <typename Layer>
+requires int8_detail::dense_c<Layer>
+struct int8_layer<Layer> {
+    using weight = typename Layer::weight; ///< The data type of the layer
+
+    static constexpr bool quantized = true; ///< Indicates if the layer is quantized
+
+    const Layer& layer; ///< The floating point layer
+
+    size_t n_in;  ///< The number of inputs
+    size_t n_out; ///< The number of outputs
+
+    std::vector<int8_t> w;        ///< The quantized weights, packed for int8_gemm
+    std::vector<float> w_scale;   ///< The scale of the weights of each output
+    std::vector<float> out_scale; ///< The scale of the products of each output
+    float in_scale;               ///< The scale of the input
+
+    mutable etl::dyn_matrix<weight, 2> x;      ///< The buffer of the input, if it cannot be read directly
+    mutable std::vector<int8_t> xq;            ///< The quantized input
+    mutable std::vector<int32_t> acc;          ///< The accumulated products
+    mutable etl::dyn_matrix<weight, 2> output; ///< The output
+
+    /*!
+     * \brief Quantize the weights of the given layer
+     * \param layer The layer to quantize
+     * \param max_abs The calibrated maximum absolute value of the input
+     */
+    int8_layer(const Layer& layer, float max_abs)
+            : layer(layer), n_in(layer.input_size()), n_out(layer.output_size()), w(int8_packed_size(n_out, n_in)), w_scale(n_out), out_scale(n_out), in_scale(int8_scale(max_abs)) {
+        std::vector<float> row(n_in);
+        std::vector<int8_t> rows(n_out * n_in);
+
+        for (size_t o = 0; o < n_out; ++o) {
+            float row_max = 0.0f;
+
+            for (size_t i = 0; i < n_in; ++i) {
+                row[i]  = layer.w(i, o);
+                row_max = std::max(row_max, std::abs(row[i]));
+            }
+
+            w_scale[o]   = int8_scale(row_max);
+            out_scale[o] = in_scale * w_scale[o];
+
+            int8_quantize(row.data(), &rows[o * n_in], n_in, w_scale[o]);
+        }
+
+        int8_pack(rows.data(), n_out, n_in, w.data());
+    }
+
+    /*!
+     * \brief Returns the memory used by the weights, in bytes
+     */
+    size_t weight_memory() const noexcept {
+        return w.size() * sizeof(int8_t) + w_scale.size() * sizeof(float);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     *
+     * \return A batch of output
+     */
+    template <typename Input>
+    const etl::dyn_matrix<weight, 2>& test_forward_batch(const Input& input) const {
+        dll::auto_timer timer("int8:dense:forward_batch", etl::dim<0>(input));
+
+        const size_t B  = etl::dim<0>(input);
+        const size_t ld = int8_round_up(n_in, int8_group);
+
+        if (etl::dim<0>(output) != B) {
+            output.resize(B, n_out);
+            xq.resize(B * ld);
+            acc.resize(B * n_out);
+        }
+
+        int8_detail::quantize_batch(input, x, B, n_in, xq, ld, in_scale);
+
+        int8_gemm(xq.data(), B, ld, w.data(), n_out, n_in, acc.data(), n_out);
+
+        weight* out = output.memory_start();
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t o = 0; o < n_out; ++o) {
+                if constexpr (Layer::no_bias) {
+                    out[b * n_out + o] = acc[b * n_out + o] * out_scale[o];
+                } else {
+                    out[b * n_out + o] = acc[b * n_out + o] * out_scale[o] + layer.b(o);
+                }
+            }
+        }
+
+        output.invalidate_gpu();
+
+        int8_detail::activate<Layer>(output);
+
+        return output;
+    }
+};
+
+/*!
+ * \brief Int8 inference for a convolutional layer.
+ *
+ * The quantized input is unrolled (im2col) into one contiguous patch per
+ * output position, with zeroes for the padding, and all the outputs of a
+ * sample are computed with a single int8 matrix-matrix product between
+ * the patches and the packed filters.
+ */
+template <typename Layer>
+requires int8_detail::conv_c<Layer>
+struct int8_layer<Layer> {
+    using weight = typename Layer::weight; ///< The data type of the layer
+
+    static constexpr bool quantized = true; ///< Indicates if the layer is quantized
+
+    const Layer& layer; ///< The floating point layer
+
+    size_t nc;  ///< The number of input channels
+    size_t nv1; ///< The first dimension of the input
+    size_t nv2; ///< The second dimension of the input
+    size_t k;   ///< The number of filters
+    size_t nw1; ///< The first dimension of the filters
+    size_t nw2; ///< The second dimension of the filters
+    size_t s1;  ///< The stride in the first dimension
+    size_t s2;  ///< The stride in the second dimension
+    size_t p1;  ///< The padding in the first dimension
+    size_t p2;  ///< The padding in the second dimension
+    size_t nh1; ///< The first dimension of the output
+    size_t nh2; ///< The second dimension of the output
+
+    std::vector<int8_t> w;        ///< The quantized filters, packed for int8_gemm
+    std::vector<float> w_scale;   ///< The scale of each filter
+    std::vector<float> out_scale; ///< The scale of the products of each filter
+    float in_scale;               ///< The scale of the input
+
+    mutable etl::dyn_matrix<weight, 2> x;      ///< The buffer of the input, if it cannot be read directly
+    mutable std::vector<int8_t> xq;            ///< The quantized input
+    mutable std::vector<int8_t> cols;          ///< The unrolled patches of one sample
+    mutable std::vector<int32_t> acc;          ///< The accumulated products of one sample
+    mutable etl::dyn_matrix<weight, 4> output; ///< The output
+
+    /*!
+     * \brief Quantize the filters of the given layer
+     * \param layer The layer to quantize
+     * \param max_abs The calibrated maximum absolute value of the input
+     */
+    int8_layer(const Layer& layer, float max_abs) : layer(layer), in_scale(int8_scale(max_abs)) {
+        if constexpr (cpp::is_specialization_of_v<dll::conv_layer_impl, Layer>) {
+            nc  = Layer::NC;
+            nv1 = Layer::NV1;
+            nv2 = Layer::NV2;
+            k   = Layer::K;
+            nw1 = Layer::NW1;
+            nw2 = Layer::NW2;
+            s1  = Layer::S1;
+            s2  = Layer::S2;
+            p1  = Layer::P1;
+            p2  = Layer::P2;
+            nh1 = Layer::NH1;
+            nh2 = Layer::NH2;
+        } else {
+            nc  = layer.nc;
+            nv1 = layer.nv1;
+            nv2 = layer.nv2;
+            k   = layer.k;
+            nw1 = layer.nw1;
+            nw2 = layer.nw2;
+            s1  = layer.s1;
+            s2  = layer.s2;
+            p1  = layer.p1;
+            p2  = layer.p2;
+            nh1 = layer.nh1;
+            nh2 = layer.nh2;
+        }
+
+        const size_t patch = nc * nw1 * nw2;
+
+        w.resize(int8_packed_size(k, patch));
+        w_scale.resize(k);
+        out_scale.resize(k);
+
+        std::vector<float> row(patch);
+        std::vector<int8_t> rows(k * patch);
+
+        for (size_t f = 0; f < k; ++f) {
+            float row_max = 0.0f;
+
+            for (size_t c = 0; c < nc; ++c) {
+                for (size_t a = 0; a < nw1; ++a) {
+                    for (size_t b = 0; b < nw2; ++b) {
+                        auto& v = row[(c * nw1 + a) * nw2 + b];
+                        v       = layer.w(f, c, a, b);
+                        row_max = std::max(row_max, std::abs(v));
+                    }
+                }
+            }
+
+            w_scale[f]   = int8_scale(row_max);
+            out_scale[f] = in_scale * w_scale[f];
+
+            int8_quantize(row.data(), &rows[f * patch], patch, w_scale[f]);
+        }
+
+        int8_pack(rows.data(), k, patch, w.data());
+
+        // The padding of the patches is never written
+        cols.resize(nh1 * nh2 * int8_round_up(patch, int8_group));
+    }
+
+    /*!
+     * \brief Returns the memory used by the weights, in bytes
+     */
+    size_t weight_memory() const noexcept {
+        return w.size() * sizeof(int8_t) + w_scale.size() * sizeof(float);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     *
+     * \return A batch of output
+     */
+    template <typename Input>
+    const etl::dyn_matrix<weight, 4>& test_forward_batch(const Input& input) const {
+        dll::auto_timer timer("int8:conv:forward_batch", etl::dim<0>(input));
+
+        const size_t B     = etl::dim<0>(input);
+        const size_t in    = nc * nv1 * nv2;
+        const size_t patch = nc * nw1 * nw2;
+        const size_t ld    = int8_round_up(patch, int8_group);
+        const size_t P     = nh1 * nh2;
+
+        if (etl::dim<0>(output) != B) {
+            output.resize(B, k, nh1, nh2);
+            xq.resize(B * in);
+            acc.resize(P * k);
+        }
+
+        int8_detail::quantize_batch(input, x, B, in, xq, in, in_scale);
+
+        weight* out = output.memory_start();
+
+        for (size_t s = 0; s < B; ++s) {
+            const int8_t* xs = &xq[s * in];
+
+            // Unroll the quantized sample, zero is exact for the padding
+
+            for (size_t i = 0; i < nh1; ++i) {
+                for (size_t j = 0; j < nh2; ++j) {
+                    int8_t* col = &cols[(i * nh2 + j) * ld];
+
+                    for (size_t c = 0; c < nc; ++c) {
+                        for (size_t a = 0; a < nw1; ++a) {
+                            const auto y = int64_t(i * s1 + a) - int64_t(p1);
+
+                            for (size_t b = 0; b < nw2; ++b) {
+                                const auto xx = int64_t(j * s2 + b) - int64_t(p2);
+
+                                if (y >= 0 && y < int64_t(nv1) && xx >= 0 && xx < int64_t(nv2)) {
+                                    *col++ = xs[(c * nv1 + y) * nv2 + xx];
+                                } else {
+                                    *col++ = 0;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            // All the positions against all the filters
+
+            int8_gemm(cols.data(), P, ld, w.data(), k, patch, acc.data(), k);
+
+            for (size_t f = 0; f < k; ++f) {
+                weight* out_f = out + (s * k + f) * P;
+
+                for (size_t p = 0; p < P; ++p) {
+                    if constexpr (Layer::no_bias) {
+                        out_f[p] = acc[p * k + f] * out_scale[f];
+                    } else {
+                        out_f[p] = acc[p * k + f] * out_scale[f] + layer.b(f);
+                    }
+                }
+            }
+        }
+
+        output.invalidate_gpu();
+
+        int8_detail::activate<Layer>(output);
+
+        return output;
+    }
+};
+
+namespace int8_detail {
+
+template <typename Network, typename Sequence>
+struct layers_tuple;
+
+template <typename Network, size_t... I>
+struct layers_tuple<Network, std::index_sequence<I...>> {
+    using type = std::tuple<int8_layer<typename Network::template layer_type<I>>...>;
+};
+
+/*!
+ * \brief Record the maximum absolute input of each quantizable layer
+ * for the given batch, forwarding the batch through the float network.
+ */
+template <size_t L, typename Network, typename Input>
+void calibrate_batch(Network& net, const Input& input, std::vector<float>& ranges) {
+    auto& layer = net.template layer_get<L>();
+
+    if constexpr (quantizable_c<std::decay_t<decltype(layer)>>) {
+        ranges[L] = std::max(ranges[L], float(etl::max(etl::abs(input))));
+    }
+
+    if constexpr (L < Network::output_layer_n) {
+        decltype(auto) next = layer.test_forward_batch(input);
+        calibrate_batch<L + 1>(net, next, ranges);
+    }
+}
+
+} //end of namespace int8_detail
+
+/*!
+ * \brief Calibrate the input range of the quantizable layers of the
+ * network on the batches of the given generator.
+ *
+ * \param net The trained network
+ * \param generator The calibration data
+ * \param max_batches The maximum number of batches to use (0 for all)
+ *
+ * \return The maximum absolute input of each layer
+ */
+template <typename Network, typename Generator>
+std::vector<float> int8_calibrate(Network& net, Generator& generator, size_t max_batches = 0) {
+    dll::auto_timer timer("int8:calibrate");
+
+    std::vector<float> ranges(Network::layers, 0.0f);
+
+    generator.reset();
+    generator.set_test();
+    generator.prepare_epoch();
+
+    size_t batches = 0;
+
+    while (generator.has_next_batch() && (!max_batches || batches < max_batches)) {
+        int8_detail::calibrate_batch<0>(net, generator.data_batch(), ranges);
+
+        generator.next_batch();
+        ++batches;
+    }
+
+    return ranges;
+}
+
+/*!
+ * \brief A quantized view of a trained network, for inference only.
+ *
+ * The network must outlive the quantized network since the layers that
+ * are not quantized, as well as the biases, are taken from it. The
+ * quantized layers reuse their buffers from one batch to the next, so a
+ * quantized network must not be used concurrently: use one per thread.
+ */
+template <typename Network>
+struct int8_network {
+    using network_t = Network;                                                                           ///< The floating point network
+    using layers_t  = typename int8_detail::layers_tuple<network_t, std::make_index_sequence<network_t::layers>>::type; ///< The quantized layers
+
+    network_t& net;  ///< The floating point network
+    layers_t layers; ///< The quantized layers
+
+    /*!
+     * \brief Quantize the network with the given calibrated ranges
+     * \param net The trained network
+     * \param ranges The maximum absolute input of each layer
+     */
+    int8_network(network_t& net, const std::vector<float>& ranges) : net(net), layers(make_layers(net, ranges, std::make_index_sequence<network_t::layers>{})) {}
+
+    /*!
+     * \brief Returns the memory used by the quantized weights, in bytes
+     */
+    size_t weight_memory() const {
+        size_t memory = 0;
+
+        cpp::for_each(layers, [&memory](auto& layer) {
+            memory += layer.weight_memory();
+        });
+
+        return memory;
+    }
+
+    /*!
+     * \brief Display a description of the quantized network
+     */
+    void display() const {
+        size_t quantized = 0;
+
+        cpp::for_each(layers, [&quantized](auto& layer) {
+            if constexpr (std::decay_t<decltype(layer)>::quantized) {
+                ++quantized;
+            }
+        });
+
+        std::cout << "Int8 network: " << quantized << "/" << network_t::layers << " layers quantized, "
+                  << weight_memory() << " bytes of quantized weights" << std::endl;
+    }
+
+    /*!
+     * \brief Compute the output of the network for the given batch of input
+     * \param input A batch of input
+     * \return A batch of output
+     */
+    template <typename Input>
+    auto forward_batch(const Input& input) const {
+        return forward_batch_impl<0>(input);
+    }
+
+    /*!
+     * \brief Evaluate the quantized network on the given classification task
+     * and return the classification error.
+     *
+     * \param generator The data generator
+     *
+     * \return The classification error
+     */
+    template <typename Generator>
+    double evaluate_error(Generator& generator) const {
+        auto forward_helper = [this](auto&& input_batch) {
+            return this->forward_batch(input_batch);
+        };
+
+        auto [error, loss] = net.evaluate_metrics(generator, forward_helper);
+        return error;
+    }
+
+private:
+    template <size_t... I>
+    static layers_t make_layers(network_t& net, const std::vector<float>& ranges, std::index_sequence<I...> /*seq*/) {
+        return layers_t{std::tuple_element_t<I, layers_t>(net.template layer_get<I>(), ranges[I])...};
+    }
+
+    template <size_t L, typename Input>
+    auto forward_batch_impl(const Input& input) const {
+        if constexpr (L != network_t::output_layer_n) {
+            decltype(auto) next = std::get<L>(layers).test_forward_batch(input);
+            return forward_batch_impl<L + 1>(next);
+        } else {
+            return std::get<L>(layers).test_forward_batch(input);
+        }
+    }
+};
+
+/*!
+ * \brief Calibrate and quantize the given network for int8 inference.
+ *
+ * \param net The trained network
+ * \param generator The calibration data
+ * \param max_batches The maximum number of calibration batches (0 for all)
+ *
+ * \return The quantized network
+ */
+template <typename Network, typename Generator>
+int8_network<Network> quantize_int8(Network& net, Generator& generator, size_t max_batches = 0) {
+    return {net, int8_calibrate(net, generator, max_batches)};
+}
+
+} //end of dll namespace
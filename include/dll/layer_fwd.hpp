@@ -89,6 +89,36 @@ struct dyn_deconv_layer_impl;
 template <typename Desc>
 struct activation_layer_impl;
 
+template <typename Desc>
+struct dropout_layer_impl;
+
+template <typename Desc>
+struct dyn_dropout_layer_impl;
+
+template <typename Desc>
+struct batch_normalization_2d_layer_impl;
+
+template <typename Desc>
+struct dyn_batch_normalization_2d_layer_impl;
+
+template <typename Desc>
+struct batch_normalization_4d_layer_impl;
+
+template <typename Desc>
+struct dyn_batch_normalization_4d_layer_impl;
+
+template <typename Desc>
+struct rnn_layer_impl;
+
+template <typename Desc>
+struct dyn_rnn_layer_impl;
+
+template <typename Desc>
+struct lstm_layer_impl;
+
+template <typename Desc>
+struct dyn_lstm_layer_impl;
+
 template <typename... Layers>
 struct group_layer_desc;
 
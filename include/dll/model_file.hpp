@@ -0,0 +1,500 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file model_file.hpp
+ * \brief Versioned binary model format.
+ *
+ * The file starts with a fixed header, followed by a manifest describing
+ * each tensor of the model (the layer it belongs to, its element size,
+ * its shape and its offset in the file) and by the tensors themselves.
+ * Each tensor is aligned on 64 bytes from the start of the file.
+ *
+ * Loading maps the file in memory and validates the manifest against the
+ * network before binding any weight. Since the layers own their weights,
+ * each tensor is then copied in a single pass from the mapped file,
+ * without any parsing. model_file gives direct access to the mapped
+ * tensors for the users that only need to read them.
+ *
+ * The tensors of a layer are its trainable parameters, the hidden biases
+ * of the RBM layers and the running statistics of the batch normalization
+ * layers. The sub layers of the group and merge layers are stored as well.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/layer_traits.hpp"
+
+namespace dll {
+
+constexpr char model_magic[8]          = {'D', 'L', 'L', 'M', 'O', 'D', 'E', 'L'}; ///< The magic of the model files
+constexpr uint32_t model_version       = 1;                                        ///< The version of the model format
+constexpr size_t model_alignment       = 64;                                       ///< The alignment of the tensors in the file
+
+/*!
+ * \brief The header of a model file
+ */
+struct model_header {
+    char magic[8];          ///< The magic of the file
+    uint32_t version;       ///< The version of the format
+    uint32_t tensors;       ///< The number of tensors
+    uint64_t manifest_size; ///< The size of the manifest, in bytes
+    uint64_t file_size;     ///< The total size of the file, in bytes
+    uint64_t reserved[4];   ///< Reserved for future versions
+};
+
+static_assert(sizeof(model_header) == 64, "The header of the model must be 64 bytes");
+
+/*!
+ * \brief The description of a tensor in the manifest of a model file
+ */
+struct model_tensor {
+    std::string layer;          ///< The description of the layer of the tensor
+    uint32_t element_size;      ///< The size of one element, in bytes
+    std::vector<uint64_t> dims; ///< The dimensions of the tensor
+    uint64_t offset;            ///< The offset of the tensor in the file
+
+    /*!
+     * \brief Returns the size of the tensor, in bytes
+     */
+    uint64_t bytes() const {
+        uint64_t size = element_size;
+
+        for (auto d : dims) {
+            size *= d;
+        }
+
+        return size;
+    }
+
+    /*!
+     * \brief Indicates if the layer, type and shape of the given tensor are the same
+     */
+    bool same_shape(const model_tensor& rhs) const {
+        return layer == rhs.layer && element_size == rhs.element_size && dims == rhs.dims;
+    }
+};
+
+namespace model_detail {
+
+template <typename Layer>
+concept bn_c = cpp::is_specialization_of_v<dll::batch_normalization_2d_layer_impl, Layer>
+               || cpp::is_specialization_of_v<dll::dyn_batch_normalization_2d_layer_impl, Layer>
+               || cpp::is_specialization_of_v<dll::batch_normalization_4d_layer_impl, Layer>
+               || cpp::is_specialization_of_v<dll::dyn_batch_normalization_4d_layer_impl, Layer>;
+
+/*!
+ * \brief Returns the tensor referenced by the given trainable parameter
+ */
+template <typename T>
+decltype(auto) unwrap(T& value) {
+    if constexpr (cpp::is_specialization_of_v<std::reference_wrapper, std::decay_t<T>>) {
+        return value.get();
+    } else {
+        return (value);
+    }
+}
+
+/*!
+ * \brief Call the functor on each stored tensor of the layer, and of its sub layers
+ */
+template <typename Layer, typename Functor>
+void for_each_tensor(Layer& layer, Functor&& functor) {
+    using layer_t = std::decay_t<Layer>;
+
+    if constexpr (requires { layer.layers; }) {
+        cpp::for_each(layer.layers, [&functor](auto& sub_layer) {
+            for_each_tensor(sub_layer, functor);
+        });
+    } else if constexpr (decay_layer_traits<layer_t>::is_rbm_layer()) {
+        functor(layer, layer.w);
+        functor(layer, layer.b);
+        functor(layer, layer.c);
+    } else if constexpr (bn_c<layer_t>) {
+        functor(layer, layer.gamma);
+        functor(layer, layer.beta);
+        functor(layer, layer.mean);
+        functor(layer, layer.var);
+    } else if constexpr (requires { layer.trainable_parameters(); }) {
+        auto parameters = layer.trainable_parameters();
+
+        cpp::for_each(parameters, [&layer, &functor](auto& tensor) {
+            functor(layer, unwrap(tensor));
+        });
+    }
+}
+
+/*!
+ * \brief Call the functor on each stored tensor of the network
+ */
+template <typename Network, typename Functor>
+void for_each_network_tensor(Network& network, Functor&& functor) {
+    network.for_each_layer([&functor](auto& layer) {
+        for_each_tensor(layer, functor);
+    });
+}
+
+/*!
+ * \brief Describe the given tensor of the given layer
+ */
+template <typename Layer, typename Tensor>
+model_tensor describe(const Layer& layer, const Tensor& tensor) {
+    model_tensor description;
+
+    description.layer        = layer.to_short_string();
+    description.element_size = sizeof(etl::value_t<Tensor>);
+    description.offset       = 0;
+
+    for (size_t d = 0; d < etl::dimensions<std::decay_t<Tensor>>(); ++d) {
+        description.dims.push_back(etl::dim(tensor, d));
+    }
+
+    return description;
+}
+
+/*!
+ * \brief Returns the manifest of the given network, without offsets
+ */
+template <typename Network>
+std::vector<model_tensor> manifest(const Network& network) {
+    std::vector<model_tensor> tensors;
+
+    for_each_network_tensor(network, [&tensors](auto& layer, auto& tensor) {
+        tensors.push_back(describe(layer, tensor));
+    });
+
+    return tensors;
+}
+
+inline uint64_t align(uint64_t offset) {
+    return (offset + model_alignment - 1) / model_alignment * model_alignment;
+}
+
+template <typename T>
+void write(std::vector<char>& out, const T& value) {
+    auto* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool read(const char*& in, const char* end, T& value) {
+    if (size_t(end - in) < sizeof(T)) {
+        return false;
+    }
+
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+
+    return true;
+}
+
+/*!
+ * \brief Serialize the manifest
+ */
+inline std::vector<char> serialize(const std::vector<model_tensor>& tensors) {
+    std::vector<char> out;
+
+    for (auto& tensor : tensors) {
+        write(out, uint32_t(tensor.layer.size()));
+        out.insert(out.end(), tensor.layer.begin(), tensor.layer.end());
+        write(out, tensor.element_size);
+        write(out, uint32_t(tensor.dims.size()));
+
+        for (auto d : tensor.dims) {
+            write(out, d);
+        }
+
+        write(out, tensor.offset);
+    }
+
+    return out;
+}
+
+/*!
+ * \brief Deserialize the manifest
+ */
+inline bool deserialize(const char* in, const char* end, size_t n, std::vector<model_tensor>& tensors) {
+    for (size_t i = 0; i < n; ++i) {
+        model_tensor tensor;
+
+        uint32_t length;
+        uint32_t dimensions;
+
+        if (!read(in, end, length) || size_t(end - in) < length) {
+            return false;
+        }
+
+        tensor.layer.assign(in, length);
+        in += length;
+
+        if (!read(in, end, tensor.element_size) || !read(in, end, dimensions)) {
+            return false;
+        }
+
+        tensor.dims.resize(dimensions);
+
+        for (auto& d : tensor.dims) {
+            if (!read(in, end, d)) {
+                return false;
+            }
+        }
+
+        if (!read(in, end, tensor.offset)) {
+            return false;
+        }
+
+        tensors.push_back(std::move(tensor));
+    }
+
+    return true;
+}
+
+} // end of namespace model_detail
+
+/*!
+ * \brief A model file mapped in memory
+ */
+struct model_file {
+    std::vector<model_tensor> tensors; ///< The manifest of the file
+
+    model_file() = default;
+
+    model_file(const model_file& rhs) = delete;
+    model_file& operator=(const model_file& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~model_file() {
+        close();
+    }
+
+    /*!
+     * \brief Map the given file and read its manifest
+     * \param file The path to the model file
+     * \return true if the file is a valid model file, false otherwise
+     */
+    bool open(const std::string& file) {
+        close();
+
+        int fd = ::open(file.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "dll: Unable to open the model file " << file << std::endl;
+            return false;
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(model_header)) {
+            std::cerr << "dll: Invalid model file " << file << std::endl;
+            ::close(fd);
+            return false;
+        }
+
+        size = st.st_size;
+
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        ::close(fd);
+
+        if (mapped == MAP_FAILED) {
+            std::cerr << "dll: Unable to map the model file " << file << std::endl;
+            size = 0;
+            return false;
+        }
+
+        memory = static_cast<const char*>(mapped);
+
+        model_header header;
+        std::memcpy(&header, memory, sizeof(header));
+
+        if (std::memcmp(header.magic, model_magic, sizeof(model_magic)) != 0) {
+            std::cerr << "dll: " << file << " is not a DLL model file" << std::endl;
+            close();
+            return false;
+        }
+
+        if (header.version != model_version) {
+            std::cerr << "dll: Unsupported model version " << header.version << " (expected " << model_version << ")" << std::endl;
+            close();
+            return false;
+        }
+
+        if (header.file_size != size || sizeof(header) + header.manifest_size > size) {
+            std::cerr << "dll: The model file " << file << " is truncated" << std::endl;
+            close();
+            return false;
+        }
+
+        const char* manifest = memory + sizeof(header);
+
+        if (!model_detail::deserialize(manifest, manifest + header.manifest_size, header.tensors, tensors)) {
+            std::cerr << "dll: Invalid manifest in the model file " << file << std::endl;
+            close();
+            return false;
+        }
+
+        for (auto& tensor : tensors) {
+            if (tensor.offset % model_alignment || tensor.offset + tensor.bytes() > size) {
+                std::cerr << "dll: Invalid tensor offset in the model file " << file << std::endl;
+                close();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Unmap the file
+     */
+    void close() {
+        if (memory) {
+            munmap(const_cast<char*>(memory), size);
+        }
+
+        memory = nullptr;
+        size   = 0;
+
+        tensors.clear();
+    }
+
+    /*!
+     * \brief Returns a pointer to the data of the ith tensor, aligned on 64 bytes
+     */
+    const void* data(size_t i) const {
+        return memory + tensors[i].offset;
+    }
+
+private:
+    const char* memory = nullptr; ///< The mapped file
+    size_t size        = 0;       ///< The size of the mapped file
+};
+
+/*!
+ * \brief Store the network in the given model file
+ * \param network The network to store
+ * \param file The path to the model file
+ * \return true if the model was written, false otherwise
+ */
+template <typename Network>
+bool store_model(const Network& network, const std::string& file) {
+    auto tensors = model_detail::manifest(network);
+
+    // The offsets are part of the manifest, its size does not depend on them
+
+    const size_t manifest_size = model_detail::serialize(tensors).size();
+
+    uint64_t offset = model_detail::align(sizeof(model_header) + manifest_size);
+
+    for (auto& tensor : tensors) {
+        tensor.offset = offset;
+        offset        = model_detail::align(offset + tensor.bytes());
+    }
+
+    model_header header{};
+    std::memcpy(header.magic, model_magic, sizeof(model_magic));
+    header.version       = model_version;
+    header.tensors       = tensors.size();
+    header.manifest_size = manifest_size;
+    header.file_size     = offset;
+
+    std::ofstream os(file, std::ofstream::binary);
+
+    if (!os) {
+        std::cerr << "dll: Unable to open the model file " << file << std::endl;
+        return false;
+    }
+
+    auto manifest = model_detail::serialize(tensors);
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(manifest.data(), manifest.size());
+
+    size_t position = sizeof(header) + manifest.size();
+    size_t i        = 0;
+
+    const char padding[model_alignment] = {};
+
+    model_detail::for_each_network_tensor(network, [&](auto& /*layer*/, auto& tensor) {
+        os.write(padding, tensors[i].offset - position);
+
+        tensor.ensure_cpu_up_to_date();
+        os.write(reinterpret_cast<const char*>(tensor.memory_start()), tensors[i].bytes());
+
+        position = tensors[i].offset + tensors[i].bytes();
+        ++i;
+    });
+
+    os.write(padding, header.file_size - position);
+
+    return bool(os);
+}
+
+/*!
+ * \brief Load the network from the given model file.
+ *
+ * The manifest of the file is validated against the network before any
+ * weight is modified.
+ *
+ * \param network The network to load
+ * \param file The path to the model file
+ * \return true if the model was loaded, false otherwise
+ */
+template <typename Network>
+bool load_model(Network& network, const std::string& file) {
+    model_file model;
+
+    if (!model.open(file)) {
+        return false;
+    }
+
+    auto expected = model_detail::manifest(network);
+
+    if (expected.size() != model.tensors.size()) {
+        std::cerr << "dll: The model file contains " << model.tensors.size() << " tensors, the network " << expected.size() << std::endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (!expected[i].same_shape(model.tensors[i])) {
+            std::cerr << "dll: The tensor " << i << " of the model file (" << model.tensors[i].layer << ") does not match the network (" << expected[i].layer << ")" << std::endl;
+            return false;
+        }
+    }
+
+    size_t i = 0;
+
+    model_detail::for_each_network_tensor(network, [&](auto& /*layer*/, auto& tensor) {
+        std::memcpy(tensor.memory_start(), model.data(i), model.tensors[i].bytes());
+        tensor.invalidate_gpu();
+        ++i;
+    });
+
+    return true;
+}
+
+} //end of dll namespace
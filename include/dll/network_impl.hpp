@@ -15,6 +15,12 @@
 
 #pragma once
 
+#include <exception>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+
 #include "cpp_utils/maybe_parallel.hpp"
 #include "cpp_utils/tuple_utils.hpp"
 
@@ -25,9 +31,14 @@
 #include "dll/trainer/rbm_training_context.hpp"
 #include "svm_common.hpp"
 #include "util/export.hpp"
+#include "model_file.hpp"
 #include "util/timers.hpp"
 #include "util/random.hpp"
 #include "util/ready.hpp"
+#include "util/pipeline_queue.hpp"
+#include "util/activation_cache.hpp"
+#include "util/csr.hpp"
+#include "util/layer_cost.hpp"
 #include "dbn_detail.hpp" // dbn_detail namespace
 
 namespace dll {
@@ -93,6 +104,12 @@ struct dbn final {
         "batch_mode dbn does not support shuffle in layers");
     static_assert(!network_traits<this_type>::shuffle_pretrain() || network_traits<this_type>::batch_mode(),
         "shuffle_pre is only compatible with batch mode, for normal mode, use shuffle in layers");
+    static_assert(!network_traits<this_type>::pretrain_cache() || network_traits<this_type>::batch_mode(),
+        "pretrain_cache is only compatible with batch mode, normal mode keeps all the activations in memory");
+    static_assert(!(network_traits<this_type>::shuffle() && layers_t::has_stateful_layer),
+        "stateful recurrent layers need the samples in order, the network must not shuffle");
+    static_assert(!network_traits<this_type>::pretrain_cache() || !network_traits<this_type>::shuffle_pretrain(),
+        "pretrain_cache is not compatible with shuffle_pre, the batches change at each epoch");
 
     template <size_t N>
     using layer_type = detail::layer_type_t<N, layers_t>; ///< The type of the layer at index Nth
@@ -140,6 +157,8 @@ public:
     static inline constexpr size_t batch_size     = desc::BatchSize;    ///< The batch size (for finetuning)
     static inline constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of pretraining batch to do at once
 
+    static constexpr bool memory_plan = network_traits<this_type>::memory_plan(); ///< Indicates if the fine-tuning memory is planned
+
     static constexpr auto loss             = desc::Loss;         ///< The loss function
     static constexpr auto updater          = desc::Updater;      ///< The Updater type
     static constexpr auto early            = desc::Early;        ///< The Early Stopping stragy
@@ -165,6 +184,12 @@ public:
 
     weight gradient_clip = 5.0; ///< The gradient clipping
 
+    weight loss_scale        = 65536.0; ///< The initial loss scale (mixed precision)
+    size_t loss_scale_window = 1000;    ///< The number of steps without overflow before the loss scale is doubled (mixed precision)
+
+    std::array<double, layers> pretrain_cache_hit_rate{}; ///< The hit rate of the activation cache of each layer in the last batch mode pretraining
+    std::array<size_t, layers> pretrain_streamed_batches{}; ///< The number of batches each layer received from the previous one in the last pipelined pretraining
+
     weight goal     = 0.0; ///< The learning goal
     size_t patience = 1;   ///< The patience for early stopping goals
 
@@ -343,6 +368,15 @@ public:
     dbn(dbn&& dbn) = delete;
     dbn& operator=(dbn&& dbn) = delete;
 
+    /*!
+     * \brief Returns the thread pool of the network.
+     *
+     * The pool is serial when the network is configured as serial.
+     */
+    auto& get_pool() noexcept {
+        return pool;
+    }
+
     /*!
      * \brief Prints a textual representation of the network.
      */
@@ -501,6 +535,159 @@ public:
         out << buffer;
     }
 
+    /*!
+     * \brief Prints the analytical cost of the operations of the layers on
+     * one batch, with the performance achieved according to the timers, in
+     * the form of a roofline table.
+     *
+     * Only the layers reporting their cost are displayed, with the
+     * operations done during training: the first layer does not backpropagate
+     * its errors and the layers computing their gradients during the backward
+     * pass only compute them separately if they are the first layer. The
+     * layers of the same type share their timers, they are displayed with
+     * the performance of their type. Only the calls made on full batches are
+     * accounted.
+     *
+     * \param peak_gflops The peak performance of the machine (GFLOP/s), 0 if unknown
+     * \param peak_gbs The peak bandwidth of the machine (GB/s), 0 if unknown
+     */
+    void display_roofline(double peak_gflops = 0.0, double peak_gbs = 0.0) const {
+        constexpr size_t columns = 11;
+
+        std::array<std::string, columns> column_name{
+            "Index", "Layer", "Pass", "GFLOP", "MB", "FLOP/B", "Time", "GFLOP/s", "GB/s", "Bound", "Efficiency"};
+
+        struct roofline_entry {
+            std::string index; ///< The index of the layer
+            std::string layer; ///< The description of the layer
+            std::string pass;  ///< The name of the operation
+            op_cost op;        ///< The cost of the operation
+        };
+
+        std::vector<roofline_entry> entries;
+
+        // The total cost of the layers sharing each timer
+        std::map<std::string, std::array<double, 3>> shared;
+
+        for_each_layer_i([&](size_t I, auto& layer) {
+            if constexpr (requires { layer.cost(batch_size); }) {
+                const auto cost = layer.cost(batch_size);
+
+                for (auto [pass, op] : {std::make_pair("forward", cost.forward), std::make_pair("backward", cost.backward), std::make_pair("gradients", cost.gradients)}) {
+                    const std::string name(pass);
+
+                    const bool skipped = !op.timer
+                                      || (name == "backward" && I == 0)
+                                      || (name == "gradients" && cost.fused_gradients && I > 0);
+
+                    if (skipped) {
+                        continue;
+                    }
+
+                    entries.push_back({std::to_string(I), layer.to_short_string(""), pass, op});
+
+                    auto& total = shared[op.timer];
+
+                    total[0] += op.flops;
+                    total[1] += op.bytes;
+                    total[2] += 1.0;
+                }
+            }
+        });
+
+        if (entries.empty()) {
+            out << "No layer reports its cost" << std::endl;
+            return;
+        }
+
+        auto format = [](const char* f, double value) {
+            char buffer[64];
+            snprintf(buffer, 64, f, value);
+            return std::string(buffer);
+        };
+
+        std::vector<std::array<std::string, columns>> rows;
+
+        for (auto& entry : entries) {
+            auto& op = entry.op;
+
+            rows.emplace_back();
+            auto& row = rows.back();
+
+            row[0] = entry.index;
+            row[1] = entry.layer;
+            row[2] = entry.pass;
+            row[3] = format("%.3f", op.flops / 1e9);
+            row[4] = format("%.3f", op.bytes / 1e6);
+            row[5] = format("%.2f", op.intensity());
+
+            const auto stats = get_timer_stats(op.timer, batch_size);
+            const auto& total = shared[op.timer];
+
+            double gflops = 0.0;
+
+            if (stats.count && stats.duration) {
+                // Each layer of the timer is called count / n times (1 FLOP/ns = 1 GFLOP/s)
+                const double calls = stats.count / total[2];
+
+                gflops = calls * total[0] / stats.duration;
+
+                row[6] = format("%.3fms", stats.duration / (calls * total[2] * 1e6));
+                row[7] = format("%.2f", gflops);
+                row[8] = format("%.2f", calls * total[1] / stats.duration);
+            } else {
+                row[6] = row[7] = row[8] = "-";
+            }
+
+            if (peak_gflops > 0.0 && peak_gbs > 0.0) {
+                const double attainable = std::min(peak_gflops, op.intensity() * peak_gbs);
+
+                row[9]  = op.intensity() < peak_gflops / peak_gbs ? "memory" : "compute";
+                row[10] = gflops > 0.0 ? format("%.1f%%", 100.0 * gflops / attainable) : "-";
+            } else {
+                row[9] = row[10] = "-";
+            }
+        }
+
+        std::array<size_t, columns> column_length;
+
+        for (size_t i = 0; i < columns; ++i) {
+            column_length[i] = column_name[i].size();
+
+            for (auto& row : rows) {
+                column_length[i] = std::max(column_length[i], row[i].size());
+            }
+        }
+
+        const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length.begin(), column_length.end(), 0);
+
+        auto print_row = [&](const std::array<std::string, columns>& row) {
+            out << " |";
+
+            for (size_t i = 0; i < columns; ++i) {
+                // The names are aligned on the left, the values on the right
+                out << ' ' << (i < 3 ? std::left : std::right) << std::setw(column_length[i]) << row[i] << " |";
+            }
+
+            out << std::right << '\n';
+        };
+
+        out << '\n';
+        out << " " << std::string(line_length, '-') << '\n';
+        print_row(column_name);
+        out << " " << std::string(line_length, '-') << '\n';
+
+        for (auto& row : rows) {
+            print_row(row);
+        }
+
+        out << " " << std::string(line_length, '-') << '\n';
+
+        if (peak_gflops > 0.0 && peak_gbs > 0.0) {
+            out << "  Ridge point: " << format("%.2f", peak_gflops / peak_gbs) << " FLOP/B" << std::endl;
+        }
+    }
+
     /*!
      * \brief Backup the weights of all the layers into a temporary storage.
      *
@@ -525,6 +712,30 @@ public:
         });
     }
 
+    /*!
+     * \brief Reset the state carried between batches by the stateful
+     * recurrent layers, for instance before new sequences.
+     */
+    void reset_states() {
+        for_each_layer([](auto& layer) {
+            if constexpr (requires { layer.reset_state(); }) {
+                layer.reset_state();
+            }
+        });
+    }
+
+    /*!
+     * \brief Reset the state carried between test batches by the stateful
+     * recurrent layers, leaving their training state untouched.
+     */
+    void reset_test_states() {
+        for_each_layer([](auto& layer) {
+            if constexpr (requires { layer.reset_test_state(); }) {
+                layer.reset_test_state();
+            }
+        });
+    }
+
     /*!
      * \brief Store the network weights to the given file.
      * \param file The path to the file
@@ -543,6 +754,33 @@ public:
         load(is);
     }
 
+    /*!
+     * \brief Store the network in the given versioned model file.
+     *
+     * Contrary to store(), the file contains a manifest of the layers and
+     * of the shapes of the tensors, which are aligned for loading by
+     * memory mapping (see model_file.hpp).
+     *
+     * \param file The path to the file
+     * \return true if the model was written, false otherwise
+     */
+    bool store_model(const std::string& file) const {
+        return dll::store_model(*this, file);
+    }
+
+    /*!
+     * \brief Load the network from the given versioned model file.
+     *
+     * The network is left untouched if the manifest of the file does not
+     * match the network.
+     *
+     * \param file The path to the file
+     * \return true if the model was loaded, false otherwise
+     */
+    bool load_model(const std::string& file) {
+        return dll::load_model(*this, file);
+    }
+
     /*!
      * \brief Store the network weights using the given output stream.
      * \param os The stream to output the network weights to.
@@ -669,7 +907,14 @@ public:
             watcher.pretraining_begin(*this, max_epochs);
 
             //Pretrain each layer one-by-one
-            if constexpr (batch_mode()) {
+            if constexpr (network_traits<this_type>::pretrain_pipeline() > 0) {
+                out << "DBN: Pretraining done in pipelined mode" << std::endl;
+
+                // The stages run concurrently and share the watcher
+                std::mutex watcher_lock;
+
+                pretrain_layer_pipeline<pipeline_next<0>()>(input, watcher, watcher_lock, max_epochs, nullptr);
+            } else if constexpr (batch_mode()) {
                 out << "DBN: Pretraining done in batch mode" << std::endl;
 
                 if (layers_t::has_shuffle_layer) {
@@ -990,6 +1235,34 @@ public:
         return test_forward_batch_impl<LS, L>(sample);
     }
 
+    /*
+     * \brief Return the test representation for the given batch of sparse
+     * input. The first layer must be a dense layer or a dense RBM.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     *
+     * \param sample The batch of sparse input
+     *
+     * \return The test representation of the LS layer
+     */
+    template <size_t LS = layers - 1>
+    auto forward_batch_sparse(const csr_batch<weight>& sample) const {
+        using first_t = layer_type<0>;
+
+        static_assert(decay_layer_traits<first_t>::is_standard_dense_layer() || decay_layer_traits<first_t>::is_dense_rbm_layer(),
+                      "Sparse input is only supported with a dense first layer");
+
+        etl::dyn_matrix<weight, 2> output(sample.rows, layer_get<0>().output_size());
+
+        layer_get<0>().test_forward_batch(output, sample);
+
+        if constexpr (LS == 0) {
+            return output;
+        } else {
+            return test_forward_batch_impl<LS, 1>(output);
+        }
+    }
+
     // Forward one sample at a time
     // This is not as fast as it could be, far from it, but supports
     // larger range of input. The rationale being that time should
@@ -1349,6 +1622,24 @@ public:
         return trainer.train(*this, generator, max_epochs);
     }
 
+    /*!
+     * \brief Fine tune the network for classifcation on batches of sparse
+     * input. The first layer must be a dense layer.
+     *
+     * \param inputs The batches of sparse inputs
+     * \param labels The batches of one-hot labels
+     * \param max_epochs The maximum number of epochs to train the network for.
+     *
+     * \return The final classification error
+     */
+    template <typename Labels>
+    weight fine_tune_sparse(const std::vector<csr_batch<weight>>& inputs, const std::vector<Labels>& labels, size_t max_epochs) {
+        dll::auto_timer timer("net:train:ft:sparse");
+
+        dll::dbn_trainer<this_type> trainer;
+        return trainer.train_sparse(*this, inputs, labels, max_epochs);
+    }
+
     /*!
      * \brief Fine tune the network for classifcation with a generator.
      *
@@ -2543,6 +2834,9 @@ private:
     //Normal version
     template <size_t I, typename Generator, cpp_enable_iff((I > 0 && I < layers && !batch_layer_ignore<I>))>
     void pretrain_layer_batch(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        static_assert(!network_traits<this_type>::pretrain_cache() || !augmented_generator<typename Generator::desc>,
+            "pretrain_cache is not compatible with augmented generators, the batches change at each epoch");
+
         using layer_t = layer_type<I>;
 
         decltype(auto) rbm = layer_get<I>();
@@ -2560,6 +2854,12 @@ private:
         //Get the specific trainer (CD)
         auto trainer = rbm_trainer_t::get_trainer(rbm);
 
+        //Cache of the inputs of the layer, indexed by the position of the batch,
+        //which is stable since the generator neither shuffles nor augments
+        using batch_t = etl::dyn_matrix<weight, etl::dimensions<decltype(forward_batch<I - 1>(generator.data_batch()))>()>;
+
+        activation_cache<batch_t> cache(network_traits<this_type>::pretrain_cache());
+
         //Train for max_epochs epoch
         for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
             size_t big_batch = 0;
@@ -2572,10 +2872,20 @@ private:
             generator.reset();
             generator.set_train();
 
+            cache.new_epoch();
+
+            [[maybe_unused]] size_t b = 0;
+
             while (generator.has_next_batch()) {
-                auto next_batch = forward_batch<I - 1>(generator.data_batch());
+                if constexpr (network_traits<this_type>::pretrain_cache() > 0) {
+                    auto& next_batch = cache.get(b++, [&]() { return this->template forward_batch<I - 1>(generator.data_batch()); });
 
-                r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
+                    r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
+                } else {
+                    auto next_batch = forward_batch<I - 1>(generator.data_batch());
+
+                    r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
+                }
 
                 if (network_traits<this_type>::is_verbose()) {
                     watcher.pretraining_batch(*this, big_batch);
@@ -2589,6 +2899,8 @@ private:
 
         r_trainer.finalize_training(rbm);
 
+        pretrain_cache_hit_rate[I] = cache.hit_rate();
+
         //train the next layer, if any
         pretrain_layer_batch<I + 1>(generator, watcher, max_epochs);
     }
@@ -2597,6 +2909,226 @@ private:
     template <size_t I, typename Generator, cpp_enable_iff(I == layers)>
     void pretrain_layer_batch(Generator&, watcher_t&, size_t) {}
 
+    /* Pretrain in pipelined mode */
+
+    /*!
+     * \brief Returns the index of the first layer from I that is trained in
+     * pipelined mode (layers if there is none)
+     */
+    template <size_t I>
+    static constexpr size_t pipeline_next() {
+        if constexpr (I >= layers) {
+            return layers;
+        } else if constexpr (batch_layer_ignore<I>) {
+            return pipeline_next<I + 1>();
+        } else {
+            return I;
+        }
+    }
+
+    /*!
+     * \brief Pretrain the layer I and, concurrently, the layers after it.
+     *
+     * The next trained layer J runs on its own thread and receives the
+     * activations of the layer I through a bounded queue, once I has
+     * trained alone for the configured number of epochs. When I is done,
+     * J computes its inputs from the generator for its remaining epochs.
+     *
+     * If a stage fails, the queues are aborted to stop the other stages and
+     * the exception is rethrown once all the threads have been joined.
+     *
+     * \param generator The generator of the input of the network
+     * \param watcher The watcher
+     * \param watcher_lock The lock serializing the calls to the watcher
+     * \param max_epochs The number of epochs of each layer
+     * \param source The queue of the inputs of I (nullptr for the first trained layer)
+     */
+    template <size_t I, typename Generator, typename Source>
+    void pretrain_layer_pipeline(Generator& generator, watcher_t& watcher, std::mutex& watcher_lock, size_t max_epochs, Source source) {
+        if constexpr (I < layers) {
+            constexpr size_t J = pipeline_next<I + 1>();
+
+            if constexpr (J < layers) {
+                using batch_t = etl::dyn_matrix<weight, etl::dimensions<decltype(this->template forward_batch<J - 1>(generator.data_batch()))>()>;
+
+                pipeline_queue<batch_t> queue(std::max<size_t>(big_batch_size, 2));
+
+                // The failure of the next stages, rethrown once they are joined
+                std::exception_ptr next_error;
+
+                std::thread next([this, &generator, &watcher, &watcher_lock, max_epochs, &queue, &next_error]() {
+                    try {
+                        this->template pretrain_layer_pipeline<J>(generator, watcher, watcher_lock, max_epochs, &queue);
+                    } catch (...) {
+                        next_error = std::current_exception();
+
+                        // Stop the producer of the failed stage
+                        queue.abort();
+                    }
+                });
+
+                try {
+                    pretrain_layer_pipeline_stage<I>(generator, watcher, watcher_lock, max_epochs, source, &queue);
+                } catch (...) {
+                    // Stop the next stages before unwinding
+                    queue.abort();
+                    next.join();
+                    throw;
+                }
+
+                next.join();
+
+                if (next_error) {
+                    std::rethrow_exception(next_error);
+                }
+            } else {
+                pretrain_layer_pipeline_stage<I>(generator, watcher, watcher_lock, max_epochs, source, nullptr);
+            }
+        }
+    }
+
+    /*!
+     * \brief Train the layer I in pipelined mode
+     *
+     * When the pipeline is aborted by another stage, the training stops
+     * and the neighbouring queues are aborted in turn.
+     *
+     * \param generator The generator of the input of the network
+     * \param watcher The watcher
+     * \param watcher_lock The lock serializing the calls to the watcher
+     * \param max_epochs The number of epochs of the layer
+     * \param source The queue of the inputs of the layer (nullptr for the first trained layer)
+     * \param output The queue of the inputs of the next trained layer (nullptr for the last trained layer)
+     */
+    template <size_t I, typename Generator, typename Source, typename Output>
+    void pretrain_layer_pipeline_stage(Generator& generator, watcher_t& watcher, std::mutex& watcher_lock, size_t max_epochs, Source source, Output output) {
+        dll::auto_timer timer("net:pretrain:pipeline:stage");
+
+        using layer_t = layer_type<I>;
+
+        constexpr size_t J = pipeline_next<I + 1>();
+
+        decltype(auto) rbm = layer_get<I>();
+
+        {
+            std::lock_guard<std::mutex> l(watcher_lock);
+
+            watcher.pretrain_layer(*this, I, rbm, generator.size());
+        }
+
+        //Each stage has its own RBM trainer, with its own RBM watcher
+        using rbm_trainer_t = dll::rbm_trainer<layer_t, !watcher_t::ignore_sub, dbn_detail::rbm_watcher_t<watcher_t>>;
+
+        //Initialize the RBM trainer
+        rbm_trainer_t r_trainer;
+
+        //Init the RBM and training parameters
+        r_trainer.init_training(rbm, generator);
+
+        //Some RBM may init weights based on the training data
+        if constexpr (I == pipeline_next<0>() && rbm_layer_traits<layer_t>::init_weights()) {
+            rbm.init_weights(generator);
+        }
+
+        //Get the specific trainer (CD)
+        auto trainer = rbm_trainer_t::get_trainer(rbm);
+
+        //The inputs are streamed until the previous layer is done
+        bool streaming = !std::is_null_pointer_v<Source>;
+
+        //Another stage has failed
+        bool aborted = false;
+
+        pretrain_streamed_batches[I] = 0;
+
+        for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
+            //Create a new context for this epoch
+            rbm_training_context context;
+
+            r_trainer.init_epoch(epoch);
+
+            const bool feed = epoch >= network_traits<this_type>::pretrain_pipeline();
+
+            auto train = [&](auto& input) {
+                r_trainer.train_batch(input, input, trainer, context, rbm);
+
+                if constexpr (!std::is_null_pointer_v<Output>) {
+                    if (feed) {
+                        using batch_t = typename std::remove_pointer_t<Output>::value_type;
+
+                        aborted = !output->push(batch_t(this->template test_forward_batch_impl<J - 1, I>(input)));
+                    }
+                }
+            };
+
+            if constexpr (!std::is_null_pointer_v<Source>) {
+                if (streaming) {
+                    typename std::remove_pointer_t<Source>::value_type input;
+
+                    auto status = source->pop(input);
+
+                    while (status == pipeline_status::BATCH && !aborted) {
+                        train(input);
+
+                        ++pretrain_streamed_batches[I];
+
+                        status = source->pop(input);
+                    }
+
+                    aborted = aborted || status == pipeline_status::ABORTED;
+
+                    //The previous layer is done, the generator is now free
+                    streaming = status == pipeline_status::EPOCH;
+                }
+            }
+
+            if (!streaming && !aborted) {
+                generator.reset();
+                generator.set_train();
+
+                while (generator.has_next_batch() && !aborted) {
+                    if constexpr (I == 0) {
+                        auto input = generator.data_batch();
+
+                        train(input);
+                    } else {
+                        auto input = forward_batch<I - 1>(generator.data_batch());
+
+                        train(input);
+                    }
+
+                    generator.next_batch();
+                }
+            }
+
+            if (aborted) {
+                if constexpr (!std::is_null_pointer_v<Source>) {
+                    source->abort();
+                }
+
+                if constexpr (!std::is_null_pointer_v<Output>) {
+                    output->abort();
+                }
+
+                return;
+            }
+
+            r_trainer.finalize_epoch(epoch, context, rbm);
+
+            if constexpr (!std::is_null_pointer_v<Output>) {
+                if (feed) {
+                    output->end_epoch();
+                }
+            }
+        }
+
+        if constexpr (!std::is_null_pointer_v<Output>) {
+            output->close();
+        }
+
+        r_trainer.finalize_training(rbm);
+    }
+
     /* Pretrain layer denoising batch  */
 
     template <size_t I, typename Generator, cpp_enable_iff((I > 0 && I < layers && !batch_layer_ignore<I>))>
@@ -66,6 +66,24 @@ struct has_shuffle_helper <Layer> {
 template <typename... Layers>
 constexpr const bool has_shuffle_layer = (... || has_shuffle_helper<Layers>::value);
 
+/*!
+ * \brief Indicates if the layer carries its state between batches
+ */
+template <typename Layer>
+constexpr bool is_stateful_layer() {
+    if constexpr (requires { Layer::stateful; }) {
+        return Layer::stateful;
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Helper traits indicate if the set contains stateful layers
+ */
+template <typename... Layers>
+constexpr const bool has_stateful_layer = (... || is_stateful_layer<Layers>());
+
 // TODO validate_layer_pair should be made more robust when
 // transform layer are present between layers
 
@@ -159,10 +177,11 @@ template <typename... Layers>
 struct layers <false, Layers...> {
     static constexpr size_t size = sizeof...(Layers); ///< The number of layers in the set
 
-    static constexpr bool is_dynamic        = detail::is_dynamic<Layers...>;        ///< Indicates if the set contains dynamic layers
-    static constexpr bool is_convolutional  = detail::is_convolutional<Layers...>;  ///< Indicates if the set contains convolutional layers
-    static constexpr bool is_denoising      = detail::is_denoising<Layers...>;      ///< Indicates if the set contains denoising layers
-    static constexpr bool has_shuffle_layer = detail::has_shuffle_layer<Layers...>; ///< Indicates if the set contains shuffle layers
+    static constexpr bool is_dynamic         = detail::is_dynamic<Layers...>;         ///< Indicates if the set contains dynamic layers
+    static constexpr bool is_convolutional   = detail::is_convolutional<Layers...>;   ///< Indicates if the set contains convolutional layers
+    static constexpr bool is_denoising       = detail::is_denoising<Layers...>;       ///< Indicates if the set contains denoising layers
+    static constexpr bool has_shuffle_layer  = detail::has_shuffle_layer<Layers...>;  ///< Indicates if the set contains shuffle layers
+    static constexpr bool has_stateful_layer = detail::has_stateful_layer<Layers...>; ///< Indicates if the set contains stateful layers
 
     static_assert(size > 0, "A network must have at least 1 layer");
     static_assert(detail::are_layers_valid<Layers...>(), "The inner sizes of the layers must correspond");
@@ -180,10 +199,11 @@ template <typename... Layers>
 struct layers <true, Layers...> {
     static constexpr size_t size = sizeof...(Layers); ///< The number of layers in the set
 
-    static constexpr bool is_dynamic        = false;                                  ///< Indicates if the set contains dynamic layers
-    static constexpr bool is_convolutional  = false;                                  ///< Indicates if the set contains convolutional layers
-    static constexpr bool is_denoising      = false;                                  ///< Indicates if the set contains denoising layers
-    static constexpr bool has_shuffle_layer = detail::has_shuffle_layer<Layers...>; ///< Indicates if the set contains shuffle layers
+    static constexpr bool is_dynamic         = false;                                 ///< Indicates if the set contains dynamic layers
+    static constexpr bool is_convolutional   = false;                                 ///< Indicates if the set contains convolutional layers
+    static constexpr bool is_denoising       = false;                                 ///< Indicates if the set contains denoising layers
+    static constexpr bool has_shuffle_layer  = detail::has_shuffle_layer<Layers...>; ///< Indicates if the set contains shuffle layers
+    static constexpr bool has_stateful_layer = false;                                 ///< Indicates if the set contains stateful layers
 
     static_assert(size > 0, "A network must have at least 1 layer");
     static_assert(detail::validate_label_layers<Layers...>::value, "The inner sizes of RBM must correspond");
@@ -93,6 +93,62 @@ struct network_traits {
         return desc::parameters::template contains<serial>();
     }
 
+    /*!
+     * \brief Returns the number of shards each fine-tuning batch is split into
+     */
+    static constexpr size_t shards() noexcept {
+        return desc::Shards;
+    }
+
+    /*!
+     * \brief Indicates if the fine-tuning batches are trained in parallel shards
+     */
+    static constexpr bool data_parallel() noexcept {
+        return shards() > 1 && !is_serial();
+    }
+
+    /*!
+     * \brief Indicates if the memory of the fine-tuning contexts is planned by liveness
+     */
+    static constexpr bool memory_plan() noexcept {
+        return desc::parameters::template contains<dll::memory_plan>() || checkpoint() > 1;
+    }
+
+    /*!
+     * \brief Returns the number of layers of each gradient checkpointing segment (1 without checkpointing)
+     */
+    static constexpr size_t checkpoint() noexcept {
+        return desc::Checkpoint;
+    }
+
+    /*!
+     * \brief Returns the number of epochs of a layer before it feeds the next one in pipelined pretraining (0 without pipeline)
+     */
+    static constexpr size_t pretrain_pipeline() noexcept {
+        return desc::PretrainPipeline;
+    }
+
+    /*!
+     * \brief Returns the number of batches of activations cached for batch mode pretraining
+     */
+    static constexpr size_t pretrain_cache() noexcept {
+        return desc::PretrainCache;
+    }
+
+    /*!
+     * \brief Returns the precision of the activations and errors during fine-tuning
+     */
+    static constexpr precision_type precision() noexcept {
+        return desc::Precision;
+    }
+
+    /*!
+     * \brief Indicates if the network is fine-tuned in mixed precision
+     */
+    static constexpr bool mixed_precision() noexcept {
+        return precision() != precision_type::FLOAT;
+    }
+
     /*!
      * \brief Indicates if the network is verbose
      */
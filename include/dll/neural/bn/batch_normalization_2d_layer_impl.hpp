@@ -9,6 +9,9 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
+
 namespace dll {
 
 /*!
@@ -76,6 +79,14 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         return 4 * Input;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return batch_normalization_cost(batch, Input, Input, true, sizeof(weight), {"bn:2d:train:forward", "bn:2d:backward", "bn:2d:gradients"});
+    }
+
     /*!
      * \brief Return the size of the input of this layer
      * \return The size of the input of this layer
@@ -120,7 +131,7 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      */
     template <typename Input, typename Output>
     void test_forward_batch(Output& output, const Input& input) const {
-        dll::auto_timer timer("bn:2d:test:forward");
+        dll::auto_timer timer("bn:2d:test:forward", etl::dim<0>(input));
 
         output = batch_hint((1.0 / etl::sqrt(var + e)) >> (input - mean));
         output = batch_hint((gamma >> output) + beta);
@@ -133,7 +144,7 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("bn:2d:train:forward");
+        dll::auto_timer timer("bn:2d:train:forward", etl::dim<0>(input));
 
         const auto B = etl::dim<0>(input);
 
@@ -168,7 +179,7 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("bn:2d:backward");
+        dll::unsafe_auto_timer timer("bn:2d:backward", etl::dim<0>(context.errors));
 
         const auto B = etl::dim<0>(context.input);
 
@@ -191,7 +202,7 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         // If the layer is not the first one, the gradients already have been computed
 
         if (!C::layer) {
-            dll::unsafe_auto_timer timer("bn:2d:gradients");
+            dll::unsafe_auto_timer timer("bn:2d:gradients", etl::dim<0>(context.errors));
 
             // Gradients of gamma
             std::get<0>(context.up.context)->grad = bias_batch_sum_2d(input_pre >> context.errors);
@@ -9,6 +9,9 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
+
 namespace dll {
 
 /*!
@@ -94,6 +97,14 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
         return 4 * Input;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return batch_normalization_cost(batch, Input, Input, true, sizeof(weight), {"bn:2d:train:forward", "bn:2d:backward", "bn:2d:gradients"});
+    }
+
     /*!
      * \brief Return the size of the input of this layer
      * \return The size of the input of this layer
@@ -138,7 +149,7 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void test_forward_batch(Output& output, const Input& input) const {
-        dll::auto_timer timer("bn:2d:test:forward");
+        dll::auto_timer timer("bn:2d:test:forward", etl::dim<0>(input));
 
         const auto B = etl::dim<0>(input);
 
@@ -156,7 +167,7 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("bn:2d:train:forward");
+        dll::auto_timer timer("bn:2d:train:forward", etl::dim<0>(input));
 
         const auto B = etl::dim<0>(input);
 
@@ -193,7 +204,7 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("bn:2d:backward");
+        dll::unsafe_auto_timer timer("bn:2d:backward", etl::dim<0>(context.errors));
 
         const auto B = etl::dim<0>(context.input);
 
@@ -217,7 +228,7 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
         // If the layer is not the first one, the gradients already have been computed
 
         if (!C::layer) {
-            dll::unsafe_auto_timer timer("bn:2d:gradients");
+            dll::unsafe_auto_timer timer("bn:2d:gradients", etl::dim<0>(context.errors));
 
             // Gradients of gamma
             std::get<0>(context.up.context)->grad = bias_batch_sum_2d(input_pre >> context.errors);
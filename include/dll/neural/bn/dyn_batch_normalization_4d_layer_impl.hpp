@@ -9,6 +9,9 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
+
 namespace dll {
 
 /*!
@@ -98,6 +101,14 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         return 4 * Kernels;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return batch_normalization_cost(batch, Kernels * W * H, Kernels, false, sizeof(weight), {"bn:4d:train:forward", "bn:4d:backward", "bn:4d:gradients"});
+    }
+
     /*!
      * \brief Return the size of the input of this layer
      * \return The size of the input of this layer
@@ -142,6 +153,8 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void test_forward_batch(Output& output, const Input& input) const {
+        dll::auto_timer timer("bn:4d:test:forward", etl::dim<0>(input));
+
         const auto B = etl::dim<0>(input);
 
         auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
@@ -160,6 +173,8 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
+        dll::auto_timer timer("bn:4d:train:forward", etl::dim<0>(input));
+
         const auto B = etl::dim<0>(input);
         const auto S = B * W * H;
 
@@ -210,6 +225,8 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
+        dll::unsafe_auto_timer timer("bn:4d:backward", etl::dim<0>(context.errors));
+
         const auto B = etl::dim<0>(context.input);
         const auto S = B * W * H;
 
@@ -240,6 +257,8 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template<typename C>
     void compute_gradients(C& context) const {
+        dll::unsafe_auto_timer timer("bn:4d:gradients", etl::dim<0>(context.errors));
+
         // Gradients of gamma
         std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
 
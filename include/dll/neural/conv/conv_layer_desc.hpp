@@ -38,6 +38,7 @@ struct conv_layer_desc {
     using parameters = cpp::type_list<Parameters...>;
 
     static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
+    static constexpr auto algorithm           = detail::get_value_v<conv_algo<conv_algorithm::DIRECT>, Parameters...>;        ///< The algorithm of the forward convolution
 
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
     using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
@@ -57,10 +58,12 @@ struct conv_layer_desc {
     static_assert(NW2 > 0, "A matrix of at least 1x1 is necessary for the weights");
     static_assert(NC > 0, "At least one channel is necessary");
     static_assert(K > 0, "At least one group is necessary");
+    static_assert(algorithm == conv_algorithm::DIRECT || (S1 == 1 && S2 == 1), "The convolution algorithms only support unit strides");
+    static_assert(algorithm != conv_algorithm::WINOGRAD || (NW1 == 3 && NW2 == 3), "Winograd convolution only supports 3x3 kernels");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, stride_id, padding_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, stride_id, padding_id, conv_algo_id>, Parameters...>,
         "Invalid parameters type for conv_layer_desc");
 };
 
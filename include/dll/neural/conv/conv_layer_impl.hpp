@@ -10,6 +10,8 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/conv_registry.hpp"
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -102,6 +104,14 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
         return K * NW1 * NW2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return conv_cost(batch, NC, NV1 * NV2, K, NH1 * NH2, NW1 * NW2, sizeof(weight), {"conv:forward_batch", "conv:backward_batch", "conv:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -150,9 +160,15 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("conv:forward_batch");
-
-        if constexpr (etl::dimensions<V>() == 4) {
+        dll::auto_timer timer("conv:forward_batch", etl::dim<0>(v));
+
+        if constexpr (desc::algorithm != conv_algorithm::DIRECT) {
+            if constexpr (etl::dimensions<V>() == 4) {
+                conv_forward<desc::algorithm>(output, v, w, P1, P2);
+            } else {
+                conv_forward<desc::algorithm>(output, etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w, P1, P2);
+            }
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward<S1, S2, P1, P2>(v, w);
         } else {
             output = etl::ml::convolution_forward<S1, S2, P1, P2>(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
@@ -221,7 +237,7 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("conv:backward_batch");
+        dll::auto_timer timer("conv:backward_batch", etl::dim<0>(context.errors));
 
         if constexpr (etl::dimensions<H>() == 4) {
             output = etl::ml::convolution_backward<S1, S2, P1, P2>(context.errors, w);
@@ -236,7 +252,7 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("conv:compute_gradients");
+        dll::auto_timer timer("conv:compute_gradients", etl::dim<0>(context.errors));
 
         std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter<S1, S2, P1, P2>(context.input, context.errors);
 
@@ -285,12 +301,17 @@ struct sgd_context<DBN, conv_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
-    etl::fast_matrix<weight, batch_size, K, NH1, NH2> output;
-    etl::fast_matrix<weight, batch_size, K, NH1, NH2> errors;
+    using input_buffer_t  = sgd_buffer_t<DBN, etl::fast_matrix<weight, batch_size, NC, NV1, NV2>>; ///< The type of the input buffer
+    using output_buffer_t = sgd_buffer_t<DBN, etl::fast_matrix<weight, batch_size, K, NH1, NH2>>;  ///< The type of the output buffer
+
+    input_buffer_t input;
+    output_buffer_t output;
+    output_buffer_t errors;
 
     sgd_context(const conv_layer_impl<Desc>& /* layer */)
-            : output(0.0), errors(0.0) {}
+            : input(make_sgd_buffer<input_buffer_t>(batch_size, NC, NV1, NV2)),
+              output(make_sgd_buffer<output_buffer_t>(batch_size, K, NH1, NH2)),
+              errors(make_sgd_buffer<output_buffer_t>(batch_size, K, NH1, NH2)) {}
 };
 
 } //end of dll namespace
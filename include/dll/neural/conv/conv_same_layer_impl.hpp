@@ -10,6 +10,7 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -94,6 +95,14 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
         return K * NW1 * NW2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return conv_cost(batch, NC, NV1 * NV2, K, NH1 * NH2, NW1 * NW2, sizeof(weight), {"conv_same:forward_batch", "conv_same:backward_batch", "conv_same:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -130,7 +139,7 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("conv:forward_batch");
+        dll::auto_timer timer("conv_same:forward_batch", etl::dim<0>(v));
 
         if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward<1, 1, P1, P2>(v, w);
@@ -192,7 +201,7 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("conv_same:backward_batch");
+        dll::auto_timer timer("conv_same:backward_batch", etl::dim<0>(context.errors));
 
         output = etl::ml::convolution_backward<1, 1, P1, P2>(context.errors, w);
     }
@@ -203,7 +212,7 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("conv_same:compute_gradients");
+        dll::auto_timer timer("conv_same:compute_gradients", etl::dim<0>(context.errors));
 
         std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter<1, 1, P1, P2>(context.input, context.errors);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
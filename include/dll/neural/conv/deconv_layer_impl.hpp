@@ -9,6 +9,9 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
+
 namespace dll {
 
 /*!
@@ -86,6 +89,14 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
         return K * NW1 * NW2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return deconv_cost(batch, NC, NV1 * NV2, K, NH1 * NH2, NW1 * NW2, sizeof(weight), {"deconv:forward_batch", "deconv:backward_batch", "deconv:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -122,6 +133,8 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("deconv:forward_batch", etl::dim<0>(v));
+
         output = etl::conv_4d_full_flipped(v, w);
 
         if constexpr (etl::decay_traits<H1>::is_fast) {
@@ -193,6 +206,8 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("deconv:backward_batch", etl::dim<0>(context.errors));
+
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
             output = etl::conv_4d_valid_flipped(context.errors, w);
         } else {
@@ -207,6 +222,8 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
+        dll::auto_timer timer("deconv:compute_gradients", etl::dim<0>(context.errors));
+
         std::get<0>(context.up.context)->grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
@@ -11,6 +11,8 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/conv_registry.hpp"
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -119,6 +121,14 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
         return k * nw1 * nw2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return conv_cost(batch, nc, nv1 * nv2, k, nh1 * nh2, nw1 * nw2, sizeof(weight), {"conv:forward_batch", "conv:backward_batch", "conv:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -167,9 +177,17 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("conv:forward_batch");
-
-        if constexpr (etl::etl_4d<V>) {
+        dll::auto_timer timer("conv:forward_batch", etl::dim<0>(v));
+
+        // The convolution algorithms only support unit strides, Winograd
+        // falls back to DIRECT for the kernels that are not 3x3
+        if (desc::algorithm != conv_algorithm::DIRECT && s1 == 1 && s2 == 1) {
+            if constexpr (etl::etl_4d<V>) {
+                conv_forward<desc::algorithm>(output, v, w, p1, p2);
+            } else {
+                conv_forward<desc::algorithm>(output, etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, p1, p2);
+            }
+        } else if constexpr (etl::etl_4d<V>) {
             output = etl::ml::convolution_forward(v, w, s1, s2, p1, p2);
         } else {
             output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, s1, s2, p1, p2);
@@ -249,7 +267,7 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("conv:backward_batch");
+        dll::auto_timer timer("conv:backward_batch", etl::dim<0>(context.errors));
 
         if constexpr (etl::dimensions<H>() == 4) {
             output = etl::ml::convolution_backward(context.errors, w, s1, s2, p1, p2);
@@ -264,7 +282,7 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("conv:compute_gradients");
+        dll::auto_timer timer("conv:compute_gradients", etl::dim<0>(context.errors));
 
         std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors, s1, s2, p1, p2);
 
@@ -304,13 +322,16 @@ struct sgd_context<DBN, dyn_conv_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::dyn_matrix<weight, 4> input;
-    etl::dyn_matrix<weight, 4> output;
-    etl::dyn_matrix<weight, 4> errors;
+    using buffer_t = sgd_buffer_t<DBN, etl::dyn_matrix<weight, 4>>; ///< The type of the batch buffers
+
+    buffer_t input;
+    buffer_t output;
+    buffer_t errors;
 
     sgd_context(const layer_t& layer)
-            : input(batch_size, layer.nc, layer.nv1, layer.nv2),
-              output(batch_size, layer.k, layer.nh1, layer.nh2), errors(batch_size, layer.k, layer.nh1, layer.nh2) {}
+            : input(make_sgd_buffer<buffer_t>(batch_size, layer.nc, layer.nv1, layer.nv2)),
+              output(make_sgd_buffer<buffer_t>(batch_size, layer.k, layer.nh1, layer.nh2)),
+              errors(make_sgd_buffer<buffer_t>(batch_size, layer.k, layer.nh1, layer.nh2)) {}
 };
 
 } //end of dll namespace
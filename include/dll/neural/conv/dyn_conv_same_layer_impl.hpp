@@ -11,6 +11,7 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -113,6 +114,14 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
         return k * nw1 * nw2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return conv_cost(batch, nc, nv1 * nv2, k, nh1 * nh2, nw1 * nw2, sizeof(weight), {"conv_same:forward_batch", "conv_same:backward_batch", "conv_same:compute_gradients"});
+    }
+
     /*!
      * \brief Return the size, in bytes, used by this layer
      * \return the size, in bytes, used by this layer
@@ -167,7 +176,7 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("conv:forward_batch");
+        dll::auto_timer timer("conv_same:forward_batch", etl::dim<0>(v));
 
         if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward(v, w, 1, 1, p1, p2);
@@ -242,6 +251,8 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("conv_same:backward_batch", etl::dim<0>(context.errors));
+
         output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
     }
 
@@ -251,6 +262,8 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename C>
     void compute_gradients(C& context) const {
+        dll::auto_timer timer("conv_same:compute_gradients", etl::dim<0>(context.errors));
+
         std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors, 1, 1, p1, p2);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
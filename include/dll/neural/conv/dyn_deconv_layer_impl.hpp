@@ -10,6 +10,9 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
+
 namespace dll {
 
 /*!
@@ -108,6 +111,14 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
         return k * nw1 * nw2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return deconv_cost(batch, nc, nv1 * nv2, k, nh1 * nh2, nw1 * nw2, sizeof(weight), {"deconv:forward_batch", "deconv:backward_batch", "deconv:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -144,6 +155,8 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("deconv:forward_batch", etl::dim<0>(v));
+
         output = etl::conv_4d_full_flipped(v, w);
 
         const auto batch_size = etl::dim<0>(output);
@@ -216,6 +229,8 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("deconv:backward_batch", etl::dim<0>(context.errors));
+
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
             output = etl::conv_4d_valid_flipped(context.errors, w);
         } else {
@@ -230,6 +245,8 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template<typename C>
     void compute_gradients(C& context) const {
+        dll::auto_timer timer("deconv:compute_gradients", etl::dim<0>(context.errors));
+
         //TODO Update the gradients (probably with conv_4d_valid_filter)
         std::get<1>(context.up.context)->grad = etl::mean_r(etl::sum_l(context.errors));
     }
@@ -11,6 +11,8 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/csr.hpp"    // for csr_batch
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -84,6 +86,14 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
         return num_visible * num_hidden + num_hidden;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return dense_cost(batch, num_visible, num_hidden, sizeof(weight), {"dense:forward_batch", "dense:backward_batch", "dense:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -130,7 +140,7 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
      */
     template <typename H, typename V>
     void forward_batch(H&& output, const V& input) const {
-        dll::auto_timer timer("dense:forward_batch");
+        dll::auto_timer timer("dense:forward_batch", etl::dim<0>(input));
 
         const auto Batch = etl::dim<0>(input);
 
@@ -148,6 +158,27 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
         output = f_activate<activation_function>(output);
     }
 
+    /*!
+     * \brief Apply the layer to the given batch of sparse input.
+     *
+     * \param input A batch of sparse input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H>
+    void forward_batch(H&& output, const csr_batch<weight>& input) const {
+        dll::auto_timer timer("dense:forward_batch:sparse");
+
+        cpp_assert(input.cols == num_visible, "Invalid sparse input for dense layer");
+
+        csr_mul(output, input, w);
+
+        if constexpr (!no_bias) {
+            output = bias_add_2d(output, b);
+        }
+
+        output = f_activate<activation_function>(output);
+    }
+
     /*!
      * \brief Prepare one empty output for this layer
      * \return an empty ETL matrix suitable to store one output of this layer
@@ -204,7 +235,7 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("dense:backward_batch");
+        dll::unsafe_auto_timer timer("dense:backward_batch", etl::dim<0>(context.errors));
 
         // The reshape has no overhead, so better than SFINAE for nothing
         constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
@@ -217,7 +248,7 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::unsafe_auto_timer timer("dense:compute_gradients");
+        dll::unsafe_auto_timer timer("dense:compute_gradients", etl::dim<0>(context.errors));
 
         std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
 
@@ -225,6 +256,22 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
             std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
         }
     }
+
+    /*!
+     * \brief Compute the gradients for this layer from its sparse input
+     * \param context The trainng context
+     * \param input The sparse input of the layer
+     */
+    template<typename C>
+    void compute_gradients(C& context, const csr_batch<weight>& input) const {
+        dll::unsafe_auto_timer timer("dense:compute_gradients:sparse");
+
+        csr_transpose_mul(std::get<0>(context.up.context)->grad, input, context.errors);
+
+        if constexpr (!no_bias) {
+            std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+        }
+    }
 };
 
 // Declare the traits for the Layer
@@ -260,12 +307,17 @@ struct sgd_context<DBN, dense_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, num_visible> input;
-    etl::fast_matrix<weight, batch_size, num_hidden> output;
-    etl::fast_matrix<weight, batch_size, num_hidden> errors;
+    using input_buffer_t  = sgd_buffer_t<DBN, etl::fast_matrix<weight, batch_size, num_visible>>; ///< The type of the input buffer
+    using output_buffer_t = sgd_buffer_t<DBN, etl::fast_matrix<weight, batch_size, num_hidden>>;  ///< The type of the output buffer
+
+    input_buffer_t input;
+    output_buffer_t output;
+    output_buffer_t errors;
 
     sgd_context(const dense_layer_impl<Desc>& /* layer */)
-            : output(0.0), errors(0.0) {}
+            : input(make_sgd_buffer<input_buffer_t>(batch_size, num_visible)),
+              output(make_sgd_buffer<output_buffer_t>(batch_size, num_hidden)),
+              errors(make_sgd_buffer<output_buffer_t>(batch_size, num_hidden)) {}
 };
 
 } //end of dll namespace
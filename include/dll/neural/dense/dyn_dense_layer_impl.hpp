@@ -10,6 +10,8 @@
 #include "dll/base_traits.hpp"  // The traits
 #include "dll/neural_layer.hpp" // The base class
 #include "dll/util/timers.hpp"  // For auto_timer
+#include "dll/util/csr.hpp"     // For csr_batch
+#include "dll/util/layer_cost.hpp" // For layer_cost
 
 namespace dll {
 
@@ -88,6 +90,14 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
         return num_visible * num_hidden + num_hidden;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return dense_cost(batch, num_visible, num_hidden, sizeof(weight), {"dense:forward", "dense:backward", "dense:gradients"});
+    }
+
     /*!
      * \brief Returns a full description of the layer
      * \return an std::string containing a full description of the layer
@@ -134,7 +144,7 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
      */
     template <typename H, typename V>
     void forward_batch(H&& output, const V& input) const {
-        dll::auto_timer timer("dense:forward");
+        dll::auto_timer timer("dense:forward", etl::dim<0>(input));
 
         const auto Batch = etl::dim<0>(input);
 
@@ -152,6 +162,27 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
         output = f_activate<activation_function>(output);
     }
 
+    /*!
+     * \brief Apply the layer to the given batch of sparse input.
+     *
+     * \param input A batch of sparse input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H>
+    void forward_batch(H&& output, const csr_batch<weight>& input) const {
+        dll::auto_timer timer("dense:forward_batch:sparse");
+
+        cpp_assert(input.cols == num_visible, "Invalid sparse input for dense layer");
+
+        csr_mul(output, input, w);
+
+        if constexpr (!no_bias) {
+            output = bias_add_2d(output, b);
+        }
+
+        output = f_activate<activation_function>(output);
+    }
+
     /*!
      * \brief Prepare one empty output for this layer
      * \return an empty ETL matrix suitable to store one output of this layer
@@ -215,7 +246,7 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("dense:backward");
+        dll::unsafe_auto_timer timer("dense:backward", etl::dim<0>(context.errors));
 
         // The reshape has no overhead, so better than SFINAE for nothing
         auto batch_size = etl::dim<0>(output);
@@ -228,7 +259,7 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::unsafe_auto_timer timer("dense:gradients");
+        dll::unsafe_auto_timer timer("dense:gradients", etl::dim<0>(context.errors));
 
         std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
 
@@ -236,6 +267,22 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
             std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
         }
     }
+
+    /*!
+     * \brief Compute the gradients for this layer from its sparse input
+     * \param context The trainng context
+     * \param input The sparse input of the layer
+     */
+    template<typename C>
+    void compute_gradients(C& context, const csr_batch<weight>& input) const {
+        dll::unsafe_auto_timer timer("dense:compute_gradients:sparse");
+
+        csr_transpose_mul(std::get<0>(context.up.context)->grad, input, context.errors);
+
+        if constexpr (!no_bias) {
+            std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+        }
+    }
 };
 
 // Declare the traits for the Layer
@@ -268,11 +315,16 @@ struct sgd_context<DBN, dyn_dense_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::dyn_matrix<weight, 2> input;
-    etl::dyn_matrix<weight, 2> output;
-    etl::dyn_matrix<weight, 2> errors;
+    using buffer_t = sgd_buffer_t<DBN, etl::dyn_matrix<weight, 2>>; ///< The type of the batch buffers
+
+    buffer_t input;
+    buffer_t output;
+    buffer_t errors;
 
-    sgd_context(const layer_t& layer) : input(batch_size, layer.num_visible, 0.0), output(batch_size, layer.num_hidden, 0.0), errors(batch_size, layer.num_hidden, 0.0) {}
+    sgd_context(const layer_t& layer)
+            : input(make_sgd_buffer<buffer_t>(batch_size, layer.num_visible)),
+              output(make_sgd_buffer<buffer_t>(batch_size, layer.num_hidden)),
+              errors(make_sgd_buffer<buffer_t>(batch_size, layer.num_hidden)) {}
 };
 
 
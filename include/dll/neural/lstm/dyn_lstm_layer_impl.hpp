@@ -185,113 +185,6 @@ struct dyn_lstm_layer_impl final : base_lstm_layer<dyn_lstm_layer_impl<Desc>, De
         return {time_steps, hidden_units};
     }
 
-    mutable etl::dyn_matrix<float, 3> g_t;
-    mutable etl::dyn_matrix<float, 3> i_t;
-    mutable etl::dyn_matrix<float, 3> f_t;
-    mutable etl::dyn_matrix<float, 3> o_t;
-
-    mutable etl::dyn_matrix<float, 3> x_t;
-    mutable etl::dyn_matrix<float, 3> s_t;
-    mutable etl::dyn_matrix<float, 3> h_t;
-
-    mutable etl::dyn_matrix<float, 3> d_h_t;
-    mutable etl::dyn_matrix<float, 3> d_c_t;
-    mutable etl::dyn_matrix<float, 3> d_x_t;
-
-    mutable etl::dyn_matrix<float, 3> d_h_o_t;
-    mutable etl::dyn_matrix<float, 3> d_h_f_t;
-    mutable etl::dyn_matrix<float, 3> d_h_i_t;
-    mutable etl::dyn_matrix<float, 3> d_h_c_t;
-
-    mutable etl::dyn_matrix<float, 3> d_x_o_t;
-    mutable etl::dyn_matrix<float, 3> d_x_f_t;
-    mutable etl::dyn_matrix<float, 3> d_x_i_t;
-    mutable etl::dyn_matrix<float, 3> d_x_c_t;
-
-    mutable etl::dyn_matrix<float, 3> d_xh_o_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_f_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_i_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_c_t;
-
-    void prepare_cache(size_t Batch) const {
-        if (cpp_unlikely(!i_t.memory_start())) {
-            g_t.resize(time_steps, Batch, hidden_units);
-            i_t.resize(time_steps, Batch, hidden_units);
-            f_t.resize(time_steps, Batch, hidden_units);
-            o_t.resize(time_steps, Batch, hidden_units);
-
-            x_t.resize(time_steps, Batch, sequence_length);
-            s_t.resize(time_steps, Batch, hidden_units);
-            h_t.resize(time_steps, Batch, hidden_units);
-
-            d_h_t.resize(time_steps, Batch, hidden_units);
-            d_c_t.resize(time_steps, Batch, hidden_units);
-            d_x_t.resize(time_steps, Batch, sequence_length);
-
-            d_h_o_t.resize(time_steps, Batch, hidden_units);
-            d_h_f_t.resize(time_steps, Batch, hidden_units);
-            d_h_i_t.resize(time_steps, Batch, hidden_units);
-            d_h_c_t.resize(time_steps, Batch, hidden_units);
-
-            d_x_o_t.resize(time_steps, Batch, sequence_length);
-            d_x_f_t.resize(time_steps, Batch, sequence_length);
-            d_x_i_t.resize(time_steps, Batch, sequence_length);
-            d_x_c_t.resize(time_steps, Batch, sequence_length);
-
-            d_xh_o_t.resize(time_steps, Batch, hidden_units);
-            d_xh_f_t.resize(time_steps, Batch, hidden_units);
-            d_xh_i_t.resize(time_steps, Batch, hidden_units);
-            d_xh_c_t.resize(time_steps, Batch, hidden_units);
-        }
-    }
-
-    /*!
-     * \brief Apply the layer to the given batch of input.
-     *
-     * \param x A batch of input
-     * \param output A batch of output that will be filled
-     */
-    template <typename H, typename V>
-    void forward_batch(H&& output, const V& x) const {
-        dll::auto_timer timer("lstm:forward_batch");
-
-        const auto Batch = etl::dim<0>(x);
-
-        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
-
-        prepare_cache(Batch);
-
-        // 1. Rearrange input
-
-        x_t = transpose_front(x);
-
-        // 2. Forward propagation through time
-
-        // t == 0
-
-        g_t(0) =    etl::tanh(bias_add_2d(x_t(0) * (u_g), b_g));
-        i_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_i), b_i));
-        f_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_f), b_f));
-        o_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_o), b_o));
-
-        s_t(0) = g_t(0) >> i_t(0);
-        h_t(0) = f_activate<activation_function>(s_t(0)) >> o_t(0);
-
-        for (size_t t = 1; t < time_steps; ++t) {
-            g_t(t) =    etl::tanh(bias_add_2d(x_t(t) * u_g + h_t(t - 1) * w_g, b_g));
-            i_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_i + h_t(t - 1) * w_i, b_i));
-            f_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_f + h_t(t - 1) * w_f, b_f));
-            o_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_o + h_t(t - 1) * w_o, b_o));
-
-            s_t(t) = f_activate<activation_function>( (g_t(t) >> i_t(t)) + (s_t(t - 1) >> f_t(t)) );
-            h_t(t) = s_t(t) >> o_t(t);
-        }
-
-        // 3. Rearrange the output
-
-        output = transpose_front(h_t);
-    }
-
     /*!
      * \brief Prepare one empty output for this layer
      * \return an empty ETL matrix suitable to store one output of this layer
@@ -318,160 +211,6 @@ struct dyn_lstm_layer_impl final : base_lstm_layer<dyn_lstm_layer_impl<Desc>, De
         }
         return output;
     }
-
-    /*!
-     * \brief Adapt the errors, called before backpropagation of the errors.
-     *
-     * This must be used by layers that have both an activation fnction and a non-linearity.
-     *
-     * \param context the training context
-     */
-    template <typename C>
-    void adapt_errors([[maybe_unused]] C& context) const {
-        // Nothing to do here (done in BPTT)
-    }
-
-    template <typename Output, typename C>
-    void backward_pass(Output& output, C& context, bool direct = true) const {
-        const size_t Batch = etl::dim<0>(context.errors);
-
-        // 1. Rearrange input/errors
-
-        etl::dyn_matrix<float, 3> delta_t(time_steps, Batch, hidden_units);
-
-        delta_t = transpose_front(context.errors);
-
-        // 2. Get gradients from the context
-
-        auto& w_i_grad = std::get<0>(context.up.context)->grad;
-        auto& u_i_grad = std::get<1>(context.up.context)->grad;
-        auto& b_i_grad = std::get<2>(context.up.context)->grad;
-        auto& w_g_grad = std::get<3>(context.up.context)->grad;
-        auto& u_g_grad = std::get<4>(context.up.context)->grad;
-        auto& b_g_grad = std::get<5>(context.up.context)->grad;
-        auto& w_f_grad = std::get<6>(context.up.context)->grad;
-        auto& u_f_grad = std::get<7>(context.up.context)->grad;
-        auto& b_f_grad = std::get<8>(context.up.context)->grad;
-        auto& w_o_grad = std::get<9>(context.up.context)->grad;
-        auto& u_o_grad = std::get<10>(context.up.context)->grad;
-        auto& b_o_grad = std::get<11>(context.up.context)->grad;
-
-        w_i_grad = 0;
-        u_i_grad = 0;
-        b_i_grad = 0;
-        w_g_grad = 0;
-        u_g_grad = 0;
-        b_g_grad = 0;
-        w_f_grad = 0;
-        u_f_grad = 0;
-        b_f_grad = 0;
-        w_o_grad = 0;
-        u_o_grad = 0;
-        b_o_grad = 0;
-
-        // 3. Backpropagation through time
-
-        size_t ttt = time_steps - 1;
-
-        do {
-            const size_t last_step = std::max(int(time_steps) - int(bptt_steps), 0);
-
-            // Backpropagation through time
-            for(int tt = ttt; tt >= int(last_step); --tt){
-                const size_t t = tt;
-
-                if (t == time_steps - 1) {
-                    d_h_t(t) = delta_t(t);
-                    d_c_t(t) = (o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t));
-                } else {
-                    d_h_t(t) = delta_t(t) + d_h_t(t + 1);
-                    d_c_t(t) = ((o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t))) + d_c_t(t + 1);
-                }
-
-                d_h_o_t(t) = etl::ml::sigmoid_backward(o_t(t), s_t(t) >> d_h_t(t));
-                d_h_i_t(t) = etl::ml::sigmoid_backward(i_t(t), g_t(t) >> d_c_t(t));
-                d_h_c_t(t) = etl::ml::tanh_backward(g_t(t), i_t(t) >> d_c_t(t));
-
-                if (t == 0) {
-                    d_h_f_t(t) = 0;
-                } else {
-                    d_h_f_t(t) = etl::ml::sigmoid_backward(f_t(t), s_t(t - 1) >> d_c_t(t));
-                }
-
-                b_o_grad += bias_batch_sum_2d(d_h_o_t(t));
-                b_i_grad += bias_batch_sum_2d(d_h_i_t(t));
-                b_f_grad += bias_batch_sum_2d(d_h_f_t(t));
-                b_g_grad += bias_batch_sum_2d(d_h_c_t(t));
-
-                u_o_grad += batch_outer(x_t(t), d_h_o_t(t));
-                u_i_grad += batch_outer(x_t(t), d_h_i_t(t));
-                u_f_grad += batch_outer(x_t(t), d_h_f_t(t));
-                u_g_grad += batch_outer(x_t(t), d_h_c_t(t));
-
-                if(t > 0){
-                    w_o_grad += batch_outer(h_t(t - 1), d_h_o_t(t));
-                    w_i_grad += batch_outer(h_t(t - 1), d_h_i_t(t));
-                    w_f_grad += batch_outer(h_t(t - 1), d_h_f_t(t));
-                    w_g_grad += batch_outer(h_t(t - 1), d_h_c_t(t));
-                }
-
-                // The part going back to x
-                d_x_o_t(t) = d_h_o_t(t) * trans(u_o);
-                d_x_i_t(t) = d_h_i_t(t) * trans(u_i);
-                d_x_f_t(t) = d_h_f_t(t) * trans(u_f);
-                d_x_c_t(t) = d_h_c_t(t) * trans(u_g);
-
-                d_x_t(t) = d_x_o_t(t) + d_x_i_t(t) + d_x_f_t(t) + d_x_c_t(t);
-
-                // The part going back to h
-                d_xh_o_t(t) = d_h_o_t(t) * trans(w_o);
-                d_xh_i_t(t) = d_h_i_t(t) * trans(w_i);
-                d_xh_f_t(t) = d_h_f_t(t) * trans(w_f);
-                d_xh_c_t(t) = d_h_c_t(t) * trans(w_g);
-
-                // Update for the next step
-                d_h_t(t) = d_xh_o_t(t) + d_xh_i_t(t) + d_xh_f_t(t) + d_xh_c_t(t);
-                d_c_t(t) = f_t(t) >> d_c_t(t);
-            }
-
-            --ttt;
-
-            // If only the last time step is used, no need to use the other errors
-            if constexpr (desc::parameters::template contains<last_only>()) {
-                break;
-            }
-        } while (ttt != 0);
-
-        // 3. Rearrange for the output
-
-        if (direct) {
-            output = transpose_front(d_x_t);
-        }
-    }
-
-    /*!
-     * \brief Backpropagate the errors to the previous layers
-     * \param output The ETL expression into which write the output
-     * \param context The training context
-     */
-    template <typename H, typename C>
-    void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("lstm:backward_batch");
-
-        backward_pass(output, context, true);
-    }
-
-    /*!
-     * \brief Compute the gradients for this layer, if any
-     * \param context The trainng context
-     */
-    template <typename C>
-    void compute_gradients(C& context) const {
-        if constexpr (!C::layer) {
-            dll::auto_timer timer("lstm:compute_gradients");
-            backward_pass(x_t, context, false);
-        }
-    }
 };
 
 // Declare the traits for the Layer
@@ -36,6 +36,11 @@ struct lstm_layer_desc {
      */
     static constexpr size_t Truncate    = detail::get_value_v<truncate<0>, Parameters...>;
 
+    /*!
+     * \brief Indicates if the state is carried from one batch to the next
+     */
+    static constexpr bool Stateful = parameters::template contains<stateful>();
+
     using w_initializer  = detail::get_type_t<rnn_initializer_w<init_lecun>, Parameters...>;     ///< The initializer for the W weights
     using u_initializer  = detail::get_type_t<rnn_initializer_u<init_lecun>, Parameters...>;     ///< The initializer for the U weights
     using b_initializer  = detail::get_type_t<initializer_bias<init_zero>, Parameters...>;       ///< The initializer for the biases
@@ -58,7 +63,7 @@ struct lstm_layer_desc {
     static_assert(
         detail::is_valid_v<cpp::type_list<
             weight_type_id, activation_id, rnn_initializer_w_id, rnn_initializer_u_id,
-            initializer_bias_id, initializer_forget_bias_id, truncate_id, last_only_id>,
+            initializer_bias_id, initializer_forget_bias_id, truncate_id, last_only_id, stateful_id>,
             Parameters...>,
         "Invalid parameters type for lstm_layer_desc");
 };
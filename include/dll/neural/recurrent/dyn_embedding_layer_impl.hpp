@@ -7,9 +7,12 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include "dll/neural_layer_no_bias.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -25,6 +28,8 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
     using layer_t     = this_type;                     ///< This layer's type
     using dyn_layer_t = typename desc::dyn_layer_t;    ///< The dynamic version of this layer
 
+    static constexpr bool lazy_gradients = desc::lazy; ///< Only compute and apply the gradients of the used rows
+
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
 
     using input_one_t  = etl::dyn_matrix<weight, 1>; ///< The type of one input
@@ -88,6 +93,14 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
         return V * K;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return embedding_cost(batch, I, K, sizeof(weight), {"embedding:forward_batch", "embedding:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -122,7 +135,7 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("embedding:forward_batch");
+        dll::auto_timer timer("embedding:forward_batch", etl::dim<0>(v));
 
         output = batch_embedding_lookup(v, w);
     }
@@ -185,9 +198,33 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("embedding:compute_gradients");
+        dll::auto_timer timer("embedding:compute_gradients", etl::dim<0>(context.errors));
+
+        if constexpr (lazy_gradients) {
+            auto& grad = std::get<0>(context.up.context)->grad;
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+            // Only the rows of the previous batch are not zero
+            for (auto row : context.rows) {
+                grad(row) = weight(0);
+            }
+
+            context.rows.clear();
+
+            for (size_t b = 0; b < etl::dim<0>(context.input); ++b) {
+                for (size_t i = 0; i < etl::dim<1>(context.input); ++i) {
+                    const auto row = size_t(context.input(b, i));
+
+                    grad(row) += context.errors(b, i);
+
+                    context.rows.push_back(row);
+                }
+            }
+
+            std::sort(context.rows.begin(), context.rows.end());
+            context.rows.erase(std::unique(context.rows.begin(), context.rows.end()), context.rows.end());
+        } else {
+            std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);
+        }
     }
 };
 
@@ -225,6 +262,8 @@ struct sgd_context<DBN, dyn_embedding_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 3> output;
     etl::dyn_matrix<weight, 3> errors;
 
+    std::vector<size_t> rows; ///< The rows used by the batch (lazy gradients)
+
     sgd_context(const dyn_embedding_layer_impl<Desc>&  layer )
             : input(batch_size, layer.I), output(batch_size, layer.I, layer.K), errors(batch_size, layer.I, layer.K) {
         output = weight(0);
@@ -7,9 +7,12 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include "dll/neural_layer_no_bias.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -25,6 +28,8 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     using layer_t     = this_type;                     ///< This layer's type
     using dyn_layer_t = typename desc::dyn_layer_t;    ///< The dynamic version of this layer
 
+    static constexpr bool lazy_gradients = desc::lazy; ///< Only compute and apply the gradients of the used rows
+
     static inline constexpr size_t V = desc::V; ///< The vocabulary size
     static inline constexpr size_t I = desc::I; ///< The input size
     static inline constexpr size_t K = desc::K; ///< The embedding size
@@ -75,6 +80,14 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
         return V * K;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return embedding_cost(batch, I, K, sizeof(weight), {"embedding:forward_batch", "embedding:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -109,7 +122,7 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("embedding:forward_batch");
+        dll::auto_timer timer("embedding:forward_batch", etl::dim<0>(v));
 
         output = batch_embedding_lookup(v, w);
     }
@@ -162,9 +175,33 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("embedding:compute_gradients");
+        dll::auto_timer timer("embedding:compute_gradients", etl::dim<0>(context.errors));
+
+        if constexpr (lazy_gradients) {
+            auto& grad = std::get<0>(context.up.context)->grad;
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+            // Only the rows of the previous batch are not zero
+            for (auto row : context.rows) {
+                grad(row) = weight(0);
+            }
+
+            context.rows.clear();
+
+            for (size_t b = 0; b < etl::dim<0>(context.input); ++b) {
+                for (size_t i = 0; i < etl::dim<1>(context.input); ++i) {
+                    const auto row = size_t(context.input(b, i));
+
+                    grad(row) += context.errors(b, i);
+
+                    context.rows.push_back(row);
+                }
+            }
+
+            std::sort(context.rows.begin(), context.rows.end());
+            context.rows.erase(std::unique(context.rows.begin(), context.rows.end()), context.rows.end());
+        } else {
+            std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);
+        }
     }
 };
 
@@ -206,6 +243,8 @@ struct sgd_context<DBN, embedding_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, I, K> output;
     etl::fast_matrix<weight, batch_size, I, K> errors;
 
+    std::vector<size_t> rows; ///< The rows used by the batch (lazy gradients)
+
     sgd_context(const embedding_layer_impl<Desc>& /* layer */)
             : output(0.0), errors(0.0) {}
 };
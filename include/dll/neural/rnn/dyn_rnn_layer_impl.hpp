@@ -11,6 +11,7 @@
 #include "dll/base_rnn_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -106,6 +107,15 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
         return hidden_units * hidden_units + hidden_units * sequence_length + hidden_units;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return recurrent_cost(batch, time_steps, sequence_length, hidden_units, 1, bptt_steps, desc::parameters::template contains<last_only>(), sizeof(weight),
+                              {"dyn_rnn:forward_batch", "dyn_rnn:backward_batch", "dyn_rnn:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -152,11 +162,31 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
      */
     template <typename H, typename V>
     void forward_batch(H&& output, const V& x) const {
-        dll::auto_timer timer("dyn_rnn:forward_batch");
+        dll::auto_timer timer("dyn_rnn:forward_batch", etl::dim<0>(x));
+
+        cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
+
+        base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units, false);
+    }
+
+    using base_type::train_forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input, in training.
+     *
+     * A stateful layer carries a separate state in training, the test
+     * batches do not change it.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void train_forward_batch(H&& output, const V& x) const {
+        dll::auto_timer timer("dyn_rnn:forward_batch", etl::dim<0>(x));
 
         cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
 
-        base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units);
+        base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units, true);
     }
 
     /*!
@@ -214,7 +244,7 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
      */
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("dyn_rnn:backward_batch");
+        dll::auto_timer timer("dyn_rnn:backward_batch", etl::dim<0>(context.errors));
 
         base_type::backward_batch_impl(output, context, w, u, time_steps, bptt_steps);
     }
@@ -225,9 +255,12 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
      */
     template <typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("dyn_rnn:compute_gradients");
+        // Only the first layer computes its gradients separately from the backward pass
+        if constexpr (!C::layer) {
+            dll::auto_timer timer("dyn_rnn:compute_gradients", etl::dim<0>(context.errors));
 
-        base_type::compute_gradients_impl(context, w, u, time_steps, bptt_steps);
+            base_type::compute_gradients_impl(context, w, u, time_steps, bptt_steps);
+        }
     }
 };
 
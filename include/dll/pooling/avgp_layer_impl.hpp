@@ -9,6 +9,9 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
+
 namespace dll {
 
 /*!
@@ -72,6 +75,14 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
         return {base::O1, base::O2, base::O3};
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return pooling_cost(batch, base::input_size(), base::output_size(), base::C1 * base::C2, sizeof(weight), {"avgp:forward_batch", "avgp:backward_batch"});
+    }
+
     /*!
      * \brief Forward activation of the layer for one batch of sample
      * \param output The output matrix
@@ -79,6 +90,8 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
+        dll::auto_timer timer("avgp:forward_batch", etl::dim<0>(input));
+
         output = etl::ml::avg_pool_forward<base::C1, base::C2, base::S1, base::S2, base::P1, base::P2>(input);
     }
 
@@ -110,6 +123,8 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("avgp:backward_batch", etl::dim<0>(context.errors));
+
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
 
@@ -213,6 +228,14 @@ struct avgp_3d_layer_impl final : pooling_3d_layer<avgp_3d_layer_impl<Desc>, Des
         return {base::O1, base::O2, base::O3};
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return pooling_cost(batch, base::input_size(), base::output_size(), base::C1 * base::C2 * base::C3, sizeof(weight), {"avgp:forward_batch", "avgp:backward_batch"});
+    }
+
     /*!
      * \brief Forward activation of the layer for one batch of sample
      * \param output The output matrix
@@ -220,6 +243,8 @@ struct avgp_3d_layer_impl final : pooling_3d_layer<avgp_3d_layer_impl<Desc>, Des
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
+        dll::auto_timer timer("avgp:forward_batch", etl::dim<0>(input));
+
         output = etl::ml::avg_pool_3d_forward<base::C1, base::C2, base::C3>(input);
     }
 
@@ -251,6 +276,8 @@ struct avgp_3d_layer_impl final : pooling_3d_layer<avgp_3d_layer_impl<Desc>, Des
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("avgp:backward_batch", etl::dim<0>(context.errors));
+
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
         static constexpr size_t C3 = base::C3; ///< The pooling third dimension
@@ -9,6 +9,9 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
+
 namespace dll {
 
 /*!
@@ -72,6 +75,14 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
         return {base::o1, base::o2, base::o3};
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return pooling_cost(batch, base::input_size(), base::output_size(), base::c1 * base::c2, sizeof(weight), {"avgp:forward_batch", "avgp:backward_batch"});
+    }
+
     /*!
      * \brief Forward activation of the layer for one batch of sample
      * \param output The output matrix
@@ -79,6 +90,8 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        dll::auto_timer timer("avgp:forward_batch", etl::dim<0>(input));
+
         output = etl::ml::avg_pool_forward(input, base::c1, base::c2, base::s1, base::s2, base::p1, base::p2);
     }
 
@@ -110,6 +123,8 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("avgp:backward_batch", etl::dim<0>(context.errors));
+
         size_t c1 = base::c1;
         size_t c2 = base::c2;
 
@@ -208,6 +223,14 @@ struct dyn_avgp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_avgp_3d_layer_imp
         return {base::o1, base::o2, base::o3};
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return pooling_cost(batch, base::input_size(), base::output_size(), base::c1 * base::c2 * base::c3, sizeof(weight), {"avgp:forward_batch", "avgp:backward_batch"});
+    }
+
     /*!
      * \brief Forward activation of the layer for one batch of sample
      * \param output The output matrix
@@ -215,6 +238,8 @@ struct dyn_avgp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_avgp_3d_layer_imp
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        dll::auto_timer timer("avgp:forward_batch", etl::dim<0>(input));
+
         output = etl::ml::avg_pool_3d_forward(input, base::c1, base::c2, base::c3);
     }
 
@@ -246,6 +271,8 @@ struct dyn_avgp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_avgp_3d_layer_imp
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("avgp:backward_batch", etl::dim<0>(context.errors));
+
         size_t c1 = base::c1;
         size_t c2 = base::c2;
         size_t c3 = base::c3;
@@ -9,6 +9,9 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
+
 namespace dll {
 
 /*!
@@ -72,6 +75,14 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
         return {base::o1, base::o2, base::o3};
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return pooling_cost(batch, base::input_size(), base::output_size(), base::c1 * base::c2, sizeof(weight), {"mp:forward_batch", "mp:backward_batch"});
+    }
+
     /*!
      * \brief Forward activation of the layer for one batch of sample
      * \param output The output matrix
@@ -79,7 +90,7 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        dll::auto_timer timer("mp:forward_batch");
+        dll::auto_timer timer("mp:forward_batch", etl::dim<0>(input));
 
         output = etl::ml::max_pool_forward(input, base::c1, base::c2, base::s1, base::s2, base::p1, base::p2);
     }
@@ -112,7 +123,7 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("mp:backward_batch");
+        dll::auto_timer timer("mp:backward_batch", etl::dim<0>(context.errors));
 
         size_t c1 = base::c1;
         size_t c2 = base::c2;
@@ -158,14 +169,16 @@ struct sgd_context<DBN, dyn_mp_2d_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::dyn_matrix<weight, 4> input;
-    etl::dyn_matrix<weight, 4> output;
-    etl::dyn_matrix<weight, 4> errors;
+    using buffer_t = sgd_buffer_t<DBN, etl::dyn_matrix<weight, 4>>; ///< The type of the batch buffers
+
+    buffer_t input;
+    buffer_t output;
+    buffer_t errors;
 
     sgd_context(const layer_t& layer)
-            : input(batch_size, layer.i1, layer.i2, layer.i3),
-              output(batch_size, layer.o1, layer.o2, layer.o3),
-              errors(batch_size, layer.o1, layer.o2, layer.o3) {}
+            : input(make_sgd_buffer<buffer_t>(batch_size, layer.i1, layer.i2, layer.i3)),
+              output(make_sgd_buffer<buffer_t>(batch_size, layer.o1, layer.o2, layer.o3)),
+              errors(make_sgd_buffer<buffer_t>(batch_size, layer.o1, layer.o2, layer.o3)) {}
 };
 
 /*!
@@ -230,6 +243,14 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
                + batch_size * (base::i1 / base::c1) * (base::i2 / base::c2) * (base::i3 / base::c3); // Errors
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    layer_cost cost(size_t batch) const noexcept {
+        return pooling_cost(batch, base::input_size(), base::output_size(), base::c1 * base::c2 * base::c3, sizeof(weight), {"mp:forward_batch", "mp:backward_batch"});
+    }
+
     /*!
      * \brief Forward activation of the layer for one batch of sample
      * \param output The output matrix
@@ -237,6 +258,8 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        dll::auto_timer timer("mp:forward_batch", etl::dim<0>(input));
+
         output = etl::ml::max_pool_3d_forward(input, base::c1, base::c2, base::c3);
     }
 
@@ -268,6 +291,8 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("mp:backward_batch", etl::dim<0>(context.errors));
+
         size_t c1 = base::c1;
         size_t c2 = base::c2;
         size_t c3 = base::c3;
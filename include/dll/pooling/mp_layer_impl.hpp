@@ -10,6 +10,7 @@
 #include "pooling_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/layer_cost.hpp"
 
 namespace dll {
 
@@ -74,6 +75,14 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
         return {base::O1, base::O2, base::O3};
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return pooling_cost(batch, base::input_size(), base::output_size(), base::C1 * base::C2, sizeof(weight), {"mp:forward_batch", "mp:backward_batch"});
+    }
+
     /*!
      * \brief Forward activation of the layer for one batch of sample
      * \param output The output matrix
@@ -81,7 +90,7 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("mp:forward_batch");
+        dll::auto_timer timer("mp:forward_batch", etl::dim<0>(input));
 
         output = etl::ml::max_pool_forward<base::C1, base::C2, base::S1, base::S2, base::P1, base::P2>(input);
     }
@@ -114,7 +123,7 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("mp:backward_batch");
+        dll::auto_timer timer("mp:backward_batch", etl::dim<0>(context.errors));
 
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
@@ -168,11 +177,17 @@ struct sgd_context<DBN, mp_2d_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, I1, I2, I3> input;
-    etl::fast_matrix<weight, batch_size, O1, O2, O3> output;
-    etl::fast_matrix<weight, batch_size, O1, O2, O3> errors;
+    using input_buffer_t  = sgd_buffer_t<DBN, etl::fast_matrix<weight, batch_size, I1, I2, I3>>; ///< The type of the input buffer
+    using output_buffer_t = sgd_buffer_t<DBN, etl::fast_matrix<weight, batch_size, O1, O2, O3>>; ///< The type of the output buffer
+
+    input_buffer_t input;
+    output_buffer_t output;
+    output_buffer_t errors;
 
-    sgd_context(const mp_2d_layer_impl<Desc>& /*layer*/){}
+    sgd_context(const mp_2d_layer_impl<Desc>& /*layer*/)
+            : input(make_sgd_buffer<input_buffer_t>(batch_size, I1, I2, I3)),
+              output(make_sgd_buffer<output_buffer_t>(batch_size, O1, O2, O3)),
+              errors(make_sgd_buffer<output_buffer_t>(batch_size, O1, O2, O3)) {}
 };
 
 /*!
@@ -219,6 +234,14 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
         return {base::O1, base::O2, base::O3};
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return pooling_cost(batch, base::input_size(), base::output_size(), base::C1 * base::C2 * base::C3, sizeof(weight), {"mp:forward_batch", "mp:backward_batch"});
+    }
+
     /*!
      * \brief Forward activation of the layer for one batch of sample
      * \param output The output matrix
@@ -226,7 +249,7 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("mp:forward_batch");
+        dll::auto_timer timer("mp:forward_batch", etl::dim<0>(input));
 
         output = etl::ml::max_pool_3d_forward<base::C1, base::C2, base::C3>(input);
     }
@@ -259,7 +282,7 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("mp:backward_batch");
+        dll::auto_timer timer("mp:backward_batch", etl::dim<0>(context.errors));
 
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
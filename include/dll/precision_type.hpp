@@ -0,0 +1,41 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <string>
+
+namespace dll {
+
+/*!
+ * \brief Define the precision of the activations and errors during training.
+ */
+enum class precision_type {
+    FLOAT, ///< Full precision, the type of the weights
+    BF16,  ///< bfloat16 (8 bits of exponent, 7 bits of mantissa)
+    FP16   ///< IEEE half precision (5 bits of exponent, 10 bits of mantissa)
+};
+
+/*!
+ * \brief Returns a string representation of a precision type
+ * \param p The precision type to transform to string
+ * \return a string representation of a precision type
+ */
+inline std::string to_string(precision_type p) {
+    switch (p) {
+        case precision_type::FLOAT:
+            return "FLOAT";
+        case precision_type::BF16:
+            return "BF16";
+        case precision_type::FP16:
+            return "FP16";
+    }
+
+    return "UNDEFINED";
+}
+
+} //end of dll namespace
@@ -58,6 +58,11 @@ struct conv_rbm_desc {
      */
     static constexpr bias_mode Bias           = detail::get_value_v<bias<bias_mode::SIMPLE>, Parameters...>;
 
+    /*!
+     * \brief The algorithm of the convolution of the hidden activations
+     */
+    static constexpr conv_algorithm algorithm = detail::get_value_v<conv_algo<conv_algorithm::DIRECT>, Parameters...>;
+
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
@@ -95,13 +100,14 @@ public:
     static_assert(NC > 0, "At least one channel is necessary");
     static_assert(K > 0, "At least one group is necessary");
     static_assert(BatchSize > 0, "Batch size must be at least 1");
+    static_assert(algorithm != conv_algorithm::WINOGRAD || (NW1 == 3 && NW2 == 3), "Winograd convolution only supports 3x3 kernels");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
                              momentum_id, batch_size_id, visible_id, hidden_id, dbn_only_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id, clip_gradients_id,
-                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id, conv_algo_id>,
                          Parameters...>,
         "Invalid parameters type");
 
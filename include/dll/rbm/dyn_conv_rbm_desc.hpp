@@ -51,6 +51,11 @@ struct dyn_conv_rbm_desc {
      */
     static constexpr bias_mode Bias           = detail::get_value_v<bias<bias_mode::SIMPLE>, Parameters...>;
 
+    /*!
+     * \brief The algorithm of the convolution of the hidden activations
+     */
+    static constexpr conv_algorithm algorithm = detail::get_value_v<conv_algo<conv_algorithm::DIRECT>, Parameters...>;
+
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
@@ -73,7 +78,7 @@ struct dyn_conv_rbm_desc {
         detail::is_valid_v<cpp::type_list<
                              batch_size_id, momentum_id, visible_id, hidden_id, dbn_only_id, clip_gradients_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id,
-                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id, conv_algo_id>,
                          Parameters...>,
         "Invalid parameters type");
 
@@ -14,6 +14,7 @@
 
 #include "dll/generators.hpp"
 #include "dll/layer.hpp"
+#include "dll/util/csr.hpp"
 #include "dll/trainer/rbm_trainer_fwd.hpp"
 
 namespace dll {
@@ -158,6 +159,17 @@ struct rbm_base : layer<Parent> {
         return trainer.train(as_derived(), *generator, max_epochs);
     }
 
+    /*!
+     * \brief Train the RBM on the given batches of sparse input
+     * \param input_batches The batches of sparse input, of at most batch_size samples
+     * \param max_epochs The maximum number of epochs for training
+     */
+    template <bool EnableWatcher = true, typename RW = void, typename... Args>
+    double train_sparse(const std::vector<csr_batch<weight>>& input_batches, size_t max_epochs, Args... args) {
+        dll::rbm_trainer<parent_t, EnableWatcher, RW> trainer(args...);
+        return trainer.train_sparse(as_derived(), input_batches, max_epochs);
+    }
+
     //Train denoising autoencoder
 
     /*!
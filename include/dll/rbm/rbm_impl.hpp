@@ -18,6 +18,7 @@
 #include "etl/etl.hpp"
 
 #include "dll/rbm/standard_rbm.hpp"
+#include "dll/util/layer_cost.hpp"
 #include "dll/base_traits.hpp"
 #include "dll/layer_traits.hpp"
 
@@ -113,6 +114,14 @@ struct rbm_impl final : public standard_rbm<rbm_impl<Desc>, Desc> {
         return num_visible * num_hidden;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the operations of the layer on a batch
+     * \param batch The number of samples in the batch
+     */
+    static layer_cost cost(size_t batch) noexcept {
+        return dense_cost(batch, num_visible, num_hidden, sizeof(weight), {"rbm:forward_batch", "rbm:backward_batch", "rbm:compute_gradients"});
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -144,6 +153,8 @@ struct rbm_impl final : public standard_rbm<rbm_impl<Desc>, Desc> {
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        dll::auto_timer timer("rbm:forward_batch", etl::dim<0>(input));
+
         this->batch_activate_hidden(output, input);
     }
 
@@ -191,6 +202,8 @@ struct rbm_impl final : public standard_rbm<rbm_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("rbm:backward_batch", etl::dim<0>(context.errors));
+
         // The reshape has no overhead, so better than SFINAE for nothing
         constexpr auto Batch = etl::decay_traits<H>::template dim<0>();
         etl::reshape<Batch, num_visible>(output) = context.errors * etl::transpose(w);
@@ -202,6 +215,8 @@ struct rbm_impl final : public standard_rbm<rbm_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
+        dll::auto_timer timer("rbm:compute_gradients", etl::dim<0>(context.errors));
+
         std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
         std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
     }
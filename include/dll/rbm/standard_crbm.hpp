@@ -25,6 +25,8 @@
 #include "standard_conv_rbm.hpp" //The base class
 #include "rbm_tmp.hpp"           // static_if macros
 
+#include "dll/util/conv_registry.hpp"
+
 namespace dll {
 
 /*!
@@ -75,7 +77,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         auto b_rep = as_derived().get_b_rep();
 
-        as_derived().reshape_h_a(h_a) = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+        conv_hidden(as_derived().reshape_h_a(h_a), as_derived().reshape_v_a(v_a));
 
         // Need to be done before h_a is computed!
 
@@ -191,7 +193,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         // TODO This code is a huge mess!
 
-        h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        conv_hidden(h_a, v_a);
 
         // Need to be done before h_a is computed!
         if constexpr (P && S && hidden_unit == unit_type::RELU) {
@@ -287,13 +289,26 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
     friend base_type;
 
 private:
+    /*!
+     * \brief Compute the convolution of the visible units with the
+     * filters, with the algorithm of the layer
+     */
+    template <typename H, typename V>
+    void conv_hidden(H&& h, const V& v) const {
+        if constexpr (desc::algorithm == conv_algorithm::DIRECT) {
+            h = etl::conv_4d_valid_flipped(v, as_derived().w);
+        } else {
+            conv_forward<desc::algorithm>(h, v, as_derived().w);
+        }
+    }
+
     template<typename Input, typename Out>
     weight energy_impl(const Input& v, const Out& h) const {
         static_assert(etl::is_etl_expr<Out>, "energy_impl works with ETL expressions only");
 
         auto rv = as_derived().reshape_v_a(v);
         auto tmp = as_derived().energy_tmp();
-        tmp = etl::conv_4d_valid_flipped(rv, as_derived().w);
+        conv_hidden(tmp, rv);
 
         if constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition according to Honglak Lee
@@ -315,7 +330,7 @@ private:
     weight free_energy_impl(const Input& v) const {
         auto rv = as_derived().reshape_v_a(v);
         auto tmp = as_derived().energy_tmp();
-        tmp = etl::conv_4d_valid_flipped(rv, as_derived().w);
+        conv_hidden(tmp, rv);
 
         if constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
@@ -20,6 +20,7 @@
 
 #include "dll/util/checks.hpp"    //NaN checks
 #include "dll/util/timers.hpp"    //auto_timer
+#include "dll/util/csr.hpp"       //Sparse input
 #include "dll/rbm/rbm_base.hpp"       //The base class
 #include "dll/base_conf.hpp"      //Descriptor configuration
 #include "dll/rbm/rbm_tmp.hpp"        // static_if macros
@@ -53,6 +54,8 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
 
     std::shared_ptr<void*> states; ///< The states for random number generaton
 
+    mutable etl::dyn_matrix<weight, 2> sparse_x; ///< The pre-activation of the hidden units for sparse input
+
     /*!
      * \brief Construct empty standard_rbm
      */
@@ -208,6 +211,78 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         }
     }
 
+    /*!
+     * \brief Compute the hidden representation from a batch of sparse input
+     * \param h_a The batch output to set the activation probabilities of the hidden representation
+     * \param h_s The batch output to set the activation samples of the hidden representation
+     * \param v The batch of sparse input
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const csr_batch<weight>& v) const {
+        dll::auto_timer timer("rbm:std:batch_activate_hidden:sparse");
+
+        static_assert(P, "Sparse input is only supported with the activation probabilities");
+
+        using namespace etl;
+
+        cpp_assert(v.cols == as_derived().input_size(), "Invalid sparse input for RBM");
+
+        // The pre-activation of the hidden units, computed once, in a buffer kept between batches
+
+        const size_t n = etl::dim<0>(h_a);
+
+        if (etl::dim<0>(sparse_x) != n || etl::dim<1>(sparse_x) != as_derived().output_size()) {
+            sparse_x.resize(n, as_derived().output_size());
+        }
+
+        auto& x = sparse_x;
+
+        csr_mul(x, v, as_derived().w);
+
+        x = bias_add_2d(x, as_derived().b);
+
+        if constexpr (hidden_unit == unit_type::BINARY) {
+            h_a = etl::sigmoid(x);
+        } else if constexpr (hidden_unit == unit_type::RELU) {
+            h_a = max(x, 0.0);
+        } else if constexpr (hidden_unit == unit_type::RELU1) {
+            h_a = min(max(x, 0.0), 1.0);
+        } else if constexpr (hidden_unit == unit_type::RELU6) {
+            h_a = min(max(x, 0.0), 6.0);
+        } else if constexpr (hidden_unit == unit_type::SOFTMAX) {
+            h_a = stable_softmax(x);
+        }
+
+        if constexpr (S && hidden_unit == unit_type::BINARY) {
+            h_s = state_bernoulli(h_a, states);
+        } else if constexpr (S && hidden_unit == unit_type::RELU) {
+            h_s = max(state_logistic_noise(x, states), 0.0);
+        } else if constexpr (S && hidden_unit == unit_type::RELU1) {
+            h_s = min(max(ranged_noise(x, 1.0), 0.0), 1.0);
+        } else if constexpr (S && hidden_unit == unit_type::RELU6) {
+            h_s = min(max(ranged_noise(x, 6.0), 0.0), 6.0);
+        } else if constexpr (S && hidden_unit == unit_type::SOFTMAX) {
+            h_s = one_if_max_sub(h_a);
+        }
+
+        nan_check_deep(h_a);
+
+        if (S) {
+            nan_check_deep(h_s);
+        }
+    }
+
+    /*!
+     * \brief Compute the hidden representation from a batch of sparse input
+     *
+     * \param h_a The batch output to set
+     * \param v The batch of sparse input
+     */
+    template <typename H>
+    void batch_activate_hidden(H&& h_a, const csr_batch<weight>& v) const {
+        batch_activate_hidden<true, false>(h_a, h_a, v);
+    }
+
     //Display functions
 
     /*!
@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include "dll/trainer/sgd_buffer.hpp" // For the batch buffers of the contexts
+
 namespace dll {
 
 /*!
@@ -15,6 +15,7 @@
 #include "dll/util/timers.hpp"
 #include "dll/util/random.hpp"
 #include "dll/util/batch.hpp" // For make_batch
+#include "dll/util/csr.hpp"   // For csr_batch
 #include "dll/test.hpp"
 #include "dll/network_traits.hpp"
 
@@ -118,6 +119,8 @@ struct dbn_trainer {
             }
         }
 
+        dbn.reset_states();
+
         watcher.fine_tuning_end(dbn);
 
         return current_error;
@@ -129,6 +132,9 @@ struct dbn_trainer {
      * \param epoch The current epoch
      */
     void start_epoch(dbn_t& dbn, size_t epoch){
+        // The sequences start again at each epoch
+        dbn.reset_states();
+
         watcher.ft_epoch_start(epoch, dbn);
     }
 
@@ -317,7 +323,7 @@ struct dbn_trainer {
         watcher.ft_epoch_end(epoch, error, loss, dbn);
 
         // Early stopping with training error/loss
-        auto stop =  early_stop(dbn, epoch, error, loss, current_error, current_loss);
+        auto stop =  early_stop(dbn, epoch, error, loss, current_error, current_loss) || diverged();
 
         // Save current error and loss
         current_error = error;
@@ -353,6 +359,8 @@ struct dbn_trainer {
             stop = early_stop(dbn, epoch, val_stats.first, val_stats.second, current_val_error, current_val_loss);
         }
 
+        stop = stop || diverged();
+
         // Save current error and loss for training and validation
         current_error = train_stats.first;
         current_loss  = train_stats.second;
@@ -378,6 +386,9 @@ struct dbn_trainer {
         if constexpr (network_traits<dbn_t>::error_on_epoch()){
             dll::auto_timer timer("net:trainer:train:epoch:error");
 
+            // The evaluation goes through the sequences from their start
+            dbn.reset_test_states();
+
             auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
                 return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
             };
@@ -423,6 +434,22 @@ struct dbn_trainer {
 
             // Go to the next batch
             generator.next_batch();
+
+            // The remaining batches cannot recover a diverged training
+            if (diverged()) {
+                break;
+            }
+        }
+    }
+
+    /*!
+     * \brief Indicates if the training diverged and cannot continue
+     */
+    bool diverged() const {
+        if constexpr (requires { trainer->diverged(); }) {
+            return trainer->diverged();
+        } else {
+            return false;
         }
     }
 
@@ -525,6 +552,61 @@ struct dbn_trainer {
         return stop_training(dbn, epoch, max_epochs);
     }
 
+    /*!
+     * \brief Train the network for max_epochs on batches of sparse input
+     *
+     * The batches are used in the given order at each epoch. The error and
+     * the loss of an epoch are the averages of the ones of its batches,
+     * computed while training.
+     *
+     * \param dbn The network to be trained
+     * \param inputs The batches of sparse inputs
+     * \param labels The batches of labels
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename Labels>
+    error_type train_sparse(DBN& dbn, const std::vector<csr_batch<typename dbn_t::weight>>& inputs, const std::vector<Labels>& labels, size_t max_epochs) {
+        dll::auto_timer timer("net:trainer:train:sparse");
+
+        cpp_assert(inputs.size() == labels.size(), "There must be as many batches of inputs as batches of labels");
+
+        // Initialization steps
+        start_training(dbn, max_epochs);
+
+        //Train the model for max_epochs epoch
+
+        size_t epoch = 0;
+        for (; epoch < max_epochs; ++epoch) {
+            dll::auto_timer timer("net:trainer:train:epoch");
+
+            start_epoch(dbn, epoch);
+
+            double error   = 0.0;
+            double loss    = 0.0;
+            size_t samples = 0;
+
+            for (size_t b = 0; b < inputs.size(); ++b) {
+                dll::auto_timer timer("net:trainer:train:epoch:batch");
+
+                auto [batch_error, batch_loss] = trainer->template train_batch_sparse<true>(epoch, inputs[b], labels[b]);
+
+                error += batch_error * inputs[b].rows;
+                loss += batch_loss * inputs[b].rows;
+                samples += inputs[b].rows;
+            }
+
+            if (stop_epoch(dbn, epoch, error / samples, loss / samples)) {
+                break;
+            }
+        }
+
+        // Finalization
+
+        return stop_training(dbn, epoch, max_epochs);
+    }
+
     /*!
      * \brief Train the network for max_epochs
      *
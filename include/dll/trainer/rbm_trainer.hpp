@@ -13,6 +13,7 @@
 
 #include "dll/decay_type.hpp"
 #include "dll/util/batch.hpp"
+#include "dll/util/csr.hpp"
 #include "dll/util/timers.hpp"
 #include "dll/util/random.hpp"
 #include "dll/layer_traits.hpp"
@@ -163,6 +164,56 @@ struct rbm_trainer {
         return finalize_training(rbm);
     }
 
+    /*!
+     * \brief Train the RBM on batches of sparse input.
+     *
+     * The batches are used in the given order at each epoch and the free
+     * energy is not computed.
+     */
+    error_type train_sparse(RBM& rbm, const std::vector<csr_batch<typename rbm_t::weight>>& input_batches, size_t max_epochs) {
+        dll::auto_timer timer("rbm_trainer:train:sparse");
+
+        rbm.momentum = rbm.initial_momentum;
+
+        if (EnableWatcher) {
+            watcher.training_begin(rbm);
+        }
+
+        total_batches = input_batches.size();
+        last_error    = 0.0;
+
+        //Allocate the trainer
+        auto trainer = get_trainer(rbm);
+
+        //Train for max_epochs epoch
+        for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
+            //Create a new context for this epoch
+            rbm_training_context context;
+
+            //Start a new epoch
+            init_epoch(epoch);
+
+            //Train on all the data
+            for (auto& input : input_batches) {
+                ++batches;
+
+                trainer->train_batch(input, context);
+
+                context.reconstruction_error += context.batch_error;
+                context.sparsity += context.batch_sparsity;
+
+                if (EnableWatcher && rbm_layer_traits<rbm_t>::is_verbose()) {
+                    watcher.batch_end(rbm, context, batches, total_batches);
+                }
+            }
+
+            //Finalize the current epoch
+            finalize_epoch(epoch, context, rbm);
+        }
+
+        return finalize_training(rbm);
+    }
+
     size_t batches = 0; ///< The number of batches
     size_t samples = 0; ///< The number of samples
 
@@ -0,0 +1,115 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Batch buffers of the SGD contexts
+ *
+ * When the network enables memory_plan, the input, output and errors
+ * buffers of the main contexts are views over an arena shared between
+ * the layers (see sgd_memory_planner). Otherwise, each context owns its
+ * buffers.
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <tuple>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the given buffer type is a view planned by the memory planner
+ */
+template <typename T>
+constexpr bool is_sgd_view = false;
+
+template <typename T, size_t D>
+constexpr bool is_sgd_view<etl::custom_dyn_matrix<T, D>> = true;
+
+/*!
+ * \brief The type of a batch buffer of a SGD context.
+ *
+ * \tparam DBN The network
+ * \tparam Owning The type of the buffer when it owns its memory
+ */
+template <typename DBN, typename Owning>
+using sgd_buffer_t = std::conditional_t<DBN::memory_plan, etl::custom_dyn_matrix<etl::value_t<Owning>, etl::dimensions<Owning>()>, Owning>;
+
+/*!
+ * \brief The owning type of a buffer, used by the contexts that inherit
+ * the type of their buffers from the previous context.
+ */
+template <typename Buffer>
+struct sgd_owning {
+    using type = Buffer; ///< The owning type
+};
+
+template <typename T, size_t D>
+struct sgd_owning<etl::custom_dyn_matrix<T, D>> {
+    using type = etl::dyn_matrix<T, D>; ///< The owning type
+};
+
+/*!
+ * \brief The owning type of a buffer
+ */
+template <typename Buffer>
+using sgd_owning_t = typename sgd_owning<Buffer>::type;
+
+/*!
+ * \brief Create a zero batch buffer of the given dimensions.
+ *
+ * A planned view is created without memory, it is bound by the planner
+ * before being used.
+ */
+template <typename Buffer, typename... Dims>
+Buffer make_sgd_buffer(Dims... dims) {
+    using T = etl::value_t<Buffer>;
+
+    if constexpr (is_sgd_view<Buffer>) {
+        return Buffer(static_cast<T*>(nullptr), size_t(dims)...);
+    } else if constexpr (etl::is_fast<Buffer>) {
+        return Buffer(T(0));
+    } else {
+        return Buffer(size_t(dims)..., T(0));
+    }
+}
+
+/*!
+ * \brief Bind a planned view to the given memory, keeping its dimensions.
+ */
+template <typename T, size_t D>
+void sgd_rebind(etl::custom_dyn_matrix<T, D>& buffer, T* memory) {
+    using buffer_t = etl::custom_dyn_matrix<T, D>;
+
+    std::array<size_t, D> dims;
+
+    for (size_t d = 0; d < D; ++d) {
+        dims[d] = etl::dim(buffer, d);
+    }
+
+    std::destroy_at(&buffer);
+
+    std::apply([&buffer, memory](auto... d) { new (&buffer) buffer_t(memory, d...); }, dims);
+}
+
+/*!
+ * \brief Indicates if two buffers are views of the same memory
+ */
+template <typename A, typename B>
+bool sgd_same_memory([[maybe_unused]] const A& a, [[maybe_unused]] const B& b) {
+    if constexpr (etl::all_dma<A, B>) {
+        return static_cast<const void*>(a.memory_start()) == static_cast<const void*>(b.memory_start());
+    } else {
+        return false;
+    }
+}
+
+} //end of dll namespace
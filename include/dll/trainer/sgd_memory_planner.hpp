@@ -0,0 +1,249 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Liveness-based planner for the batch buffers of the SGD contexts
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include "dll/trainer/sgd_buffer.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Plan the batch buffers of the SGD contexts of a network in a
+ * single arena.
+ *
+ * The forward pass of layer L happens at step L. The backward passes
+ * (including the gradients) then happen from the last layer to the first.
+ * With gradient checkpointing, the layers are split in segments of K
+ * layers. Only the output of the last layer of each segment is kept
+ * after the forward pass. The other outputs of a segment are recomputed
+ * just before its backward pass. This gives the following live ranges:
+ *
+ *  - output of L (and input of L + 1, which shares its memory): from the
+ *  forward pass of L to its backward pass, or, inside a segment, during
+ *  the forward pass of L + 1 and from the recomputation of L to its
+ *  backward pass
+ *  - errors of L: from the backward pass of L + 1 to the backward pass of L
+ *  - input of L, when it is not the output of L - 1: from the forward pass
+ *  of L to its backward pass
+ *
+ * When the outputs are stored in reduced precision (mixed precision), the
+ * output of L is only live during the forward passes of L and L + 1 and,
+ * once loaded back, from the backward pass of L + 1 to the one of L.
+ *
+ * The output of the last layer is kept until the end, for the metrics of
+ * the batch. Buffers whose ranges do not overlap share memory, which is
+ * assigned greedily from the largest buffer to the smallest.
+ *
+ * \tparam T The value type of the buffers
+ */
+template <typename T>
+struct sgd_memory_planner {
+    using ranges_t = std::vector<std::pair<size_t, size_t>>; ///< A set of live ranges
+
+    /*!
+     * \brief A buffer to place in the arena
+     */
+    struct request {
+        size_t size;                                  ///< The number of elements of the buffer
+        ranges_t ranges;                              ///< The steps the buffer is live
+        std::function<void(T*)> bind;                 ///< Bind the buffer to its memory
+        std::vector<std::function<void(T*)>> aliases; ///< Buffers sharing the exact same memory
+    };
+
+    /*!
+     * \brief A block of the arena, shared by non-overlapping buffers
+     */
+    struct block {
+        size_t size;     ///< The number of elements of the block
+        ranges_t ranges; ///< The live ranges of the buffers of this block
+    };
+
+    static constexpr size_t alignment = 64 / sizeof(T); ///< The alignment of the blocks, in elements
+
+    std::unique_ptr<T[]> arena;  ///< The memory of all the planned buffers
+    size_t planned_size   = 0;   ///< The number of elements of the arena
+    size_t unplanned_size = 0;   ///< The number of elements without planning
+
+    /*!
+     * \brief Plan and bind the buffers of the given contexts
+     * \param contexts The (layer, context) pairs of the network
+     * \param k The number of layers of each checkpointing segment (1 to keep all outputs)
+     * \param stored Indicates if the outputs are stored in reduced precision between the passes
+     */
+    template <typename Contexts>
+    void plan(Contexts& contexts, size_t k = 1, bool stored = false) {
+        constexpr size_t n = std::tuple_size_v<Contexts>;
+
+        // Compute the steps of the recomputations and backward passes
+
+        std::vector<size_t> backward(n);
+        std::vector<size_t> recompute(n, size_t(-1));
+
+        size_t step = n;
+
+        for (size_t s = (n + k - 1) / k; s-- > 0;) {
+            const size_t first = s * k;
+            const size_t last  = std::min(n, first + k) - 1;
+
+            for (size_t l = first; l < last; ++l) {
+                recompute[l] = step++;
+            }
+
+            for (size_t l = last + 1; l-- > first;) {
+                backward[l] = step++;
+            }
+        }
+
+        const size_t end = step;
+
+        // The live ranges of the output of layer L
+        auto activation = [&](size_t L) -> ranges_t {
+            if (L == n - 1) {
+                return {{L, end}};
+            } else if (stored) {
+                return {{L, L + 1}, {backward[L + 1], backward[L]}};
+            } else if (recompute[L] == size_t(-1)) {
+                return {{L, backward[L]}};
+            } else {
+                return {{L, L + 1}, {recompute[L], backward[L]}};
+            }
+        };
+
+        // The live ranges of the errors of layer L
+        auto errors = [&](size_t L) -> ranges_t {
+            return {{L == n - 1 ? backward[L] : backward[L + 1], backward[L]}};
+        };
+
+        std::vector<request> requests;
+
+        // Index of the request holding the output of the previous layer
+        size_t previous_output = size_t(-1);
+
+        cpp::for_each_i(contexts, [&](size_t L, auto& layer_ctx) {
+            auto& context = *layer_ctx.second;
+
+            // group and merge contexts always own their buffers
+            if constexpr (requires { context.output; }) {
+                using buffer_t = std::decay_t<decltype(context.output)>;
+
+                if constexpr (is_sgd_view<buffer_t>) {
+                    // The input is the output of the previous layer when possible
+
+                    if (previous_output != size_t(-1) && requests[previous_output].size == etl::size(context.input)) {
+                        requests[previous_output].aliases.push_back([&context](T* memory) { sgd_rebind(context.input, memory); });
+                    } else {
+                        // Only filled by the forward pass of the layer, it must stay live until its backward pass
+                        requests.push_back({etl::size(context.input), {{L, backward[L]}}, [&context](T* memory) { sgd_rebind(context.input, memory); }, {}});
+                    }
+
+                    requests.push_back({etl::size(context.output), activation(L), [&context](T* memory) { sgd_rebind(context.output, memory); }, {}});
+
+                    previous_output = requests.size() - 1;
+
+                    requests.push_back({etl::size(context.errors), errors(L), [&context](T* memory) { sgd_rebind(context.errors, memory); }, {}});
+
+                    return;
+                }
+            }
+
+            previous_output = size_t(-1);
+        });
+
+        // Assign the buffers to blocks, largest first
+
+        std::vector<size_t> order(requests.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&requests](size_t a, size_t b) { return requests[a].size > requests[b].size; });
+
+        std::vector<block> blocks;
+        std::vector<size_t> assignment(requests.size());
+
+        for (auto r : order) {
+            auto& req = requests[r];
+
+            unplanned_size += req.size * (1 + req.aliases.size());
+
+            auto overlaps = [&req](const block& b) {
+                for (auto& range : req.ranges) {
+                    for (auto& other : b.ranges) {
+                        if (range.first <= other.second && other.first <= range.second) {
+                            return true;
+                        }
+                    }
+                }
+
+                return false;
+            };
+
+            auto it = std::find_if(blocks.begin(), blocks.end(), [&](const block& b) { return !overlaps(b); });
+
+            if (it == blocks.end()) {
+                blocks.push_back({req.size, {}});
+                it = blocks.end() - 1;
+            }
+
+            it->ranges.insert(it->ranges.end(), req.ranges.begin(), req.ranges.end());
+            assignment[r] = std::distance(blocks.begin(), it);
+        }
+
+        // Layout the blocks in the arena
+
+        std::vector<size_t> offsets(blocks.size());
+
+        planned_size = 0;
+
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            offsets[b]   = planned_size;
+            planned_size += (blocks[b].size + alignment - 1) / alignment * alignment;
+        }
+
+        arena = std::make_unique<T[]>(planned_size + alignment);
+
+        // Align the start of the arena itself
+
+        auto base = reinterpret_cast<std::uintptr_t>(arena.get());
+        T* start  = arena.get() + ((alignment - (base / sizeof(T)) % alignment) % alignment);
+
+        for (size_t r = 0; r < requests.size(); ++r) {
+            T* memory = start + offsets[assignment[r]];
+
+            requests[r].bind(memory);
+
+            for (auto& alias : requests[r].aliases) {
+                alias(memory);
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the memory of the planned buffers, in bytes
+     */
+    size_t planned_memory() const noexcept {
+        return planned_size * sizeof(T);
+    }
+
+    /*!
+     * \brief Returns the memory the planned buffers would use without planning, in bytes
+     */
+    size_t unplanned_memory() const noexcept {
+        return unplanned_size * sizeof(T);
+    }
+};
+
+} //end of dll namespace
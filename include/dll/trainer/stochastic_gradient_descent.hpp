@@ -18,7 +18,11 @@
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "dll/trainer/context_fwd.hpp" // For sgd_context
+#include "dll/trainer/sgd_memory_planner.hpp" // For memory_plan
 #include "dll/util/checks.hpp"         // For NaN checks
+#include "dll/util/csr.hpp"            // For csr_batch
+#include "dll/util/fused_updaters.hpp" // For the fused updaters
+#include "dll/util/reduced_precision.hpp" // For mixed_precision
 #include "dll/util/timers.hpp"         // For auto_timer
 
 namespace dll {
@@ -35,6 +39,9 @@ concept utility_layer = group_layer_c<Layer> || merge_layer_c<Layer>;
 template <typename Layer>
 concept standard_layer = !utility_layer<Layer>;
 
+template <typename Layer>
+concept lazy_layer = Layer::lazy_gradients;
+
 /*!
  * \brief Build the sub context for a updater context
  *
@@ -248,20 +255,18 @@ struct updater_sub_context <Layer, I, updater_type::ADAM_CORRECT> {
 
     type grad; ///< The gradients of the variable
     type m;    ///< Estimates of the first moment of the gradient
-    type mt;   ///< Corrected estimates of the first moment of the gradient
     type v;    ///< Estimates of the second moment of the gradient
-    type vt;   ///< Corrected estimates of the second moment of the gradient
+
+    // The corrected estimates are not kept, the update does not use them
 
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
      */
-    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), mt(grad), v(grad), vt(grad) {
+    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), v(grad) {
         grad = 0;
         m = 0;
-        mt = 0;
         v = 0;
-        vt = 0;
     }
 };
 
@@ -351,6 +356,32 @@ struct updater_context<UT, true, Layer> {
     }
 };
 
+/*!
+ * \brief A view of a network whose contexts own their buffers.
+ *
+ * The contexts of the group and merge layers are built with this view,
+ * their buffers are never planned by the memory planner. The shards of
+ * data-parallel training use it with a reduced batch size and the SGD
+ * updater, they only need to hold gradients, the state of the updater is
+ * only kept in the main context.
+ *
+ * \tparam Network The viewed network
+ * \tparam B The batch size of the contexts
+ * \tparam UT The updater of the contexts
+ */
+template <typename Network, size_t B = Network::batch_size, updater_type UT = Network::updater>
+struct sgd_owning_network {
+    using weight = typename Network::weight; ///< The data type of the network
+
+    template <size_t N>
+    using layer_type = typename Network::template layer_type<N>; ///< The type of the layer at index N
+
+    static constexpr size_t layers     = Network::layers; ///< The number of layers
+    static constexpr size_t batch_size = B;               ///< The batch size
+    static constexpr auto updater      = UT;              ///< The updater of the network
+    static constexpr bool memory_plan  = false;           ///< The contexts own their buffers
+};
+
 /*!
  * \brief The full SGD context, it contains the context of the layer as well as
  * the context for the SGD updater
@@ -379,11 +410,11 @@ struct full_sgd_context : sgd_context<Network, Layer, L> {
 template <typename Network, typename... Layers, size_t L>
 struct full_sgd_context <Network, group_layer_impl<group_layer_desc<Layers...>>, L>  {
     using layer_t      = group_layer_impl<group_layer_desc<Layers...>>; ///< The layer
-    using context_type = sgd_context<Network, layer_t, L>;                  ///< The parent context type
+    using context_type = sgd_context<sgd_owning_network<Network>, layer_t, L>; ///< The parent context type
 
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
 
-    std::tuple<full_sgd_context<Network, Layers, L>...> sub_contexts; ///< The sub contexts
+    std::tuple<full_sgd_context<sgd_owning_network<Network>, Layers, L>...> sub_contexts; ///< The sub contexts
 
     /*!
      * \brief Construct the full_sgd_context for the given layer
@@ -400,11 +431,11 @@ struct full_sgd_context <Network, group_layer_impl<group_layer_desc<Layers...>>,
 template <typename Network, typename... Layers, size_t L>
 struct full_sgd_context <Network, dyn_group_layer_impl<dyn_group_layer_desc<Layers...>>, L>  {
     using layer_t      = dyn_group_layer_impl<dyn_group_layer_desc<Layers...>>; ///< The layer
-    using context_type = sgd_context<Network, layer_t, L>;                  ///< The parent context type
+    using context_type = sgd_context<sgd_owning_network<Network>, layer_t, L>; ///< The parent context type
 
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
 
-    std::tuple<full_sgd_context<Network, Layers, L>...> sub_contexts; ///< The sub contexts
+    std::tuple<full_sgd_context<sgd_owning_network<Network>, Layers, L>...> sub_contexts; ///< The sub contexts
 
     /*!
      * \brief Construct the full_sgd_context for the given layer
@@ -419,13 +450,13 @@ struct full_sgd_context <Network, dyn_group_layer_impl<dyn_group_layer_desc<Laye
  * the context for the SGD updater
  */
 template <typename Network, size_t D, typename... Layers, size_t L>
-struct full_sgd_context<Network, merge_layer_impl<merge_layer_desc<D, Layers...>>, L> : sgd_context<Network, merge_layer_impl<merge_layer_desc<D, Layers...>>, L> {
+struct full_sgd_context<Network, merge_layer_impl<merge_layer_desc<D, Layers...>>, L> : sgd_context<sgd_owning_network<Network>, merge_layer_impl<merge_layer_desc<D, Layers...>>, L> {
     using layer_t      = merge_layer_impl<merge_layer_desc<D, Layers...>>; ///< The layer
-    using context_type = sgd_context<Network, layer_t, L>;                     ///< The parent context type
+    using context_type = sgd_context<sgd_owning_network<Network>, layer_t, L>; ///< The parent context type
 
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
 
-    std::tuple<full_sgd_context<Network, Layers, L>...> sub_contexts; ///< The sub contexts
+    std::tuple<full_sgd_context<sgd_owning_network<Network>, Layers, L>...> sub_contexts; ///< The sub contexts
 
     /*!
      * \brief Construct the full_sgd_context for the given layer
@@ -440,13 +471,13 @@ struct full_sgd_context<Network, merge_layer_impl<merge_layer_desc<D, Layers...>
  * the context for the SGD updater
  */
 template <typename Network, size_t D, typename... Layers, size_t L>
-struct full_sgd_context<Network, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>, L> : sgd_context<Network, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>, L> {
+struct full_sgd_context<Network, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>, L> : sgd_context<sgd_owning_network<Network>, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>, L> {
     using layer_t      = dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>; ///< The layer
-    using context_type = sgd_context<Network, layer_t, L>;                     ///< The parent context type
+    using context_type = sgd_context<sgd_owning_network<Network>, layer_t, L>; ///< The parent context type
 
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
 
-    std::tuple<full_sgd_context<Network, Layers, L>...> sub_contexts; ///< The sub contexts
+    std::tuple<full_sgd_context<sgd_owning_network<Network>, Layers, L>...> sub_contexts; ///< The sub contexts
 
     /*!
      * \brief Construct the full_sgd_context for the given layer
@@ -480,6 +511,79 @@ auto build_context(Network& network){
     return build_context<Context>(network, std::make_index_sequence<Network::layers>());
 }
 
+/*!
+ * \brief Indicates if a layer can be trained concurrently on several shards.
+ *
+ * Layers keeping training state inside the layer itself (batch normalization
+ * statistics, dropout generator, recurrent caches) cannot be sharded.
+ */
+template <typename Layer>
+struct sgd_shard_safe : std::bool_constant<!(
+        cpp::is_specialization_of_v<dll::batch_normalization_2d_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::dyn_batch_normalization_2d_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::batch_normalization_4d_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::dyn_batch_normalization_4d_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::dropout_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::dyn_dropout_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::rnn_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::dyn_rnn_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::lstm_layer_impl, Layer>
+        || cpp::is_specialization_of_v<dll::dyn_lstm_layer_impl, Layer>)> {};
+
+template <typename... Layers>
+struct sgd_shard_safe<group_layer_impl<group_layer_desc<Layers...>>> : std::bool_constant<(sgd_shard_safe<Layers>::value && ...)> {};
+
+template <typename... Layers>
+struct sgd_shard_safe<dyn_group_layer_impl<dyn_group_layer_desc<Layers...>>> : std::bool_constant<(sgd_shard_safe<Layers>::value && ...)> {};
+
+template <size_t D, typename... Layers>
+struct sgd_shard_safe<merge_layer_impl<merge_layer_desc<D, Layers...>>> : std::bool_constant<(sgd_shard_safe<Layers>::value && ...)> {};
+
+template <size_t D, typename... Layers>
+struct sgd_shard_safe<dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>> : std::bool_constant<(sgd_shard_safe<Layers>::value && ...)> {};
+
+/*!
+ * \brief Build the context of one shard of a Network for the given sequence of layers
+ * \param network The Network to build the context from
+ */
+template<template<typename, typename, size_t> typename Context, typename ShardNetwork, typename Network, size_t... I>
+auto build_shard_context(Network& network, std::index_sequence<I...> /*seq*/){
+    return std::make_tuple
+        (
+            (std::make_pair(
+                std::ref(network.template layer_get<I>()),  // Reference to the layer
+                std::make_shared<Context<ShardNetwork, typename Network::template layer_type<I>, I>>(network.template layer_get<I>()))
+            )...
+        );
+}
+
+/*!
+ * \brief Build the context of one shard of a Network
+ * \param network The Network to build the context from
+ */
+template<template<typename, typename, size_t> typename Context, typename ShardNetwork, typename Network>
+auto build_shard_context(Network& network){
+    return build_shard_context<Context, ShardNetwork>(network, std::make_index_sequence<Network::layers>());
+}
+
+/*!
+ * \brief The type of the contexts of the shards of a Network
+ */
+template <typename Network, size_t Shards>
+struct sgd_shard_contexts {
+    using network_t = sgd_owning_network<Network, Network::batch_size / Shards, updater_type::SGD>; ///< The network type of a shard
+
+    using type = std::vector<decltype(build_shard_context<full_sgd_context, network_t>(std::declval<Network&>()))>; ///< The contexts
+};
+
+/*!
+ * \brief The type of the contexts of the shards of a Network (no sharding)
+ */
+template <typename Network>
+struct sgd_shard_contexts<Network, 1> {
+    using type = std::vector<std::tuple<>>; ///< The contexts
+};
+
 /*!
  * \brief Simple gradient descent trainer
  */
@@ -492,10 +596,46 @@ struct sgd_trainer {
     static constexpr auto layers     = network_t::layers;     ///< The number of layers
     static constexpr auto batch_size = network_t::batch_size; ///< The batch size for training
 
+    static constexpr auto shards        = network_traits<network_t>::shards();        ///< The number of shards per batch
+    static constexpr auto data_parallel = network_traits<network_t>::data_parallel(); ///< Indicates if shards are trained in parallel
+    static constexpr auto memory_plan   = network_traits<network_t>::memory_plan();   ///< Indicates if the buffers of the contexts are planned
+    static constexpr auto checkpoint    = network_traits<network_t>::checkpoint();    ///< The number of layers of each checkpointing segment
+    static constexpr auto precision     = network_traits<network_t>::precision();     ///< The precision of the activations and errors
+    static constexpr auto mixed         = network_traits<network_t>::mixed_precision(); ///< Indicates if the training is in mixed precision
+
+    static constexpr size_t fused_chunk_size = 16384; ///< The minimum size of a chunk of the fused updaters
+    static constexpr size_t max_overflows    = 10;    ///< The number of consecutive overflows at loss scale 1 before the training is considered diverged
+
+    using shard_network_t = sgd_owning_network<network_t, batch_size / shards, updater_type::SGD>; ///< The network type of a shard
+
     network_t& network;                                                  ///< The Network being trained
     decltype(build_context<full_sgd_context>(network)) full_context; ///< The context
     size_t iteration;                                            ///< The current iteration
 
+    typename sgd_shard_contexts<network_t, shards>::type shard_contexts; ///< The contexts of the shards (data-parallel mode)
+
+    sgd_memory_planner<weight> memory_planner; ///< The planner of the buffers of the contexts (memory_plan mode)
+
+    weight loss_scale;       ///< The current loss scale (mixed precision)
+    size_t loss_scale_steps; ///< The number of steps since the last overflow (mixed precision)
+    size_t overflows;        ///< The number of consecutive overflows at loss scale 1 (mixed precision)
+
+    std::array<std::vector<uint16_t>, layers> stored_outputs; ///< The outputs of the layers, in reduced precision (mixed precision)
+
+    template <size_t... I>
+    static constexpr bool shard_safe(std::index_sequence<I...> /*seq*/) {
+        return (sgd_shard_safe<typename network_t::template layer_type<I>>::value && ...);
+    }
+
+    static_assert(!data_parallel || shard_safe(std::make_index_sequence<layers>()),
+                  "parallel_shards does not support layers with training state (batch normalization, dropout, recurrent)");
+
+    static_assert(checkpoint == 1 || shard_safe(std::make_index_sequence<layers>()),
+                  "checkpoint does not support layers with training state (batch normalization, dropout, recurrent)");
+
+    static_assert(!mixed || (!data_parallel && checkpoint == 1), "mixed_precision does not support parallel_shards nor checkpoint");
+    static_assert(!mixed || memory_plan, "mixed_precision needs memory_plan to reuse the memory of the stored outputs");
+
     // Transform layers need to inherit dimensions from back
 
     /*!
@@ -519,10 +659,35 @@ struct sgd_trainer {
      * \brief construct a new sgd_trainer
      * \param network The Network being trained
      */
-    explicit sgd_trainer(network_t& network) : network(network), full_context(build_context<full_sgd_context>(network)), iteration(1) {
+    explicit sgd_trainer(network_t& network)
+            : network(network), full_context(build_context<full_sgd_context>(network)), iteration(1), loss_scale(network.loss_scale), loss_scale_steps(0), overflows(0) {
+        // Bind the planned buffers before anything reads them
+
+        if constexpr (memory_plan) {
+            memory_planner.plan(full_context, checkpoint, mixed);
+        }
+
         // Inherit dimensions from front to end (for transform layers)
 
-        cpp::for_each_pair(full_context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
+        inherit_contexts(full_context);
+
+        // Prepare one replica of the context for each shard
+
+        if constexpr (data_parallel) {
+            for (size_t s = 0; s < shards; ++s) {
+                shard_contexts.push_back(build_shard_context<full_sgd_context, shard_network_t>(network));
+
+                inherit_contexts(shard_contexts.back());
+            }
+        }
+    }
+
+    /*!
+     * \brief Inherit the dimensions of the transform layers from front to end
+     */
+    template <typename Contexts>
+    static void inherit_contexts(Contexts& contexts) {
+        cpp::for_each_pair(contexts, [](auto& layer_ctx_1, auto& layer_ctx_2) {
             constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
 
             if (l2_transform) {
@@ -541,9 +706,9 @@ struct sgd_trainer {
     /*!
      * \brief Compute the errors of the last layer given the loss function
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto & last_ctx = *std::get<layers - 1>(full_context).second;
+    template<loss_function F, typename Contexts, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
+    static void last_errors(Contexts& contexts, bool full_batch, size_t n, const Labels& labels){
+        auto & last_ctx = *std::get<layers - 1>(contexts).second;
 
         if (cpp_unlikely(!full_batch)) {
             last_ctx.errors = 0;
@@ -563,10 +728,10 @@ struct sgd_trainer {
     /*!
      * \brief Compute the errors of the last layer given the loss function
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto & last_layer = std::get<layers - 1>(full_context).first;
-        auto & last_ctx   = *std::get<layers - 1>(full_context).second;
+    template<loss_function F, typename Contexts, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
+    static void last_errors(Contexts& contexts, bool full_batch, size_t n, const Labels& labels){
+        auto & last_layer = std::get<layers - 1>(contexts).first;
+        auto & last_ctx   = *std::get<layers - 1>(contexts).second;
 
         if (cpp_unlikely(!full_batch)) {
             last_ctx.errors = 0;
@@ -585,10 +750,10 @@ struct sgd_trainer {
     /*!
      * \brief Compute the errors of the last layer given the loss function
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto & last_layer = std::get<layers - 1>(full_context).first;
-        auto & last_ctx   = *std::get<layers - 1>(full_context).second;
+    template<loss_function F, typename Contexts, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
+    static void last_errors(Contexts& contexts, bool full_batch, size_t n, const Labels& labels){
+        auto & last_layer = std::get<layers - 1>(contexts).first;
+        auto & last_ctx   = *std::get<layers - 1>(contexts).second;
 
         // Avoid Nan from division by ((1 - out) * out)
         auto out = etl::force_temporary(etl::clip(last_ctx.output, 0.001, 0.999));
@@ -624,13 +789,19 @@ struct sgd_trainer {
     std::pair<double, double> train_batch([[maybe_unused]] size_t epoch, const Inputs& inputs, const Labels& labels) {
         dll::auto_timer timer("sgd::train_batch");
 
-        auto& first_layer = std::get<0>(full_context).first;
         auto& first_ctx   = *std::get<0>(full_context).second;
         auto& last_ctx    = *std::get<layers - 1>(full_context).second;
 
         const auto n          = etl::dim<0>(inputs);
         const bool full_batch = n == etl::dim<0>(first_ctx.input);
 
+        // Only the full batches are split into shards
+        if constexpr (data_parallel) {
+            if (full_batch) {
+                return train_batch_shards<Error>(inputs, labels);
+            }
+        }
+
         // Ensure that the data batch and the label batch are of the same size
         cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
 
@@ -650,31 +821,53 @@ struct sgd_trainer {
 
             //Compute the errors of the last layer
 
-            last_errors<network_t::loss>(full_batch, n, labels);
-
-            // Backpropagate the error
+            last_errors<network_t::loss>(full_context, full_batch, n, labels);
 
-            bool last = true;
+            // Scale the loss to keep the small errors in the reduced precision
+            if constexpr (mixed) {
+                last_ctx.errors *= loss_scale;
 
-            cpp::for_each_rpair(full_context, [&last](auto& layer_ctx_1, auto& layer_ctx_2) {
-                backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
-            });
+                round_batch(last_ctx.errors);
+            }
 
-            first_layer.adapt_errors(first_ctx);
+            // Backpropagate the error
+            // With planned buffers, the gradients must be computed before
+            // the errors of the layer are reused
+
+            if constexpr (checkpoint > 1) {
+                bool last = true;
+                backward_segment<(layers - 1) / checkpoint>(full_context, last);
+            } else if constexpr (mixed) {
+                backward_batch_stored();
+            } else {
+                backward_batch_helper<memory_plan>(full_context);
+            }
         }
 
         // Compute and apply the gradients
 
+        bool applied = true;
+
         {
             dll::auto_timer timer("sgd::grad");
 
-            cpp::for_each(full_context, [this, n](auto& layer_ctx) {
-                this->apply_gradients_layer(n, layer_ctx.first, *layer_ctx.second);
-            });
+            if constexpr (mixed) {
+                applied = update_weights_scaled(n);
+            } else {
+                cpp::for_each(full_context, [this, n](auto& layer_ctx) {
+                    if constexpr (memory_plan) {
+                        this->update_weights_layer(n, layer_ctx.first, *layer_ctx.second);
+                    } else {
+                        this->apply_gradients_layer(n, layer_ctx.first, *layer_ctx.second);
+                    }
+                });
+            }
         }
 
-        // Update the counter of iterations
-        ++iteration;
+        // Update the counter of iterations, the skipped steps do not count
+        if (applied) {
+            ++iteration;
+        }
 
         // Compute error and loss
 
@@ -689,173 +882,726 @@ struct sgd_trainer {
         }
     }
 
-    template <utility_layer Layer, typename Context>
-    void apply_gradients_layer(size_t n, Layer& layer, Context& context){
-        cpp::for_each(layer.layers, context.sub_contexts, [this, n](auto & sub_layer, auto & sub_context) {
-            this->apply_gradients_layer(n, sub_layer, sub_context);
-        });
-    }
+    /*!
+     * \brief Train a batch of sparse data.
+     *
+     * The first layer, which must be dense, is forwarded and computes its
+     * gradients with sparse-dense products. The other layers are trained
+     * as usual.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of sparse inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <bool Error, typename Labels>
+    std::pair<double, double> train_batch_sparse([[maybe_unused]] size_t epoch, const csr_batch<weight>& inputs, const Labels& labels) {
+        dll::auto_timer timer("sgd::train_batch:sparse");
 
-    template <standard_layer Layer, typename Context>
-    void apply_gradients_layer(size_t n, Layer& layer, Context& context){
-        // Compute the gradients
-        layer.compute_gradients(context);
+        static_assert(decay_layer_traits<typename network_t::template layer_type<0>>::is_standard_dense_layer(),
+                      "Sparse input is only supported with a dense first layer");
+        static_assert(!memory_plan && checkpoint == 1, "Sparse input does not support memory_plan nor checkpoint");
+        static_assert(!mixed, "Sparse input does not support mixed_precision");
+        static_assert(!data_parallel, "Sparse input does not support data_parallel");
 
-        // Apply the gradients
-        this->update_weights<network_traits<network_t>::updater()>(layer, context, n);
-    }
+        auto& first_layer = std::get<0>(full_context).first;
+        auto& first_ctx   = *std::get<0>(full_context).second;
+        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
 
-    template <size_t L, group_layer_c Layer, typename Context, typename Errors>
-    static void backward_layer_group(Layer & layer, Context & context, Errors && errors, bool & last) {
-        auto& sub_layer   = std::get<L>(layer.layers);
-        auto& sub_context = std::get<L>(context.sub_contexts);
+        const auto n          = inputs.rows;
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
 
-        if (!last) {
-            sub_layer.adapt_errors(sub_context);
-        }
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
 
-        last = false;
+        // Ensure that the context can hold the inputs
+        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
 
-        if constexpr (L == 0) {
-            sub_layer.backward_batch(errors, sub_context);
-        } else {
-            auto& prev_sub_context = std::get<L - 1>(context.sub_contexts);
+        //Feedforward pass
 
-            sub_layer.backward_batch(prev_sub_context.errors, sub_context);
+        {
+            dll::auto_timer timer("sgd::forward");
 
-            backward_layer_group<L - 1>(layer, context, errors, last);
+            first_layer.train_forward_batch(first_ctx.output, inputs);
+
+            cpp::for_each_pair(full_context, [this](auto& layer_ctx_1, auto& layer_ctx_2) {
+                this->template forward_layer<true>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
+            });
         }
-    }
 
-    template <group_layer_c Layer, typename Context, typename Errors>
-    static void backward_layer(Layer & layer, Context & context, Errors && errors, bool & last) {
-        backward_layer_group<Layer::n_layers - 1>(layer, context, errors, last);
-    }
+        {
+            dll::auto_timer timer("sgd::backward");
 
-    template <merge_layer_c Layer, typename Context, typename Errors>
-    static void backward_layer(Layer & layer, Context & context, Errors && errors, bool & last) {
-        errors = 0;
+            //Compute the errors of the last layer
 
-        // Dispatch all the sub contexts
+            last_errors<network_t::loss>(full_context, full_batch, n, labels);
 
-        cpp::for_each_i(layer.layers, context.sub_contexts, [&context, &errors, &last](size_t i, auto & sub_layer, auto & sub_context) {
-            batch_dispatch(get_errors(sub_context), context.errors, i);
+            // Backpropagate the error
 
-            auto back_errors = errors;
+            backward_batch_helper(full_context);
+        }
 
-            bool sub_last = last;
-            backward_layer(sub_layer, sub_context, back_errors, sub_last);
+        // Compute and apply the gradients
 
-            errors += back_errors;
-        });
+        {
+            dll::auto_timer timer("sgd::grad");
 
-        last = false;
-    }
+            first_layer.compute_gradients(first_ctx, inputs);
 
-    template <standard_layer Layer, typename Context, typename Errors>
-    static void backward_layer(Layer & layer, Context & context, Errors && errors, bool & last) {
-        if (!last) {
-            layer.adapt_errors(context);
-        }
+            this->update_weights<network_traits<network_t>::updater()>(first_layer, first_ctx, n);
 
-        last = false;
+            cpp::for_each_pair(full_context, [this, n](auto& /*layer_ctx_1*/, auto& layer_ctx_2) {
+                this->apply_gradients_layer(n, layer_ctx_2.first, *layer_ctx_2.second);
+            });
+        }
 
-        layer.backward_batch(errors, context);
-    }
+        // Update the counter of iterations
+        ++iteration;
 
-    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
-    static void forward_layer_group(Layer& layer, Inputs&& inputs, Context& context) {
-        if constexpr (L < Layer::n_layers) {
-            auto& sub_layer   = std::get<L>(layer.layers);
-            auto& sub_context = std::get<L>(context.sub_contexts);
+        // Compute error and loss
 
-            sub_context.input = inputs;
+        if constexpr (Error) {
+            dll::auto_timer timer("sgd::error");
 
-            if constexpr (Train) {
-                sub_layer.train_forward_batch(sub_context.output, sub_context.input);
-            } else {
-                sub_layer.test_forward_batch(sub_context.output, sub_context.input);
-            }
+            auto[error, loss] = network.evaluate_metrics_batch(last_ctx.output, labels, n, true);
 
-            forward_layer_group<Train, L + 1>(layer, sub_context.output, context);
+            return std::make_pair(error, loss);
+        } else {
+            return {0, 0};
         }
     }
 
-    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
-    static void forward_layer_merge(Layer& layer, Inputs&& inputs, Context& context) {
-        if constexpr (L < Layer::n_layers) {
-            auto& sub_layer   = std::get<L>(layer.layers);
-            auto& sub_context = std::get<L>(context.sub_contexts);
+    /*!
+     * \brief Train a full batch of data split into shards trained in parallel.
+     *
+     * Each shard is forwarded and backpropagated in its own context, the
+     * gradients of the shards are then summed into the main context before
+     * being applied.
+     *
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <bool Error, typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_shards(const Inputs& inputs, const Labels& labels) {
+        auto& last_ctx = *std::get<layers - 1>(full_context).second;
 
-            forward_layer<Train>(sub_layer, inputs, sub_context);
+        const auto n = etl::dim<0>(inputs);
 
-            forward_layer_merge<Train, L + 1>(layer, inputs, context);
-        }
-    }
+        constexpr size_t shard_size = shard_network_t::batch_size;
 
-    template <bool Train, group_layer_c Layer, typename Inputs, typename Context>
-    static void forward_layer(Layer & layer, Inputs && inputs, Context & context) {
-        forward_layer_group<Train, 0>(layer, inputs, context);
-    }
+        {
+            dll::auto_timer timer("sgd::shards");
 
-    template <bool Train, merge_layer_c Layer, typename Inputs, typename Context>
-    static void forward_layer(Layer & layer, Inputs && inputs, Context & context) {
-        context.input = inputs;
+            auto& pool = network.get_pool();
 
-        // Fully forward each group
+            for (size_t s = 0; s < shards; ++s) {
+                pool.do_task([this, s, &inputs, &labels]() {
+                    auto& contexts = shard_contexts[s];
 
-        forward_layer_merge<Train, 0>(layer, context.input, context);
+                    auto shard_inputs = etl::slice(inputs, s * shard_size, (s + 1) * shard_size);
+                    auto shard_labels = etl::slice(labels, s * shard_size, (s + 1) * shard_size);
 
-        // Concatenate all the sub contexts
+                    // The parallelism is done at the shard level
+                    SERIAL_SECTION {
+                        this->template forward_batch_helper<true>(contexts, shard_inputs);
 
-        cpp::for_each_i(context.sub_contexts, [&context](size_t i, auto & sub_context) { batch_merge(context.output, get_output(sub_context), i); });
-    }
+                        last_errors<network_t::loss>(contexts, true, shard_size, shard_labels);
 
-    template <bool Train, standard_layer Layer, typename Inputs, typename Context>
-    static void forward_layer(Layer & layer, Inputs && inputs, Context & context) {
-        context.input = inputs;
+                        backward_batch_helper(contexts);
 
-        if constexpr (Train) {
-            layer.train_forward_batch(context.output, context.input);
-        } else {
-            layer.test_forward_batch(context.output, context.input);
-        }
-    }
+                        cpp::for_each(contexts, [](auto& layer_ctx) {
+                            compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+                        });
+                    }
+                });
+            }
 
-    template <typename Context>
-    static auto& get_output(Context& context) {
-        if constexpr (group_layer_c<typename Context::layer_t>) {
-            return get_output(std::get<Context::n_layers - 1>(context.sub_contexts));
-        } else {
-            return context.output;
+            pool.wait();
         }
-    }
 
-    template <typename Context>
-    static auto& get_errors(Context& context) {
-        if constexpr (group_layer_c< typename Context::layer_t>) {
-            return get_errors(std::get<Context::n_layers - 1>(context.sub_contexts));
-        } else {
-            return context.errors;
-        }
-    }
+        {
+            dll::auto_timer timer("sgd::grad");
 
-    //TODO
-    template <bool Train, typename Inputs>
-    auto& forward_batch_helper([[maybe_unused]] network_t& network, Inputs&& inputs) {
-        return this->template forward_batch_helper<Train>(inputs);
-    }
+            // Sum the gradients of the shards into the main context
 
-    template <bool Train, typename Inputs>
-    auto& forward_batch_helper(Inputs&& inputs) {
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+            for (size_t s = 0; s < shards; ++s) {
+                cpp::for_each(full_context, shard_contexts[s], [s](auto& layer_ctx, auto& shard_layer_ctx) {
+                    reduce_gradients(*layer_ctx.second, *shard_layer_ctx.second, s == 0);
+                });
 
-        const auto n          = etl::dim<0>(inputs);
-        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+                // Gather the output for the computation of the error
+                if constexpr (Error) {
+                    auto& shard_last_ctx = *std::get<layers - 1>(shard_contexts[s]).second;
 
-        // Ensure that the context can hold the inputs
+                    etl::slice(last_ctx.output, s * shard_size, (s + 1) * shard_size) = shard_last_ctx.output;
+                }
+            }
+
+            cpp::for_each(full_context, [this, n](auto& layer_ctx) {
+                this->update_weights_layer(n, layer_ctx.first, *layer_ctx.second);
+            });
+        }
+
+        // Update the counter of iterations
+        ++iteration;
+
+        // Compute error and loss
+
+        if constexpr (Error) {
+            dll::auto_timer timer("sgd::error");
+
+            auto[error, loss] = network.evaluate_metrics_batch(last_ctx.output, labels, n, true);
+
+            return std::make_pair(error, loss);
+        } else {
+            return {0, 0};
+        }
+    }
+
+    /*!
+     * \brief Sum the gradients of one shard context into the given context
+     * \param context The context receiving the gradients
+     * \param shard_context The context of the shard
+     * \param first Indicates if this is the first shard (gradients are overwritten)
+     */
+    template <typename Context, typename ShardContext>
+    static void reduce_gradients(Context& context, ShardContext& shard_context, bool first) {
+        using layer_t = typename Context::layer_t;
+
+        if constexpr (utility_layer<layer_t>) {
+            cpp::for_each(context.sub_contexts, shard_context.sub_contexts, [first](auto& sub_context, auto& shard_sub_context) {
+                reduce_gradients(sub_context, shard_sub_context, first);
+            });
+        } else if constexpr (decay_layer_traits<layer_t>::is_neural_layer()) {
+            cpp::for_each(context.up.context, shard_context.up.context, [first](auto& sub, auto& shard_sub) {
+                if (first) {
+                    sub->grad = shard_sub->grad;
+                } else {
+                    sub->grad += shard_sub->grad;
+                }
+            });
+
+            // The used rows of the lazy gradients are the union of the rows of the shards
+            if constexpr (lazy_layer<layer_t>) {
+                if (first) {
+                    context.rows.clear();
+                }
+
+                context.rows.insert(context.rows.end(), shard_context.rows.begin(), shard_context.rows.end());
+
+                std::sort(context.rows.begin(), context.rows.end());
+                context.rows.erase(std::unique(context.rows.begin(), context.rows.end()), context.rows.end());
+            }
+        }
+    }
+
+    /*!
+     * \brief Round a batch of activations or errors to the precision of the
+     * training (mixed precision)
+     */
+    template <typename E>
+    static void round_batch(E& batch) {
+        if constexpr (mixed) {
+            batch.ensure_cpu_up_to_date();
+
+            round_precision<precision>(batch.memory_start(), etl::size(batch));
+
+            batch.invalidate_gpu();
+        }
+    }
+
+    /*!
+     * \brief Indicates if the training diverged, the gradients overflowing
+     * even without loss scaling (mixed precision)
+     */
+    bool diverged() const noexcept {
+        return overflows >= max_overflows;
+    }
+
+    /*!
+     * \brief Indicates if the output of the given context is planned, and
+     * can therefore be stored in reduced precision between the passes
+     */
+    template <typename Context>
+    static constexpr bool stored_output() {
+        if constexpr (requires(Context& context) { context.output; }) {
+            return is_sgd_view<std::decay_t<decltype(std::declval<Context&>().output)>>;
+        } else {
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Store the output of the layer l in the precision of the training,
+     * after its forward pass (mixed precision).
+     *
+     * The output is rounded in place for the forward pass of the next
+     * layer. The planned outputs are stored in reduced precision, their
+     * memory is reused until they are loaded back for the backward pass.
+     * The output of the last layer is not stored, it is kept for the
+     * metrics of the batch.
+     */
+    template <typename Context>
+    void store_output([[maybe_unused]] size_t l, [[maybe_unused]] Context& context) {
+        if constexpr (mixed) {
+            if constexpr (stored_output<Context>()) {
+                if (l < layers - 1) {
+                    auto& output = context.output;
+                    auto& stored = stored_outputs[l];
+
+                    output.ensure_cpu_up_to_date();
+
+                    stored.resize(etl::size(output));
+                    store_precision<precision>(output.memory_start(), stored.data(), etl::size(output));
+
+                    output.invalidate_gpu();
+
+                    return;
+                }
+            }
+
+            round_batch(get_output(context));
+        }
+    }
+
+    /*!
+     * \brief Load back the stored output of the layer l, before the backward
+     * pass of the next layer (mixed precision)
+     */
+    template <typename Context>
+    void load_output([[maybe_unused]] size_t l, [[maybe_unused]] Context& context) {
+        if constexpr (mixed && stored_output<Context>()) {
+            if (l < layers - 1) {
+                auto& output = context.output;
+                auto& stored = stored_outputs[l];
+
+                load_precision<precision>(stored.data(), output.memory_start(), stored.size());
+
+                output.invalidate_gpu();
+            }
+        }
+    }
+
+    /*!
+     * \brief Divide the gradients of one context by the loss scale
+     * \param context The context of the layer
+     * \return true if all the gradients are finite
+     */
+    template <typename Context>
+    bool unscale_gradients(Context& context) const {
+        using layer_t = typename Context::layer_t;
+
+        bool finite = true;
+
+        if constexpr (utility_layer<layer_t>) {
+            cpp::for_each(context.sub_contexts, [this, &finite](auto& sub_context) {
+                finite &= this->unscale_gradients(sub_context);
+            });
+        } else if constexpr (decay_layer_traits<layer_t>::is_neural_layer()) {
+            const weight inv = weight(1) / loss_scale;
+
+            cpp::for_each(context.up.context, [inv, &finite](auto& sub) {
+                auto& grad = sub->grad;
+
+                grad.ensure_cpu_up_to_date();
+
+                auto* g = grad.memory_start();
+
+                for (size_t i = 0; i < etl::size(grad); ++i) {
+                    g[i] *= inv;
+                    finite &= std::isfinite(g[i]);
+                }
+
+                grad.invalidate_gpu();
+            });
+        }
+
+        return finite;
+    }
+
+    /*!
+     * \brief Compute the gradients scaled by the loss scale and apply them,
+     * unless they overflowed (mixed precision).
+     *
+     * The loss scale is halved at each overflow and doubled after
+     * loss_scale_window steps without overflow. After max_overflows
+     * consecutive overflows at loss scale 1, the training has diverged.
+     *
+     * \param n The number of samples in the batch
+     * \return true if the gradients have been applied, false if the step has been skipped
+     */
+    bool update_weights_scaled(size_t n) {
+        // With planned buffers, the gradients are computed during the backward pass
+        if constexpr (!memory_plan) {
+            cpp::for_each(full_context, [](auto& layer_ctx) {
+                compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+            });
+        }
+
+        bool finite = true;
+
+        cpp::for_each(full_context, [this, &finite](auto& layer_ctx) {
+            finite &= this->unscale_gradients(*layer_ctx.second);
+        });
+
+        if (!finite) {
+            // At loss scale 1, the overflow does not come from the scaling
+            if (loss_scale <= weight(1) && ++overflows == max_overflows) {
+                std::cerr << "dll: The gradients overflow at loss scale 1, the training diverged" << std::endl;
+            }
+
+            loss_scale       = std::max(loss_scale / weight(2), weight(1));
+            loss_scale_steps = 0;
+
+            return false;
+        }
+
+        overflows = 0;
+
+        cpp::for_each(full_context, [this, n](auto& layer_ctx) {
+            this->update_weights_layer(n, layer_ctx.first, *layer_ctx.second);
+        });
+
+        if (++loss_scale_steps >= network.loss_scale_window) {
+            loss_scale *= weight(2);
+            loss_scale_steps = 0;
+        }
+
+        return true;
+    }
+
+    template <utility_layer Layer, typename Context>
+    static void compute_gradients_layer(Layer& layer, Context& context){
+        cpp::for_each(layer.layers, context.sub_contexts, [](auto & sub_layer, auto & sub_context) {
+            compute_gradients_layer(sub_layer, sub_context);
+        });
+    }
+
+    template <standard_layer Layer, typename Context>
+    static void compute_gradients_layer(Layer& layer, Context& context){
+        layer.compute_gradients(context);
+    }
+
+    template <utility_layer Layer, typename Context>
+    void update_weights_layer(size_t n, Layer& layer, Context& context){
+        cpp::for_each(layer.layers, context.sub_contexts, [this, n](auto & sub_layer, auto & sub_context) {
+            this->update_weights_layer(n, sub_layer, sub_context);
+        });
+    }
+
+    template <standard_layer Layer, typename Context>
+    void update_weights_layer(size_t n, Layer& layer, Context& context){
+        this->update_weights<network_traits<network_t>::updater()>(layer, context, n);
+    }
+
+    template <utility_layer Layer, typename Context>
+    void apply_gradients_layer(size_t n, Layer& layer, Context& context){
+        cpp::for_each(layer.layers, context.sub_contexts, [this, n](auto & sub_layer, auto & sub_context) {
+            this->apply_gradients_layer(n, sub_layer, sub_context);
+        });
+    }
+
+    template <standard_layer Layer, typename Context>
+    void apply_gradients_layer(size_t n, Layer& layer, Context& context){
+        // Compute the gradients
+        layer.compute_gradients(context);
+
+        // Apply the gradients
+        this->update_weights<network_traits<network_t>::updater()>(layer, context, n);
+    }
+
+    template <size_t L, group_layer_c Layer, typename Context, typename Errors>
+    static void backward_layer_group(Layer & layer, Context & context, Errors && errors, bool & last) {
+        auto& sub_layer   = std::get<L>(layer.layers);
+        auto& sub_context = std::get<L>(context.sub_contexts);
+
+        if (!last) {
+            sub_layer.adapt_errors(sub_context);
+        }
+
+        last = false;
+
+        if constexpr (L == 0) {
+            sub_layer.backward_batch(errors, sub_context);
+        } else {
+            auto& prev_sub_context = std::get<L - 1>(context.sub_contexts);
+
+            sub_layer.backward_batch(prev_sub_context.errors, sub_context);
+
+            backward_layer_group<L - 1>(layer, context, errors, last);
+        }
+    }
+
+    template <group_layer_c Layer, typename Context, typename Errors>
+    static void backward_layer(Layer & layer, Context & context, Errors && errors, bool & last) {
+        backward_layer_group<Layer::n_layers - 1>(layer, context, errors, last);
+    }
+
+    template <merge_layer_c Layer, typename Context, typename Errors>
+    static void backward_layer(Layer & layer, Context & context, Errors && errors, bool & last) {
+        errors = 0;
+
+        // Dispatch all the sub contexts
+
+        cpp::for_each_i(layer.layers, context.sub_contexts, [&context, &errors, &last](size_t i, auto & sub_layer, auto & sub_context) {
+            batch_dispatch(get_errors(sub_context), context.errors, i);
+
+            auto back_errors = errors;
+
+            bool sub_last = last;
+            backward_layer(sub_layer, sub_context, back_errors, sub_last);
+
+            errors += back_errors;
+        });
+
+        last = false;
+    }
+
+    template <standard_layer Layer, typename Context, typename Errors>
+    static void backward_layer(Layer & layer, Context & context, Errors && errors, bool & last) {
+        if (!last) {
+            layer.adapt_errors(context);
+        }
+
+        last = false;
+
+        layer.backward_batch(errors, context);
+    }
+
+    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
+    static void forward_layer_group(Layer& layer, Inputs&& inputs, Context& context) {
+        if constexpr (L < Layer::n_layers) {
+            auto& sub_layer   = std::get<L>(layer.layers);
+            auto& sub_context = std::get<L>(context.sub_contexts);
+
+            sub_context.input = inputs;
+
+            if constexpr (Train) {
+                sub_layer.train_forward_batch(sub_context.output, sub_context.input);
+            } else {
+                sub_layer.test_forward_batch(sub_context.output, sub_context.input);
+            }
+
+            forward_layer_group<Train, L + 1>(layer, sub_context.output, context);
+        }
+    }
+
+    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
+    static void forward_layer_merge(Layer& layer, Inputs&& inputs, Context& context) {
+        if constexpr (L < Layer::n_layers) {
+            auto& sub_layer   = std::get<L>(layer.layers);
+            auto& sub_context = std::get<L>(context.sub_contexts);
+
+            forward_layer<Train>(sub_layer, inputs, sub_context);
+
+            forward_layer_merge<Train, L + 1>(layer, inputs, context);
+        }
+    }
+
+    template <bool Train, group_layer_c Layer, typename Inputs, typename Context>
+    static void forward_layer(Layer & layer, Inputs && inputs, Context & context) {
+        forward_layer_group<Train, 0>(layer, inputs, context);
+    }
+
+    template <bool Train, merge_layer_c Layer, typename Inputs, typename Context>
+    static void forward_layer(Layer & layer, Inputs && inputs, Context & context) {
+        context.input = inputs;
+
+        // Fully forward each group
+
+        forward_layer_merge<Train, 0>(layer, context.input, context);
+
+        // Concatenate all the sub contexts
+
+        cpp::for_each_i(context.sub_contexts, [&context](size_t i, auto & sub_context) { batch_merge(context.output, get_output(sub_context), i); });
+    }
+
+    template <bool Train, standard_layer Layer, typename Inputs, typename Context>
+    static void forward_layer(Layer & layer, Inputs && inputs, Context & context) {
+        // With planned buffers, the input may already be the previous output
+        if (!sgd_same_memory(context.input, inputs)) {
+            context.input = inputs;
+        }
+
+        if constexpr (Train) {
+            layer.train_forward_batch(context.output, context.input);
+        } else {
+            layer.test_forward_batch(context.output, context.input);
+        }
+    }
+
+    template <typename Context>
+    static auto& get_output(Context& context) {
+        if constexpr (group_layer_c<typename Context::layer_t>) {
+            return get_output(std::get<Context::n_layers - 1>(context.sub_contexts));
+        } else {
+            return context.output;
+        }
+    }
+
+    template <typename Context>
+    static auto& get_errors(Context& context) {
+        if constexpr (group_layer_c< typename Context::layer_t>) {
+            return get_errors(std::get<Context::n_layers - 1>(context.sub_contexts));
+        } else {
+            return context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer through the given contexts
+     * \tparam Gradients Compute the gradients of each layer right after its backward pass
+     * \param contexts The contexts of the layers
+     */
+    template <bool Gradients = false, typename Contexts>
+    static void backward_batch_helper(Contexts& contexts) {
+        auto& first_layer = std::get<0>(contexts).first;
+        auto& first_ctx   = *std::get<0>(contexts).second;
+
+        bool last = true;
+
+        cpp::for_each_rpair(contexts, [&last](auto& layer_ctx_1, auto& layer_ctx_2) {
+            backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+
+            round_batch(get_errors(*layer_ctx_1.second));
+
+            if constexpr (Gradients) {
+                compute_gradients_layer(layer_ctx_2.first, *layer_ctx_2.second);
+            }
+        });
+
+        first_layer.adapt_errors(first_ctx);
+
+        if constexpr (Gradients) {
+            compute_gradients_layer(first_layer, first_ctx);
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer and compute the
+     * gradients of each layer right after its backward pass, loading back
+     * each stored output just before the backward pass of the next layer
+     * (mixed precision).
+     */
+    void backward_batch_stored() {
+        auto& first_layer = std::get<0>(full_context).first;
+        auto& first_ctx   = *std::get<0>(full_context).second;
+
+        bool last = true;
+        size_t l  = layers - 1;
+
+        cpp::for_each_rpair(full_context, [this, &last, &l](auto& layer_ctx_1, auto& layer_ctx_2) {
+            this->load_output(--l, *layer_ctx_1.second);
+
+            backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+
+            round_batch(get_errors(*layer_ctx_1.second));
+
+            compute_gradients_layer(layer_ctx_2.first, *layer_ctx_2.second);
+        });
+
+        first_layer.adapt_errors(first_ctx);
+
+        compute_gradients_layer(first_layer, first_ctx);
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the checkpointing segment S
+     * and then through the previous segments.
+     *
+     * The activations of the segment, except its output, are first
+     * recomputed from its input. The gradients of each layer are computed
+     * right after its backward pass.
+     *
+     * \param contexts The contexts of the layers
+     * \param last Indicates if the last layer of the network has not been backpropagated yet
+     */
+    template <size_t S, typename Contexts>
+    static void backward_segment(Contexts& contexts, bool& last) {
+        constexpr size_t first = S * checkpoint;
+        constexpr size_t end   = std::min(first + checkpoint, layers) - 1;
+
+        {
+            dll::auto_timer timer("sgd::recompute");
+
+            recompute_layer<first, end>(contexts);
+        }
+
+        backward_segment_layer<end, first>(contexts, last);
+
+        if constexpr (S > 0) {
+            backward_segment<S - 1>(contexts, last);
+        }
+    }
+
+    /*!
+     * \brief Recompute the forward activations of the layers [L, E[
+     *
+     * Only the planned outputs need to be recomputed, the other buffers
+     * are never reused.
+     */
+    template <size_t L, size_t E, typename Contexts>
+    static void recompute_layer(Contexts& contexts) {
+        if constexpr (L < E) {
+            auto& [layer, context] = std::get<L>(contexts);
+
+            if constexpr (requires { context->output; }) {
+                if constexpr (is_sgd_view<std::decay_t<decltype(context->output)>>) {
+                    if constexpr (L == 0) {
+                        layer.train_forward_batch(context->output, context->input);
+                    } else {
+                        forward_layer<true>(layer, get_output(*std::get<L - 1>(contexts).second), *context);
+                    }
+                }
+            }
+
+            recompute_layer<L + 1, E>(contexts);
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the layers [F, L] and
+     * compute their gradients
+     */
+    template <size_t L, size_t F, typename Contexts>
+    static void backward_segment_layer(Contexts& contexts, bool& last) {
+        auto& [layer, context] = std::get<L>(contexts);
+
+        if constexpr (L == 0) {
+            layer.adapt_errors(*context);
+        } else {
+            backward_layer(layer, *context, get_errors(*std::get<L - 1>(contexts).second), last);
+        }
+
+        compute_gradients_layer(layer, *context);
+
+        if constexpr (L > F) {
+            backward_segment_layer<L - 1, F>(contexts, last);
+        }
+    }
+
+    //TODO
+    template <bool Train, typename Inputs>
+    auto& forward_batch_helper([[maybe_unused]] network_t& network, Inputs&& inputs) {
+        return this->template forward_batch_helper<Train>(inputs);
+    }
+
+    template <bool Train, typename Inputs>
+    auto& forward_batch_helper(Inputs&& inputs) {
+        return this->template forward_batch_helper<Train>(full_context, inputs);
+    }
+
+    template <bool Train, typename Contexts, typename Inputs>
+    auto& forward_batch_helper(Contexts& contexts, Inputs&& inputs) {
+        auto& first_layer = std::get<0>(contexts).first;
+        auto& first_ctx   = *std::get<0>(contexts).second;
+        auto& last_ctx    = *std::get<layers - 1>(contexts).second;
+
+        const auto n          = etl::dim<0>(inputs);
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        // Ensure that the context can hold the inputs
         cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
 
         if (cpp_unlikely(!full_batch)) {
@@ -871,12 +1617,20 @@ struct sgd_trainer {
 
         if constexpr (Train) {
             first_layer.train_forward_batch(first_ctx.output, first_ctx.input);
+
+            store_output(0, first_ctx);
         } else {
             first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
         }
 
-        cpp::for_each_pair(full_context, [this](auto& layer_ctx_1, auto& layer_ctx_2) {
+        size_t l = 1;
+
+        cpp::for_each_pair(contexts, [this, &l](auto& layer_ctx_1, auto& layer_ctx_2) {
             this->template forward_layer<Train>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
+
+            if constexpr (Train) {
+                this->store_output(l++, *layer_ctx_2.second);
+            }
         });
 
         return last_ctx.output;
@@ -914,6 +1668,18 @@ struct sgd_trainer {
             eps *= 1.0 / (1.0 + eps_decay * iteration);
         }
 
+        // The layers with lazy gradients only update the rows used by the batch
+        if constexpr (I == 0 && lazy_layer<L>) {
+            update_variable_lazy<UT>(layer, context, n, eps);
+            return;
+        }
+
+        // The fused updaters decay, clip and apply the gradients in one pass
+        if constexpr (fused_updater(UT)) {
+            apply_gradients_fused<I, UT>(layer, context, n, eps);
+            return;
+        }
+
         //2. Update the gradients (L1/L2 and gradient clipping)
 
         auto& w      = std::get<I>(layer.trainable_parameters());
@@ -931,6 +1697,264 @@ struct sgd_trainer {
         apply_gradients<I, UT>(layer, context, n, eps);
     }
 
+    /*!
+     * \brief Indicates if the given updater has a fused kernel
+     */
+    static constexpr bool fused_updater(updater_type UT) {
+        return UT == updater_type::ADAM || UT == updater_type::ADAM_CORRECT || UT == updater_type::NADAM || UT == updater_type::RMSPROP;
+    }
+
+    /*!
+     * \brief Returns the number of chunks a parameter tensor of the given
+     * size is split into for the fused updaters.
+     */
+    static size_t fused_chunks(size_t size) {
+        if constexpr (network_traits<network_t>::is_serial()) {
+            return 1;
+        } else {
+            return std::max<size_t>(1, std::min<size_t>(etl::threads, size / fused_chunk_size));
+        }
+    }
+
+    /*!
+     * \brief Call the functor on each of the chunks of a parameter tensor,
+     * in parallel on the thread pool of the network.
+     *
+     * \param size The size of the tensor
+     * \param chunks The number of chunks, from fused_chunks
+     * \param functor The functor, called with the chunk index and its range
+     */
+    template <typename Functor>
+    void parallel_chunks(size_t size, size_t chunks, Functor&& functor) {
+        if (chunks == 1) {
+            functor(0, 0, size);
+            return;
+        }
+
+        if constexpr (!network_traits<network_t>::is_serial()) {
+            // Multiples of 16 keep the chunks aligned for the vectorized kernels
+            const size_t chunk = ((size + chunks - 1) / chunks + 15) & ~size_t(15);
+
+            auto& pool = network.get_pool();
+
+            for (size_t c = 0; c < chunks; ++c) {
+                const size_t first = std::min(size, c * chunk);
+                const size_t last  = std::min(size, first + chunk);
+
+                pool.do_task([&functor, c, first, last]() {
+                    functor(c, first, last);
+                });
+            }
+
+            pool.wait();
+        }
+    }
+
+    /*!
+     * \brief Apply the gradients to the given layer with the fused kernel of
+     * the updater.
+     *
+     * The weight decay and the clipping are applied on the fly, the gradients
+     * are not modified. The clipping needs the norm of all the gradients and
+     * therefore one reduction pass before the update.
+     */
+    template <size_t I, updater_type UT, typename L, typename C>
+    void apply_gradients_fused(L& layer, C& context, size_t n, weight eps) {
+        dll::auto_timer timer(UT == updater_type::ADAM           ? "sgd::apply_grad:adam"
+                              : UT == updater_type::ADAM_CORRECT ? "sgd::apply_grad:adam_correct"
+                              : UT == updater_type::NADAM        ? "sgd::apply_grad:nadam"
+                                                                 : "sgd::apply_grad:rmsprop");
+
+        auto& w   = std::get<I>(layer.trainable_parameters());
+        auto& sub = *std::get<I>(context.up.context);
+
+        // Note the distinction for w and b for decay is far from optimal...
+        constexpr auto decay = I == 0 ? w_decay(network_traits<network_t>::decay()) : b_decay(network_traits<network_t>::decay());
+
+        grad_transform<weight> transform;
+
+        if constexpr (decay == decay_type::L1 || decay == decay_type::L1L2) {
+            transform.l1 = network.l1_weight_cost;
+        }
+
+        if constexpr (decay == decay_type::L2 || decay == decay_type::L1L2) {
+            transform.l2 = network.l2_weight_cost;
+        }
+
+        w.ensure_cpu_up_to_date();
+        sub.grad.ensure_cpu_up_to_date();
+
+        const size_t size   = etl::size(w);
+        const size_t chunks = fused_chunks(size);
+
+        weight* W       = w.memory_start();
+        const weight* G = sub.grad.memory_start();
+
+        if constexpr (network_traits<network_t>::has_clip_gradients()) {
+            std::vector<double> sums(chunks);
+
+            parallel_chunks(size, chunks, [&](size_t c, size_t first, size_t last) {
+                sums[c] = fused_squared_norm(W + first, G + first, last - first, transform);
+            });
+
+            double sum = 0.0;
+            for (auto partial : sums) {
+                sum += partial;
+            }
+
+            const auto t            = network.gradient_clip;
+            const auto grad_l2_norm = std::sqrt(sum / (n * n));
+
+            if (grad_l2_norm > t) {
+                transform.scale = t / grad_l2_norm;
+            }
+        }
+
+        const weight e = 1e-8;
+
+        if constexpr (UT == updater_type::RMSPROP) {
+            const weight decay_rate = network.rmsprop_decay;
+
+            sub.inc.ensure_cpu_up_to_date();
+
+            weight* INC = sub.inc.memory_start();
+
+            parallel_chunks(size, chunks, [&](size_t /*c*/, size_t first, size_t last) {
+                fused_rmsprop(W + first, G + first, INC + first, last - first, transform, decay_rate, eps, e);
+            });
+
+            sub.inc.invalidate_gpu();
+        } else {
+            const weight beta1 = network.adam_beta1;
+            const weight beta2 = network.adam_beta2;
+            const weight t     = iteration;
+
+            // The coefficients of w += (m1 * g + m2 * m) / (sqrt(c2 * v) + e)
+            weight m1 = 0;
+            weight m2 = eps;
+            weight c2 = 1;
+
+            // ADAM_CORRECT updates with the uncorrected moments, like its
+            // previous kernel which computed the corrected estimates but did
+            // not use them in the update
+
+            if constexpr (UT == updater_type::NADAM) {
+                const weight schedule_decay = network.nadam_schedule_decay;
+
+                auto& m_schedule = sub.m_schedule;
+
+                // Compute the schedule for momentum
+
+                weight momentum_cache_t   = beta1 * (1.0 - 0.5 * (std::pow(0.96, t * schedule_decay)));
+                weight momentum_cache_t_1 = beta1 * (1.0 - 0.5 * (std::pow(0.96, (t + 1) * schedule_decay)));
+
+                weight m_schedule_new  = m_schedule * momentum_cache_t;
+                weight m_schedule_next = m_schedule * momentum_cache_t * momentum_cache_t_1;
+
+                if constexpr (I == 0) {
+                    m_schedule = m_schedule_new;
+                }
+
+                // The bias correction is folded into the coefficients
+                m1 = eps * ((weight(1) - momentum_cache_t) / (weight(1) - m_schedule_new));
+                m2 = eps * momentum_cache_t_1 / (weight(1) - m_schedule_next);
+                c2 = weight(1) / (weight(1) - std::pow(beta2, t));
+            }
+
+            sub.m.ensure_cpu_up_to_date();
+            sub.v.ensure_cpu_up_to_date();
+
+            weight* M = sub.m.memory_start();
+            weight* V = sub.v.memory_start();
+
+            parallel_chunks(size, chunks, [&](size_t /*c*/, size_t first, size_t last) {
+                fused_adam(W + first, G + first, M + first, V + first, last - first, transform, beta1, beta2, m1, m2, c2, e);
+            });
+
+            sub.m.invalidate_gpu();
+            sub.v.invalidate_gpu();
+        }
+
+        w.invalidate_gpu();
+
+        nan_check_deep(w);
+    }
+
+    /*!
+     * \brief Update the weights of a layer with lazy gradients, only on the
+     * rows used by the batch.
+     */
+    template <updater_type UT, typename L, typename C>
+    void update_variable_lazy(L& layer, C& context, size_t n, weight eps) {
+        dll::auto_timer timer("sgd::apply_grad:lazy");
+
+        static_assert(UT == updater_type::SGD || UT == updater_type::ADAGRAD || UT == updater_type::ADAM,
+                      "Lazy gradients are only supported with the SGD, Adagrad and Adam updaters");
+
+        auto& w      = std::get<0>(layer.trainable_parameters());
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        // Decay the gradients of the used rows, the other rows have no gradients
+
+        for (auto row : context.rows) {
+            auto row_grad = w_grad(row);
+
+            this->decay_grad<w_decay(network_traits<network_t>::decay())>(w(row), row_grad);
+        }
+
+        // Clip the gradients, the norm only depends on the used rows
+
+        if constexpr (network_traits<network_t>::has_clip_gradients()) {
+            const auto t = network.gradient_clip;
+
+            weight sum = 0;
+
+            for (auto row : context.rows) {
+                sum += etl::sum(w_grad(row) >> w_grad(row));
+            }
+
+            const auto grad_l2_norm = std::sqrt(sum / (n * n));
+
+            if (grad_l2_norm > t) {
+                for (auto row : context.rows) {
+                    w_grad(row) = w_grad(row) >> (t / grad_l2_norm);
+                }
+            }
+        }
+
+        // Apply the gradients of the used rows
+
+        const auto e = 1e-8;
+
+        for (auto row : context.rows) {
+            auto row_w    = w(row);
+            auto row_grad = w_grad(row);
+
+            if constexpr (UT == updater_type::SGD) {
+                row_w += (eps / n) * row_grad;
+            } else if constexpr (UT == updater_type::ADAGRAD) {
+                auto row_inc = std::get<0>(context.up.context)->inc(row);
+
+                row_inc = row_inc + (row_grad >> row_grad);
+
+                row_w += (eps * row_grad) / etl::sqrt(row_inc + e);
+            } else if constexpr (UT == updater_type::ADAM) {
+                const auto beta1 = network.adam_beta1;
+                const auto beta2 = network.adam_beta2;
+
+                auto row_m = std::get<0>(context.up.context)->m(row);
+                auto row_v = std::get<0>(context.up.context)->v(row);
+
+                row_m = beta1 * row_m + ((1.0 - beta1) * row_grad);
+                row_v = beta2 * row_v + ((1.0 - beta2) * (row_grad >> row_grad));
+
+                row_w += (eps * row_m) / (etl::sqrt(row_v) + e);
+            }
+        }
+
+        nan_check_deep(w);
+    }
+
     /*!
      * \brief Apply the gradients to the given layer
      */
@@ -944,16 +1968,8 @@ struct sgd_trainer {
             apply_gradients_nesterov<I>(layer, context, n, eps);
         } else if constexpr (UT == updater_type::ADAGRAD) {
             apply_gradients_adagrad<I>(layer, context, eps);
-        } else if constexpr (UT == updater_type::RMSPROP) {
-            apply_gradients_rmsprop<I>(layer, context, eps);
-        } else if constexpr (UT == updater_type::ADAM) {
-            apply_gradients_adam<I>(layer, context, eps);
-        } else if constexpr (UT == updater_type::ADAM_CORRECT) {
-            apply_gradients_adam_correct<I>(layer, context, eps);
         } else if constexpr (UT == updater_type::ADAMAX) {
             apply_gradients_adamax<I>(layer, context, eps);
-        } else if constexpr (UT == updater_type::NADAM) {
-            apply_gradients_nadam<I>(layer, context, eps);
         } else if constexpr (UT == updater_type::ADADELTA) {
             apply_gradients_adadelta<I>(layer, context);
         }
@@ -1062,66 +2078,6 @@ struct sgd_trainer {
         w += w_v;
     }
 
-    /*!
-     * \brief Apply the gradients to the given layer
-     */
-    template <size_t I, typename L, typename C>
-    void apply_gradients_adam(L& layer, C& context, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adam");
-
-        const auto beta1 = network.adam_beta1;
-        const auto beta2 = network.adam_beta2;
-        const auto e = 1e-8;
-
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_m    = std::get<I>(context.up.context)->m;
-        auto& w_v    = std::get<I>(context.up.context)->v;
-
-        // Standard Adam estimations of the first and second moments
-
-        w_m = beta1 * w_m + ((1.0 - beta1) * w_grad);
-        w_v = beta2 * w_v + ((1.0 - beta2) * (w_grad >> w_grad));
-
-        // Update the parameters
-
-        w += (eps * w_m) / (etl::sqrt(w_v) + e);
-    }
-
-    /*!
-     * \brief Apply the gradients to the given layer
-     */
-    template <size_t I, typename L, typename C>
-    void apply_gradients_adam_correct(L& layer, C& context, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adam_correct");
-
-        const auto beta1 = network.adam_beta1;
-        const auto beta2 = network.adam_beta2;
-        const auto e = 1e-8;
-        const auto t = iteration;
-
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_m    = std::get<I>(context.up.context)->m;
-        auto& w_mt   = std::get<I>(context.up.context)->mt;
-        auto& w_v    = std::get<I>(context.up.context)->v;
-        auto& w_vt   = std::get<I>(context.up.context)->vt;
-
-        // Standard Adam estimations of the first and second moments
-
-        w_m = beta1 * w_m + ((1.0 - beta1) * w_grad);
-        w_v = beta2 * w_v + ((1.0 - beta2) * (w_grad >> w_grad));
-
-        // Correct the bias (towards zero) of the first and second moments
-
-        w_mt = w_m / (1.0 - std::pow(beta1, t));
-        w_vt = w_v / (1.0 - std::pow(beta2, t));
-
-        // Update the parameters
-
-        w += (eps * w_m) / (etl::sqrt(w_v) + e);
-    }
-
     /*!
      * \brief Apply the gradients to the given layer
      */
@@ -1150,84 +2106,6 @@ struct sgd_trainer {
         w += (eps >> w_m) / w_v;
     }
 
-    /*!
-     * \brief Apply the gradients to the given layer
-     */
-    template <size_t I, typename L, typename C>
-    void apply_gradients_nadam(L& layer, C& context, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:nadam");
-
-        // The scalar parameters
-        const weight beta1          = network.adam_beta1;
-        const weight beta2          = network.adam_beta2;
-        const weight schedule_decay = network.nadam_schedule_decay;
-        const weight e              = 1e-8;
-        const weight t              = iteration;
-
-        auto& w          = std::get<I>(layer.trainable_parameters());
-        auto& w_grad     = std::get<I>(context.up.context)->grad;
-        auto& w_m        = std::get<I>(context.up.context)->m;
-        auto& w_v        = std::get<I>(context.up.context)->v;
-        auto& m_schedule = std::get<I>(context.up.context)->m_schedule;
-
-        // Compute the schedule for momentum
-
-        weight momentum_cache_t   = beta1 * (1.0 - 0.5 * (std::pow(0.96, t * schedule_decay)));
-        weight momentum_cache_t_1 = beta1 * (1.0 - 0.5 * (std::pow(0.96, (t + 1) * schedule_decay)));
-
-        weight m_schedule_new  = m_schedule * momentum_cache_t;
-        weight m_schedule_next = m_schedule * momentum_cache_t * momentum_cache_t_1;
-
-        if constexpr (I == 0) {
-            m_schedule = m_schedule_new;
-        }
-
-        // Standard Adam estimations of the first and second order moments
-
-        w_m = beta1 * w_m + ((weight(1) - beta1) >> w_grad);
-        w_v = beta2 * w_v + ((weight(1) - beta2) >> (w_grad >> w_grad));
-
-        // Correct the bias (towards zero) of the first and second moments
-
-        // Inlined into the final expression for performance
-        //w_mt = w_m / (1.0 - m_schedule_next);
-        //w_vt = w_v / (1.0 - std::pow(beta2, t));
-
-        // Update the parameters
-
-        weight f1 = 1.0 - momentum_cache_t;
-        weight f2 = 1.0 - m_schedule_new;
-
-        weight m1 = eps * (f1 / f2);
-        weight m2 = eps * momentum_cache_t_1;
-
-        // Compute the new weights
-        // Basic version: w += (m1 * w_grad + m2 * w_mt) / (etl::sqrt(w_vt) + e);
-        // Optimized for performance into:
-        //w += (m1 * w_grad + m2 * (w_m / (weight(1) - m_schedule_next))) / (etl::sqrt(w_v / (weight(1) - std::pow(beta2, t))) + e);
-        // Optimized into
-        w += (m1 * w_grad + (m2 / (weight(1) - m_schedule_next)) * w_m) / (etl::sqrt(w_v / (weight(1) - std::pow(beta2, t))) + e);
-    }
-
-    /*!
-     * \brief Apply the gradients to the given layer
-     */
-    template <size_t I, typename L, typename C>
-    void apply_gradients_rmsprop(L& layer, C& context, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:rmsprop");
-
-        const auto decay = network.rmsprop_decay;
-        const auto e = 1e-8;
-
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_inc  = std::get<I>(context.up.context)->inc;
-
-        w_inc = decay * w_inc + (1 - decay) * (w_grad >> w_grad);
-
-        w += (eps >> w_grad) / etl::sqrt(w_inc + e);
-    }
-
     /*!
      * \brief Update the given gradients according to the given decay function
      */
@@ -1248,6 +2126,16 @@ struct sgd_trainer {
      */
     template <decay_type decay, typename V, typename G>
     void update_grad(const V& value, G& grad, size_t n) {
+        decay_grad<decay>(value, grad);
+
+        clip_gradients(grad, n);
+    }
+
+    /*!
+     * \brief Decay the given gradients according to the given decay function
+     */
+    template <decay_type decay, typename V, typename G>
+    void decay_grad(const V& value, G& grad) {
         if constexpr (decay == decay_type::L1) {
             grad = grad - network.l1_weight_cost * abs(value);
         } else if constexpr (decay == decay_type::L2) {
@@ -1255,8 +2143,6 @@ struct sgd_trainer {
         } else if constexpr (decay == decay_type::L1L2) {
             grad = grad - network.l1_weight_cost * abs(value) - network.l2_weight_cost * value;
         }
-
-        clip_gradients(grad, n);
     }
 
     /*!
@@ -0,0 +1,121 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bounded LRU cache of batches of activations
+ */
+
+#pragma once
+
+#include <iterator>
+#include <list>
+#include <unordered_map>
+
+namespace dll {
+
+/*!
+ * \brief A bounded LRU cache of batches of activations, indexed by the
+ * position of the batch in the epoch.
+ *
+ * The batches are read in the same order at each epoch, which would make
+ * a plain LRU cache evict every batch just before it is used again. The
+ * batches used during the current epoch are therefore never evicted, a
+ * batch that does not fit is computed without being cached.
+ *
+ * \tparam T The type of batch
+ */
+template <typename T>
+struct activation_cache {
+    /*!
+     * \brief Create a cache holding at most capacity batches
+     */
+    explicit activation_cache(size_t capacity) : capacity(capacity) {}
+
+    activation_cache(const activation_cache& rhs) = delete;
+    activation_cache& operator=(const activation_cache& rhs) = delete;
+
+    /*!
+     * \brief Start a new epoch
+     */
+    void new_epoch() {
+        ++epoch;
+    }
+
+    /*!
+     * \brief Return the batch at the given position, computing it on a miss
+     * \param key The position of the batch in the epoch
+     * \param compute The functor computing the batch
+     * \return a reference to the batch, valid until the next call
+     */
+    template <typename Functor>
+    T& get(size_t key, Functor&& compute) {
+        auto it = index.find(key);
+
+        if (it != index.end()) {
+            ++hits;
+
+            entries.splice(entries.begin(), entries, it->second);
+            it->second->epoch = epoch;
+
+            return it->second->value;
+        }
+
+        ++misses;
+
+        if (entries.size() < capacity) {
+            entries.push_front({key, epoch, T(compute())});
+        } else if (!entries.empty() && entries.back().epoch != epoch) {
+            // Evict the least recently used batch, reusing its node
+            index.erase(entries.back().key);
+
+            entries.splice(entries.begin(), entries, std::prev(entries.end()));
+
+            entries.front().key   = key;
+            entries.front().epoch = epoch;
+            entries.front().value = compute();
+        } else {
+            scratch = compute();
+
+            return scratch;
+        }
+
+        index[key] = entries.begin();
+
+        return entries.front().value;
+    }
+
+    /*!
+     * \brief Returns the ratio of batches found in the cache
+     */
+    double hit_rate() const {
+        return hits + misses ? hits / double(hits + misses) : 0.0;
+    }
+
+private:
+    /*!
+     * \brief A cached batch
+     */
+    struct entry {
+        size_t key;   ///< The position of the batch
+        size_t epoch; ///< The last epoch the batch was used
+        T value;      ///< The batch
+    };
+
+    const size_t capacity; ///< The maximum number of cached batches
+    size_t epoch = 0;      ///< The current epoch
+
+    std::list<entry> entries;                                           ///< The batches, most recently used first
+    std::unordered_map<size_t, typename std::list<entry>::iterator> index; ///< The position of the batches in the list
+
+    T scratch; ///< The batch computed on a miss that is not cached
+
+    size_t hits   = 0; ///< The number of batches found in the cache
+    size_t misses = 0; ///< The number of batches computed
+};
+
+} //end of dll namespace
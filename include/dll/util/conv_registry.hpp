@@ -0,0 +1,709 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Forward convolution algorithms and their autotuner.
+ *
+ * All the algorithms compute the same stride-1 convolution (without
+ * flipping the kernels) of a batch of images, with optional zero padding.
+ * With conv_algorithm::AUTO, the candidates are timed on the first use of
+ * a shape and the fastest one is kept in a registry, which is saved for the
+ * later runs in the user cache directory, in $XDG_CACHE_HOME/dll/conv_cache
+ * (~/.cache/dll/conv_cache by default). The DLL_CONV_CACHE environment
+ * variable sets another file, an empty value keeps the registry in memory
+ * only. The working directory is never written to.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/conv_algorithm.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+namespace conv_detail {
+
+/*!
+ * \brief The shape of a forward convolution
+ */
+struct conv_shape {
+    size_t B;  ///< The number of images
+    size_t C;  ///< The number of input channels
+    size_t H;  ///< The height of the input
+    size_t W;  ///< The width of the input
+    size_t K;  ///< The number of kernels
+    size_t KH; ///< The height of the kernels
+    size_t KW; ///< The width of the kernels
+    size_t P1; ///< The padding of the first dimension
+    size_t P2; ///< The padding of the second dimension
+
+    size_t HP() const { return H + 2 * P1; } ///< The height of the padded input
+    size_t WP() const { return W + 2 * P2; } ///< The width of the padded input
+    size_t OH() const { return HP() - KH + 1; } ///< The height of the output
+    size_t OW() const { return WP() - KW + 1; } ///< The width of the output
+
+    /*!
+     * \brief Returns the key of the shape in the registry.
+     *
+     * The number of images is not part of the key, the last partial batch
+     * of an epoch and the inference use the algorithm of the full batches.
+     */
+    std::string key(size_t element_size) const {
+        return std::to_string(element_size) + ":" + std::to_string(C) + "x" + std::to_string(H) + "x" + std::to_string(W)
+               + ":" + std::to_string(K) + "x" + std::to_string(KH) + "x" + std::to_string(KW)
+               + ":" + std::to_string(P1) + "x" + std::to_string(P2);
+    }
+};
+
+/*!
+ * \brief The buffers of the convolution algorithms.
+ *
+ * Each thread has its own workspace, the buffers only grow and are reused
+ * by all the convolutions of the thread.
+ */
+template <typename T>
+struct conv_workspace {
+    using complex = std::complex<T>; ///< The complex type of the transforms
+
+    std::vector<T> input;  ///< The input, when it is not contiguous
+    std::vector<T> kernel; ///< The kernels, when they are not contiguous
+    std::vector<T> x;      ///< The padded input
+    std::vector<T> y;      ///< The output, when it cannot be written in place
+    std::vector<T> col;    ///< The unrolled patches (im2col)
+    std::vector<T> U;      ///< The transformed kernels (Winograd)
+    std::vector<T> V;      ///< The transformed input tiles (Winograd)
+    std::vector<T> M;      ///< The transformed output tiles (Winograd)
+
+    etl::dyn_matrix<complex, 3> xr;  ///< The padded channels of an image (FFT)
+    etl::dyn_matrix<complex, 3> xf;  ///< The transformed channels of an image (FFT)
+    etl::dyn_matrix<complex, 3> wr;  ///< The padded kernels (FFT)
+    etl::dyn_matrix<complex, 3> wf;  ///< The conjugate of the transformed kernels (FFT)
+    etl::dyn_matrix<complex, 3> acc; ///< The products of an image with each kernel (FFT)
+    etl::dyn_matrix<complex, 3> out; ///< The inverse transforms of the products (FFT)
+};
+
+/*!
+ * \brief Returns the workspace of the convolutions of the current thread
+ */
+template <typename T>
+conv_workspace<T>& workspace() {
+    static thread_local conv_workspace<T> ws;
+
+    return ws;
+}
+
+/*!
+ * \brief Resize a 3D matrix of the workspace, if its dimensions differ
+ */
+template <typename M>
+void ensure_dims(M& m, size_t d0, size_t d1, size_t d2) {
+    if (etl::size(m) != d0 * d1 * d2 || etl::dim<0>(m) != d0 || etl::dim<1>(m) != d1) {
+        m.resize(d0, d1, d2);
+    }
+}
+
+/*!
+ * \brief Returns the contiguous memory of the given 4D expression, evaluated
+ * in the buffer if the expression has no direct memory
+ */
+template <typename T, typename E>
+const T* contiguous(const E& e, std::vector<T>& buffer) {
+    if constexpr (etl::all_dma<E>) {
+        e.ensure_cpu_up_to_date();
+
+        return e.memory_start();
+    } else {
+        buffer.resize(etl::size(e));
+
+        etl::custom_dyn_matrix<T, 4> m(buffer.data(), etl::dim<0>(e), etl::dim<1>(e), etl::dim<2>(e), etl::dim<3>(e));
+
+        m = e;
+
+        return buffer.data();
+    }
+}
+
+/*!
+ * \brief Convolution with the input patches unrolled in columns and a
+ * single GEMM per image.
+ *
+ * \param y The output (B x K x OH x OW)
+ * \param x The padded input (B x C x HP x WP)
+ * \param w The kernels (K x C x KH x KW)
+ * \param s The shape of the convolution
+ * \param ws The workspace
+ */
+template <typename T>
+void im2col_conv(T* y, const T* x, const T* w, const conv_shape& s, conv_workspace<T>& ws) {
+    dll::auto_timer timer("conv:algo:im2col");
+
+    const size_t HP = s.HP();
+    const size_t WP = s.WP();
+    const size_t OH = s.OH();
+    const size_t OW = s.OW();
+    const size_t R  = s.C * s.KH * s.KW;
+    const size_t N  = OH * OW;
+
+    ws.col.resize(R * N);
+
+    etl::custom_dyn_matrix<T, 2> col_m(ws.col.data(), R, N);
+    etl::custom_dyn_matrix<T, 2> w_m(const_cast<T*>(w), s.K, R);
+
+    for (size_t b = 0; b < s.B; ++b) {
+        const T* xb = x + b * s.C * HP * WP;
+
+        for (size_t c = 0; c < s.C; ++c) {
+            for (size_t u = 0; u < s.KH; ++u) {
+                for (size_t v = 0; v < s.KW; ++v) {
+                    T* row = ws.col.data() + ((c * s.KH + u) * s.KW + v) * N;
+
+                    for (size_t i = 0; i < OH; ++i) {
+                        const T* in = xb + (c * HP + i + u) * WP + v;
+
+                        std::copy(in, in + OW, row + i * OW);
+                    }
+                }
+            }
+        }
+
+        etl::custom_dyn_matrix<T, 2> y_m(y + b * s.K * N, s.K, N);
+
+        y_m = w_m * col_m;
+    }
+}
+
+/*!
+ * \brief Returns the smallest power of two greater or equal to n
+ */
+inline size_t next_pow2(size_t n) {
+    size_t p = 1;
+
+    while (p < n) {
+        p <<= 1;
+    }
+
+    return p;
+}
+
+/*!
+ * \brief Convolution with pointwise products in the frequency domain.
+ *
+ * The correlation with a kernel is the product with the conjugate of its
+ * transform. The transforms are large enough for the valid part of the
+ * output not to wrap around.
+ *
+ * \param y The output (B x K x OH x OW)
+ * \param x The padded input (B x C x HP x WP)
+ * \param w The kernels (K x C x KH x KW)
+ * \param s The shape of the convolution
+ * \param ws The workspace
+ */
+template <typename T>
+void fft_conv(T* y, const T* x, const T* w, const conv_shape& s, conv_workspace<T>& ws) {
+    dll::auto_timer timer("conv:algo:fft");
+
+    using complex = std::complex<T>;
+
+    const size_t HP = s.HP();
+    const size_t WP = s.WP();
+    const size_t OH = s.OH();
+    const size_t OW = s.OW();
+    const size_t FH = next_pow2(HP);
+    const size_t FW = next_pow2(WP);
+
+    ensure_dims(ws.xr, s.C, FH, FW);
+    ensure_dims(ws.xf, s.C, FH, FW);
+    ensure_dims(ws.wr, s.K * s.C, FH, FW);
+    ensure_dims(ws.wf, s.K * s.C, FH, FW);
+    ensure_dims(ws.acc, s.K, FH, FW);
+    ensure_dims(ws.out, s.K, FH, FW);
+
+    // Transform the kernels
+
+    ws.wr = complex(0);
+
+    for (size_t kc = 0; kc < s.K * s.C; ++kc) {
+        for (size_t u = 0; u < s.KH; ++u) {
+            const T* in = w + (kc * s.KH + u) * s.KW;
+
+            std::copy(in, in + s.KW, ws.wr.memory_start() + (kc * FH + u) * FW);
+        }
+    }
+
+    ws.wf = etl::fft_2d_many(ws.wr);
+    ws.wf = etl::conj(ws.wf);
+
+    ws.xr = complex(0);
+
+    for (size_t b = 0; b < s.B; ++b) {
+        // Transform the channels of the image, the padding stays at zero
+
+        for (size_t c = 0; c < s.C; ++c) {
+            for (size_t i = 0; i < HP; ++i) {
+                const T* in = x + ((b * s.C + c) * HP + i) * WP;
+
+                std::copy(in, in + WP, ws.xr.memory_start() + (c * FH + i) * FW);
+            }
+        }
+
+        ws.xf = etl::fft_2d_many(ws.xr);
+
+        for (size_t k = 0; k < s.K; ++k) {
+            ws.acc(k) = ws.xf(0) >> ws.wf(k * s.C);
+
+            for (size_t c = 1; c < s.C; ++c) {
+                ws.acc(k) += ws.xf(c) >> ws.wf(k * s.C + c);
+            }
+        }
+
+        ws.out = etl::ifft_2d_many(ws.acc);
+
+        for (size_t k = 0; k < s.K; ++k) {
+            for (size_t i = 0; i < OH; ++i) {
+                const complex* in = ws.out.memory_start() + (k * FH + i) * FW;
+
+                std::transform(in, in + OW, y + ((b * s.K + k) * OH + i) * OW, [](const complex& v) { return v.real(); });
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Winograd F(2x2, 3x3) convolution.
+ *
+ * Each 2x2 output tile is computed from a 4x4 input tile with 16
+ * multiplications per channel instead of 36. The products of all the
+ * tiles are done as 16 GEMMs (one per position of the transformed tile).
+ *
+ * \param y The output (B x K x OH x OW)
+ * \param x The padded input (B x C x HP x WP)
+ * \param w The kernels (K x C x 3 x 3)
+ * \param s The shape of the convolution
+ * \param ws The workspace
+ */
+template <typename T>
+void winograd_conv(T* y, const T* x, const T* w, const conv_shape& s, conv_workspace<T>& ws) {
+    dll::auto_timer timer("conv:algo:winograd");
+
+    cpp_assert(s.KH == 3 && s.KW == 3, "Winograd F(2x2, 3x3) only supports 3x3 kernels");
+
+    const size_t HP = s.HP();
+    const size_t WP = s.WP();
+    const size_t OH = s.OH();
+    const size_t OW = s.OW();
+    const size_t TH = (OH + 1) / 2;
+    const size_t TW = (OW + 1) / 2;
+    const size_t NT = TH * TW;
+
+    auto& U = ws.U;
+    auto& V = ws.V;
+    auto& M = ws.M;
+
+    U.resize(16 * s.K * s.C);
+    V.resize(16 * s.C * NT);
+    M.resize(16 * s.K * NT);
+
+    // Transform the kernels: U = G g G^T
+
+    for (size_t k = 0; k < s.K; ++k) {
+        for (size_t c = 0; c < s.C; ++c) {
+            const T* g = w + (k * s.C + c) * 9;
+
+            T t[4][3];
+
+            for (size_t j = 0; j < 3; ++j) {
+                t[0][j] = g[j];
+                t[1][j] = (g[j] + g[3 + j] + g[6 + j]) / T(2);
+                t[2][j] = (g[j] - g[3 + j] + g[6 + j]) / T(2);
+                t[3][j] = g[6 + j];
+            }
+
+            for (size_t i = 0; i < 4; ++i) {
+                const T u[4] = {t[i][0], (t[i][0] + t[i][1] + t[i][2]) / T(2), (t[i][0] - t[i][1] + t[i][2]) / T(2), t[i][2]};
+
+                for (size_t j = 0; j < 4; ++j) {
+                    U[((i * 4 + j) * s.K + k) * s.C + c] = u[j];
+                }
+            }
+        }
+    }
+
+    for (size_t b = 0; b < s.B; ++b) {
+        // Transform the input tiles: V = B^T d B
+
+        for (size_t c = 0; c < s.C; ++c) {
+            const T* in = x + (b * s.C + c) * HP * WP;
+
+            for (size_t ti = 0; ti < TH; ++ti) {
+                for (size_t tj = 0; tj < TW; ++tj) {
+                    T d[4][4];
+
+                    for (size_t i = 0; i < 4; ++i) {
+                        for (size_t j = 0; j < 4; ++j) {
+                            const size_t r  = 2 * ti + i;
+                            const size_t cc = 2 * tj + j;
+
+                            d[i][j] = r < HP && cc < WP ? in[r * WP + cc] : T(0);
+                        }
+                    }
+
+                    T t[4][4];
+
+                    for (size_t j = 0; j < 4; ++j) {
+                        t[0][j] = d[0][j] - d[2][j];
+                        t[1][j] = d[1][j] + d[2][j];
+                        t[2][j] = d[2][j] - d[1][j];
+                        t[3][j] = d[1][j] - d[3][j];
+                    }
+
+                    for (size_t i = 0; i < 4; ++i) {
+                        const T v[4] = {t[i][0] - t[i][2], t[i][1] + t[i][2], t[i][2] - t[i][1], t[i][1] - t[i][3]};
+
+                        for (size_t j = 0; j < 4; ++j) {
+                            V[((i * 4 + j) * s.C + c) * NT + ti * TW + tj] = v[j];
+                        }
+                    }
+                }
+            }
+        }
+
+        // One GEMM per position of the tile
+
+        for (size_t e = 0; e < 16; ++e) {
+            etl::custom_dyn_matrix<T, 2> u_m(U.data() + e * s.K * s.C, s.K, s.C);
+            etl::custom_dyn_matrix<T, 2> v_m(V.data() + e * s.C * NT, s.C, NT);
+            etl::custom_dyn_matrix<T, 2> m_m(M.data() + e * s.K * NT, s.K, NT);
+
+            m_m = u_m * v_m;
+        }
+
+        // Transform the output tiles: Y = A^T m A
+
+        for (size_t k = 0; k < s.K; ++k) {
+            T* out = y + (b * s.K + k) * OH * OW;
+
+            for (size_t ti = 0; ti < TH; ++ti) {
+                for (size_t tj = 0; tj < TW; ++tj) {
+                    T m[4][4];
+
+                    for (size_t e = 0; e < 16; ++e) {
+                        m[e / 4][e % 4] = M[(e * s.K + k) * NT + ti * TW + tj];
+                    }
+
+                    T t[2][4];
+
+                    for (size_t j = 0; j < 4; ++j) {
+                        t[0][j] = m[0][j] + m[1][j] + m[2][j];
+                        t[1][j] = m[1][j] - m[2][j] - m[3][j];
+                    }
+
+                    for (size_t i = 0; i < 2; ++i) {
+                        const T o[2] = {t[i][0] + t[i][1] + t[i][2], t[i][1] - t[i][2] - t[i][3]};
+
+                        for (size_t j = 0; j < 2; ++j) {
+                            const size_t r  = 2 * ti + i;
+                            const size_t cc = 2 * tj + j;
+
+                            if (r < OH && cc < OW) {
+                                out[r * OW + cc] = o[j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Returns the path of the file of the registry, empty if the
+ * registry is only kept in memory.
+ *
+ * DLL_CONV_CACHE has the priority, then the user cache directory
+ * ($XDG_CACHE_HOME, or ~/.cache when it is not set or not absolute).
+ */
+inline std::string conv_registry_file() {
+    if (auto* file = std::getenv("DLL_CONV_CACHE")) {
+        return file;
+    }
+
+    if (auto* cache = std::getenv("XDG_CACHE_HOME"); cache && cache[0] == '/') {
+        return std::string(cache) + "/dll/conv_cache";
+    }
+
+    if (auto* home = std::getenv("HOME"); home && home[0]) {
+        return std::string(home) + "/.cache/dll/conv_cache";
+    }
+
+    return {};
+}
+
+} //end of namespace conv_detail
+
+/*!
+ * \brief Registry of the fastest convolution algorithm of each shape,
+ * persisted in the user cache directory.
+ */
+struct conv_registry {
+    /*!
+     * \brief Returns the registry of the process
+     */
+    static conv_registry& instance() {
+        static conv_registry registry(conv_detail::conv_registry_file());
+
+        return registry;
+    }
+
+    /*!
+     * \brief Find the algorithm of the given shape
+     * \param key The key of the shape
+     * \param algorithm The algorithm, set if it is found
+     * \return true if the shape has been tuned, false otherwise
+     */
+    bool find(const std::string& key, conv_algorithm& algorithm) {
+        std::lock_guard<std::mutex> l(lock);
+
+        auto it = algorithms.find(key);
+
+        if (it == algorithms.end()) {
+            return false;
+        }
+
+        algorithm = it->second;
+
+        return true;
+    }
+
+    /*!
+     * \brief Store the algorithm of the given shape and append it to the file
+     */
+    void store(const std::string& key, conv_algorithm algorithm) {
+        std::lock_guard<std::mutex> l(lock);
+
+        algorithms[key] = algorithm;
+
+        if (file.empty()) {
+            return;
+        }
+
+        // The file is only a cache, failing to write it only means tuning again next time
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(file).parent_path(), error);
+
+        std::ofstream stream(file, std::ios::app);
+
+        if (stream) {
+            stream << key << ' ' << to_string(algorithm) << '\n';
+        }
+    }
+
+private:
+    /*!
+     * \brief Create the registry and load the previously tuned shapes
+     */
+    explicit conv_registry(std::string file) : file(std::move(file)) {
+        std::ifstream stream(this->file);
+
+        std::string key;
+        std::string name;
+
+        while (stream >> key >> name) {
+            for (auto algorithm : {conv_algorithm::DIRECT, conv_algorithm::IM2COL, conv_algorithm::FFT, conv_algorithm::WINOGRAD}) {
+                if (to_string(algorithm) == name) {
+                    algorithms[key] = algorithm;
+                }
+            }
+        }
+    }
+
+    std::string file;                                          ///< The file of the registry
+    std::mutex lock;                                           ///< The lock protecting the registry
+    std::unordered_map<std::string, conv_algorithm> algorithms; ///< The algorithm of each tuned shape
+};
+
+/*!
+ * \brief Compute the stride-1 forward convolution of a batch with the given
+ * algorithm
+ *
+ * Winograd falls back to DIRECT for the kernels that are not 3x3.
+ *
+ * \param algorithm The algorithm to use (not AUTO)
+ * \param output The output batch (B x K x OH x OW)
+ * \param input The input batch (B x C x H x W)
+ * \param w The kernels (K x C x KH x KW)
+ * \param p1 The padding of the first dimension
+ * \param p2 The padding of the second dimension
+ */
+template <typename O, typename I, typename W>
+void conv_forward(conv_algorithm algorithm, O&& output, const I& input, const W& w, size_t p1 = 0, size_t p2 = 0) {
+    using T = etl::value_t<W>;
+
+    // The kernels of the dynamic layers are only known at runtime
+    if (algorithm == conv_algorithm::WINOGRAD && (etl::dim<2>(w) != 3 || etl::dim<3>(w) != 3)) {
+        algorithm = conv_algorithm::DIRECT;
+    }
+
+    if (algorithm == conv_algorithm::DIRECT) {
+        output = etl::ml::convolution_forward(input, w, 1, 1, p1, p2);
+        return;
+    }
+
+    const conv_detail::conv_shape s{etl::dim<0>(input), etl::dim<1>(input), etl::dim<2>(input), etl::dim<3>(input),
+                                    etl::dim<0>(w), etl::dim<2>(w), etl::dim<3>(w), p1, p2};
+
+    auto& ws = conv_detail::workspace<T>();
+
+    // The input and the kernels are only copied when they are not contiguous
+
+    const T* in = conv_detail::contiguous(input, ws.input);
+    const T* k  = conv_detail::contiguous(w, ws.kernel);
+
+    // Only the padded input needs a copy, one row at a time
+
+    const T* x = in;
+
+    if (p1 || p2) {
+        ws.x.assign(s.B * s.C * s.HP() * s.WP(), T(0));
+
+        for (size_t bc = 0; bc < s.B * s.C; ++bc) {
+            for (size_t i = 0; i < s.H; ++i) {
+                const T* row = in + (bc * s.H + i) * s.W;
+
+                std::copy(row, row + s.W, ws.x.data() + (bc * s.HP() + i + p1) * s.WP() + p2);
+            }
+        }
+
+        x = ws.x.data();
+    }
+
+    // The output is written in place when it is contiguous
+
+    T* y;
+
+    if constexpr (etl::all_dma<std::decay_t<O>>) {
+        cpp_assert(etl::size(output) == s.B * s.K * s.OH() * s.OW(), "Invalid output size");
+
+        y = output.memory_start();
+    } else {
+        ws.y.resize(s.B * s.K * s.OH() * s.OW());
+
+        y = ws.y.data();
+    }
+
+    switch (algorithm) {
+        case conv_algorithm::IM2COL:
+            conv_detail::im2col_conv(y, x, k, s, ws);
+            break;
+        case conv_algorithm::FFT:
+            conv_detail::fft_conv(y, x, k, s, ws);
+            break;
+        case conv_algorithm::WINOGRAD:
+            conv_detail::winograd_conv(y, x, k, s, ws);
+            break;
+        default:
+            cpp_unreachable("Invalid convolution algorithm");
+    }
+
+    if constexpr (etl::all_dma<std::decay_t<O>>) {
+        output.invalidate_gpu();
+    } else {
+        output = etl::custom_dyn_matrix<T, 4>(ws.y.data(), s.B, s.K, s.OH(), s.OW());
+    }
+}
+
+/*!
+ * \brief Time the candidate algorithms on the given convolution and
+ * return the fastest
+ */
+template <typename O, typename I, typename W>
+conv_algorithm conv_autotune(O& output, const I& input, const W& w, size_t p1, size_t p2) {
+    dll::auto_timer timer("conv:autotune");
+
+    std::vector<conv_algorithm> candidates{conv_algorithm::DIRECT, conv_algorithm::IM2COL, conv_algorithm::FFT};
+
+    if (etl::dim<2>(w) == 3 && etl::dim<3>(w) == 3) {
+        candidates.push_back(conv_algorithm::WINOGRAD);
+    }
+
+    constexpr size_t runs = 3;
+
+    auto best      = conv_algorithm::DIRECT;
+    auto best_time = std::numeric_limits<double>::max();
+
+    for (auto algorithm : candidates) {
+        // Warm-up
+        conv_forward(algorithm, output, input, w, p1, p2);
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t r = 0; r < runs; ++r) {
+            conv_forward(algorithm, output, input, w, p1, p2);
+        }
+
+        double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (duration < best_time) {
+            best      = algorithm;
+            best_time = duration;
+        }
+    }
+
+    return best;
+}
+
+/*!
+ * \brief Compute the stride-1 forward convolution of a batch with the
+ * algorithm A, autotuned on the first use of each shape for AUTO.
+ *
+ * \param output The output batch (B x K x OH x OW)
+ * \param input The input batch (B x C x H x W)
+ * \param w The kernels (K x C x KH x KW)
+ * \param p1 The padding of the first dimension
+ * \param p2 The padding of the second dimension
+ */
+template <conv_algorithm A, typename O, typename I, typename W>
+void conv_forward(O&& output, const I& input, const W& w, size_t p1 = 0, size_t p2 = 0) {
+    if constexpr (A == conv_algorithm::AUTO) {
+        const conv_detail::conv_shape s{etl::dim<0>(input), etl::dim<1>(input), etl::dim<2>(input), etl::dim<3>(input),
+                                        etl::dim<0>(w), etl::dim<2>(w), etl::dim<3>(w), p1, p2};
+
+        const auto key = s.key(sizeof(etl::value_t<W>));
+
+        auto& registry = conv_registry::instance();
+
+        conv_algorithm algorithm;
+
+        if (!registry.find(key, algorithm)) {
+            algorithm = conv_autotune(output, input, w, p1, p2);
+
+            registry.store(key, algorithm);
+        }
+
+        conv_forward(algorithm, output, input, w, p1, p2);
+    } else {
+        conv_forward(A, output, input, w, p1, p2);
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,214 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Sparse (CSR) batches of inputs and sparse-dense products
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A batch of sparse inputs, in Compressed Sparse Row format.
+ *
+ * Each row is one sample, flattened. Only the non-zero values are stored,
+ * with their column, row after row.
+ *
+ * \tparam T The value type
+ */
+template <typename T>
+struct csr_batch {
+    using value_type = T; ///< The value type
+
+    size_t rows = 0; ///< The number of samples
+    size_t cols = 0; ///< The number of values of one sample
+
+    std::vector<T> values;       ///< The non-zero values
+    std::vector<size_t> indices; ///< The column of each non-zero value
+    std::vector<size_t> offsets; ///< The position of the first value of each row, plus the end
+
+    /*!
+     * \brief Create an empty batch of samples of the given size
+     */
+    explicit csr_batch(size_t cols = 0) : cols(cols), offsets(1, 0) {}
+
+    /*!
+     * \brief Create a batch from a dense batch, dropping the zeroes
+     * \param dense The dense batch, the first dimension being the samples
+     */
+    template <typename E>
+    static csr_batch from_dense(const E& dense) {
+        const size_t n = etl::dim<0>(dense);
+
+        csr_batch batch(etl::size(dense) / n);
+
+        for (size_t i = 0; i < n; ++i) {
+            auto sample = etl::reshape(dense(i), batch.cols);
+
+            for (size_t j = 0; j < batch.cols; ++j) {
+                if (sample[j] != T(0)) {
+                    batch.push(j, sample[j]);
+                }
+            }
+
+            batch.end_row();
+        }
+
+        return batch;
+    }
+
+    /*!
+     * \brief Add a value to the current row
+     * \param col The column of the value, increasing inside the row
+     * \param value The value
+     */
+    void push(size_t col, T value) {
+        cpp_assert(col < cols, "Invalid column in CSR batch");
+
+        indices.push_back(col);
+        values.push_back(value);
+    }
+
+    /*!
+     * \brief Finish the current row
+     */
+    void end_row() {
+        offsets.push_back(values.size());
+        ++rows;
+    }
+
+    /*!
+     * \brief Returns the number of non-zero values
+     */
+    size_t nnz() const noexcept {
+        return values.size();
+    }
+
+    /*!
+     * \brief Returns the ratio of non-zero values
+     */
+    double density() const noexcept {
+        return rows && cols ? nnz() / double(rows * cols) : 0.0;
+    }
+};
+
+/*!
+ * \brief Compute the product of a CSR batch by a dense matrix.
+ *
+ * The output may have more rows than the batch, the extra rows are set to
+ * zero, as if the batch was padded with empty samples.
+ *
+ * \param output The (N, H) output
+ * \param a The (R, V) CSR batch, with R <= N
+ * \param w The (V, H) dense matrix
+ */
+template <typename T, typename O, typename W>
+void csr_mul(O&& output, const csr_batch<T>& a, const W& w) {
+    const size_t H = etl::dim<1>(w);
+
+    cpp_assert(etl::dim<0>(w) == a.cols, "Invalid dimensions for csr_mul");
+    cpp_assert(etl::size(output) >= a.rows * H, "Invalid dimensions for csr_mul");
+
+    w.ensure_cpu_up_to_date();
+
+    const T* W_ = w.memory_start();
+    T* O_       = output.memory_start();
+
+    std::fill(O_, O_ + etl::size(output), T(0));
+
+    for (size_t i = 0; i < a.rows; ++i) {
+        T* out = O_ + i * H;
+
+        for (size_t k = a.offsets[i]; k < a.offsets[i + 1]; ++k) {
+            const T v    = a.values[k];
+            const T* row = W_ + a.indices[k] * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                out[j] += v * row[j];
+            }
+        }
+    }
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the product of the transpose of a CSR batch by a dense
+ * matrix, the gradients of the weights of a first layer.
+ *
+ * The dense matrix may have more rows than the batch, the extra rows are
+ * ignored, as if the batch was padded with empty samples.
+ *
+ * \param output The (V, H) output
+ * \param a The (R, V) CSR batch
+ * \param e The (N, H) dense matrix, with R <= N
+ */
+template <typename T, typename O, typename E>
+void csr_transpose_mul(O&& output, const csr_batch<T>& a, const E& e) {
+    const size_t H = etl::size(e) / etl::dim<0>(e);
+
+    cpp_assert(etl::size(output) == a.cols * H, "Invalid dimensions for csr_transpose_mul");
+    cpp_assert(etl::dim<0>(e) >= a.rows, "Invalid dimensions for csr_transpose_mul");
+
+    e.ensure_cpu_up_to_date();
+
+    const T* E_ = e.memory_start();
+    T* O_       = output.memory_start();
+
+    std::fill(O_, O_ + etl::size(output), T(0));
+
+    for (size_t i = 0; i < a.rows; ++i) {
+        const T* err = E_ + i * H;
+
+        for (size_t k = a.offsets[i]; k < a.offsets[i + 1]; ++k) {
+            const T v = a.values[k];
+            T* out    = O_ + a.indices[k] * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                out[j] += v * err[j];
+            }
+        }
+    }
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Expand a CSR batch into a dense batch.
+ *
+ * The extra rows of the output are set to zero.
+ *
+ * \param output The (N, V) output, with R <= N
+ * \param a The (R, V) CSR batch
+ */
+template <typename T, typename O>
+void csr_to_dense(O&& output, const csr_batch<T>& a) {
+    cpp_assert(etl::size(output) >= a.rows * a.cols, "Invalid dimensions for csr_to_dense");
+
+    T* O_ = output.memory_start();
+
+    std::fill(O_, O_ + etl::size(output), T(0));
+
+    for (size_t i = 0; i < a.rows; ++i) {
+        for (size_t k = a.offsets[i]; k < a.offsets[i + 1]; ++k) {
+            O_[i * a.cols + a.indices[k]] = a.values[k];
+        }
+    }
+
+    output.invalidate_gpu();
+}
+
+} //end of dll namespace
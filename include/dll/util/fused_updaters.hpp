@@ -0,0 +1,210 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file fused_updaters.hpp
+ * \brief Single-pass kernels of the Adam, Nadam and RMSProp updaters.
+ *
+ * Each kernel reads the weights, the gradients and the state of the updater
+ * once and writes the weights and the state once. The weight decay and the
+ * gradient clipping are folded in, the gradients are left untouched.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief The transformation of the gradients folded into the fused kernels:
+ * scale * (g - l1 * |w| - l2 * w)
+ */
+template <typename T>
+struct grad_transform {
+    T l1    = 0; ///< The L1 weight cost
+    T l2    = 0; ///< The L2 weight cost
+    T scale = 1; ///< The clipping factor
+
+    /*!
+     * \brief Returns the transformed gradient of the given weight
+     */
+    T operator()(T w, T g) const {
+        return scale * (g - l1 * std::abs(w) - l2 * w);
+    }
+
+#if defined(__AVX__)
+    /*!
+     * \brief Returns the transformed gradients of the given eight weights
+     */
+    __m256 operator()(__m256 w, __m256 g) const requires std::is_same_v<T, float> {
+        const __m256 abs_w = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), w);
+
+        g = _mm256_sub_ps(g, _mm256_mul_ps(_mm256_set1_ps(l1), abs_w));
+        g = _mm256_sub_ps(g, _mm256_mul_ps(_mm256_set1_ps(l2), w));
+
+        return _mm256_mul_ps(_mm256_set1_ps(scale), g);
+    }
+#endif
+};
+
+/*!
+ * \brief Compute the sum of the squares of n transformed gradients.
+ *
+ * This is the reduction needed before the clipping factor is known, the
+ * transform must not have any clipping yet.
+ *
+ * \param w The weights
+ * \param g The gradients
+ * \param n The number of values
+ * \param t The transformation of the gradients
+ * \return The sum of the squares, accumulated in double precision
+ */
+template <typename T>
+double fused_squared_norm(const T* w, const T* g, size_t n, const grad_transform<T>& t) {
+    size_t i   = 0;
+    double sum = 0.0;
+
+    if constexpr (std::is_same_v<T, float>) {
+#if defined(__AVX__)
+        __m256d acc = _mm256_setzero_pd();
+
+        for (; i + 8 <= n; i += 8) {
+            const __m256 x  = t(_mm256_loadu_ps(w + i), _mm256_loadu_ps(g + i));
+            const __m256 x2 = _mm256_mul_ps(x, x);
+
+            acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_castps256_ps128(x2)));
+            acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_extractf128_ps(x2, 1)));
+        }
+
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, acc);
+
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    }
+
+    for (; i < n; ++i) {
+        const T x = t(w[i], g[i]);
+        sum += double(x * x);
+    }
+
+    return sum;
+}
+
+/*!
+ * \brief Apply the Adam family update to n weights, in one pass:
+ *
+ *   m = beta1 * m + (1 - beta1) * g
+ *   v = beta2 * v + (1 - beta2) * g * g
+ *   w += (m1 * g + m2 * m) / (sqrt(c2 * v) + e)
+ *
+ * Adam is m1 = 0, m2 = eps and c2 = 1. Nadam uses the Nesterov term m1 and
+ * its bias correction is folded into m1, m2 and c2.
+ *
+ * \param w The weights
+ * \param g The gradients
+ * \param m The estimates of the first moment
+ * \param v The estimates of the second moment
+ * \param n The number of values
+ * \param t The transformation of the gradients
+ */
+template <typename T>
+void fused_adam(T* w, const T* g, T* m, T* v, size_t n, const grad_transform<T>& t, T beta1, T beta2, T m1, T m2, T c2, T e) {
+    size_t i = 0;
+
+    if constexpr (std::is_same_v<T, float>) {
+#if defined(__AVX__)
+        const __m256 b1  = _mm256_set1_ps(beta1);
+        const __m256 b2  = _mm256_set1_ps(beta2);
+        const __m256 nb1 = _mm256_set1_ps(1.0f - beta1);
+        const __m256 nb2 = _mm256_set1_ps(1.0f - beta2);
+        const __m256 m1_ = _mm256_set1_ps(m1);
+        const __m256 m2_ = _mm256_set1_ps(m2);
+        const __m256 c2_ = _mm256_set1_ps(c2);
+        const __m256 e_  = _mm256_set1_ps(e);
+
+        for (; i + 8 <= n; i += 8) {
+            const __m256 wi = _mm256_loadu_ps(w + i);
+            const __m256 gi = t(wi, _mm256_loadu_ps(g + i));
+
+            const __m256 mi = _mm256_add_ps(_mm256_mul_ps(b1, _mm256_loadu_ps(m + i)), _mm256_mul_ps(nb1, gi));
+            const __m256 vi = _mm256_add_ps(_mm256_mul_ps(b2, _mm256_loadu_ps(v + i)), _mm256_mul_ps(nb2, _mm256_mul_ps(gi, gi)));
+
+            const __m256 num = _mm256_add_ps(_mm256_mul_ps(m1_, gi), _mm256_mul_ps(m2_, mi));
+            const __m256 den = _mm256_add_ps(_mm256_sqrt_ps(_mm256_mul_ps(c2_, vi)), e_);
+
+            _mm256_storeu_ps(m + i, mi);
+            _mm256_storeu_ps(v + i, vi);
+            _mm256_storeu_ps(w + i, _mm256_add_ps(wi, _mm256_div_ps(num, den)));
+        }
+#endif
+    }
+
+    for (; i < n; ++i) {
+        const T gi = t(w[i], g[i]);
+
+        m[i] = beta1 * m[i] + (T(1) - beta1) * gi;
+        v[i] = beta2 * v[i] + (T(1) - beta2) * (gi * gi);
+
+        w[i] += (m1 * gi + m2 * m[i]) / (std::sqrt(c2 * v[i]) + e);
+    }
+}
+
+/*!
+ * \brief Apply the RMSProp update to n weights, in one pass:
+ *
+ *   inc = decay * inc + (1 - decay) * g * g
+ *   w += eps * g / sqrt(inc + e)
+ *
+ * \param w The weights
+ * \param g The gradients
+ * \param inc The accumulated squared gradients
+ * \param n The number of values
+ * \param t The transformation of the gradients
+ */
+template <typename T>
+void fused_rmsprop(T* w, const T* g, T* inc, size_t n, const grad_transform<T>& t, T decay, T eps, T e) {
+    size_t i = 0;
+
+    if constexpr (std::is_same_v<T, float>) {
+#if defined(__AVX__)
+        const __m256 d    = _mm256_set1_ps(decay);
+        const __m256 nd   = _mm256_set1_ps(1.0f - decay);
+        const __m256 eps_ = _mm256_set1_ps(eps);
+        const __m256 e_   = _mm256_set1_ps(e);
+
+        for (; i + 8 <= n; i += 8) {
+            const __m256 wi = _mm256_loadu_ps(w + i);
+            const __m256 gi = t(wi, _mm256_loadu_ps(g + i));
+
+            const __m256 inci = _mm256_add_ps(_mm256_mul_ps(d, _mm256_loadu_ps(inc + i)), _mm256_mul_ps(nd, _mm256_mul_ps(gi, gi)));
+
+            const __m256 step = _mm256_div_ps(_mm256_mul_ps(eps_, gi), _mm256_sqrt_ps(_mm256_add_ps(inci, e_)));
+
+            _mm256_storeu_ps(inc + i, inci);
+            _mm256_storeu_ps(w + i, _mm256_add_ps(wi, step));
+        }
+#endif
+    }
+
+    for (; i < n; ++i) {
+        const T gi = t(w[i], g[i]);
+
+        inc[i] = decay * inc[i] + (T(1) - decay) * (gi * gi);
+
+        w[i] += (eps * gi) / std::sqrt(inc[i] + e);
+    }
+}
+
+} //end of dll namespace
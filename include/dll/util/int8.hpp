@@ -0,0 +1,404 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file int8.hpp
+ * \brief Kernels for symmetric 8-bit integer quantization.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief Compute the symmetric scale mapping [-max_abs, max_abs] to [-127, 127]
+ * \param max_abs The maximum absolute value of the quantized range
+ * \return The scale of the quantization
+ */
+inline float int8_scale(float max_abs) {
+    return max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+}
+
+/*!
+ * \brief Quantize n float values to int8 with the given scale.
+ *
+ * Values outside of the calibrated range are saturated.
+ *
+ * \param in The input values
+ * \param out The quantized values
+ * \param n The number of values
+ * \param scale The quantization scale
+ */
+template <typename T>
+void int8_quantize(const T* in, int8_t* out, size_t n, float scale) {
+    const float inv = 1.0f / scale;
+
+    for (size_t i = 0; i < n; ++i) {
+        float q = std::nearbyint(float(in[i]) * inv);
+        q       = q > 127.0f ? 127.0f : (q < -127.0f ? -127.0f : q);
+        out[i]  = int8_t(q);
+    }
+}
+
+/*!
+ * \brief Compute the dot product of two int8 vectors with 32-bit accumulation.
+ *
+ * The vectors are sign-extended to 16 bits and multiplied pairwise with
+ * madd, which cannot overflow since both operands are in [-127, 127].
+ *
+ * \param a The first vector
+ * \param b The second vector
+ * \param n The size of the vectors
+ * \return the dot product of a and b
+ */
+inline int32_t int8_dot(const int8_t* a, const int8_t* b, size_t n) {
+    size_t i       = 0;
+    int32_t result = 0;
+
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+
+        __m256i a_lo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(va));
+        __m256i a_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(va, 1));
+        __m256i b_lo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(vb));
+        __m256i b_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vb, 1));
+
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a_lo, b_lo));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a_hi, b_hi));
+    }
+
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum         = _mm_hadd_epi32(sum, sum);
+    sum         = _mm_hadd_epi32(sum, sum);
+    result      = _mm_cvtsi128_si32(sum);
+#elif defined(__SSE4_1__)
+    __m128i acc = _mm_setzero_si128();
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+
+        __m128i a_lo = _mm_cvtepi8_epi16(va);
+        __m128i a_hi = _mm_cvtepi8_epi16(_mm_srli_si128(va, 8));
+        __m128i b_lo = _mm_cvtepi8_epi16(vb);
+        __m128i b_hi = _mm_cvtepi8_epi16(_mm_srli_si128(vb, 8));
+
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a_lo, b_lo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a_hi, b_hi));
+    }
+
+    acc    = _mm_hadd_epi32(acc, acc);
+    acc    = _mm_hadd_epi32(acc, acc);
+    result = _mm_cvtsi128_si32(acc);
+#endif
+
+    for (; i < n; ++i) {
+        result += int32_t(a[i]) * int32_t(b[i]);
+    }
+
+    return result;
+}
+
+constexpr size_t int8_block = 8; ///< The number of outputs of a block of packed weights
+constexpr size_t int8_group = 4; ///< The number of inputs of a group of packed weights
+
+/*!
+ * \brief Round n up to a multiple of m
+ */
+inline size_t int8_round_up(size_t n, size_t m) {
+    return (n + m - 1) / m * m;
+}
+
+/*!
+ * \brief Returns the number of bytes of the packed weights of n outputs of k inputs
+ */
+inline size_t int8_packed_size(size_t n, size_t k) {
+    return int8_round_up(n, int8_block) * int8_round_up(k, int8_group);
+}
+
+/*!
+ * \brief Pack the int8 weights of n outputs of k inputs for int8_gemm.
+ *
+ * The outputs are packed in blocks of 8, and the inputs of each block in
+ * groups of 4, so that one vector holds 4 consecutive inputs of 8 outputs.
+ * The padding is filled with zeroes.
+ *
+ * \param w The weights, one row of k inputs per output
+ * \param n The number of outputs
+ * \param k The number of inputs
+ * \param packed The packed weights, of int8_packed_size(n, k) bytes
+ */
+inline void int8_pack(const int8_t* w, size_t n, size_t k, int8_t* packed) {
+    const size_t groups = int8_round_up(k, int8_group) / int8_group;
+    const size_t blocks = int8_round_up(n, int8_block) / int8_block;
+
+    for (size_t blk = 0; blk < blocks; ++blk) {
+        for (size_t g = 0; g < groups; ++g) {
+            for (size_t r = 0; r < int8_block; ++r) {
+                for (size_t j = 0; j < int8_group; ++j) {
+                    const size_t o = blk * int8_block + r;
+                    const size_t i = g * int8_group + j;
+
+                    *packed++ = o < n && i < k ? w[o * k + i] : 0;
+                }
+            }
+        }
+    }
+}
+
+namespace int8_detail {
+
+#if defined(__AVX2__)
+
+/*!
+ * \brief Accumulate the products of |x| (unsigned) and the signed weights.
+ *
+ * With |x| and |w| at most 127, the pairs of products of maddubs cannot
+ * saturate.
+ */
+inline __m256i dot_accumulate(__m256i acc, __m256i ax, __m256i sw) {
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    return _mm256_dpbusd_epi32(acc, ax, sw);
+#elif defined(__AVXVNNI__)
+    return _mm256_dpbusd_avx_epi32(acc, ax, sw);
+#else
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(ax, sw), _mm256_set1_epi16(1)));
+#endif
+}
+
+#elif defined(__SSE4_1__)
+
+/*!
+ * \brief Accumulate the products of |x| (unsigned) and the signed weights.
+ *
+ * With |x| and |w| at most 127, the pairs of products of maddubs cannot
+ * saturate.
+ */
+inline __m128i dot_accumulate(__m128i acc, __m128i ax, __m128i sw) {
+    return _mm_add_epi32(acc, _mm_madd_epi16(_mm_maddubs_epi16(ax, sw), _mm_set1_epi16(1)));
+}
+
+#endif
+
+/*!
+ * \brief Store the outputs of one block, leaving out the padded outputs
+ */
+inline void store_block(int32_t* out, const int32_t* block, size_t valid) {
+    std::memcpy(out, block, std::min(valid, int8_block) * sizeof(int32_t));
+}
+
+/*!
+ * \brief Compute a tile of MR rows of x by NB blocks of outputs.
+ *
+ * Each vector of weights is loaded once for the MR rows, and each group of
+ * inputs of a row is broadcast once for the NB blocks.
+ */
+template <size_t MR, size_t NB>
+void gemm_tile(const int8_t* x, size_t ldx, const int8_t* packed, size_t groups, size_t first, size_t n, int32_t* out, size_t ldo) {
+    const size_t block_bytes = groups * int8_group * int8_block;
+
+#if defined(__AVX2__)
+    __m256i acc[MR][NB];
+
+    for (size_t r = 0; r < MR; ++r) {
+        for (size_t nb = 0; nb < NB; ++nb) {
+            acc[r][nb] = _mm256_setzero_si256();
+        }
+    }
+
+    for (size_t g = 0; g < groups; ++g) {
+        __m256i w[NB];
+
+        for (size_t nb = 0; nb < NB; ++nb) {
+            w[nb] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(packed + nb * block_bytes + g * int8_group * int8_block));
+        }
+
+        for (size_t r = 0; r < MR; ++r) {
+            int32_t group;
+            std::memcpy(&group, x + r * ldx + g * int8_group, sizeof(group));
+
+            const __m256i xb = _mm256_set1_epi32(group);
+            const __m256i ax = _mm256_sign_epi8(xb, xb);
+
+            for (size_t nb = 0; nb < NB; ++nb) {
+                acc[r][nb] = dot_accumulate(acc[r][nb], ax, _mm256_sign_epi8(w[nb], xb));
+            }
+        }
+    }
+
+    alignas(32) int32_t block[int8_block];
+
+    for (size_t r = 0; r < MR; ++r) {
+        for (size_t nb = 0; nb < NB; ++nb) {
+            const size_t o = first + nb * int8_block;
+
+            if (o + int8_block <= n) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + r * ldo + o), acc[r][nb]);
+            } else {
+                _mm256_store_si256(reinterpret_cast<__m256i*>(block), acc[r][nb]);
+                store_block(out + r * ldo + o, block, n - o);
+            }
+        }
+    }
+#elif defined(__SSE4_1__)
+    __m128i acc[MR][NB][2];
+
+    for (size_t r = 0; r < MR; ++r) {
+        for (size_t nb = 0; nb < NB; ++nb) {
+            acc[r][nb][0] = _mm_setzero_si128();
+            acc[r][nb][1] = _mm_setzero_si128();
+        }
+    }
+
+    for (size_t g = 0; g < groups; ++g) {
+        __m128i w[NB][2];
+
+        for (size_t nb = 0; nb < NB; ++nb) {
+            const int8_t* wg = packed + nb * block_bytes + g * int8_group * int8_block;
+
+            w[nb][0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wg));
+            w[nb][1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wg + 16));
+        }
+
+        for (size_t r = 0; r < MR; ++r) {
+            int32_t group;
+            std::memcpy(&group, x + r * ldx + g * int8_group, sizeof(group));
+
+            const __m128i xb = _mm_set1_epi32(group);
+            const __m128i ax = _mm_sign_epi8(xb, xb);
+
+            for (size_t nb = 0; nb < NB; ++nb) {
+                acc[r][nb][0] = dot_accumulate(acc[r][nb][0], ax, _mm_sign_epi8(w[nb][0], xb));
+                acc[r][nb][1] = dot_accumulate(acc[r][nb][1], ax, _mm_sign_epi8(w[nb][1], xb));
+            }
+        }
+    }
+
+    alignas(16) int32_t block[int8_block];
+
+    for (size_t r = 0; r < MR; ++r) {
+        for (size_t nb = 0; nb < NB; ++nb) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(block), acc[r][nb][0]);
+            _mm_store_si128(reinterpret_cast<__m128i*>(block + 4), acc[r][nb][1]);
+
+            const size_t o = first + nb * int8_block;
+
+            store_block(out + r * ldo + o, block, n - o);
+        }
+    }
+#else
+    for (size_t r = 0; r < MR; ++r) {
+        for (size_t nb = 0; nb < NB; ++nb) {
+            int32_t block[int8_block] = {};
+
+            for (size_t g = 0; g < groups; ++g) {
+                const int8_t* wg = packed + nb * block_bytes + g * int8_group * int8_block;
+                const int8_t* xg = x + r * ldx + g * int8_group;
+
+                for (size_t o = 0; o < int8_block; ++o) {
+                    for (size_t j = 0; j < int8_group; ++j) {
+                        block[o] += int32_t(xg[j]) * int32_t(wg[o * int8_group + j]);
+                    }
+                }
+            }
+
+            const size_t o = first + nb * int8_block;
+
+            store_block(out + r * ldo + o, block, n - o);
+        }
+    }
+#endif
+}
+
+/*!
+ * \brief Compute the tiles of MR rows of x, for all the blocks of outputs
+ */
+template <size_t MR>
+void gemm_rows(const int8_t* x, size_t ldx, const int8_t* packed, size_t groups, size_t n, int32_t* out, size_t ldo) {
+#if defined(__AVX2__)
+    constexpr size_t NB = 2;
+#else
+    constexpr size_t NB = 1;
+#endif
+
+    const size_t blocks      = int8_round_up(n, int8_block) / int8_block;
+    const size_t block_bytes = groups * int8_group * int8_block;
+
+    size_t blk = 0;
+
+    for (; blk + NB <= blocks; blk += NB) {
+        gemm_tile<MR, NB>(x, ldx, packed + blk * block_bytes, groups, blk * int8_block, n, out, ldo);
+    }
+
+    if constexpr (NB > 1) {
+        for (; blk < blocks; ++blk) {
+            gemm_tile<MR, 1>(x, ldx, packed + blk * block_bytes, groups, blk * int8_block, n, out, ldo);
+        }
+    }
+}
+
+} //end of namespace int8_detail
+
+/*!
+ * \brief Compute the int8 products of m rows of inputs with n packed rows
+ * of weights, with 32-bit accumulation: out(r, o) = sum_i x(r, i) * w(o, i).
+ *
+ * The rows are computed by tiles of 4 rows and 8 (or 16) outputs, keeping
+ * the accumulators in registers and without any horizontal reduction. The
+ * products are computed on |x| and w with the sign of x, with maddubs (or
+ * VNNI when available), which cannot saturate since the values are in
+ * [-127, 127].
+ *
+ * \param x The inputs, m rows read up to int8_round_up(k, 4)
+ * \param m The number of rows of inputs
+ * \param ldx The distance between two rows of inputs
+ * \param packed The weights packed with int8_pack
+ * \param n The number of outputs
+ * \param k The number of inputs
+ * \param out The outputs, m rows of n values
+ * \param ldo The distance between two rows of outputs
+ */
+inline void int8_gemm(const int8_t* x, size_t m, size_t ldx, const int8_t* packed, size_t n, size_t k, int32_t* out, size_t ldo) {
+    constexpr size_t MR = 4;
+
+    const size_t groups = int8_round_up(k, int8_group) / int8_group;
+
+    size_t r = 0;
+
+    for (; r + MR <= m; r += MR) {
+        int8_detail::gemm_rows<MR>(x + r * ldx, ldx, packed, groups, n, out + r * ldo, ldo);
+    }
+
+    switch (m - r) {
+        case 3:
+            int8_detail::gemm_rows<3>(x + r * ldx, ldx, packed, groups, n, out + r * ldo, ldo);
+            break;
+        case 2:
+            int8_detail::gemm_rows<2>(x + r * ldx, ldx, packed, groups, n, out + r * ldo, ldo);
+            break;
+        case 1:
+            int8_detail::gemm_rows<1>(x + r * ldx, ldx, packed, groups, n, out + r * ldo, ldo);
+            break;
+        default:
+            break;
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,294 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Analytical number of operations and of bytes moved by the layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+namespace dll {
+
+/*!
+ * \brief The analytical cost of one operation of a layer on one batch
+ */
+struct op_cost {
+    double flops = 0.0;          ///< The number of floating point operations
+    double bytes = 0.0;          ///< The number of bytes read and written, each value counted once
+    const char* timer = nullptr; ///< The name of the timer measuring the operation
+
+    /*!
+     * \brief Returns the arithmetic intensity (FLOP/Byte)
+     */
+    double intensity() const noexcept {
+        return bytes > 0.0 ? flops / bytes : 0.0;
+    }
+};
+
+/*!
+ * \brief The analytical cost of the operations of a layer on one batch.
+ *
+ * An operation without a timer is not done by the layer.
+ */
+struct layer_cost {
+    op_cost forward;   ///< The forward propagation
+    op_cost backward;  ///< The backpropagation of the errors to the input
+    op_cost gradients; ///< The computation of the gradients of the parameters
+
+    /*!
+     * \brief Indicates that the backward pass also computes the gradients,
+     * in which case the gradients are only computed separately by the first
+     * layer, which has no errors to backpropagate.
+     */
+    bool fused_gradients = false;
+};
+
+/*!
+ * \brief Returns the cost of a dense layer
+ * \param batch The number of samples in the batch
+ * \param v The number of inputs
+ * \param h The number of outputs
+ * \param s The size of one value
+ * \param timers The names of the forward, backward and gradients timers
+ */
+inline layer_cost dense_cost(size_t batch, size_t v, size_t h, size_t s, const char* const (&timers)[3]) {
+    const double B = batch;
+
+    layer_cost cost;
+
+    // Product, bias and activation
+    cost.forward = {2.0 * B * v * h + 2.0 * B * h, s * (B * v + double(v) * h + h + B * h), timers[0]};
+
+    // Product by the transposed weights
+    cost.backward = {2.0 * B * h * v, s * (B * h + double(v) * h + B * v), timers[1]};
+
+    // Outer products and sum of the errors
+    cost.gradients = {2.0 * B * v * h + B * h, s * (B * v + B * h + double(v) * h + h), timers[2]};
+
+    return cost;
+}
+
+/*!
+ * \brief Returns the cost of a 2D convolutional layer
+ * \param batch The number of samples in the batch
+ * \param nc The number of input channels
+ * \param nv The size of one input channel
+ * \param k The number of filters
+ * \param nh The size of one output channel
+ * \param nw The size of one filter
+ * \param s The size of one value
+ * \param timers The names of the forward, backward and gradients timers
+ */
+inline layer_cost conv_cost(size_t batch, size_t nc, size_t nv, size_t k, size_t nh, size_t nw, size_t s, const char* const (&timers)[3]) {
+    const double B     = batch;
+    const double macs  = B * k * nh * nc * nw;
+    const double input = B * nc * nv;
+    const double out   = B * k * nh;
+    const double w     = double(k) * nc * nw;
+
+    layer_cost cost;
+
+    // Convolution, bias and activation
+    cost.forward = {2.0 * macs + 2.0 * out, s * (input + w + k + out), timers[0]};
+
+    // Full convolution of the errors
+    cost.backward = {2.0 * macs, s * (out + w + input), timers[1]};
+
+    // Convolution of the input by the errors and sum of the errors
+    cost.gradients = {2.0 * macs + out, s * (input + out + w + k), timers[2]};
+
+    return cost;
+}
+
+/*!
+ * \brief Returns the cost of a 2D transposed convolutional layer
+ * \param batch The number of samples in the batch
+ * \param nc The number of input channels
+ * \param nv The size of one input channel
+ * \param k The number of filters
+ * \param nh The size of one output channel
+ * \param nw The size of one filter
+ * \param s The size of one value
+ * \param timers The names of the forward, backward and gradients timers
+ */
+inline layer_cost deconv_cost(size_t batch, size_t nc, size_t nv, size_t k, size_t nh, size_t nw, size_t s, const char* const (&timers)[3]) {
+    const double B     = batch;
+    const double macs  = B * k * nv * nc * nw;
+    const double input = B * nc * nv;
+    const double out   = B * k * nh;
+    const double w     = double(k) * nc * nw;
+
+    layer_cost cost;
+
+    // Full convolution, bias and activation
+    cost.forward = {2.0 * macs + 2.0 * out, s * (input + w + k + out), timers[0]};
+
+    // Valid convolution of the errors
+    cost.backward = {2.0 * macs, s * (out + w + input), timers[1]};
+
+    // Convolution of the errors by the input and sum of the errors
+    cost.gradients = {2.0 * macs + out, s * (input + out + w + k), timers[2]};
+
+    return cost;
+}
+
+/*!
+ * \brief Returns the cost of a pooling layer, without parameters
+ * \param batch The number of samples in the batch
+ * \param in The size of one input
+ * \param out The size of one output
+ * \param window The size of the pooling window
+ * \param s The size of one value
+ * \param timers The names of the forward and backward timers
+ */
+inline layer_cost pooling_cost(size_t batch, size_t in, size_t out, size_t window, size_t s, const char* const (&timers)[2]) {
+    const double B = batch;
+
+    layer_cost cost;
+
+    // One operation per value of each window
+    cost.forward = {B * out * window, s * (B * in + B * out), timers[0]};
+
+    // The errors are dispatched over the windows, from the input and the output
+    cost.backward = {B * in, s * (B * in + 2.0 * B * out + B * in), timers[1]};
+
+    return cost;
+}
+
+/*!
+ * \brief Returns the cost of a batch normalization layer in training
+ * \param batch The number of samples in the batch
+ * \param n The number of values of one sample
+ * \param features The number of normalized features (n for 2D, the channels for 4D)
+ * \param fused Indicates if the backward pass also computes the gradients
+ * \param s The size of one value
+ * \param timers The names of the forward, backward and gradients timers
+ */
+inline layer_cost batch_normalization_cost(size_t batch, size_t n, size_t features, bool fused, size_t s, const char* const (&timers)[3]) {
+    const double values = double(batch) * n;
+    const double f      = features;
+
+    layer_cost cost;
+
+    // Mean, variance, normalization, scale and shift
+    cost.forward = {8.0 * values, s * (2.0 * values + 4.0 * f), timers[0]};
+
+    // Reductions of the errors and of the normalized input
+    cost.gradients = {3.0 * values, s * (2.0 * values + 2.0 * f), timers[2]};
+
+    // Two reductions over the batch and the update of the errors
+    cost.backward = {7.0 * values, s * (3.0 * values + 3.0 * f), timers[1]};
+
+    if (fused) {
+        cost.backward.flops += cost.gradients.flops;
+        cost.backward.bytes += s * 2.0 * f;
+        cost.fused_gradients = true;
+    }
+
+    return cost;
+}
+
+/*!
+ * \brief Returns the cost of an embedding layer
+ *
+ * The indices are the input of the network, the errors are not
+ * backpropagated.
+ *
+ * \param batch The number of samples in the batch
+ * \param i The number of indices of one sample
+ * \param k The size of one embedding
+ * \param s The size of one value
+ * \param timers The names of the forward and gradients timers
+ */
+inline layer_cost embedding_cost(size_t batch, size_t i, size_t k, size_t s, const char* const (&timers)[2]) {
+    const double B = batch;
+
+    layer_cost cost;
+
+    // Copy of the rows of the embeddings
+    cost.forward = {0.0, s * (B * i + 2.0 * B * i * k), timers[0]};
+
+    // Accumulation of the errors into the rows
+    cost.gradients = {B * i * k, s * (B * i + 3.0 * B * i * k), timers[1]};
+
+    return cost;
+}
+
+/*!
+ * \brief Returns the number of steps done by the backpropagation through
+ * time of the recurrent layers.
+ *
+ * From each time step t, the errors are backpropagated down to the step
+ * T - bptt, which makes a quadratic number of steps.
+ *
+ * \param t The number of time steps
+ * \param bptt The number of steps of the truncated backpropagation
+ * \param last_only Indicates if only the last time step has errors
+ */
+inline double bptt_steps(size_t t, size_t bptt, bool last_only) {
+    const double T = t;
+    const double m = std::min(t, bptt);
+
+    if (last_only) {
+        return m;
+    } else if (bptt < t) {
+        return m * (m + 1.0) / 2.0;
+    } else {
+        return std::max(m, T * (T + 1.0) / 2.0 - 1.0);
+    }
+}
+
+/*!
+ * \brief Returns the cost of a recurrent layer with the given number of gates
+ *
+ * The backward pass computes the gradients during the backpropagation
+ * through time. The first layer computes the same pass for its gradients.
+ *
+ * \param batch The number of samples in the batch
+ * \param t The number of time steps
+ * \param sl The length of the sequences
+ * \param h The number of hidden units
+ * \param gates The number of gates (1 for a simple RNN, 4 for a LSTM)
+ * \param bptt The number of steps of the truncated backpropagation
+ * \param last_only Indicates if only the last time step has errors
+ * \param s The size of one value
+ * \param timers The names of the forward, backward and gradients timers
+ */
+inline layer_cost recurrent_cost(size_t batch, size_t t, size_t sl, size_t h, size_t gates, size_t bptt, bool last_only, size_t s, const char* const (&timers)[3]) {
+    const double B     = batch;
+    const double T     = t;
+    const double G     = gates;
+    const double input = B * T * sl;
+    const double out   = B * T * h;
+    const double w     = G * (double(sl) * h + double(h) * h + h);
+    const double steps = bptt_steps(t, bptt, last_only);
+
+    // The element-wise operations of the cell, per hidden unit and per time step
+    const double cell = gates == 1 ? 2.0 : 12.0;
+
+    layer_cost cost;
+
+    cost.forward = {2.0 * G * B * T * h * (sl + h) + cell * out, s * (input + w + (G + 1) * out), timers[0]};
+
+    // Each step backpropagates the errors to the input and to the previous
+    // step, and accumulates the gradients of the weights
+    const double step_flops = 4.0 * G * B * h * (sl + h) + (cell + G) * B * h;
+    const double step_bytes = 2.0 * B * sl + (G + 3) * B * h;
+
+    cost.backward  = {steps * step_flops, s * (steps * step_bytes + 2.0 * w), timers[1]};
+    cost.gradients = {steps * step_flops, s * (steps * step_bytes + 2.0 * w), timers[2]};
+
+    cost.fused_gradients = true;
+
+    return cost;
+}
+
+} //end of dll namespace
@@ -0,0 +1,152 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bounded queue of batches between two pipelined training stages
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace dll {
+
+/*!
+ * \brief The result of a pop from a pipeline_queue
+ */
+enum class pipeline_status {
+    BATCH, ///< A batch has been popped
+    EPOCH,  ///< The producer has finished an epoch
+    CLOSED, ///< The producer is done
+    ABORTED ///< The pipeline has been aborted
+};
+
+/*!
+ * \brief A bounded queue of batches, delimited in epochs, between a producer
+ * and a consumer thread.
+ *
+ * \tparam T The type of batch
+ */
+template <typename T>
+struct pipeline_queue {
+    using value_type = T; ///< The type of batch
+
+    /*!
+     * \brief Create a queue holding at most capacity batches
+     */
+    explicit pipeline_queue(size_t capacity) : capacity(capacity) {}
+
+    pipeline_queue(const pipeline_queue& rhs) = delete;
+    pipeline_queue& operator=(const pipeline_queue& rhs) = delete;
+
+    /*!
+     * \brief Push a batch, waiting for room in the queue
+     * \return false if the pipeline has been aborted, true otherwise
+     */
+    bool push(T&& batch) {
+        std::unique_lock<std::mutex> l(lock);
+
+        not_full.wait(l, [this] { return aborted || queue.size() < capacity; });
+
+        if (aborted) {
+            return false;
+        }
+
+        queue.emplace_back(std::move(batch));
+
+        not_empty.notify_one();
+
+        return true;
+    }
+
+    /*!
+     * \brief Mark the end of the current epoch of the producer
+     */
+    void end_epoch() {
+        std::lock_guard<std::mutex> l(lock);
+
+        queue.emplace_back(std::nullopt);
+
+        not_empty.notify_one();
+    }
+
+    /*!
+     * \brief Indicates that the producer will not push anything anymore
+     */
+    void close() {
+        std::lock_guard<std::mutex> l(lock);
+
+        closed = true;
+
+        not_empty.notify_one();
+    }
+
+    /*!
+     * \brief Abort the pipeline, waking up the producer and the consumer.
+     *
+     * The pending batches are dropped and all the following operations
+     * return immediately.
+     */
+    void abort() {
+        std::lock_guard<std::mutex> l(lock);
+
+        aborted = true;
+
+        queue.clear();
+
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    /*!
+     * \brief Pop the next batch, waiting for the producer
+     * \param batch The popped batch, only set if BATCH is returned
+     * \return The status of the pop
+     */
+    pipeline_status pop(T& batch) {
+        std::unique_lock<std::mutex> l(lock);
+
+        not_empty.wait(l, [this] { return aborted || closed || !queue.empty(); });
+
+        if (aborted) {
+            return pipeline_status::ABORTED;
+        }
+
+        if (queue.empty()) {
+            return pipeline_status::CLOSED;
+        }
+
+        auto status = pipeline_status::EPOCH;
+
+        if (queue.front()) {
+            batch  = std::move(*queue.front());
+            status = pipeline_status::BATCH;
+        }
+
+        queue.pop_front();
+
+        not_full.notify_one();
+
+        return status;
+    }
+
+private:
+    const size_t capacity; ///< The maximum number of batches in the queue
+
+    std::deque<std::optional<T>> queue; ///< The batches, epochs are delimited by empty elements
+    std::mutex lock;                    ///< The lock protecting the queue
+    std::condition_variable not_full;   ///< The condition the producer waits on
+    std::condition_variable not_empty;  ///< The condition the consumer waits on
+    bool closed  = false;               ///< Indicates that the producer is done
+    bool aborted = false;               ///< Indicates that the pipeline has been aborted
+};
+
+} //end of dll namespace
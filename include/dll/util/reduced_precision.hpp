@@ -0,0 +1,233 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file reduced_precision.hpp
+ * \brief Conversions between float and the bfloat16 and half precision formats.
+ */
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "dll/precision_type.hpp"
+
+#if defined(__AVX512BF16__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief Convert a float to bfloat16, rounding to nearest even
+ */
+inline uint16_t bf16_from_float(float f) {
+    uint32_t x = std::bit_cast<uint32_t>(f);
+
+    // Keep the NaN quiet, the rounding could turn them into infinities
+    if ((x & 0x7FFFFFFF) > 0x7F800000) {
+        return uint16_t((x >> 16) | 0x40);
+    }
+
+    x += 0x7FFF + ((x >> 16) & 1);
+
+    return uint16_t(x >> 16);
+}
+
+/*!
+ * \brief Convert a bfloat16 to float, exactly
+ */
+inline float bf16_to_float(uint16_t h) {
+    return std::bit_cast<float>(uint32_t(h) << 16);
+}
+
+/*!
+ * \brief Convert a float to half precision, rounding to nearest even.
+ *
+ * The values too large for half precision become infinities.
+ */
+inline uint16_t fp16_from_float(float f) {
+    uint32_t x          = std::bit_cast<uint32_t>(f);
+    const uint32_t sign = x & 0x80000000;
+
+    x ^= sign;
+
+    uint16_t h;
+
+    if (x >= (127 + 16) << 23) {
+        // Infinity or NaN (quiet)
+        h = x > 0x7F800000 ? 0x7E00 : 0x7C00;
+    } else if (x < (127 - 14) << 23) {
+        // Subnormal or zero, the addition aligns the mantissa bits and rounds
+        const uint32_t magic = (127 - 1) << 23;
+
+        h = uint16_t(std::bit_cast<uint32_t>(std::bit_cast<float>(x) + std::bit_cast<float>(magic)) - magic);
+    } else {
+        // Normal, rebias the exponent and round, a carry into the exponent gives infinity
+        const uint32_t odd = (x >> 13) & 1;
+
+        x -= (127 - 15) << 23;
+        x += 0xFFF + odd;
+
+        h = uint16_t(x >> 13);
+    }
+
+    return uint16_t(h | (sign >> 16));
+}
+
+/*!
+ * \brief Convert a half precision value to float, exactly
+ */
+inline float fp16_to_float(uint16_t h) {
+    const uint32_t shifted_exp = 0x7C00 << 13;
+
+    uint32_t x         = uint32_t(h & 0x7FFF) << 13;
+    const uint32_t exp = x & shifted_exp;
+
+    x += (127 - 15) << 23;
+
+    if (exp == shifted_exp) {
+        // Infinity or NaN
+        x += (128 - 16) << 23;
+    } else if (!exp) {
+        // Subnormal or zero, renormalize
+        x += 1 << 23;
+        x = std::bit_cast<uint32_t>(std::bit_cast<float>(x) - std::bit_cast<float>(uint32_t(113) << 23));
+    }
+
+    return std::bit_cast<float>(x | (uint32_t(h & 0x8000) << 16));
+}
+
+/*!
+ * \brief Round n values to the nearest value representable in the given
+ * precision, in place.
+ *
+ * This emulates the storage of the values in the reduced precision, the
+ * values are kept in their type. The AVX-512 BF16 conversion flushes the
+ * subnormal floats to zero, unlike the scalar conversion.
+ *
+ * \param values The values to round
+ * \param n The number of values
+ */
+template <precision_type P, typename T>
+void round_precision(T* values, size_t n) {
+    size_t i = 0;
+
+    if constexpr (P == precision_type::BF16 && std::is_same_v<T, float>) {
+#if defined(__AVX512BF16__)
+        for (; i + 16 <= n; i += 16) {
+            __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(values + i));
+            __m512i x  = _mm512_slli_epi32(_mm512_cvtepu16_epi32(__m256i(h)), 16);
+
+            _mm512_storeu_ps(values + i, _mm512_castsi512_ps(x));
+        }
+#endif
+    } else if constexpr (P == precision_type::FP16 && std::is_same_v<T, float>) {
+#if defined(__F16C__)
+        for (; i + 8 <= n; i += 8) {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+
+            _mm256_storeu_ps(values + i, _mm256_cvtph_ps(h));
+        }
+#endif
+    }
+
+    for (; i < n; ++i) {
+        if constexpr (P == precision_type::BF16) {
+            values[i] = bf16_to_float(bf16_from_float(float(values[i])));
+        } else if constexpr (P == precision_type::FP16) {
+            values[i] = fp16_to_float(fp16_from_float(float(values[i])));
+        }
+    }
+}
+
+/*!
+ * \brief Store n values in the given precision and round them in place.
+ *
+ * The values keep the rounded values, the stored values can be loaded back
+ * exactly with load_precision.
+ *
+ * \param values The values to store
+ * \param stored The stored values, in the reduced precision
+ * \param n The number of values
+ */
+template <precision_type P, typename T>
+void store_precision(T* values, uint16_t* stored, size_t n) {
+    size_t i = 0;
+
+    if constexpr (P == precision_type::BF16 && std::is_same_v<T, float>) {
+#if defined(__AVX512BF16__)
+        for (; i + 16 <= n; i += 16) {
+            __m256i h = __m256i(_mm512_cvtneps_pbh(_mm512_loadu_ps(values + i)));
+            __m512i x = _mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(stored + i), h);
+            _mm512_storeu_ps(values + i, _mm512_castsi512_ps(x));
+        }
+#endif
+    } else if constexpr (P == precision_type::FP16 && std::is_same_v<T, float>) {
+#if defined(__F16C__)
+        for (; i + 8 <= n; i += 8) {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(stored + i), h);
+            _mm256_storeu_ps(values + i, _mm256_cvtph_ps(h));
+        }
+#endif
+    }
+
+    for (; i < n; ++i) {
+        if constexpr (P == precision_type::BF16) {
+            stored[i] = bf16_from_float(float(values[i]));
+            values[i] = bf16_to_float(stored[i]);
+        } else if constexpr (P == precision_type::FP16) {
+            stored[i] = fp16_from_float(float(values[i]));
+            values[i] = fp16_to_float(stored[i]);
+        }
+    }
+}
+
+/*!
+ * \brief Load n values stored in the given precision
+ * \param stored The stored values, in the reduced precision
+ * \param values The loaded values
+ * \param n The number of values
+ */
+template <precision_type P, typename T>
+void load_precision(const uint16_t* stored, T* values, size_t n) {
+    size_t i = 0;
+
+    if constexpr (P == precision_type::BF16 && std::is_same_v<T, float>) {
+#if defined(__AVX512BF16__)
+        for (; i + 16 <= n; i += 16) {
+            __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stored + i));
+            __m512i x = _mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16);
+
+            _mm512_storeu_ps(values + i, _mm512_castsi512_ps(x));
+        }
+#endif
+    } else if constexpr (P == precision_type::FP16 && std::is_same_v<T, float>) {
+#if defined(__F16C__)
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(values + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(stored + i))));
+        }
+#endif
+    }
+
+    for (; i < n; ++i) {
+        if constexpr (P == precision_type::BF16) {
+            values[i] = bf16_to_float(stored[i]);
+        } else if constexpr (P == precision_type::FP16) {
+            values[i] = fp16_to_float(stored[i]);
+        }
+    }
+}
+
+} //end of dll namespace
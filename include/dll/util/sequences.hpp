@@ -0,0 +1,88 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Utilities to train stateful recurrent layers on long sequences
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Split a long sequence into chunks for stateful recurrent layers.
+ *
+ * The sequence is split into batch_size streams of equal length, each
+ * stream being split into chunks of time_steps steps. The chunks are
+ * ordered so that the sample at position i of a batch is continued by the
+ * sample at position i of the next batch. The steps that would not fill a
+ * chunk of every stream are dropped.
+ *
+ * \param sequence The (L, S) sequence
+ * \param time_steps The number of time steps of a chunk
+ * \param batch_size The batch size of the network
+ *
+ * \return the (time_steps, S) chunks, to be used without shuffling
+ */
+template <typename E>
+std::vector<etl::dyn_matrix<etl::value_t<E>, 2>> chunk_sequence(const E& sequence, size_t time_steps, size_t batch_size) {
+    const size_t S      = etl::dim<1>(sequence);
+    const size_t chunks = etl::dim<0>(sequence) / (batch_size * time_steps);
+    const size_t stream = chunks * time_steps;
+
+    std::vector<etl::dyn_matrix<etl::value_t<E>, 2>> samples;
+    samples.reserve(chunks * batch_size);
+
+    for (size_t c = 0; c < chunks; ++c) {
+        for (size_t b = 0; b < batch_size; ++b) {
+            samples.emplace_back(time_steps, S);
+
+            for (size_t t = 0; t < time_steps; ++t) {
+                samples.back()(t) = sequence(b * stream + c * time_steps + t);
+            }
+        }
+    }
+
+    return samples;
+}
+
+/*!
+ * \brief Returns the state carried by a stateful recurrent layer for a batch
+ * of the given size.
+ *
+ * The state is zero for the first batch. Since the samples of a batch
+ * continue the samples of the previous batch at the same positions, a
+ * change of the batch size breaks the sequences and the state is reset.
+ *
+ * \param state The carried state
+ * \param batch The size of the batch
+ * \param hidden_units The number of hidden units of the layer
+ *
+ * \return a reference to the state, of size (batch, hidden_units)
+ */
+template <typename T>
+etl::dyn_matrix<T, 2>& carried_state(etl::dyn_matrix<T, 2>& state, size_t batch, size_t hidden_units) {
+    if (etl::size(state) != batch * hidden_units) {
+        if (etl::size(state)) {
+            std::cerr << "dll: The batch size of a stateful recurrent layer changed from " << etl::dim<0>(state)
+                      << " to " << batch << ", its state is reset" << std::endl;
+        }
+
+        state.resize(batch, hidden_units);
+        state = 0;
+    }
+
+    return state;
+}
+
+} //end of dll namespace
@@ -11,9 +11,23 @@
 
 #ifndef DLL_NO_TIMERS
 
-#include <iosfwd>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #endif
 
@@ -42,6 +56,14 @@ struct stop_timer {
     }
 };
 
+/*!
+ * \brief The statistics of a timer, over all its scopes and threads
+ */
+struct timer_stats {
+    size_t count    = 0; ///< The number of calls
+    size_t duration = 0; ///< The total duration (ns)
+};
+
 #ifdef DLL_NO_TIMERS
 
 /*!
@@ -70,98 +92,522 @@ inline void dump_timers_pretty() {
     std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
 }
 
+/*!
+ * \brief Reset all timers.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void reset_timers() {}
+
+/*!
+ * \brief Returns the statistics of the timer with the given name.
+ *
+ * Nothing is recorded if the timers were disabled.
+ */
+inline timer_stats get_timer_stats(const char* /*name*/, size_t /*batch*/ = 0) {
+    return {};
+}
+
+/*!
+ * \brief Dump the timers of each thread to the console.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void dump_timers_threads() {
+    std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
+}
+
+/*!
+ * \brief Start recording the trace events.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void start_tracing() {}
+
+/*!
+ * \brief Stop recording the trace events.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void stop_tracing() {}
+
+/*!
+ * \brief Export the trace events.
+ *
+ * Nothing is recorded if the timers were disabled.
+ */
+inline bool export_chrome_trace(const std::string& /*file*/) {
+    std::cerr << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
+    return false;
+}
+
 struct auto_timer {
-    auto_timer(const char* /*name*/) {}
+    auto_timer(const char* /*name*/, size_t /*batch*/ = 0) {}
 };
 
 struct unsafe_auto_timer {
-    unsafe_auto_timer(const char* /*name*/) {}
+    unsafe_auto_timer(const char* /*name*/, size_t /*batch*/ = 0) {}
 };
 
 #else
 
-constexpr size_t max_timers = 128; ///< The maximum number of timers
+/*!
+ * \brief The number of buckets of the histogram of the durations of a scope.
+ *
+ * Each power of two is split into four buckets.
+ */
+constexpr size_t profile_buckets = 4 * 64;
+
+/*!
+ * \brief The maximum number of trace events recorded by one thread
+ */
+constexpr size_t max_trace_events = 1 << 20;
+
+/*!
+ * \brief The statistics of the calls of a scope on batches of one size
+ */
+struct batch_profile {
+    size_t batch    = 0; ///< The size of the batches
+    size_t count    = 0; ///< The number of calls
+    size_t duration = 0; ///< The total duration (ns)
+};
+
+/*!
+ * \brief A scope of the profiler, with the statistics of all its calls.
+ */
+struct profile_node {
+    const char* name = nullptr;          ///< The name of the scope
+    size_t parent    = 0;                ///< The index of the parent scope
+    size_t child     = 0;                ///< The index of the first child, 0 if none
+    size_t sibling   = 0;                ///< The index of the next sibling, 0 if none
+    size_t count     = 0;                ///< The number of calls
+    size_t duration  = 0;                ///< The total duration (ns)
+    size_t min       = 0;                ///< The minimum duration (ns)
+    size_t max       = 0;                ///< The maximum duration (ns)
+    size_t threads   = 0;                ///< The number of threads having called the scope (merged trees only)
+    std::array<size_t, profile_buckets> histogram{}; ///< The distribution of the durations
+    std::vector<batch_profile> batches;              ///< The calls by size of batch, for the timers given a batch size
+
+    /*!
+     * \brief Returns the histogram bucket of the given duration
+     */
+    static size_t bucket(size_t duration) {
+        if (duration < 4) {
+            return duration;
+        }
+
+        const size_t k = std::bit_width(duration) - 1;
+
+        return 4 * k + ((duration >> (k - 2)) & 3);
+    }
+
+    /*!
+     * \brief Returns the upper bound of the durations of the given bucket
+     */
+    static size_t bucket_bound(size_t b) {
+        if (b < 4) {
+            return b;
+        }
+
+        const size_t k = b / 4;
+
+        return ((4 + b % 4 + 1) << (k - 2)) - 1;
+    }
+
+    /*!
+     * \brief Returns the statistics of the calls on batches of the given size
+     */
+    batch_profile& batch_stats(size_t batch) {
+        for (auto& b : batches) {
+            if (b.batch == batch) {
+                return b;
+            }
+        }
+
+        batches.push_back({batch, 0, 0});
+
+        return batches.back();
+    }
+
+    /*!
+     * \brief Record one call of the given duration, on a batch of the given
+     * size (0 if unknown)
+     */
+    void add(size_t d, size_t batch = 0) {
+        min = count ? std::min(min, d) : d;
+        max = std::max(max, d);
+
+        ++count;
+        duration += d;
+        ++histogram[bucket(d)];
+
+        if (batch) {
+            auto& b = batch_stats(batch);
+
+            ++b.count;
+            b.duration += d;
+        }
+    }
+
+    /*!
+     * \brief Add the statistics of another node of the same scope
+     */
+    void merge(const profile_node& rhs) {
+        if (!rhs.count) {
+            return;
+        }
+
+        min = count ? std::min(min, rhs.min) : rhs.min;
+        max = std::max(max, rhs.max);
+
+        count += rhs.count;
+        duration += rhs.duration;
+
+        for (size_t b = 0; b < profile_buckets; ++b) {
+            histogram[b] += rhs.histogram[b];
+        }
+
+        for (auto& b : rhs.batches) {
+            auto& lhs = batch_stats(b.batch);
+
+            lhs.count += b.count;
+            lhs.duration += b.duration;
+        }
+    }
+
+    /*!
+     * \brief Reset the statistics, keeping the position in the tree
+     */
+    void reset() {
+        count    = 0;
+        duration = 0;
+        min      = 0;
+        max      = 0;
+        histogram.fill(0);
+        batches.clear();
+    }
+
+    /*!
+     * \brief Returns the given quantile of the durations, as the upper
+     * bound of its bucket.
+     */
+    size_t quantile(double q) const {
+        const size_t target = std::max(size_t(1), size_t(std::ceil(q * count)));
+
+        size_t seen = 0;
+
+        for (size_t b = 0; b < profile_buckets; ++b) {
+            seen += histogram[b];
+
+            if (seen >= target) {
+                return std::min(bucket_bound(b), max);
+            }
+        }
+
+        return max;
+    }
+};
 
 /*!
- * \brief A timer
+ * \brief A tree of scopes, the first node being the root.
  */
-struct timer_t {
-    const char* name;             ///< The name of the timer
-    std::atomic<size_t> count;    ///< The number of times it was incremented
-    std::atomic<size_t> duration; ///< The total duration
+struct profile_tree {
+    std::vector<profile_node> nodes; ///< The scopes
 
     /*!
-     * \brief Initialize an empty counter
+     * \brief Create a tree with only the root
      */
-    timer_t()
-            : name(nullptr), count(0), duration(0) {}
+    profile_tree() : nodes(1) {}
 
     /*!
-     * \brief Copy a timer
+     * \brief Returns the index of the child of the given node with the given name, creating it if necessary.
      */
-    timer_t(const timer_t& rhs)
-            : name(rhs.name), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    size_t child(size_t parent, const char* name) {
+        size_t last = 0;
+
+        for (size_t c = nodes[parent].child; c; c = nodes[c].sibling) {
+            if (nodes[c].name == name || !std::strcmp(nodes[c].name, name)) {
+                return c;
+            }
+
+            last = c;
+        }
+
+        const size_t c = nodes.size();
+
+        nodes.emplace_back();
+        nodes[c].name   = name;
+        nodes[c].parent = parent;
+
+        if (last) {
+            nodes[last].sibling = c;
+        } else {
+            nodes[parent].child = c;
+        }
+
+        return c;
+    }
 
     /*!
-     * \brief Copy assign a timer
+     * \brief Merge the given subtree of another tree under the given node of this tree
      */
-    timer_t& operator=(const timer_t& rhs) {
-        if (&rhs != this) {
-            name     = rhs.name;
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    void merge(size_t target, const profile_tree& rhs, size_t source) {
+        for (size_t c = rhs.nodes[source].child; c; c = rhs.nodes[c].sibling) {
+            const size_t t = child(target, rhs.nodes[c].name);
+
+            nodes[t].merge(rhs.nodes[c]);
+
+            // The nodes of a thread have no count of threads
+            nodes[t].threads += std::max(rhs.nodes[c].threads, size_t(rhs.nodes[c].count > 0));
+
+            merge(t, rhs, c);
         }
+    }
+};
+
+/*!
+ * \brief A complete scope, for the trace
+ */
+struct trace_event {
+    const char* name; ///< The name of the scope
+    size_t start;     ///< The start time (ns since the creation of the profiler)
+    size_t duration;  ///< The duration (ns)
+};
+
+/*!
+ * \brief The trace events kept after the exit of a thread
+ */
+struct thread_trace {
+    size_t id;                       ///< The index of the thread in the profiler
+    std::vector<trace_event> events; ///< The trace events
+    size_t dropped = 0;              ///< The number of trace events dropped when the buffer was full
+};
+
+/*!
+ * \brief The profile of one thread.
+ *
+ * Only the owning thread records into its profile, without any lock: it
+ * only raises its recording flag and checks that no other thread is
+ * reading. The threads reading or resetting the profile (the dumps, under
+ * the lock of the profiler) raise the reading flag and wait for the
+ * current record to end. The owning thread only waits while a dump reads
+ * its profile.
+ */
+struct thread_profile {
+    size_t id;                       ///< The index of the thread in the profiler
+    profile_tree tree;               ///< The scopes of the thread
+    size_t current = 0;              ///< The innermost running scope
+    std::vector<trace_event> events; ///< The trace events
+    size_t dropped = 0;              ///< The number of trace events dropped when the buffer was full
+
+    std::atomic<bool> recording{false}; ///< Indicates that the owning thread is recording
+    std::atomic<bool> reading{false};   ///< Indicates that another thread is reading the profile
+
+    /*!
+     * \brief Create the profile of the thread of the given index
+     */
+    explicit thread_profile(size_t id) : id(id) {}
+
+    /*!
+     * \brief Start a record, from the owning thread
+     */
+    void begin_record() {
+        // The flags are sequentially consistent: either the reader sees the
+        // record or the record sees the reader
+        recording.store(true);
+
+        while (reading.load()) {
+            recording.store(false);
 
-        return *this;
+            while (reading.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+
+            recording.store(true);
+        }
     }
 
     /*!
-     * \brief Move construct a timer
+     * \brief End a record, from the owning thread
      */
-    timer_t(timer_t&& rhs)
-            : name(std::move(rhs.name)), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    void end_record() {
+        recording.store(false, std::memory_order_release);
+    }
 
     /*!
-     * \brief Move assign a timer
+     * \brief Start reading the profile from another thread.
+     *
+     * The readers must be serialized by the lock of the profiler.
      */
-    timer_t& operator=(timer_t&& rhs) {
-        if (&rhs != this) {
-            name     = std::move(rhs.name);
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    void begin_read() {
+        reading.store(true);
+
+        while (recording.load()) {
+            std::this_thread::yield();
         }
+    }
+
+    /*!
+     * \brief Stop reading the profile from another thread
+     */
+    void end_read() {
+        reading.store(false, std::memory_order_release);
+    }
+};
+
+/*!
+ * \brief Read (or reset) the profile of a thread from another thread, for
+ * the duration of the scope
+ */
+struct profile_read_guard {
+    thread_profile& profile; ///< The profile being read
+
+    /*!
+     * \brief Wait for the current record of the given profile to end
+     */
+    explicit profile_read_guard(thread_profile& profile) : profile(profile) {
+        profile.begin_read();
+    }
 
-        return *this;
+    profile_read_guard(const profile_read_guard& rhs) = delete;
+    profile_read_guard& operator=(const profile_read_guard& rhs) = delete;
+
+    /*!
+     * \brief Let the owning thread record again
+     */
+    ~profile_read_guard() {
+        profile.end_read();
     }
 };
 
 /*!
- * \brief The structure holding all the timers
+ * \brief The profiler, holding the profiles of all the threads.
+ *
+ * The profile of a thread is released when the thread exits: its scopes are
+ * merged into the retired tree and its trace events are kept, up to
+ * max_trace_events for all the exited threads.
  */
-struct timers_t {
-    std::array<timer_t, max_timers> timers; ///< The timers
-    std::mutex lock; ///< The lock to protect the timers
+struct profiler_t {
+    std::vector<std::unique_ptr<thread_profile>> threads;            ///< The profiles of the running threads
+    profile_tree retired;                                            ///< The scopes of the exited threads
+    std::vector<thread_trace> retired_traces;                        ///< The trace events of the exited threads
+    size_t retired_events = 0;                                       ///< The number of trace events of the exited threads
+    size_t next_id        = 0;                                       ///< The index of the next thread
+    std::mutex lock;                                                 ///< The lock protecting the list of threads and the retired data
+    std::atomic<bool> tracing{false};                                ///< Indicates if the trace events are recorded
+    std::chrono::time_point<std::chrono::steady_clock> epoch = std::chrono::steady_clock::now(); ///< The origin of the trace
+
+    /*!
+     * \brief Register a new thread
+     */
+    thread_profile* register_thread() {
+        std::lock_guard<std::mutex> l(lock);
+
+        threads.push_back(std::make_unique<thread_profile>(next_id++));
+
+        return threads.back().get();
+    }
+
+    /*!
+     * \brief Release the profile of an exiting thread, keeping its
+     * statistics and its trace events.
+     */
+    void retire_thread(thread_profile* profile) {
+        std::lock_guard<std::mutex> l(lock);
+
+        retired.merge(0, profile->tree, 0);
+
+        if (!profile->events.empty() || profile->dropped) {
+            const size_t kept = std::min(profile->events.size(), max_trace_events - std::min(max_trace_events, retired_events));
+
+            thread_trace trace{profile->id, {}, profile->dropped + profile->events.size() - kept};
+            trace.events.assign(profile->events.begin(), profile->events.begin() + kept);
+
+            retired_events += kept;
+            retired_traces.push_back(std::move(trace));
+        }
+
+        threads.erase(std::find_if(threads.begin(), threads.end(), [profile](auto& thread) { return thread.get() == profile; }));
+    }
+
+    /*!
+     * \brief Reset the statistics and the trace events of all the threads
+     */
+    void reset() {
+        std::lock_guard<std::mutex> l(lock);
+
+        for (auto& thread : threads) {
+            profile_read_guard guard(*thread);
+
+            for (auto& node : thread->tree.nodes) {
+                node.reset();
+            }
+
+            thread->events.clear();
+            thread->dropped = 0;
+        }
+
+        retired = profile_tree();
+        retired_traces.clear();
+        retired_events = 0;
+    }
 
     /*!
-     * \brief Reset the status of the timers
+     * \brief Returns the scopes of all the threads merged together
      */
-    void reset(){
+    profile_tree merged() {
         std::lock_guard<std::mutex> l(lock);
 
-        for(auto& timer : timers){
-            timer.name = nullptr;
-            timer.duration = 0;
-            timer.count = 0;
+        profile_tree tree;
+
+        tree.merge(0, retired, 0);
+
+        for (auto& thread : threads) {
+            profile_read_guard guard(*thread);
+
+            tree.merge(0, thread->tree, 0);
         }
+
+        return tree;
     }
 };
 
 /*!
- * \brief Get a reference to the timer structure
+ * \brief Get a reference to the profiler
  */
-inline timers_t& get_timers() {
-    static timers_t timers;
-    return timers;
+inline profiler_t& get_profiler() {
+    static profiler_t profiler;
+    return profiler;
+}
+
+/*!
+ * \brief The owner of the profile of a thread, releasing it when the thread exits
+ */
+struct thread_profile_owner {
+    thread_profile* profile; ///< The profile of the thread
+
+    /*!
+     * \brief Register the profile of the current thread
+     */
+    thread_profile_owner() : profile(get_profiler().register_thread()) {}
+
+    thread_profile_owner(const thread_profile_owner& rhs) = delete;
+    thread_profile_owner& operator=(const thread_profile_owner& rhs) = delete;
+
+    /*!
+     * \brief Release the profile of the current thread
+     */
+    ~thread_profile_owner() {
+        get_profiler().retire_thread(profile);
+    }
+};
+
+/*!
+ * \brief Get a reference to the profile of the current thread
+ */
+inline thread_profile& local_profile() {
+    thread_local thread_profile_owner owner;
+    return *owner.profile;
 }
 
 inline std::string to_string_precision(double duration, int precision = 6) {
@@ -186,268 +632,431 @@ inline std::string duration_str(double duration, int precision = 6) {
  * \brief Reset all timers
  */
 inline void reset_timers() {
-    decltype(auto) timers = get_timers();
-    timers.reset();
+    get_profiler().reset();
 }
 
 /*!
- * \brief Dump the values of the timer on the console.
- *
- * This has no effect if the timers were disabled.
+ * \brief Start recording the trace events, to be exported with
+ * export_chrome_trace().
  */
-inline void dump_timers() {
-    decltype(auto) timers = get_timers().timers;
+inline void start_tracing() {
+    get_profiler().tracing = true;
+}
+
+/*!
+ * \brief Stop recording the trace events
+ */
+inline void stop_tracing() {
+    get_profiler().tracing = false;
+}
+
+namespace profiler_detail {
+
+/*!
+ * \brief Returns the timers aggregated by name, sorted by duration (DESC)
+ */
+inline std::vector<profile_node> flat_timers() {
+    auto tree = get_profiler().merged();
+
+    std::vector<profile_node> timers;
+
+    for (size_t i = 1; i < tree.nodes.size(); ++i) {
+        auto& node = tree.nodes[i];
+
+        if (!node.count) {
+            continue;
+        }
+
+        auto it = std::find_if(timers.begin(), timers.end(), [&node](auto& timer) { return !std::strcmp(timer.name, node.name); });
+
+        if (it == timers.end()) {
+            timers.push_back(node);
+        } else {
+            it->merge(node);
+        }
+    }
 
-    //Sort the timers by duration (DESC)
     std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
         return left.duration > right.duration;
     });
 
-    // Print all the used timers
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-            std::cout << timer.name << "(" << count << ") : "
-                      << duration_str(duration)
-                      << " (" << duration_str(duration / count) << ")" << std::endl;
+    return timers;
+}
+
+/*!
+ * \brief Returns the number of calls recorded in the subtree of the given node
+ */
+inline size_t subtree_count(const profile_tree& tree, size_t n) {
+    size_t count = tree.nodes[n].count;
+
+    for (size_t c = tree.nodes[n].child; c; c = tree.nodes[c].sibling) {
+        count += subtree_count(tree, c);
+    }
+
+    return count;
+}
+
+/*!
+ * \brief Append the rows of the given node and its children, sorted by duration (DESC)
+ */
+inline void tree_rows(const profile_tree& tree, size_t n, size_t depth, bool show_threads, std::vector<std::vector<std::string>>& rows) {
+    std::vector<size_t> children;
+
+    for (size_t c = tree.nodes[n].child; c; c = tree.nodes[c].sibling) {
+        if (subtree_count(tree, c)) {
+            children.push_back(c);
+        }
+    }
+
+    std::sort(children.begin(), children.end(), [&tree](size_t left, size_t right) {
+        return tree.nodes[left].duration > tree.nodes[right].duration;
+    });
+
+    // The percentage is relative to the parent, or to the longest scope at the top
+    double reference = n ? tree.nodes[n].duration : 0.0;
+
+    for (size_t c : children) {
+        reference = std::max(reference, double(tree.nodes[c].duration));
+    }
+
+    for (size_t c : children) {
+        auto& node = tree.nodes[c];
+
+        std::vector<std::string> row;
+
+        row.push_back(to_string_precision(reference ? 100.0 * (node.duration / reference) : 0.0, 4) + "%");
+        row.push_back(std::string(2 * depth, ' ') + node.name);
+        row.push_back(std::to_string(node.count));
+
+        if (show_threads) {
+            row.push_back(std::to_string(node.threads));
+        }
+
+        if (node.count) {
+            row.push_back(duration_str(node.duration));
+            row.push_back(duration_str(node.min));
+            row.push_back(duration_str(node.duration / node.count));
+            row.push_back(duration_str(node.quantile(0.99)));
+            row.push_back(duration_str(node.max));
+        } else {
+            row.insert(row.end(), 5, "-");
+        }
+
+        rows.push_back(std::move(row));
+
+        tree_rows(tree, c, depth + 1, show_threads, rows);
+    }
+}
+
+/*!
+ * \brief Print the given rows in the form of a nice table
+ */
+inline void print_table(const std::vector<std::string>& header, const std::vector<std::vector<std::string>>& rows) {
+    const size_t columns = header.size();
+
+    std::vector<size_t> column_length(columns);
+
+    for (size_t i = 0; i < columns; ++i) {
+        column_length[i] = header[i].size();
+
+        for (auto& row : rows) {
+            column_length[i] = std::max(column_length[i], row[i].size());
+        }
+    }
+
+    const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length.begin(), column_length.end(), size_t(0));
+
+    auto print_row = [&](const std::vector<std::string>& row) {
+        std::cout << " |";
+
+        for (size_t i = 0; i < columns; ++i) {
+            printf(" %-*s |", int(column_length[i]), row[i].c_str());
+        }
+
+        std::cout << '\n';
+    };
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+    print_row(header);
+    std::cout << " " << std::string(line_length, '-') << '\n';
+
+    for (auto& row : rows) {
+        print_row(row);
+    }
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+}
+
+/*!
+ * \brief Escape a string for JSON
+ */
+inline std::string json_escape(const char* str) {
+    std::string escaped;
+
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') {
+            escaped += '\\';
+            escaped += *str;
+        } else if (static_cast<unsigned char>(*str) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(*str));
+            escaped += code;
+        } else {
+            escaped += *str;
+        }
+    }
+
+    return escaped;
+}
+
+} //end of namespace profiler_detail
+
+/*!
+ * \brief Returns the statistics of the timer with the given name,
+ * aggregated over all its scopes and threads.
+ *
+ * \param name The name of the timer
+ * \param batch If not zero, only the calls on batches of this size are counted
+ */
+inline timer_stats get_timer_stats(const char* name, size_t batch = 0) {
+    for (auto& timer : profiler_detail::flat_timers()) {
+        if (!std::strcmp(timer.name, name)) {
+            if (!batch) {
+                return {timer.count, timer.duration};
+            }
+
+            for (auto& b : timer.batches) {
+                if (b.batch == batch) {
+                    return {b.count, b.duration};
+                }
+            }
+
+            return {};
         }
     }
+
+    return {};
+}
+
+/*!
+ * \brief Dump the values of the timer on the console.
+ *
+ * The timers are aggregated by name, regardless of their parents.
+ */
+inline void dump_timers() {
+    for (auto& timer : profiler_detail::flat_timers()) {
+        std::cout << timer.name << "(" << timer.count << ") : "
+                  << duration_str(timer.duration)
+                  << " (" << duration_str(timer.duration / timer.count) << ")" << std::endl;
+    }
 }
 
 /*!
  * \brief Dump all timers values to the console, with percentage of time from
  * the total.
  *
- * The total is the counter with the maximum total time
+ * The total is the counter with the maximum total time. The timers are
+ * aggregated by name, regardless of their parents.
  */
 inline void dump_timers_one() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = profiler_detail::flat_timers();
 
-    if(timers.empty()){
+    if (timers.empty()) {
         return;
     }
 
-    //Sort the timers by duration (DESC)
-    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
-        return left.duration > right.duration;
-    });
-
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
-    // Print all the used timers
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-            std::cout << timer.name << "(" << count << ") : "
-                      << duration_str(duration)
-                      << " (" << 100.0 * (duration / total_duration) << "%, " << duration_str(duration / count) << ")" << std::endl;
-        }
+    for (auto& timer : timers) {
+        std::cout << timer.name << "(" << timer.count << ") : "
+                  << duration_str(timer.duration)
+                  << " (" << 100.0 * (timer.duration / total_duration) << "%, " << duration_str(timer.duration / timer.count) << ")" << std::endl;
     }
 }
 
 /*!
- * \brief Dump all timers values to the console in the form of a nice table.
+ * \brief Dump the hierarchy of timers of all the threads to the console in
+ * the form of a nice table.
+ *
+ * The scopes of the different threads are merged by path. The percentage
+ * of a scope is relative to its parent.
  */
 inline void dump_timers_pretty() {
-    decltype(auto) timers = get_timers().timers;
+    auto tree = get_profiler().merged();
+
+    std::vector<std::vector<std::string>> rows;
+    profiler_detail::tree_rows(tree, 0, 0, true, rows);
 
-    if(timers.empty()){
+    if (rows.empty()) {
         std::cout << "No timers have been recorded!" << std::endl;
         return;
     }
 
     std::cout << std::endl;
 
-    //Sort the timers by duration (DESC)
-    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
-        return left.duration > right.duration;
-    });
+    profiler_detail::print_table({"%", "Timer", "Count", "Threads", "Total", "Min", "Mean", "P99", "Max"}, rows);
+}
 
-    double total_duration = timers.front().duration.load();
-
-    constexpr size_t columns = 5;
-
-    std::string column_name[columns];
-    column_name[0] = "%";
-    column_name[1] = "Timer";
-    column_name[2] = "Count";
-    column_name[3] = "Total";
-    column_name[4] = "Average";
-
-    size_t column_length[columns];
-    column_length[0] = 8;
-    column_length[1] = column_name[1].size();
-    column_length[2] = column_name[2].size();
-    column_length[3] = column_name[3].size();
-    column_length[4] = column_name[4].size();
-
-    // Compute the width of each column
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-
-            column_length[1] = std::max(column_length[1], std::string(timer.name).size());
-            column_length[2] = std::max(column_length[2], std::to_string(count).size());
-            column_length[3] = std::max(column_length[3], duration_str(duration).size());
-            column_length[4] = std::max(column_length[4], duration_str(duration / count).size());
-        }
-    }
+/*!
+ * \brief Dump the hierarchy of timers of each thread to the console in the
+ * form of nice tables.
+ */
+inline void dump_timers_threads() {
+    auto& profiler = get_profiler();
 
-    const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length, column_length + columns, 0);
+    std::lock_guard<std::mutex> l(profiler.lock);
 
-    std::cout << " " << std::string(line_length, '-') << '\n';
+    for (auto& thread : profiler.threads) {
+        std::vector<std::vector<std::string>> rows;
 
-    printf(" | %-*s | %-*s | %-*s | %-*s | %-*s |\n",
-        int(column_length[0]), column_name[0].c_str(),
-        int(column_length[1]), column_name[1].c_str(),
-        int(column_length[2]), column_name[2].c_str(),
-        int(column_length[3]), column_name[3].c_str(),
-        int(column_length[4]), column_name[4].c_str());
+        {
+            profile_read_guard guard(*thread);
+            profiler_detail::tree_rows(thread->tree, 0, 0, false, rows);
+        }
 
-    std::cout << " " << std::string(line_length, '-') << '\n';
+        if (!rows.empty()) {
+            std::cout << std::endl << " Thread " << thread->id << std::endl;
 
-    // Print all the used timers
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-
-            printf(" | %*.3f%% | %-*s | %-*s | %-*s | %-*s |\n",
-                int(column_length[0] - 1), 100.0 * (duration / double(total_duration)),
-                int(column_length[1]), timer.name,
-                int(column_length[2]), std::to_string(count).c_str(),
-                int(column_length[3]), duration_str(duration).c_str(),
-                int(column_length[4]), duration_str(duration / count).c_str());
+            profiler_detail::print_table({"%", "Timer", "Count", "Total", "Min", "Mean", "P99", "Max"}, rows);
         }
     }
 
-    std::cout << " " << std::string(line_length, '-') << '\n';
+    std::vector<std::vector<std::string>> rows;
+    profiler_detail::tree_rows(profiler.retired, 0, 0, true, rows);
+
+    if (!rows.empty()) {
+        std::cout << std::endl << " Exited threads" << std::endl;
+
+        profiler_detail::print_table({"%", "Timer", "Count", "Threads", "Total", "Min", "Mean", "P99", "Max"}, rows);
+    }
 }
 
 /*!
- * \brief Automatic timer with RAII.
+ * \brief Export the trace events recorded since start_tracing() in the
+ * Chrome trace event format (JSON), to be opened in a trace viewer.
+ * \param file The path to the output file
+ * \return true if the trace was written, false otherwise
  */
-struct auto_timer {
-    const char* name;                               ///< The name of the timer
-    std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
-    std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
+inline bool export_chrome_trace(const std::string& file) {
+    std::ofstream os(file);
 
-    /*!
-     * \brief Create an auto_timer witht the given name
-     * \param name The name of the timer
-     */
-    auto_timer(const char* name) : name(name) {
-        start = std::chrono::steady_clock::now();
+    if (!os) {
+        std::cerr << "dll: Unable to open " << file << " to export the trace" << std::endl;
+        return false;
     }
 
-    /*!
-     * \brief Destructs the timer, effectively incrementing the timer.
-     */
-    ~auto_timer() {
-        end           = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    auto& profiler = get_profiler();
 
-        decltype(auto) timers = get_timers();
+    std::lock_guard<std::mutex> l(profiler.lock);
 
-        // Try to increment without the lock
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
 
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
+    bool first = true;
 
-                return;
-            }
-        }
+    auto write_events = [&os, &first](size_t id, const std::vector<trace_event>& events, size_t dropped) {
+        os << (first ? "\n" : ",\n")
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << id
+           << ",\"args\":{\"name\":\"thread " << id << "\"}}";
 
-        {
-            std::lock_guard<std::mutex> lock(timers.lock);
+        first = false;
 
-            // Retry again to increment with lock
+        for (auto& event : events) {
+            os << ",\n{\"name\":\"" << profiler_detail::json_escape(event.name)
+               << "\",\"cat\":\"dll\",\"ph\":\"X\",\"pid\":0,\"tid\":" << id
+               << ",\"ts\":" << to_string_precision(event.start / 1000.0, 15)
+               << ",\"dur\":" << to_string_precision(event.duration / 1000.0, 15) << "}";
+        }
 
-            for (decltype(auto) timer : timers.timers) {
-                if (timer.name == name) {
-                    timer.duration += duration;
-                    ++timer.count;
+        if (dropped) {
+            std::cerr << "dll: " << dropped << " trace events of thread " << id << " have been dropped" << std::endl;
+        }
+    };
 
-                    return;
-                }
-            }
+    for (auto& thread : profiler.threads) {
+        profile_read_guard guard(*thread);
 
-            // At this point the timer does not exist, create it
+        write_events(thread->id, thread->events, thread->dropped);
+    }
 
-            for (decltype(auto) timer : timers.timers) {
-                if (!timer.name) {
-                    timer.name     = name;
-                    timer.duration = duration;
-                    timer.count    = 1;
+    for (auto& trace : profiler.retired_traces) {
+        write_events(trace.id, trace.events, trace.dropped);
+    }
 
-                    return;
-                }
-            }
-        }
+    os << "\n]}\n";
 
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
-    }
-};
+    return bool(os);
+}
 
 /*!
- * \brief Automatic timer with RAII, without synchronization.
+ * \brief Automatic timer with RAII.
+ *
+ * The timer is recorded as a child of the innermost running timer of the
+ * same thread. Each thread records into its own profile, without any lock,
+ * and only waits while a dump reads its profile.
  */
-struct unsafe_auto_timer {
-    const char* name;                                         ///< The name of the timer
+struct auto_timer {
+    thread_profile& profile;                                  ///< The profile of the thread
+    size_t node;                                              ///< The scope in the profile
+    size_t batch;                                             ///< The size of the timed batch, 0 if unknown
     std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
-    std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
 
     /*!
-     * \brief Create an unsafe_auto_timer witht the given name
+     * \brief Create an auto_timer witht the given name
      * \param name The name of the timer
+     * \param batch The size of the timed batch, to get the statistics by size of batch
      */
-    unsafe_auto_timer(const char* name) : name(name) {
+    auto_timer(const char* name, size_t batch = 0) : profile(local_profile()), batch(batch) {
+        profile.begin_record();
+
+        node            = profile.tree.child(profile.current, name);
+        profile.current = node;
+
+        profile.end_record();
+
         start = std::chrono::steady_clock::now();
     }
 
+    auto_timer(const auto_timer& rhs) = delete;
+    auto_timer& operator=(const auto_timer& rhs) = delete;
+
     /*!
      * \brief Destructs the timer, effectively incrementing the timer.
      */
-    ~unsafe_auto_timer() {
-        end           = std::chrono::steady_clock::now();
+    ~auto_timer() {
+        auto end      = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
-        decltype(auto) timers = get_timers();
-
-        // Increment the timer if it exists
+        profile.begin_record();
 
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
+        auto& n = profile.tree.nodes[node];
 
-                return;
-            }
-        }
+        n.add(duration, batch);
 
-        // At this point the timer does not exist, create it
+        profile.current = n.parent;
 
-        for (decltype(auto) timer : timers.timers) {
-            if (!timer.name) {
-                timer.name     = name;
-                timer.duration = duration;
-                timer.count    = 1;
+        auto& profiler = get_profiler();
 
-                return;
+        if (profiler.tracing.load(std::memory_order_relaxed)) {
+            if (profile.events.size() < max_trace_events) {
+                auto since = std::chrono::duration_cast<std::chrono::nanoseconds>(start - profiler.epoch).count();
+                profile.events.push_back({n.name, size_t(since), size_t(duration)});
+            } else {
+                ++profile.dropped;
             }
         }
 
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
+        profile.end_record();
     }
 };
 
+/*!
+ * \brief Automatic timer with RAII, without synchronization.
+ *
+ * Since the timers of each thread are only synchronized with the dumps,
+ * this is the same as auto_timer.
+ */
+using unsafe_auto_timer = auto_timer;
+
 #endif
 
 } //end of namespace dll
@@ -242,6 +242,11 @@ struct default_dbn_watcher {
             std::cout << " weight_cost(L2)=" << dbn.l2_weight_cost << std::endl;
         }
 
+        if (network_traits<DBN>::mixed_precision()) {
+            std::cout << "       precision=" << dll::to_string(network_traits<DBN>::precision()) << std::endl;
+            std::cout << "      loss_scale=" << dbn.loss_scale << std::endl;
+        }
+
         std::cout << std::endl;
 
         ft_max_epochs = max_epochs;
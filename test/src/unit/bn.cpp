@@ -5,6 +5,7 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cstdio>
 #include <deque>
 
 #include "dll_test.hpp"
@@ -16,6 +17,7 @@
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/network.hpp"
 #include "dll/datasets.hpp"
+#include "dll/fused_network.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -204,3 +206,89 @@ DLL_TEST_CASE("unit/bn/5", "[unit][bn]") {
     FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
     TEST_CHECK_2(net, dataset, 0.25);
 }
+
+// (Conv) BN before the non-linearity, fused for inference
+DLL_TEST_CASE("unit/bn/fused/1", "[unit][bn]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::no_bias, dll::no_activation>::layer_t,
+            dll::batch_normalization_4d_layer_desc<6, 24, 24>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<6 * 24 * 24, 200, dll::no_bias, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<200>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<200, 10, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SOFTMAX>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::early_training, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->initial_momentum = 0.9;
+    net->final_momentum   = 0.9;
+    net->learning_rate    = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
+    TEST_CHECK_2(net, dataset, 0.25);
+
+    auto fused = dll::fuse_inference(*net);
+
+    fused.display();
+
+    REQUIRE(fused.fused_layers() == 3);
+
+    auto test_error  = net->evaluate_error(dataset.test());
+    auto fused_error = fused.evaluate_error(dataset.test());
+
+    std::cout << "fused_error:" << fused_error << std::endl;
+
+    REQUIRE(std::abs(fused_error - test_error) < 1e-2);
+}
+
+// (Dense) BN network stored in a versioned model file
+DLL_TEST_CASE("unit/bn/model/1", "[unit][bn]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 200, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<200>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<200, 10, dll::softmax>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+
+    using other_network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t
+        >,
+        dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
+    TEST_CHECK_2(net, dataset, 0.25);
+
+    REQUIRE(net->store_model("bn_model_1.dll"));
+
+    auto loaded = std::make_unique<network_t>();
+
+    REQUIRE(loaded->load_model("bn_model_1.dll"));
+
+    REQUIRE(loaded->evaluate_error(dataset.test()) == net->evaluate_error(dataset.test()));
+    REQUIRE(etl::sum(loaded->layer_get<1>().mean) == etl::sum(net->layer_get<1>().mean));
+
+    // The manifest must not match another network
+    auto other = std::make_unique<other_network_t>();
+
+    REQUIRE(!other->load_model("bn_model_1.dll"));
+
+    std::remove("bn_model_1.dll");
+}
@@ -13,6 +13,7 @@
 #include "dll/neural/dense/dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/datasets.hpp"
+#include "dll/int8_network.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -159,3 +160,29 @@ DLL_TEST_CASE("unit/conv/sgd/partial/1", "[conv][dbn][mnist][sgd]") {
 
     TEST_CHECK(0.25);
 }
+
+DLL_TEST_CASE("unit/conv/int8/1", "[conv][dbn][mnist][int8]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<6 * 24 * 24, 10, dll::activation<dll::function::SIGMOID>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    // Load the dataset
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 5e-2);
+
+    auto float_error = dbn->evaluate_error(dataset.test());
+
+    auto int8_dbn = dll::quantize_int8(*dbn, dataset.train(), 10);
+
+    auto int8_error = int8_dbn.evaluate_error(dataset.test());
+    std::cout << "int8_error:" << int8_error << std::endl;
+
+    REQUIRE(int8_error < float_error + 0.02);
+}
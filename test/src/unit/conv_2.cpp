@@ -92,3 +92,34 @@ DLL_TEST_CASE("unit/conv/sgd/8", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.25);
 }
+
+DLL_TEST_CASE("unit/conv/sgd/memory_plan/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::mp_2d_layer<6, 24, 24, 2, 2>,
+            dll::conv_layer_desc<6, 12, 12, 6, 5, 5, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::dense_layer_desc<6 * 8 * 8, 200, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::dense_layer_desc<200, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::memory_plan, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate    = 0.001;
+    dbn->initial_momentum = 0.9;
+    dbn->final_momentum   = 0.9;
+
+    FT_CHECK(50, 6e-2);
+    TEST_CHECK(0.25);
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    std::cout << "planned:" << trainer.memory_planner.planned_memory() << " unplanned:" << trainer.memory_planner.unplanned_memory() << std::endl;
+
+    REQUIRE(trainer.memory_planner.planned_memory() < trainer.memory_planner.unplanned_memory());
+}
@@ -5,11 +5,16 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cstdlib>
 #include <deque>
+#include <filesystem>
+#include <fstream>
 
 #include "dll_test.hpp"
 
 #include "dll/neural/conv/conv_layer.hpp"
+#include "dll/neural/conv/dyn_conv_layer.hpp"
+#include "dll/util/conv_registry.hpp"
 #include "dll/neural/dense/dense_layer.hpp"
 #include "dll/neural/activation/activation_layer.hpp"
 #include "dll/dbn.hpp"
@@ -70,3 +75,150 @@ DLL_TEST_CASE("unit/conv/sgd/10", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.22);
 }
+
+DLL_TEST_CASE("unit/conv/algorithm/1", "[unit][conv]") {
+    etl::dyn_matrix<float, 4> input(2, 3, 12, 12);
+    etl::dyn_matrix<float, 4> w(4, 3, 3, 3);
+
+    input = etl::normal_generator(0.0, 1.0);
+    w     = etl::normal_generator(0.0, 0.1);
+
+    etl::dyn_matrix<float, 4> direct(2, 4, 12, 12);
+    etl::dyn_matrix<float, 4> output(2, 4, 12, 12);
+
+    dll::conv_forward(dll::conv_algorithm::DIRECT, direct, input, w, 1, 1);
+
+    for (auto algorithm : {dll::conv_algorithm::IM2COL, dll::conv_algorithm::FFT, dll::conv_algorithm::WINOGRAD}) {
+        output = 0.0;
+
+        dll::conv_forward(algorithm, output, input, w, 1, 1);
+
+        REQUIRE(etl::approx_equals(output, direct, 1e-3));
+    }
+}
+
+DLL_TEST_CASE("unit/conv/algorithm/2", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::RELU>, dll::conv_algo<dll::conv_algorithm::AUTO>>::layer_t,
+            dll::mp_3d_layer_desc<6, 24, 24, 1, 2, 2>::layer_t,
+            dll::dense_layer_desc<6 * 12 * 12, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::NADAM>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    // Keep the tuned shapes out of the working directory
+    auto cache = std::filesystem::temp_directory_path() / "dll_test_conv_cache";
+
+    std::filesystem::remove(cache);
+    setenv("DLL_CONV_CACHE", cache.c_str(), 1);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.002;
+
+    FT_CHECK(25, 6e-2);
+    TEST_CHECK(0.3);
+
+    // The shape is tuned once, whatever the number of images of the batches
+
+    std::ifstream stream(cache);
+
+    size_t entries = 0;
+    std::string line;
+
+    while (std::getline(stream, line)) {
+        ++entries;
+    }
+
+    REQUIRE(entries == 1);
+
+    std::filesystem::remove(cache);
+}
+
+// Winograd is selected at compile time but the kernels of the dynamic layers are only known at runtime
+DLL_TEST_CASE("unit/conv/algorithm/3", "[unit][conv]") {
+    dll::dyn_conv_layer_desc<dll::conv_algo<dll::conv_algorithm::WINOGRAD>>::layer_t layer;
+    dll::dyn_conv_layer_desc<>::layer_t direct_layer;
+
+    layer.init_layer(3, 12, 12, 4, 5, 5);
+    direct_layer.init_layer(3, 12, 12, 4, 5, 5);
+
+    direct_layer.w = layer.w;
+    direct_layer.b = layer.b;
+
+    etl::dyn_matrix<float, 4> input(2, 3, 12, 12);
+
+    input = etl::normal_generator(0.0, 1.0);
+
+    etl::dyn_matrix<float, 4> output(2, 4, 8, 8);
+    etl::dyn_matrix<float, 4> direct(2, 4, 8, 8);
+
+    layer.forward_batch(output, input);
+    direct_layer.forward_batch(direct, input);
+
+    REQUIRE(etl::approx_equals(output, direct, 1e-5));
+
+    // The 3x3 kernels still use Winograd
+
+    layer.init_layer(3, 12, 12, 4, 3, 3);
+    direct_layer.init_layer(3, 12, 12, 4, 3, 3);
+
+    direct_layer.w = layer.w;
+    direct_layer.b = layer.b;
+
+    etl::dyn_matrix<float, 4> output_3(2, 4, 10, 10);
+    etl::dyn_matrix<float, 4> direct_3(2, 4, 10, 10);
+
+    layer.forward_batch(output_3, input);
+    direct_layer.forward_batch(direct_3, input);
+
+    REQUIRE(etl::approx_equals(output_3, direct_3, 1e-3));
+}
+
+// The tuned shapes are saved in the user cache directory
+DLL_TEST_CASE("unit/conv/algorithm/4", "[unit][conv]") {
+    std::string dll_cache = std::getenv("DLL_CONV_CACHE") ? std::getenv("DLL_CONV_CACHE") : "";
+    std::string xdg_cache = std::getenv("XDG_CACHE_HOME") ? std::getenv("XDG_CACHE_HOME") : "";
+    std::string home      = std::getenv("HOME") ? std::getenv("HOME") : "";
+
+    unsetenv("DLL_CONV_CACHE");
+    setenv("XDG_CACHE_HOME", "/tmp/xdg", 1);
+    setenv("HOME", "/home/user", 1);
+
+    REQUIRE(dll::conv_detail::conv_registry_file() == "/tmp/xdg/dll/conv_cache");
+
+    // A relative XDG_CACHE_HOME is ignored
+    setenv("XDG_CACHE_HOME", "cache", 1);
+
+    REQUIRE(dll::conv_detail::conv_registry_file() == "/home/user/.cache/dll/conv_cache");
+
+    unsetenv("XDG_CACHE_HOME");
+
+    REQUIRE(dll::conv_detail::conv_registry_file() == "/home/user/.cache/dll/conv_cache");
+
+    // Without any cache directory, the registry stays in memory
+    unsetenv("HOME");
+
+    REQUIRE(dll::conv_detail::conv_registry_file().empty());
+
+    setenv("DLL_CONV_CACHE", "/tmp/conv_cache", 1);
+
+    REQUIRE(dll::conv_detail::conv_registry_file() == "/tmp/conv_cache");
+
+    // Restore the environment
+    auto restore = [](const char* name, const std::string& value) {
+        if (value.empty()) {
+            unsetenv(name);
+        } else {
+            setenv(name, value.c_str(), 1);
+        }
+    };
+
+    restore("DLL_CONV_CACHE", dll_cache);
+    restore("XDG_CACHE_HOME", xdg_cache);
+    restore("HOME", home);
+}
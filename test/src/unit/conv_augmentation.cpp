@@ -11,6 +11,7 @@
  */
 
 #include <deque>
+#include <iterator>
 
 #include "dll_test.hpp"
 
@@ -24,6 +25,47 @@
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
 
+namespace {
+
+/*!
+ * \brief Single-pass view of an iterator, like the ImageNet iterators
+ */
+template <typename Iterator>
+struct single_pass_iterator {
+    using iterator_category = std::input_iterator_tag;
+    using value_type        = typename std::iterator_traits<Iterator>::value_type;
+    using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+    using pointer           = typename std::iterator_traits<Iterator>::pointer;
+    using reference         = typename std::iterator_traits<Iterator>::reference;
+
+    Iterator it; ///< The wrapped iterator
+
+    reference operator*() const {
+        return *it;
+    }
+
+    single_pass_iterator& operator++() {
+        ++it;
+        return *this;
+    }
+
+    single_pass_iterator operator++(int) {
+        auto copy = *this;
+        ++it;
+        return copy;
+    }
+
+    bool operator==(const single_pass_iterator& rhs) const {
+        return it == rhs.it;
+    }
+
+    bool operator!=(const single_pass_iterator& rhs) const {
+        return it != rhs.it;
+    }
+};
+
+} // end of anonymous namespace
+
 // Use a simple in-memory generator for fine-tuning
 DLL_TEST_CASE("unit/augment/conv/mnist/1", "[dbn][unit]") {
     typedef dll::dbn_desc<
@@ -421,3 +463,176 @@ DLL_TEST_CASE("unit/augment/conv/mnist/11", "[dbn][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     CHECK(test_error < 0.3);
 }
+
+// Use an in-memory generator with several augmentation workers
+DLL_TEST_CASE("unit/augment/conv/mnist/12", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 24, 24, 6, 3, 3>::layer_t,
+            dll::mp_2d_layer<6, 22, 22, 2, 2>,
+            dll::dense_layer_desc<6 * 11 * 11, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::updater<dll::updater_type::MOMENTUM>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::random_crop<24,24>, dll::batch_size<25>, dll::big_batch_size<4>, dll::workers<3>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 100);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use an out-memory generator with several prefetching readers
+DLL_TEST_CASE("unit/augment/conv/mnist/13", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 3, 3>::layer_t,
+            dll::mp_2d_layer<6, 26, 26, 2, 2>,
+            dll::dense_layer_desc<6 * 13 * 13, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::updater<dll::updater_type::MOMENTUM>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(400);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<6>, dll::workers<4>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Read single-pass iterators with the only reader worker
+DLL_TEST_CASE("unit/augment/conv/mnist/14", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(110);
+    REQUIRE(!dataset.training_images.empty());
+
+    using image_it = single_pass_iterator<decltype(dataset.training_images.cbegin())>;
+    using label_it = single_pass_iterator<decltype(dataset.training_labels.cbegin())>;
+
+    using train_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<2>, dll::threaded, dll::categorical, dll::scale_pre<255>>;
+
+    auto generator = dll::make_generator(
+        image_it{dataset.training_images.cbegin()}, image_it{dataset.training_images.cend()},
+        label_it{dataset.training_labels.cbegin()}, label_it{dataset.training_labels.cend()},
+        dataset.training_images.size(), 10, train_generator_t{});
+
+    static_assert(!std::decay_t<decltype(*generator)>::multi_pass, "The iterators must be single-pass");
+
+    // Two epochs, the second one reads from the reset iterators
+    for (size_t epoch = 0; epoch < 2; ++epoch) {
+        generator->reset();
+
+        size_t i = 0;
+
+        while (generator->has_next_batch()) {
+            auto data  = generator->data_batch();
+            auto label = generator->label_batch();
+
+            for (size_t s = 0; s < etl::dim<0>(data); ++s, ++i) {
+                REQUIRE(etl::approx_equals(data(s), dataset.training_images[i] / 255.0f, 1e-6));
+                REQUIRE(label(s)(dataset.training_labels[i]) == 1.0f);
+                REQUIRE(etl::sum(label(s)) == 1.0f);
+            }
+
+            generator->next_batch();
+        }
+
+        REQUIRE(i == dataset.training_images.size());
+    }
+}
+
+// The augmented batches do not depend on the number of workers
+DLL_TEST_CASE("unit/augment/conv/mnist/15", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(210);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll::set_seed(42);
+
+    using serial_generator_t   = dll::inmemory_data_generator_desc<dll::random_crop<24,24>, dll::batch_size<25>, dll::big_batch_size<4>, dll::workers<1>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+    using parallel_generator_t = dll::inmemory_data_generator_desc<dll::random_crop<24,24>, dll::batch_size<25>, dll::big_batch_size<4>, dll::workers<3>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto serial_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        serial_generator_t{});
+
+    auto parallel_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        parallel_generator_t{});
+
+    serial_generator->set_train();
+    parallel_generator->set_train();
+
+    // Two epochs, each one with its own random streams
+    for (size_t epoch = 0; epoch < 2; ++epoch) {
+        serial_generator->reset();
+        parallel_generator->reset();
+
+        size_t batches = 0;
+
+        while (serial_generator->has_next_batch()) {
+            REQUIRE(parallel_generator->has_next_batch());
+
+            auto serial_data   = serial_generator->data_batch();
+            auto parallel_data = parallel_generator->data_batch();
+
+            auto serial_label   = serial_generator->label_batch();
+            auto parallel_label = parallel_generator->label_batch();
+
+            REQUIRE(etl::size(serial_data) == etl::size(parallel_data));
+            REQUIRE(etl::size(serial_label) == etl::size(parallel_label));
+
+            for (size_t i = 0; i < etl::size(serial_data); ++i) {
+                REQUIRE(serial_data[i] == parallel_data[i]);
+            }
+
+            for (size_t i = 0; i < etl::size(serial_label); ++i) {
+                REQUIRE(serial_label[i] == parallel_label[i]);
+            }
+
+            serial_generator->next_batch();
+            parallel_generator->next_batch();
+
+            ++batches;
+        }
+
+        REQUIRE(!parallel_generator->has_next_batch());
+        REQUIRE(batches == serial_generator->batches());
+    }
+}
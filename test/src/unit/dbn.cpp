@@ -431,3 +431,168 @@ DLL_TEST_CASE("unit/dbn/mnist/12", "[dbn][unit]") {
 
     dll::dump_timers();
 }
+
+DLL_TEST_CASE("unit/dbn/mnist/13", "[dbn][pipeline][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::pretrain_pipeline<5>, dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    // 10 batches per epoch: the next layers train on the batches of the
+    // previous layer, while it trains, after its first 5 epochs
+    REQUIRE(dbn->pretrain_streamed_batches[0] == 0);
+    REQUIRE(dbn->pretrain_streamed_batches[1] == 15 * 10);
+    REQUIRE(dbn->pretrain_streamed_batches[2] == 15 * 10);
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        5);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+DLL_TEST_CASE("unit/dbn/mnist/14", "[dbn][cache][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::pretrain_cache<4>, dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    // 10 batches per epoch: after the first epoch, the 4 cached batches are hits
+    REQUIRE(dbn->pretrain_cache_hit_rate[0] == 0.0);
+    REQUIRE(dbn->pretrain_cache_hit_rate[1] == doctest::Approx(4.0 * 19.0 / (10.0 * 20.0)));
+    REQUIRE(dbn->pretrain_cache_hit_rate[2] == doctest::Approx(4.0 * 19.0 / (10.0 * 20.0)));
+
+    // The cached inputs are the same as the recomputed ones
+    {
+        using batch_t = etl::dyn_matrix<float, 2>;
+
+        std::vector<batch_t> batches;
+
+        for (size_t b = 0; b < 10; ++b) {
+            batches.emplace_back(25, 28 * 28);
+
+            for (size_t i = 0; i < 25; ++i) {
+                batches.back()(i) = dataset.training_images[b * 25 + i];
+            }
+        }
+
+        dll::activation_cache<batch_t> cache(4);
+
+        for (size_t epoch = 0; epoch < 3; ++epoch) {
+            cache.new_epoch();
+
+            for (size_t b = 0; b < batches.size(); ++b) {
+                auto& cached = cache.get(b, [&]() { return dbn->template forward_batch<0>(batches[b]); });
+
+                batch_t direct = dbn->template forward_batch<0>(batches[b]);
+
+                REQUIRE(etl::size(cached) == etl::size(direct));
+
+                for (size_t i = 0; i < etl::size(direct); ++i) {
+                    REQUIRE(cached[i] == direct[i]);
+                }
+            }
+        }
+
+        REQUIRE(cache.hit_rate() == doctest::Approx(8.0 / 30.0));
+    }
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        5);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+template <typename RBM>
+using dbn_ppcd_trainer_t = dll::parallel_pcd_trainer<1, RBM, 2>;
+
+// Without streaming, the pipelined pretraining is the sequential one
+DLL_TEST_CASE("unit/dbn/mnist/15", "[dbn][pipeline][unit]") {
+    using layers_t = dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights, dll::trainer_rbm<dbn_ppcd_trainer_t>>::layer_t,
+        dll::rbm_desc<100, 50, dll::momentum, dll::batch_size<25>, dll::trainer_rbm<dbn_ppcd_trainer_t>>::layer_t,
+        dll::rbm_desc<50, 20, dll::momentum, dll::batch_size<25>, dll::trainer_rbm<dbn_ppcd_trainer_t>>::layer_t>;
+
+    using pipeline_dbn_t = dll::dbn_desc<layers_t, dll::pretrain_pipeline<5>, dll::batch_size<25>>::dbn_t;
+    using batch_dbn_t    = dll::dbn_desc<layers_t, dll::batch_mode, dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto pipelined  = std::make_unique<pipeline_dbn_t>();
+    auto sequential = std::make_unique<batch_dbn_t>();
+
+    auto copy = [](auto& from, auto& to) {
+        to.w = from.w;
+        to.b = from.b;
+        to.c = from.c;
+    };
+
+    copy(pipelined->template layer_get<0>(), sequential->template layer_get<0>());
+    copy(pipelined->template layer_get<1>(), sequential->template layer_get<1>());
+    copy(pipelined->template layer_get<2>(), sequential->template layer_get<2>());
+
+    // The chains of the trainers are seeded from the seed of the library
+    dll::set_seed(42);
+    pipelined->pretrain(dataset.training_images, 5);
+
+    dll::set_seed(42);
+    sequential->pretrain(dataset.training_images, 5);
+
+    REQUIRE(pipelined->pretrain_streamed_batches[1] == 0);
+    REQUIRE(pipelined->pretrain_streamed_batches[2] == 0);
+
+    auto equal = [](auto& a, auto& b) {
+        for (size_t i = 0; i < etl::size(a.w); ++i) {
+            REQUIRE(a.w[i] == b.w[i]);
+        }
+
+        for (size_t i = 0; i < etl::size(a.b); ++i) {
+            REQUIRE(a.b[i] == b.b[i]);
+        }
+
+        for (size_t i = 0; i < etl::size(a.c); ++i) {
+            REQUIRE(a.c[i] == b.c[i]);
+        }
+    };
+
+    equal(pipelined->template layer_get<0>(), sequential->template layer_get<0>());
+    equal(pipelined->template layer_get<1>(), sequential->template layer_get<1>());
+    equal(pipelined->template layer_get<2>(), sequential->template layer_get<2>());
+}
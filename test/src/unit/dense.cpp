@@ -5,7 +5,11 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithm>
 #include <deque>
+#include <limits>
+#include <random>
+#include <thread>
 
 #include "dll_test.hpp"
 
@@ -14,6 +18,12 @@
 #include "dll/neural/activation/activation_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/datasets.hpp"
+#include "dll/int8_network.hpp"
+#include "dll/inference_workspace.hpp"
+#include "dll/inference_batcher.hpp"
+#include "dll/util/csr.hpp"
+#include "dll/util/fused_updaters.hpp"
+#include "dll/util/reduced_precision.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -310,3 +320,773 @@ DLL_TEST_CASE("unit/dense/sgd/14", "[unit][dense][dbn][mnist][sgd]") {
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// Test Sigmoid -> Softmax network with data-parallel shards
+DLL_TEST_CASE("unit/dense/sgd/15", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::parallel_shards<2>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Test a deep network with gradient checkpointing
+DLL_TEST_CASE("unit/dense/sgd/16", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200>::layer_t,
+            dll::dense_layer_desc<200, 200>::layer_t,
+            dll::dense_layer_desc<200, 100>::layer_t,
+            dll::dense_layer_desc<100, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::checkpoint<2>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    REQUIRE(trainer.memory_planner.planned_memory() < trainer.memory_planner.unplanned_memory());
+}
+
+// Test int8 inference of a Sigmoid -> Softmax network
+DLL_TEST_CASE("unit/dense/int8/0", "[unit][dense][dbn][mnist][int8]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    auto float_error = dbn->evaluate_error(dataset.test());
+
+    auto int8_dbn = dll::quantize_int8(*dbn, dataset.train(), 10);
+
+    auto int8_error = int8_dbn.evaluate_error(dataset.test());
+    std::cout << "int8_error:" << int8_error << std::endl;
+
+    REQUIRE(int8_error < float_error + 0.02);
+    REQUIRE(int8_dbn.weight_memory() < dbn->layer_get<0>().w.size() * sizeof(float) / 2);
+}
+
+// Test the int8 products against the reference, on all the tile sizes
+DLL_TEST_CASE("unit/dense/int8/1", "[unit][dense][int8]") {
+    std::mt19937_64 engine(42);
+    std::uniform_int_distribution<int> dist(-127, 127);
+
+    for (size_t m : {1, 3, 4, 9}) {
+        for (size_t n : {1, 8, 17, 40}) {
+            for (size_t k : {1, 6, 32, 101}) {
+                const size_t ldx = dll::int8_round_up(k, dll::int8_group);
+
+                std::vector<int8_t> x(m * ldx);
+                std::vector<int8_t> w(n * k);
+                std::vector<int8_t> packed(dll::int8_packed_size(n, k));
+                std::vector<int32_t> out(m * n);
+
+                for (auto& v : x) {
+                    v = dist(engine);
+                }
+
+                for (auto& v : w) {
+                    v = dist(engine);
+                }
+
+                dll::int8_pack(w.data(), n, k, packed.data());
+                dll::int8_gemm(x.data(), m, ldx, packed.data(), n, k, out.data(), n);
+
+                for (size_t r = 0; r < m; ++r) {
+                    for (size_t o = 0; o < n; ++o) {
+                        int32_t expected = 0;
+
+                        for (size_t i = 0; i < k; ++i) {
+                            expected += int32_t(x[r * ldx + i]) * int32_t(w[o * k + i]);
+                        }
+
+                        REQUIRE(out[r * n + o] == expected);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Test concurrent inference with one workspace per thread
+DLL_TEST_CASE("unit/dense/workspace/0", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(400);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+
+    // The expected labels come from the non-reentrant path, single-threaded
+
+    std::vector<size_t> expected;
+
+    for (auto& image : dataset.training_images) {
+        expected.push_back(dbn->predict(image));
+    }
+
+    const dbn_t& shared = *dbn;
+
+    constexpr size_t threads = 4;
+
+    std::vector<size_t> errors(threads, 0);
+    std::vector<std::thread> pool;
+
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&shared, &dataset, &expected, &errors, t]() {
+            auto workspace = dll::make_inference_workspace(shared, dataset.training_images[0]);
+
+            for (size_t i = t; i < dataset.training_images.size(); i += threads) {
+                if (workspace.predict(dataset.training_images[i]) != expected[i]) {
+                    ++errors[t];
+                }
+            }
+
+            // Partial batch
+            etl::dyn_matrix<float, 2> batch(7, 28 * 28);
+
+            for (size_t i = 0; i < 7; ++i) {
+                batch(i) = dataset.training_images[i];
+            }
+
+            auto output = workspace.forward_batch(batch);
+
+            for (size_t i = 0; i < 7; ++i) {
+                auto row = output(i);
+
+                if (size_t(std::distance(row.begin(), std::max_element(row.begin(), row.end()))) != expected[i]) {
+                    ++errors[t];
+                }
+            }
+        });
+    }
+
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    for (size_t t = 0; t < threads; ++t) {
+        REQUIRE(errors[t] == 0);
+    }
+}
+
+// Test the micro-batching of single requests
+DLL_TEST_CASE("unit/dense/batcher/0", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(400);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+
+    using sample_t = etl::fast_dyn_matrix<float, 28 * 28>;
+
+    size_t errors = 0;
+
+    {
+        dll::inference_batcher<dbn_t, sample_t> batcher(*dbn, dataset.training_images[0], 16, std::chrono::microseconds(1000));
+
+        std::vector<std::future<typename decltype(batcher)::output_t>> results;
+
+        for (auto& image : dataset.training_images) {
+            results.push_back(batcher.submit(image));
+        }
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto output = results[i].get();
+
+            if (size_t(std::distance(output.begin(), std::max_element(output.begin(), output.end()))) != dbn->predict(dataset.training_images[i])) {
+                ++errors;
+            }
+        }
+
+        REQUIRE(batcher.average_batch() > 1.0);
+    }
+
+    REQUIRE(errors == 0);
+}
+
+// Test the training and the inference on sparse input
+DLL_TEST_CASE("unit/dense/sparse/0", "[unit][dense][dbn][mnist][sparse]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(400);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    std::vector<dll::csr_batch<float>> inputs;
+    std::vector<etl::dyn_matrix<float, 2>> labels;
+
+    for (size_t b = 0; b < dataset.training_images.size() / 20; ++b) {
+        etl::dyn_matrix<float, 2> batch(20, 28 * 28);
+        etl::dyn_matrix<float, 2> label(20, 10);
+
+        label = 0.0;
+
+        for (size_t i = 0; i < 20; ++i) {
+            batch(i) = dataset.training_images[b * 20 + i];
+            label(i, dataset.training_labels[b * 20 + i]) = 1.0;
+        }
+
+        inputs.push_back(dll::csr_batch<float>::from_dense(batch));
+        labels.push_back(label);
+
+        REQUIRE(inputs.back().density() < 0.3);
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    auto ft_error = dbn->fine_tune_sparse(inputs, labels, 50);
+    REQUIRE(ft_error < 5e-2);
+
+    TEST_CHECK(0.3);
+
+    // The sparse and dense inference must match
+
+    etl::dyn_matrix<float, 2> batch(20, 28 * 28);
+
+    for (size_t i = 0; i < 20; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    auto sparse_output = dbn->forward_batch_sparse(inputs[0]);
+    auto dense_output  = dbn->forward_batch(batch);
+
+    REQUIRE(etl::approx_equals(sparse_output, dense_output, 1e-4));
+}
+
+// Test mixed precision training with bfloat16 activations and errors
+DLL_TEST_CASE("unit/dense/mixed/0", "[unit][dense][dbn][mnist][mixed]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::mixed_precision<>, dll::memory_plan, dll::batch_size<20>
+    >::dbn_t;
+
+    // Rounding to nearest even, on 8 bits of significand
+    REQUIRE(dll::bf16_to_float(dll::bf16_from_float(1.0f + 1.0f / 256)) == 1.0f);
+    REQUIRE(dll::bf16_to_float(dll::bf16_from_float(1.0f + 3.0f / 256)) == 1.0f + 4.0f / 256);
+    REQUIRE(dll::bf16_to_float(dll::bf16_from_float(-3.0e38f)) == doctest::Approx(-3.0e38f).epsilon(0.01));
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Test the storage of the outputs in reduced precision
+DLL_TEST_CASE("unit/dense/mixed/2", "[unit][dense][dbn][mnist][mixed]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200>::layer_t,
+            dll::dense_layer_desc<200, 200>::layer_t,
+            dll::dense_layer_desc<200, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::mixed_precision<>, dll::memory_plan, dll::batch_size<20>
+    >::dbn_t;
+
+    using float_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200>::layer_t,
+            dll::dense_layer_desc<200, 200>::layer_t,
+            dll::dense_layer_desc<200, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::memory_plan, dll::batch_size<20>
+    >::dbn_t;
+
+    // The stored values are loaded back exactly, as the rounded values
+
+    etl::dyn_matrix<float, 1> values(1003), loaded(1003);
+    std::vector<uint16_t> stored(1003);
+
+    values = etl::uniform_generator(-1.0, 1.0);
+
+    etl::dyn_matrix<float, 1> rounded(values);
+
+    dll::store_precision<dll::precision_type::BF16>(rounded.memory_start(), stored.data(), 1003);
+    dll::load_precision<dll::precision_type::BF16>(stored.data(), loaded.memory_start(), 1003);
+
+    REQUIRE(etl::approx_equals(loaded, rounded, 0.0));
+    REQUIRE(etl::approx_equals(rounded, values, 1e-2));
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // Only the hidden outputs are stored, the full precision buffers are shared
+
+    auto float_dbn = std::make_unique<float_dbn_t>();
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+    dll::sgd_trainer<float_dbn_t> float_trainer(*float_dbn);
+
+    REQUIRE(trainer.memory_planner.planned_memory() < float_trainer.memory_planner.planned_memory());
+
+    etl::dyn_matrix<float, 2> inputs(20, 28 * 28);
+    etl::dyn_matrix<float, 2> labels(20, 10);
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    labels = 0.0;
+
+    for (size_t i = 0; i < 20; ++i) {
+        labels(i, i % 10) = 1.0;
+    }
+
+    trainer.template train_batch<false>(0, inputs, labels);
+
+    REQUIRE(trainer.stored_outputs[0].size() == 20 * 200);
+    REQUIRE(trainer.stored_outputs[1].size() == 20 * 200);
+    REQUIRE(trainer.stored_outputs[2].size() == 20 * 100);
+    REQUIRE(trainer.stored_outputs[3].empty());
+}
+
+// Test the detection of a diverged mixed precision training
+DLL_TEST_CASE("unit/dense/mixed/3", "[unit][dense][dbn][mixed]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::mixed_precision<dll::precision_type::FP16>, dll::memory_plan, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->loss_scale = 1.0;
+
+    // The gradients overflow whatever the loss scale
+    dbn->template layer_get<0>().w(0, 0) = std::numeric_limits<float>::quiet_NaN();
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    etl::dyn_matrix<float, 2> inputs(20, 28 * 28);
+    etl::dyn_matrix<float, 2> labels(20, 10);
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    labels = 0.0;
+
+    for (size_t i = 0; i < 20; ++i) {
+        labels(i, i % 10) = 1.0;
+    }
+
+    for (size_t i = 0; i < trainer.max_overflows; ++i) {
+        REQUIRE(!trainer.diverged());
+
+        trainer.template train_batch<false>(0, inputs, labels);
+    }
+
+    REQUIRE(trainer.diverged());
+    REQUIRE(trainer.iteration == 1);
+    REQUIRE(trainer.loss_scale == 1.0f);
+}
+
+// Test mixed precision training with half precision, starting with a loss scale that overflows
+DLL_TEST_CASE("unit/dense/mixed/1", "[unit][dense][dbn][mnist][mixed]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::mixed_precision<dll::precision_type::FP16>, dll::memory_plan, dll::batch_size<20>
+    >::dbn_t;
+
+    // The values too large for half precision overflow, the small ones become subnormal
+    REQUIRE(std::isinf(dll::fp16_to_float(dll::fp16_from_float(65520.0f))));
+    REQUIRE(dll::fp16_to_float(dll::fp16_from_float(65504.0f)) == 65504.0f);
+    REQUIRE(dll::fp16_to_float(dll::fp16_from_float(1.0e-7f)) == std::ldexp(1.0f, -23));
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    // The steps are skipped until the loss scale has been reduced enough
+    dbn->loss_scale = 1.0e20;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Test the fused Adam updater, with bias correction, weight decay and clipping
+DLL_TEST_CASE("unit/dense/fused/0", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM_CORRECT>, dll::weight_decay<dll::decay_type::L2>, dll::clip_gradients, dll::batch_size<20>
+    >::dbn_t;
+
+    // The kernel must match the separate expressions, the AVX part and the tail included
+
+    etl::dyn_matrix<float, 1> w(1003), g(1003), m(1003), v(1003);
+
+    w = etl::uniform_generator(-1.0, 1.0);
+    g = etl::uniform_generator(-1.0, 1.0);
+    m = etl::uniform_generator(-0.1, 0.1);
+    v = etl::uniform_generator(0.0, 0.1);
+
+    etl::dyn_matrix<float, 1> ref_w(w), ref_m(m), ref_v(v), ref_g(g);
+
+    ref_g = 0.5f * (g - 0.01f * etl::abs(w) - 0.02f * w);
+    ref_m = 0.9f * ref_m + 0.1f * ref_g;
+    ref_v = 0.999f * ref_v + 0.001f * (ref_g >> ref_g);
+    ref_w += (0.1f * ref_g + 0.2f * ref_m) / (etl::sqrt(1.5f * ref_v) + 1e-8f);
+
+    dll::grad_transform<float> transform{0.01f, 0.02f, 0.5f};
+
+    REQUIRE(dll::fused_squared_norm(w.memory_start(), g.memory_start(), 1003, transform) == doctest::Approx(etl::sum(ref_g >> ref_g)).epsilon(1e-4));
+
+    dll::fused_adam(w.memory_start(), g.memory_start(), m.memory_start(), v.memory_start(), 1003, transform, 0.9f, 0.999f, 0.1f, 0.2f, 1.5f, 1e-8f);
+
+    REQUIRE(etl::approx_equals(w, ref_w, 1e-4));
+    REQUIRE(etl::approx_equals(m, ref_m, 1e-6));
+    REQUIRE(etl::approx_equals(v, ref_v, 1e-6));
+
+    // The weights of the first layer are updated in several chunks
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Test the fused RMSProp updater
+DLL_TEST_CASE("unit/dense/fused/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::RMSPROP>, dll::weight_decay<dll::decay_type::L1L2>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Test the fused Nadam updater against the previous ETL kernel
+DLL_TEST_CASE("unit/dense/fused/2", "[unit][dense][dbn][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.01;
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    // The chunks cover the whole tensor exactly once
+
+    std::vector<size_t> covered(100003, 0);
+    std::vector<size_t> firsts(7, 1);
+
+    trainer.parallel_chunks(covered.size(), 7, [&covered, &firsts](size_t c, size_t first, size_t last) {
+        firsts[c] = first;
+
+        for (size_t i = first; i < last; ++i) {
+            ++covered[i];
+        }
+    });
+
+    REQUIRE(std::all_of(covered.begin(), covered.end(), [](size_t c) { return c == 1; }));
+    REQUIRE(std::all_of(firsts.begin(), firsts.end(), [](size_t first) { return first % 16 == 0; }));
+
+    // The weights of the first layer are split in several chunks
+
+    auto& w   = dbn->template layer_get<0>().w;
+    auto& sub = *std::get<0>(std::get<0>(trainer.full_context).second->up.context);
+
+    REQUIRE(trainer.fused_chunks(etl::size(w)) == std::max<size_t>(1, std::min<size_t>(etl::threads, etl::size(w) / trainer.fused_chunk_size)));
+
+    etl::dyn_matrix<float, 2> inputs(20, 28 * 28);
+    etl::dyn_matrix<float, 2> labels(20, 10);
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    labels = 0.0;
+
+    for (size_t i = 0; i < 20; ++i) {
+        labels(i, i % 10) = 1.0;
+    }
+
+    const float beta1          = dbn->adam_beta1;
+    const float beta2          = dbn->adam_beta2;
+    const float schedule_decay = dbn->nadam_schedule_decay;
+    const float eps            = dbn->learning_rate;
+    const float e              = 1e-8;
+
+    for (size_t step = 0; step < 3; ++step) {
+        std::decay_t<decltype(w)> ref_w(w);
+        std::decay_t<decltype(sub.m)> ref_m(sub.m);
+        std::decay_t<decltype(sub.v)> ref_v(sub.v);
+
+        const float t          = trainer.iteration;
+        const float m_schedule = sub.m_schedule;
+
+        trainer.template train_batch<false>(0, inputs, labels);
+
+        // The previous kernel, with the gradients left untouched by the fused one
+
+        float momentum_cache_t   = beta1 * (1.0 - 0.5 * (std::pow(0.96, t * schedule_decay)));
+        float momentum_cache_t_1 = beta1 * (1.0 - 0.5 * (std::pow(0.96, (t + 1) * schedule_decay)));
+
+        float m_schedule_new  = m_schedule * momentum_cache_t;
+        float m_schedule_next = m_schedule * momentum_cache_t * momentum_cache_t_1;
+
+        float m1 = eps * ((1.0f - momentum_cache_t) / (1.0f - m_schedule_new));
+        float m2 = eps * momentum_cache_t_1;
+
+        ref_m = beta1 * ref_m + ((1.0f - beta1) >> sub.grad);
+        ref_v = beta2 * ref_v + ((1.0f - beta2) >> (sub.grad >> sub.grad));
+        ref_w += (m1 * sub.grad + (m2 / (1.0f - m_schedule_next)) * ref_m) / (etl::sqrt(ref_v / (1.0f - std::pow(beta2, t))) + e);
+
+        REQUIRE(sub.m_schedule == doctest::Approx(m_schedule_new));
+        REQUIRE(etl::approx_equals(sub.m, ref_m, 1e-6));
+        REQUIRE(etl::approx_equals(sub.v, ref_v, 1e-6));
+        REQUIRE(etl::approx_equals(w, ref_w, 1e-5));
+    }
+}
+
+// Test the fused ADAM_CORRECT updater against the previous ETL kernel
+DLL_TEST_CASE("unit/dense/fused/3", "[unit][dense][dbn][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM_CORRECT>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.01;
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    auto& w   = dbn->template layer_get<0>().w;
+    auto& sub = *std::get<0>(std::get<0>(trainer.full_context).second->up.context);
+
+    etl::dyn_matrix<float, 2> inputs(20, 28 * 28);
+    etl::dyn_matrix<float, 2> labels(20, 10);
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    labels = 0.0;
+
+    for (size_t i = 0; i < 20; ++i) {
+        labels(i, i % 10) = 1.0;
+    }
+
+    const float beta1 = dbn->adam_beta1;
+    const float beta2 = dbn->adam_beta2;
+    const float eps   = dbn->learning_rate;
+    const float e     = 1e-8;
+
+    for (size_t step = 0; step < 3; ++step) {
+        std::decay_t<decltype(w)> ref_w(w);
+        std::decay_t<decltype(sub.m)> ref_m(sub.m);
+        std::decay_t<decltype(sub.v)> ref_v(sub.v);
+
+        trainer.template train_batch<false>(0, inputs, labels);
+
+        // The previous kernel, which does not use the corrected moments
+
+        ref_m = beta1 * ref_m + ((1.0f - beta1) >> sub.grad);
+        ref_v = beta2 * ref_v + ((1.0f - beta2) >> (sub.grad >> sub.grad));
+
+        if (step == 0) {
+            // The uncorrected first step is eps * (1 - beta1) / sqrt(1 - beta2) * sign(g) for the large gradients
+            for (size_t i = 0; i < etl::size(w); ++i) {
+                if (std::abs(sub.grad[i]) > 1e-4f) {
+                    REQUIRE(std::abs(w[i] - ref_w[i]) == doctest::Approx(eps * (1.0f - beta1) / std::sqrt(1.0f - beta2)).epsilon(1e-3));
+                }
+            }
+        }
+
+        ref_w += (eps * ref_m) / (etl::sqrt(ref_v) + e);
+
+        REQUIRE(etl::approx_equals(sub.m, ref_m, 1e-6));
+        REQUIRE(etl::approx_equals(sub.v, ref_v, 1e-6));
+        REQUIRE(etl::approx_equals(w, ref_w, 1e-5));
+    }
+}
+
+DLL_TEST_CASE("unit/dense/cost/0", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>
+    >::dbn_t;
+
+    using layer_t = dll::dense_layer_desc<28 * 28, 100>::layer_t;
+
+    // 2 FLOP per weight and per sample, plus the biases and the activations
+    auto cost = layer_t::cost(20);
+
+    REQUIRE(cost.forward.flops == doctest::Approx(2.0 * 20 * 28 * 28 * 100 + 2.0 * 20 * 100));
+    REQUIRE(cost.backward.flops == doctest::Approx(2.0 * 20 * 28 * 28 * 100));
+    REQUIRE(cost.gradients.flops == doctest::Approx(2.0 * 20 * 28 * 28 * 100 + 20 * 100));
+    REQUIRE(cost.forward.bytes == doctest::Approx(4.0 * (20 * 28 * 28 + 28 * 28 * 100 + 100 + 20 * 100)));
+    REQUIRE(cost.forward.intensity() > 1.0);
+    REQUIRE(!cost.fused_gradients);
+
+    // The number of operations is linear in the batch size
+    REQUIRE(layer_t::cost(40).forward.flops == doctest::Approx(2.0 * cost.forward.flops));
+
+    // The pooling layers have no gradients and the embeddings no backward pass
+    auto pooling = dll::pooling_cost(20, 4 * 8 * 8, 4 * 4 * 4, 4, 4, {"mp:forward_batch", "mp:backward_batch"});
+
+    REQUIRE(pooling.forward.flops == doctest::Approx(20.0 * 4 * 4 * 4 * 4));
+    REQUIRE(!pooling.gradients.timer);
+
+    auto embedding = dll::embedding_cost(20, 10, 16, 4, {"embedding:forward_batch", "embedding:compute_gradients"});
+
+    REQUIRE(!embedding.backward.timer);
+    REQUIRE(embedding.gradients.flops == doctest::Approx(20.0 * 10 * 16));
+
+    // The 2D batch normalization computes its gradients in the backward pass
+    auto bn_2d = dll::batch_normalization_cost(20, 100, 100, true, 4, {"bn:2d:train:forward", "bn:2d:backward", "bn:2d:gradients"});
+    auto bn_4d = dll::batch_normalization_cost(20, 100, 4, false, 4, {"bn:4d:train:forward", "bn:4d:backward", "bn:4d:gradients"});
+
+    REQUIRE(bn_2d.fused_gradients);
+    REQUIRE(!bn_4d.fused_gradients);
+    REQUIRE(bn_2d.backward.flops == doctest::Approx(bn_4d.backward.flops + bn_4d.gradients.flops));
+
+    // The backpropagation through time is quadratic in the number of steps,
+    // unless it is truncated
+    REQUIRE(dll::bptt_steps(10, 10, false) == doctest::Approx(54.0));
+    REQUIRE(dll::bptt_steps(10, 3, false) == doctest::Approx(6.0));
+    REQUIRE(dll::bptt_steps(10, 3, true) == doctest::Approx(3.0));
+    REQUIRE(dll::bptt_steps(10, 20, true) == doctest::Approx(10.0));
+
+    auto full      = dll::recurrent_cost(20, 10, 28, 50, 4, 10, false, 4, {"lstm:forward_batch", "lstm:backward_batch", "lstm:compute_gradients"});
+    auto truncated = dll::recurrent_cost(20, 10, 28, 50, 4, 3, false, 4, {"lstm:forward_batch", "lstm:backward_batch", "lstm:compute_gradients"});
+
+    REQUIRE(full.fused_gradients);
+    REQUIRE(full.forward.flops == doctest::Approx(truncated.forward.flops));
+    REQUIRE(full.backward.flops == doctest::Approx(9.0 * truncated.backward.flops));
+
+    // Only the calls on the accounted batch size are reported
+    dll::reset_timers();
+
+    layer_t layer;
+
+    etl::dyn_matrix<float, 2> input(20, 28 * 28, 0.5f);
+    etl::dyn_matrix<float, 2> output(20, 100);
+    etl::dyn_matrix<float, 2> last_input(7, 28 * 28, 0.5f);
+    etl::dyn_matrix<float, 2> last_output(7, 100);
+
+    for (size_t i = 0; i < 3; ++i) {
+        layer.forward_batch(output, input);
+    }
+
+    layer.forward_batch(last_output, last_input);
+
+#ifndef DLL_NO_TIMERS
+    REQUIRE(dll::get_timer_stats("dense:forward_batch", 20).count == 3);
+    REQUIRE(dll::get_timer_stats("dense:forward_batch", 7).count == 1);
+    REQUIRE(dll::get_timer_stats("dense:forward_batch", 10).count == 0);
+    REQUIRE(dll::get_timer_stats("dense:forward_batch").count == 4);
+#endif
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dll::reset_timers();
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+#ifndef DLL_NO_TIMERS
+    // 200 samples in full batches of 20, over two epochs
+    REQUIRE(dll::get_timer_stats("dense:backward_batch", 20).count == 2 * 10);
+    REQUIRE(dll::get_timer_stats("dense:compute_gradients", 20).count == 2 * 2 * 10);
+#endif
+
+    // The achieved performance comes from the timers of the training
+    dbn->display_roofline(100.0, 20.0);
+}
@@ -142,3 +142,70 @@ DLL_TEST_CASE("unit/embedding/2", "[unit][embedding]") {
     REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
     REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
 }
+
+// Embedding with three group CNN and gradient checkpointing
+DLL_TEST_CASE("unit/embedding/3", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 16;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>
+            , dll::merge_layer<
+                0
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 3, embedding>
+                    , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 4, embedding>
+                    , dll::mp_2d_layer<16, length - 4 + 1, 1, length - 4 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 5, embedding>
+                    , dll::mp_2d_layer<16, length - 5 + 1, 1, length - 5 + 1, 1>
+                >
+            >
+            , dll::dense_layer<48, 32>
+            , dll::dense_layer<32, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>     // Nesterov Adam (NADAM)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+        , dll::checkpoint<2>                         // Recompute one activation out of two
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
+}
+
+// Simple embedding with lazy gradients
+DLL_TEST_CASE("unit/embedding/4", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding, dll::lazy_gradients>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam, applied lazily on the embeddings
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
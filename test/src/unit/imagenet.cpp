@@ -0,0 +1,76 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * \file
+ * \brief Tests for the parallel decoding stage of the ImageNet dataset.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "dll_test.hpp"
+
+#include "dll/datasets.hpp"
+#include "dll/datasets/imagenet.hpp"
+
+namespace {
+
+using image_t = etl::fast_dyn_matrix<float, 1, 4, 4>;
+
+// A fake decoder, taking a varying time for each image
+void fake_decode(size_t index, image_t& image) {
+    std::this_thread::sleep_for(std::chrono::microseconds((index * 7919) % 300));
+
+    for (size_t i = 0; i < etl::size(image); ++i) {
+        image[i] = float(index * 16 + i);
+    }
+}
+
+std::vector<image_t> decode_all(size_t threads) {
+    dll::imagenet::parallel_decoder<image_t> decoder(fake_decode, 100, threads, 8);
+
+    // The threads are only started on the first request
+    REQUIRE(decoder.threads.empty());
+
+    std::vector<image_t> images;
+
+    for (size_t i = 0; i < 100; ++i) {
+        images.push_back(decoder.get(i));
+    }
+
+    // A new epoch moves the window back
+    for (size_t i = 0; i < 50; ++i) {
+        images.push_back(decoder.get(i));
+    }
+
+    return images;
+}
+
+} // end of anonymous namespace
+
+// The order and the content of the images do not depend on the number of threads
+DLL_TEST_CASE("unit/imagenet/decoder/1", "[unit][imagenet]") {
+    auto reference = decode_all(1);
+
+    REQUIRE(reference.size() == 150);
+
+    for (size_t i = 0; i < 150; ++i) {
+        REQUIRE(reference[i](0, 0, 0) == float((i % 100) * 16));
+        REQUIRE(reference[i](0, 3, 3) == float((i % 100) * 16 + 15));
+    }
+
+    for (size_t threads : {2, 4, 8}) {
+        auto images = decode_all(threads);
+
+        REQUIRE(images.size() == reference.size());
+
+        for (size_t i = 0; i < images.size(); ++i) {
+            REQUIRE(etl::approx_equals(images[i], reference[i], 0.0));
+        }
+    }
+}
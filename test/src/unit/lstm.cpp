@@ -11,6 +11,7 @@
 #include "dll/neural/lstm/lstm_layer.hpp"
 #include "dll/neural/recurrent/recurrent_last_layer.hpp"
 #include "dll/network.hpp"
+#include "dll/util/sequences.hpp"
 #include "dll/datasets.hpp"
 
 // Simple LSTM
@@ -85,3 +86,333 @@ DLL_TEST_CASE("unit/lstm/3", "[unit][lstm]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Fused gates against the per-gate formulation
+DLL_TEST_CASE("unit/lstm/4", "[unit][lstm]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 3;
+
+    dll::lstm_layer<time_steps, sequence_length, hidden_units> layer;
+
+    etl::dyn_matrix<float, 3> x(2, time_steps, sequence_length);
+    etl::dyn_matrix<float, 3> output(2, time_steps, hidden_units);
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    layer.forward_batch(output, x);
+
+    etl::dyn_matrix<float, 3> x_t(time_steps, 2, sequence_length);
+    etl::dyn_matrix<float, 3> s_t(time_steps, 2, hidden_units);
+    etl::dyn_matrix<float, 3> h_t(time_steps, 2, hidden_units);
+
+    x_t = transpose_front(x);
+
+    for (size_t t = 0; t < time_steps; ++t) {
+        etl::dyn_matrix<float, 2> g(2, hidden_units);
+        etl::dyn_matrix<float, 2> i(2, hidden_units);
+        etl::dyn_matrix<float, 2> f(2, hidden_units);
+        etl::dyn_matrix<float, 2> o(2, hidden_units);
+
+        if (t == 0) {
+            g = etl::tanh(bias_add_2d(x_t(t) * layer.u_g, layer.b_g));
+            i = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_i, layer.b_i));
+            o = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_o, layer.b_o));
+
+            s_t(t) = g >> i;
+            h_t(t) = etl::tanh(s_t(t)) >> o;
+        } else {
+            g = etl::tanh(bias_add_2d(x_t(t) * layer.u_g + h_t(t - 1) * layer.w_g, layer.b_g));
+            i = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_i + h_t(t - 1) * layer.w_i, layer.b_i));
+            f = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_f + h_t(t - 1) * layer.w_f, layer.b_f));
+            o = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_o + h_t(t - 1) * layer.w_o, layer.b_o));
+
+            s_t(t) = etl::tanh((g >> i) + (s_t(t - 1) >> f));
+            h_t(t) = s_t(t) >> o;
+        }
+    }
+
+    etl::dyn_matrix<float, 3> expected(2, time_steps, hidden_units);
+
+    expected = transpose_front(h_t);
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-4));
+}
+
+// Stateful LSTM on chunks of a long sequence
+DLL_TEST_CASE("unit/lstm/5", "[unit][lstm]") {
+    dll::lstm_layer<8, 3, 4> full;
+    dll::lstm_layer<4, 3, 4, dll::stateful> chunked;
+
+    chunked.w_i = full.w_i;
+    chunked.u_i = full.u_i;
+    chunked.b_i = full.b_i;
+    chunked.w_g = full.w_g;
+    chunked.u_g = full.u_g;
+    chunked.b_g = full.b_g;
+    chunked.w_f = full.w_f;
+    chunked.u_f = full.u_f;
+    chunked.b_f = full.b_f;
+    chunked.w_o = full.w_o;
+    chunked.u_o = full.u_o;
+    chunked.b_o = full.b_o;
+
+    etl::dyn_matrix<float, 2> sequence(16, 3);
+    sequence = etl::normal_generator(0.0, 1.0);
+
+    // Two streams of 8 steps, in two batches of two chunks of 4 steps
+    auto chunks = dll::chunk_sequence(sequence, 4, 2);
+
+    REQUIRE(chunks.size() == 4);
+
+    etl::dyn_matrix<float, 3> x(2, 8, 3);
+    etl::dyn_matrix<float, 3> x_1(2, 4, 3);
+    etl::dyn_matrix<float, 3> x_2(2, 4, 3);
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t t = 0; t < 8; ++t) {
+            x(i)(t) = sequence(i * 8 + t);
+        }
+
+        x_1(i) = chunks[i];
+        x_2(i) = chunks[2 + i];
+    }
+
+    etl::dyn_matrix<float, 3> y(2, 8, 4);
+    etl::dyn_matrix<float, 3> y_1(2, 4, 4);
+    etl::dyn_matrix<float, 3> y_2(2, 4, 4);
+
+    full.forward_batch(y, x);
+
+    etl::dyn_matrix<float, 3> expected_1(2, 4, 4);
+    etl::dyn_matrix<float, 3> expected_2(2, 4, 4);
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t t = 0; t < 4; ++t) {
+            expected_1(i)(t) = y(i)(t);
+            expected_2(i)(t) = y(i)(4 + t);
+        }
+    }
+
+    // In training, the chunks continue each other
+    chunked.train_forward_batch(y_1, x_1);
+
+    REQUIRE(etl::approx_equals(y_1, expected_1, 1e-4));
+
+    // A test batch in between does not change the training state
+    etl::dyn_matrix<float, 3> y_test(2, 4, 4);
+    chunked.forward_batch(y_test, x_2);
+
+    chunked.train_forward_batch(y_2, x_2);
+
+    REQUIRE(etl::approx_equals(y_2, expected_2, 1e-4));
+
+    // The test batches carry their own state
+    chunked.reset_test_state();
+    chunked.forward_batch(y_1, x_1);
+    chunked.forward_batch(y_2, x_2);
+
+    REQUIRE(etl::approx_equals(y_1, expected_1, 1e-4));
+    REQUIRE(etl::approx_equals(y_2, expected_2, 1e-4));
+
+    // After a reset, the first chunks start from a zero state again
+    chunked.reset_state();
+    chunked.train_forward_batch(y_1, x_1);
+
+    REQUIRE(etl::approx_equals(y_1, expected_1, 1e-4));
+}
+
+namespace {
+
+struct lstm_test_gradient {
+    etl::dyn_matrix<float, 2> grad;
+};
+
+struct lstm_test_updater {
+    std::array<std::unique_ptr<lstm_test_gradient>, 12> context;
+};
+
+struct lstm_test_context {
+    etl::dyn_matrix<float, 3> errors;
+    lstm_test_updater up;
+};
+
+} // end of anonymous namespace
+
+// Fused backpropagation through time against the per-gate formulation
+DLL_TEST_CASE("unit/lstm/6", "[unit][lstm]") {
+    constexpr size_t T = 5;
+    constexpr size_t S = 4;
+    constexpr size_t H = 3;
+    constexpr size_t B = 2;
+
+    dll::lstm_layer<T, S, H, dll::last_only> layer;
+
+    etl::dyn_matrix<float, 3> x(B, T, S);
+    etl::dyn_matrix<float, 3> output(B, T, H);
+    etl::dyn_matrix<float, 3> d_x(B, T, S);
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    lstm_test_context context;
+
+    context.errors = etl::dyn_matrix<float, 3>(B, T, H);
+    context.errors = etl::normal_generator(0.0, 1.0);
+
+    for (size_t p = 0; p < 12; ++p) {
+        // The parameters of each gate are W (H, H), U (S, H) and b (H)
+        const size_t rows = p % 3 == 0 ? H : p % 3 == 1 ? S : 1;
+
+        context.up.context[p] = std::make_unique<lstm_test_gradient>();
+        context.up.context[p]->grad = etl::dyn_matrix<float, 2>(rows, H);
+    }
+
+    auto check = [&]() {
+        layer.forward_batch(output, x);
+        layer.backward_batch(d_x, context);
+
+        // Per-gate forward pass
+
+        etl::dyn_matrix<float, 3> x_t(T, B, S);
+        etl::dyn_matrix<float, 3> g_t(T, B, H);
+        etl::dyn_matrix<float, 3> i_t(T, B, H);
+        etl::dyn_matrix<float, 3> f_t(T, B, H);
+        etl::dyn_matrix<float, 3> o_t(T, B, H);
+        etl::dyn_matrix<float, 3> s_t(T, B, H);
+        etl::dyn_matrix<float, 3> h_t(T, B, H);
+
+        x_t = transpose_front(x);
+
+        for (size_t t = 0; t < T; ++t) {
+            if (t == 0) {
+                g_t(t) = etl::tanh(bias_add_2d(x_t(t) * layer.u_g, layer.b_g));
+                i_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_i, layer.b_i));
+                f_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_f, layer.b_f));
+                o_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_o, layer.b_o));
+
+                s_t(t) = g_t(t) >> i_t(t);
+                h_t(t) = etl::tanh(s_t(t)) >> o_t(t);
+            } else {
+                g_t(t) = etl::tanh(bias_add_2d(x_t(t) * layer.u_g + h_t(t - 1) * layer.w_g, layer.b_g));
+                i_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_i + h_t(t - 1) * layer.w_i, layer.b_i));
+                f_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_f + h_t(t - 1) * layer.w_f, layer.b_f));
+                o_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * layer.u_o + h_t(t - 1) * layer.w_o, layer.b_o));
+
+                s_t(t) = etl::tanh((g_t(t) >> i_t(t)) + (s_t(t - 1) >> f_t(t)));
+                h_t(t) = s_t(t) >> o_t(t);
+            }
+        }
+
+        etl::dyn_matrix<float, 3> expected(B, T, H);
+        expected = transpose_front(h_t);
+
+        REQUIRE(etl::approx_equals(output, expected, 1e-4));
+
+        // Per-gate backward pass, in a single pass since only the last output is used
+
+        etl::dyn_matrix<float, 3> delta_t(T, B, H);
+        etl::dyn_matrix<float, 3> d_h_t(T, B, H);
+        etl::dyn_matrix<float, 3> d_c_t(T, B, H);
+        etl::dyn_matrix<float, 3> d_x_t(T, B, S);
+
+        delta_t = transpose_front(context.errors);
+
+        etl::dyn_matrix<float, 2> w_i_grad(H, H, 0.0);
+        etl::dyn_matrix<float, 2> u_i_grad(S, H, 0.0);
+        etl::dyn_matrix<float, 1> b_i_grad(H, 0.0);
+        etl::dyn_matrix<float, 2> w_g_grad(H, H, 0.0);
+        etl::dyn_matrix<float, 2> u_g_grad(S, H, 0.0);
+        etl::dyn_matrix<float, 1> b_g_grad(H, 0.0);
+        etl::dyn_matrix<float, 2> w_f_grad(H, H, 0.0);
+        etl::dyn_matrix<float, 2> u_f_grad(S, H, 0.0);
+        etl::dyn_matrix<float, 1> b_f_grad(H, 0.0);
+        etl::dyn_matrix<float, 2> w_o_grad(H, H, 0.0);
+        etl::dyn_matrix<float, 2> u_o_grad(S, H, 0.0);
+        etl::dyn_matrix<float, 1> b_o_grad(H, 0.0);
+
+        etl::dyn_matrix<float, 2> d_i(B, H);
+        etl::dyn_matrix<float, 2> d_g(B, H);
+        etl::dyn_matrix<float, 2> d_f(B, H);
+        etl::dyn_matrix<float, 2> d_o(B, H);
+
+        for (int tt = T - 1; tt >= 0; --tt) {
+            const size_t t = tt;
+
+            if (t == T - 1) {
+                d_h_t(t) = delta_t(t);
+                d_c_t(t) = (o_t(t) >> d_h_t(t)) >> (1.0f - (s_t(t) >> s_t(t)));
+            } else {
+                d_h_t(t) = delta_t(t) + d_h_t(t + 1);
+                d_c_t(t) = ((o_t(t) >> d_h_t(t)) >> (1.0f - (s_t(t) >> s_t(t)))) + d_c_t(t + 1);
+            }
+
+            d_o = (o_t(t) >> (1.0f - o_t(t))) >> (s_t(t) >> d_h_t(t));
+            d_i = (i_t(t) >> (1.0f - i_t(t))) >> (g_t(t) >> d_c_t(t));
+            d_g = (1.0f - (g_t(t) >> g_t(t))) >> (i_t(t) >> d_c_t(t));
+
+            if (t == 0) {
+                d_f = 0;
+            } else {
+                d_f = (f_t(t) >> (1.0f - f_t(t))) >> (s_t(t - 1) >> d_c_t(t));
+            }
+
+            b_i_grad += bias_batch_sum_2d(d_i);
+            b_g_grad += bias_batch_sum_2d(d_g);
+            b_f_grad += bias_batch_sum_2d(d_f);
+            b_o_grad += bias_batch_sum_2d(d_o);
+
+            u_i_grad += batch_outer(x_t(t), d_i);
+            u_g_grad += batch_outer(x_t(t), d_g);
+            u_f_grad += batch_outer(x_t(t), d_f);
+            u_o_grad += batch_outer(x_t(t), d_o);
+
+            if (t > 0) {
+                w_i_grad += batch_outer(h_t(t - 1), d_i);
+                w_g_grad += batch_outer(h_t(t - 1), d_g);
+                w_f_grad += batch_outer(h_t(t - 1), d_f);
+                w_o_grad += batch_outer(h_t(t - 1), d_o);
+            }
+
+            d_x_t(t) = d_i * trans(layer.u_i) + d_g * trans(layer.u_g) + d_f * trans(layer.u_f) + d_o * trans(layer.u_o);
+            d_h_t(t) = d_i * trans(layer.w_i) + d_g * trans(layer.w_g) + d_f * trans(layer.w_f) + d_o * trans(layer.w_o);
+            d_c_t(t) = f_t(t) >> d_c_t(t);
+        }
+
+        etl::dyn_matrix<float, 3> expected_d_x(B, T, S);
+        expected_d_x = transpose_front(d_x_t);
+
+        REQUIRE(etl::approx_equals(d_x, expected_d_x, 1e-4));
+
+        auto& grads = context.up.context;
+
+        REQUIRE(etl::approx_equals(grads[0]->grad, w_i_grad, 1e-4));
+        REQUIRE(etl::approx_equals(grads[1]->grad, u_i_grad, 1e-4));
+        REQUIRE(etl::approx_equals(etl::reshape(grads[2]->grad, H), b_i_grad, 1e-4));
+        REQUIRE(etl::approx_equals(grads[3]->grad, w_g_grad, 1e-4));
+        REQUIRE(etl::approx_equals(grads[4]->grad, u_g_grad, 1e-4));
+        REQUIRE(etl::approx_equals(etl::reshape(grads[5]->grad, H), b_g_grad, 1e-4));
+        REQUIRE(etl::approx_equals(grads[6]->grad, w_f_grad, 1e-4));
+        REQUIRE(etl::approx_equals(grads[7]->grad, u_f_grad, 1e-4));
+        REQUIRE(etl::approx_equals(etl::reshape(grads[8]->grad, H), b_f_grad, 1e-4));
+        REQUIRE(etl::approx_equals(grads[9]->grad, w_o_grad, 1e-4));
+        REQUIRE(etl::approx_equals(grads[10]->grad, u_o_grad, 1e-4));
+        REQUIRE(etl::approx_equals(etl::reshape(grads[11]->grad, H), b_o_grad, 1e-4));
+    };
+
+    check();
+
+    // The weights modified through the trainable parameters are packed again
+
+    std::get<0>(layer.trainable_parameters()) *= 0.5;
+    std::get<4>(layer.trainable_parameters()) += 0.1;
+    std::get<11>(layer.trainable_parameters()) -= 0.2;
+
+    check();
+
+    // The weights modified directly are packed again once invalidated
+
+    layer.u_f *= -1.0;
+    layer.invalidate_packed_weights();
+
+    check();
+}
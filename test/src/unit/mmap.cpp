@@ -0,0 +1,168 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * \file
+ * \brief Tests for the memory-mapped dataset format and generator.
+ */
+
+#include <filesystem>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense/dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// Write a dataset and read it back
+DLL_TEST_CASE("unit/mmap/1", "[unit][mmap]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_test_1.dat", dataset.training_images, dataset.training_labels, 10));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<16>, dll::categorical>;
+
+    auto generator = dll::make_mmap_generator<float, 3>("mmap_test_1.dat", generator_t{});
+
+    REQUIRE(generator->size() == 100);
+    REQUIRE(generator->batches() == 7);
+
+    size_t i = 0;
+
+    while (generator->has_next_batch()) {
+        auto data   = generator->data_batch();
+        auto labels = generator->label_batch();
+
+        for (size_t b = 0; b < etl::dim<0>(data); ++b) {
+            REQUIRE(etl::approx_equals(data(b), dataset.training_images[i], 1e-6));
+            REQUIRE(labels(b, dataset.training_labels[i]) == 1.0f);
+            REQUIRE(etl::sum(labels(b)) == 1.0f);
+            ++i;
+        }
+
+        generator->next_batch();
+    }
+
+    REQUIRE(i == 100);
+
+    std::remove("mmap_test_1.dat");
+}
+
+// Train a network directly from a memory-mapped dataset
+DLL_TEST_CASE("unit/mmap/2", "[unit][mmap]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    REQUIRE(dll::write_mmap_dataset("mmap_test_2.dat", dataset.training_images, dataset.training_labels, 10));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<20>, dll::categorical>;
+
+    auto generator = dll::make_mmap_generator<float, 1>("mmap_test_2.dat", generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    auto error = dbn->fine_tune(*generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    std::remove("mmap_test_2.dat");
+}
+
+// Reject truncated files and files not matching the generator
+DLL_TEST_CASE("unit/mmap/3", "[unit][mmap]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_test_3.dat", dataset.training_images, dataset.training_labels, 10));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<16>, dll::categorical>;
+    using flat_generator_t = dll::mmap_data_generator_desc<dll::batch_size<16>>;
+
+    REQUIRE(dll::make_mmap_generator<float, 3>("mmap_test_3.dat", generator_t{})->valid());
+
+    // Wrong type, rank or labels
+
+    auto double_generator = dll::make_mmap_generator<double, 3>("mmap_test_3.dat", generator_t{});
+    REQUIRE(!double_generator->valid());
+    REQUIRE(double_generator->size() == 0);
+    REQUIRE(!double_generator->has_next_batch());
+
+    REQUIRE(!dll::make_mmap_generator<float, 1>("mmap_test_3.dat", generator_t{})->valid());
+    REQUIRE(!dll::make_mmap_generator<float, 3>("mmap_test_3.dat", flat_generator_t{})->valid());
+
+    // The labels are missing
+
+    std::filesystem::resize_file("mmap_test_3.dat", std::filesystem::file_size("mmap_test_3.dat") - 4);
+
+    auto truncated = dll::make_mmap_generator<float, 3>("mmap_test_3.dat", generator_t{});
+    REQUIRE(!truncated->valid());
+    REQUIRE(truncated->size() == 0);
+    REQUIRE(!truncated->has_next_batch());
+
+    std::remove("mmap_test_3.dat");
+}
+
+// The batches are read ahead in the order of the generation
+DLL_TEST_CASE("unit/mmap/4", "[unit][mmap]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_test_4.dat", dataset.training_images, dataset.training_labels, 10));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<16>, dll::categorical>;
+
+    auto generator = dll::make_mmap_generator<float, 3>("mmap_test_4.dat", generator_t{});
+
+    REQUIRE(generator->valid());
+    REQUIRE(generator->batches() == 7);
+
+    // In order, the kernel readahead is kept
+
+    REQUIRE(generator->file.access == MADV_SEQUENTIAL);
+
+    // The current batch and the next one are always prefetched
+
+    size_t b = 0;
+
+    while (generator->has_next_batch()) {
+        REQUIRE(generator->current_batch() == b);
+        REQUIRE(generator->prefetched == std::min<size_t>(b + 2, 7));
+
+        generator->next_batch();
+        ++b;
+    }
+
+    REQUIRE(b == 7);
+    REQUIRE(generator->prefetched == 7);
+
+    generator->reset();
+
+    REQUIRE(generator->prefetched == 2);
+    REQUIRE(generator->file.access == MADV_SEQUENTIAL);
+
+    // Once shuffled, the batches are read out of order
+
+    generator->reset_shuffle();
+
+    REQUIRE(generator->prefetched == 2);
+    REQUIRE(generator->file.access == MADV_RANDOM);
+
+    std::remove("mmap_test_4.dat");
+}
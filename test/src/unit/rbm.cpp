@@ -212,3 +212,198 @@ DLL_TEST_CASE("unit/rbm/mnist/10", "[rbm][pcd][unit]") {
         REQUIRE(error < 15e-2);
     }
 }
+
+template <typename RBM>
+using ppcd_trainer_t = dll::parallel_pcd_trainer<1, RBM, 4>;
+
+template <typename RBM>
+using pt_trainer_t = dll::parallel_pcd_trainer<1, RBM, 4, true>;
+
+namespace {
+
+/*!
+ * \brief Train the RBM directly with the given trainer, batch after batch
+ */
+template <typename Trainer, typename Batches>
+void train_with(Trainer& trainer, Batches& batches, size_t epochs) {
+    dll::rbm_training_context context;
+
+    for (size_t epoch = 0; epoch < epochs; ++epoch) {
+        for (auto& batch : batches) {
+            trainer.train_batch(batch, batch, context);
+        }
+    }
+}
+
+template <typename RBM>
+std::vector<etl::dyn_matrix<float, 2>> make_rbm_batches(const std::vector<etl::dyn_vector<float>>& images) {
+    std::vector<etl::dyn_matrix<float, 2>> batches;
+
+    for (size_t b = 0; b < images.size() / RBM::batch_size; ++b) {
+        batches.emplace_back(RBM::batch_size, 28 * 28);
+
+        for (size_t i = 0; i < RBM::batch_size; ++i) {
+            batches.back()(i) = images[b * RBM::batch_size + i];
+        }
+    }
+
+    return batches;
+}
+
+} // end of anonymous namespace
+
+DLL_TEST_CASE("unit/rbm/mnist/11", "[rbm][pcd][unit]") {
+    using rbm_t = dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<5>,
+        dll::momentum,
+        dll::trainer_rbm<ppcd_trainer_t>>::layer_t;
+
+    rbm_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    // The training is deterministic with a fixed seed
+
+    auto batches = make_rbm_batches<rbm_t>(dataset.training_images);
+
+    rbm_t rbm_a;
+    rbm_t rbm_b;
+
+    rbm_b.w = rbm_a.w;
+    rbm_b.b = rbm_a.b;
+    rbm_b.c = rbm_a.c;
+
+    dll::set_seed(42);
+
+    {
+        ppcd_trainer_t<rbm_t> trainer(rbm_a);
+        train_with(trainer, batches, 5);
+    }
+
+    dll::set_seed(42);
+
+    {
+        ppcd_trainer_t<rbm_t> trainer(rbm_b);
+        train_with(trainer, batches, 5);
+    }
+
+    for (size_t i = 0; i < etl::size(rbm_a.w); ++i) {
+        REQUIRE(rbm_a.w[i] == rbm_b.w[i]);
+    }
+
+    for (size_t i = 0; i < etl::size(rbm_a.b); ++i) {
+        REQUIRE(rbm_a.b[i] == rbm_b.b[i]);
+    }
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+DLL_TEST_CASE("unit/rbm/mnist/12", "[rbm][pcd][unit]") {
+    using rbm_t = dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<5>,
+        dll::momentum,
+        dll::trainer_rbm<pt_trainer_t>>::layer_t;
+
+    rbm_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto batches = make_rbm_batches<rbm_t>(dataset.training_images);
+
+    rbm_t rbm_a;
+    rbm_t rbm_b;
+
+    rbm_b.w = rbm_a.w;
+    rbm_b.b = rbm_a.b;
+    rbm_b.c = rbm_a.c;
+
+    dll::set_seed(42);
+
+    pt_trainer_t<rbm_t> trainer_a(rbm_a);
+    train_with(trainer_a, batches, 5);
+
+    dll::set_seed(42);
+
+    pt_trainer_t<rbm_t> trainer_b(rbm_b);
+    train_with(trainer_b, batches, 5);
+
+    // Every batch attempts one swap per particle between each pair of neighbouring chains
+    REQUIRE(trainer_a.swaps_attempted == 5 * batches.size() * 3 * 5);
+
+    // The neighbouring temperatures are close enough for some swaps to be accepted, but not all
+    REQUIRE(trainer_a.swap_rate() > 0.01);
+    REQUIRE(trainer_a.swap_rate() < 0.99);
+
+    // The training, including the swaps, is deterministic with a fixed seed
+    REQUIRE(trainer_a.swaps_accepted == trainer_b.swaps_accepted);
+
+    for (size_t i = 0; i < etl::size(rbm_a.w); ++i) {
+        REQUIRE(rbm_a.w[i] == rbm_b.w[i]);
+    }
+
+    for (size_t i = 0; i < etl::size(rbm_a.b); ++i) {
+        REQUIRE(rbm_a.b[i] == rbm_b.b[i]);
+    }
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+DLL_TEST_CASE("unit/rbm/mnist/13", "[rbm][sparse][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    std::vector<dll::csr_batch<float>> batches;
+
+    for (size_t b = 0; b < dataset.training_images.size() / 25; ++b) {
+        etl::dyn_matrix<float, 2> batch(25, 28 * 28);
+
+        for (size_t i = 0; i < 25; ++i) {
+            batch(i) = dataset.training_images[b * 25 + i];
+        }
+
+        batches.push_back(dll::csr_batch<float>::from_dense(batch));
+    }
+
+    auto error = rbm.train_sparse(batches, 50);
+
+    REQUIRE(error < 1e-2);
+
+    // The sparse and dense activations must match
+
+    etl::dyn_matrix<float, 2> batch(25, 28 * 28);
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    etl::dyn_matrix<float, 2> sparse_h(25, 100);
+    etl::dyn_matrix<float, 2> dense_h(25, 100);
+
+    rbm.batch_activate_hidden(sparse_h, batches[0]);
+    rbm.batch_activate_hidden(dense_h, batch);
+
+    REQUIRE(etl::approx_equals(sparse_h, dense_h, 1e-4));
+}
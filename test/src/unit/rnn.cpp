@@ -11,6 +11,7 @@
 #include "dll/neural/rnn/rnn_layer.hpp"
 #include "dll/neural/recurrent/recurrent_last_layer.hpp"
 #include "dll/network.hpp"
+#include "dll/util/sequences.hpp"
 #include "dll/datasets.hpp"
 
 // Simple RNN
@@ -85,3 +86,61 @@ DLL_TEST_CASE("unit/rnn/3", "[unit][rnn]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Stateful RNN on chunks of a long sequence
+DLL_TEST_CASE("unit/rnn/4", "[unit][rnn]") {
+    dll::rnn_layer<8, 3, 4> full;
+    dll::rnn_layer<4, 3, 4, dll::stateful> chunked;
+
+    chunked.w = full.w;
+    chunked.u = full.u;
+    chunked.b = full.b;
+
+    etl::dyn_matrix<float, 2> sequence(16, 3);
+    sequence = etl::normal_generator(0.0, 1.0);
+
+    // Two streams of 8 steps, in two batches of two chunks of 4 steps
+    auto chunks = dll::chunk_sequence(sequence, 4, 2);
+
+    REQUIRE(chunks.size() == 4);
+
+    etl::dyn_matrix<float, 3> x(2, 8, 3);
+    etl::dyn_matrix<float, 3> x_1(2, 4, 3);
+    etl::dyn_matrix<float, 3> x_2(2, 4, 3);
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t t = 0; t < 8; ++t) {
+            x(i)(t) = sequence(i * 8 + t);
+        }
+
+        x_1(i) = chunks[i];
+        x_2(i) = chunks[2 + i];
+    }
+
+    etl::dyn_matrix<float, 3> y(2, 8, 4);
+    etl::dyn_matrix<float, 3> y_1(2, 4, 4);
+    etl::dyn_matrix<float, 3> y_2(2, 4, 4);
+
+    full.forward_batch(y, x);
+    chunked.forward_batch(y_1, x_1);
+    chunked.forward_batch(y_2, x_2);
+
+    etl::dyn_matrix<float, 3> expected_1(2, 4, 4);
+    etl::dyn_matrix<float, 3> expected_2(2, 4, 4);
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t t = 0; t < 4; ++t) {
+            expected_1(i)(t) = y(i)(t);
+            expected_2(i)(t) = y(i)(4 + t);
+        }
+    }
+
+    REQUIRE(etl::approx_equals(y_1, expected_1, 1e-4));
+    REQUIRE(etl::approx_equals(y_2, expected_2, 1e-4));
+
+    // After a reset, the first chunks start from a zero state again
+    chunked.reset_state();
+    chunked.forward_batch(y_1, x_1);
+
+    REQUIRE(etl::approx_equals(y_1, expected_1, 1e-4));
+}
@@ -0,0 +1,328 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * \file
+ * \brief Tests for the hierarchical timers and the trace export.
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "dll_test.hpp"
+
+#include "dll/util/timers.hpp"
+
+#ifndef DLL_NO_TIMERS
+
+namespace {
+
+/*!
+ * \brief Returns the index of the child of the given node with the given name, 0 if none
+ */
+size_t find_child(const dll::profile_tree& tree, size_t parent, const char* name) {
+    for (size_t c = tree.nodes[parent].child; c; c = tree.nodes[c].sibling) {
+        if (!std::strcmp(tree.nodes[c].name, name)) {
+            return c;
+        }
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Minimal JSON syntax checker, counting the occurrences of a string value
+ */
+struct json_checker {
+    const std::string& json;
+    const std::string needle;
+    size_t i     = 0;
+    size_t found = 0;
+
+    json_checker(const std::string& json, std::string needle) : json(json), needle(std::move(needle)) {}
+
+    void skip() {
+        while (i < json.size() && std::isspace(static_cast<unsigned char>(json[i]))) {
+            ++i;
+        }
+    }
+
+    bool string() {
+        if (json[i] != '"') {
+            return false;
+        }
+
+        std::string value;
+
+        for (++i; i < json.size() && json[i] != '"'; ++i) {
+            if (static_cast<unsigned char>(json[i]) < 0x20) {
+                return false;
+            }
+
+            if (json[i] == '\\') {
+                if (++i == json.size() || !std::strchr("\"\\/bfnrtu", json[i])) {
+                    return false;
+                }
+
+                value += '\\';
+
+                if (json[i] == 'u') {
+                    if (i + 4 >= json.size()) {
+                        return false;
+                    }
+
+                    for (size_t k = 1; k <= 4; ++k) {
+                        if (!std::isxdigit(static_cast<unsigned char>(json[i + k]))) {
+                            return false;
+                        }
+                    }
+
+                    value += json.substr(i, 4);
+                    i += 4;
+                }
+            }
+
+            value += json[i];
+        }
+
+        if (i == json.size()) {
+            return false;
+        }
+
+        ++i;
+
+        found += value == needle;
+
+        return true;
+    }
+
+    bool number() {
+        const size_t start = i;
+
+        while (i < json.size() && std::strchr("+-.eE0123456789", json[i])) {
+            ++i;
+        }
+
+        return i > start;
+    }
+
+    bool value() {
+        skip();
+
+        if (i == json.size()) {
+            return false;
+        }
+
+        bool valid;
+
+        if (json[i] == '{') {
+            valid = members('}', true);
+        } else if (json[i] == '[') {
+            valid = members(']', false);
+        } else if (json[i] == '"') {
+            valid = string();
+        } else {
+            valid = number();
+        }
+
+        skip();
+
+        return valid;
+    }
+
+    bool members(char end, bool object) {
+        ++i;
+        skip();
+
+        if (i < json.size() && json[i] == end) {
+            ++i;
+            return true;
+        }
+
+        while (true) {
+            if (object) {
+                skip();
+
+                if (i == json.size() || !string()) {
+                    return false;
+                }
+
+                skip();
+
+                if (i == json.size() || json[i++] != ':') {
+                    return false;
+                }
+            }
+
+            if (!value() || i == json.size()) {
+                return false;
+            }
+
+            if (json[i] == end) {
+                ++i;
+                return true;
+            }
+
+            if (json[i++] != ',') {
+                return false;
+            }
+        }
+    }
+
+    bool document() {
+        return value() && i == json.size();
+    }
+};
+
+} // end of anonymous namespace
+
+// The scopes are nested in their running parent
+DLL_TEST_CASE("unit/timers/1", "[unit][timers]") {
+    dll::reset_timers();
+
+    for (size_t i = 0; i < 3; ++i) {
+        dll::auto_timer outer("timers:outer", 10);
+
+        {
+            dll::auto_timer inner("timers:inner");
+        }
+
+        {
+            dll::auto_timer inner("timers:inner");
+        }
+    }
+
+    {
+        dll::auto_timer inner("timers:inner");
+    }
+
+    auto tree = dll::get_profiler().merged();
+
+    const size_t outer  = find_child(tree, 0, "timers:outer");
+    const size_t nested = find_child(tree, outer, "timers:inner");
+    const size_t top    = find_child(tree, 0, "timers:inner");
+
+    REQUIRE(outer);
+    REQUIRE(nested);
+    REQUIRE(top);
+
+    REQUIRE(tree.nodes[outer].count == 3);
+    REQUIRE(tree.nodes[nested].count == 6);
+    REQUIRE(tree.nodes[top].count == 1);
+    REQUIRE(tree.nodes[nested].parent == outer);
+    REQUIRE(tree.nodes[outer].duration >= tree.nodes[nested].duration);
+
+    REQUIRE(dll::get_timer_stats("timers:inner").count == 7);
+    REQUIRE(dll::get_timer_stats("timers:outer", 10).count == 3);
+    REQUIRE(dll::get_timer_stats("timers:outer", 5).count == 0);
+}
+
+// The quantiles of a known distribution
+DLL_TEST_CASE("unit/timers/2", "[unit][timers]") {
+    dll::profile_node node;
+
+    // 990 fast calls and 10 slow calls
+    for (size_t i = 0; i < 990; ++i) {
+        node.add(100 + i % 10);
+    }
+
+    for (size_t i = 0; i < 10; ++i) {
+        node.add(1000000);
+    }
+
+    REQUIRE(node.count == 1000);
+    REQUIRE(node.min == 100);
+    REQUIRE(node.max == 1000000);
+
+    // The buckets split each power of two in four
+    REQUIRE(node.quantile(0.99) >= 109);
+    REQUIRE(node.quantile(0.99) <= 109 * 5 / 4);
+    REQUIRE(node.quantile(0.999) == 1000000);
+    REQUIRE(node.quantile(1.0) == 1000000);
+
+    // Uniform distribution
+    dll::profile_node uniform;
+
+    for (size_t d = 1; d <= 10000; ++d) {
+        uniform.add(d);
+    }
+
+    REQUIRE(uniform.quantile(0.5) >= 5000);
+    REQUIRE(uniform.quantile(0.5) <= 5000 * 5 / 4);
+    REQUIRE(uniform.quantile(0.99) >= 9900);
+    REQUIRE(uniform.quantile(0.99) <= 10000);
+}
+
+// The profiles of the exited threads are released, not their statistics
+DLL_TEST_CASE("unit/timers/3", "[unit][timers]") {
+    dll::reset_timers();
+
+    {
+        dll::auto_timer timer("timers:main");
+    }
+
+    const size_t threads = dll::get_profiler().threads.size();
+
+    for (size_t i = 0; i < 4; ++i) {
+        std::thread worker([] {
+            dll::auto_timer timer("timers:worker");
+        });
+
+        worker.join();
+    }
+
+    REQUIRE(dll::get_profiler().threads.size() == threads);
+    REQUIRE(dll::get_timer_stats("timers:worker").count == 4);
+
+    auto tree = dll::get_profiler().merged();
+
+    REQUIRE(tree.nodes[find_child(tree, 0, "timers:worker")].threads == 4);
+}
+
+// The exported trace is valid JSON, with the events of the exited threads
+DLL_TEST_CASE("unit/timers/4", "[unit][timers]") {
+    dll::reset_timers();
+    dll::start_tracing();
+
+    for (size_t i = 0; i < 5; ++i) {
+        dll::auto_timer outer("timers:trace");
+        dll::auto_timer inner("timers:\"quoted\"\\name\n");
+    }
+
+    std::thread worker([] {
+        dll::auto_timer timer("timers:trace");
+    });
+
+    worker.join();
+
+    dll::stop_tracing();
+
+    REQUIRE(dll::export_chrome_trace("timers_test_4.json"));
+
+    std::ifstream is("timers_test_4.json");
+    std::string json((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+
+    json_checker checker(json, "timers:trace");
+
+    REQUIRE(checker.document());
+    REQUIRE(checker.found == 6);
+
+    json_checker quoted(json, "timers:\\\"quoted\\\"\\\\name\\u000a");
+
+    REQUIRE(quoted.document());
+    REQUIRE(quoted.found == 5);
+
+    std::remove("timers_test_4.json");
+}
+
+#endif
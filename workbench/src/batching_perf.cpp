@@ -0,0 +1,130 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Load generator for the micro-batching inference front-end.
+ *
+ * Several clients send single requests in a closed loop, either directly
+ * through forward_one or through the inference_batcher. The latency
+ * percentiles and the throughput of both paths are reported.
+ *
+ * Usage: dll_batching_perf [clients] [requests per client] [max batch] [max delay (us)]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll/neural/dense/dense_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/inference_batcher.hpp"
+
+namespace {
+
+using clock      = std::chrono::steady_clock;
+using resolution = std::chrono::microseconds;
+
+using network_t = dll::network_desc<
+    dll::network_layers<
+        dll::dense_layer<28 * 28, 500>,
+        dll::dense_layer<500, 500>,
+        dll::dense_layer<500, 10, dll::softmax>>,
+    dll::batch_size<64>>::network_t;
+
+using sample_t = etl::fast_dyn_matrix<float, 28 * 28>;
+
+/*!
+ * \brief Run the clients with the given scoring function and print the
+ * latency percentiles and the throughput
+ */
+template <typename Functor>
+void run(const std::string& name, size_t clients, size_t requests, const std::vector<sample_t>& samples, Functor score) {
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<std::thread> threads;
+
+    auto start = clock::now();
+
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c]() {
+            latencies[c].reserve(requests);
+
+            for (size_t r = 0; r < requests; ++r) {
+                auto& sample = samples[(c * requests + r) % samples.size()];
+
+                auto request_start = clock::now();
+                score(sample);
+                auto request_end = clock::now();
+
+                latencies[c].push_back(std::chrono::duration_cast<resolution>(request_end - request_start).count());
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto duration = std::chrono::duration_cast<resolution>(clock::now() - start).count();
+
+    std::vector<double> all;
+
+    for (auto& l : latencies) {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+
+    std::sort(all.begin(), all.end());
+
+    auto percentile = [&all](double p) { return all[std::min(all.size() - 1, size_t(p * all.size()))]; };
+
+    std::cout << name << ": p50 " << percentile(0.50) << "us"
+              << ", p99 " << percentile(0.99) << "us"
+              << ", throughput " << all.size() / (duration / 1e6) << " req/s" << std::endl;
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char** argv) {
+    const size_t clients   = argc > 1 ? std::stoul(argv[1]) : 16;
+    const size_t requests  = argc > 2 ? std::stoul(argv[2]) : 2000;
+    const size_t max_batch = argc > 3 ? std::stoul(argv[3]) : 32;
+    const size_t max_delay = argc > 4 ? std::stoul(argv[4]) : 500;
+
+    std::default_random_engine engine(42);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+    std::vector<sample_t> samples(1024);
+
+    for (auto& sample : samples) {
+        for (auto& v : sample) {
+            v = dist(engine);
+        }
+    }
+
+    auto net = std::make_unique<network_t>();
+
+    const network_t& shared = *net;
+
+    std::cout << clients << " clients, " << requests << " requests per client" << std::endl;
+
+    run("unbatched", clients, requests, samples, [&shared](const sample_t& sample) {
+        return shared.forward_one(sample);
+    });
+
+    dll::inference_batcher<network_t, sample_t> batcher(shared, samples[0], max_batch, std::chrono::microseconds(max_delay));
+
+    run("batched (" + std::to_string(max_batch) + ", " + std::to_string(max_delay) + "us)", clients, requests, samples, [&batcher](const sample_t& sample) {
+        return batcher.submit(sample).get();
+    });
+
+    std::cout << "average batch: " << batcher.average_batch() << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Throughput of the int8 inference against the floating point inference.
+ *
+ * For each layer, the int8 test_forward_batch is compared to the float
+ * test_forward_batch (into a preallocated output) on the same batch, and
+ * the complete networks are compared as well. The networks are not
+ * trained, the input ranges are calibrated on the benchmark batch.
+ *
+ * Usage: dll_int8_perf [batch] [iterations]
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dll/neural/conv/conv_layer.hpp"
+#include "dll/neural/dense/dense_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/int8_network.hpp"
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+constexpr size_t B = 128; ///< The batch size of the networks
+
+using mlp_t = dll::network_desc<
+    dll::network_layers<
+        dll::dense_layer<28 * 28, 1000>,
+        dll::dense_layer<1000, 1000>,
+        dll::dense_layer<1000, 10, dll::softmax>>,
+    dll::batch_size<B>>::network_t;
+
+using cnn_t = dll::network_desc<
+    dll::network_layers<
+        dll::conv_layer<1, 28, 28, 32, 5, 5>,
+        dll::conv_layer<32, 24, 24, 32, 5, 5>,
+        dll::dense_layer<32 * 20 * 20, 10, dll::softmax>>,
+    dll::batch_size<B>>::network_t;
+
+/*!
+ * \brief Returns the mean duration of the functor, in microseconds
+ */
+template <typename Functor>
+double measure(size_t iterations, Functor functor) {
+    // Warmup, also allocating the buffers
+    functor();
+
+    auto start = clock::now();
+
+    for (size_t i = 0; i < iterations; ++i) {
+        functor();
+    }
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count() / (1000.0 * iterations);
+}
+
+/*!
+ * \brief Print one line of results
+ */
+void report(const std::string& name, size_t batch, double float_us, double int8_us) {
+    std::cout << std::setw(24) << std::left << name
+              << " float: " << std::setw(10) << std::right << std::fixed << std::setprecision(1) << float_us << "us"
+              << " int8: " << std::setw(10) << int8_us << "us"
+              << " speedup: " << std::setprecision(2) << float_us / int8_us << "x"
+              << " (" << std::setprecision(0) << batch * 1e6 / int8_us << " samples/s)" << std::endl;
+}
+
+/*!
+ * \brief Compare the layers of the float and int8 networks, then the
+ * complete networks
+ */
+template <typename Network, typename Input>
+void compare(const std::string& name, Network& net, const Input& input, size_t iterations) {
+    // Calibrate on the benchmark batch
+
+    std::vector<float> ranges(Network::layers, 0.0f);
+    dll::int8_detail::calibrate_batch<0>(net, input, ranges);
+
+    dll::int8_network<Network> int8_net(net, ranges);
+
+    int8_net.display();
+
+    // Layer by layer, on the float input of each layer
+
+    auto compare_layer = [&](auto l, const auto& x) {
+        constexpr size_t L = decltype(l)::value;
+
+        auto& layer      = net.template layer_get<L>();
+        auto& int8_layer = std::get<L>(int8_net.layers);
+
+        auto output = layer.test_forward_batch(x);
+
+        double float_us = measure(iterations, [&]() { layer.test_forward_batch(output, x); });
+        double int8_us  = measure(iterations, [&]() { int8_layer.test_forward_batch(x); });
+
+        report(name + " layer " + std::to_string(L), etl::dim<0>(x), float_us, int8_us);
+    };
+
+    auto hidden_1 = net.template forward_batch<0>(input);
+    auto hidden_2 = net.template forward_batch<1>(input);
+
+    compare_layer(std::integral_constant<size_t, 0>{}, input);
+    compare_layer(std::integral_constant<size_t, 1>{}, hidden_1);
+    compare_layer(std::integral_constant<size_t, 2>{}, hidden_2);
+
+    // The complete networks
+
+    double float_us = measure(iterations, [&]() { net.forward_batch(input); });
+    double int8_us  = measure(iterations, [&]() { int8_net.forward_batch(input); });
+
+    report(name + " network", etl::dim<0>(input), float_us, int8_us);
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    const size_t batch      = argc > 1 ? std::stoul(argv[1]) : B;
+    const size_t iterations = argc > 2 ? std::stoul(argv[2]) : 20;
+
+    etl::dyn_matrix<float, 2> flat_input(batch, 28 * 28);
+    flat_input = etl::uniform_generator(0.0, 1.0);
+
+    auto mlp = std::make_unique<mlp_t>();
+    compare("mlp", *mlp, flat_input, iterations);
+
+    etl::dyn_matrix<float, 4> input(batch, 1, 28, 28);
+    input = etl::uniform_generator(0.0, 1.0);
+
+    auto cnn = std::make_unique<cnn_t>();
+    compare("cnn", *cnn, input, iterations);
+
+    return 0;
+}
@@ -0,0 +1,487 @@
+//=======================================================================
+// Copyright (c) 2014-2023 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Micro-benchmarks of the forward, backward and gradients operations of
+ * each layer type, in static and dynamic variants, over a grid of batch
+ * sizes and shapes.
+ *
+ * Usage: dll_layer_bench [--filter name] [--iterations n] [--output file.json]
+ *                        [--baseline file.json] [--threshold percent]
+ *
+ * The results are written in JSON with --output. A file written this way
+ * can be given back with --baseline, the cases slower than the baseline by
+ * more than the threshold (10% by default) are reported as regressions and
+ * the program then exits with a non-zero status.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dll/neural/dense/dense_layer.hpp"
+#include "dll/neural/conv/conv_layer.hpp"
+#include "dll/neural/conv/conv_same_layer.hpp"
+#include "dll/neural/conv/deconv_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/neural/bn/batch_normalization_layer.hpp"
+#include "dll/neural/lstm/lstm_layer.hpp"
+#include "dll/neural/rnn/rnn_layer.hpp"
+#include "dll/neural/recurrent/embedding_layer.hpp"
+#include "dll/rbm/rbm.hpp"
+#include "dll/rbm/conv_rbm.hpp"
+#include "dll/network.hpp"
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+/*!
+ * \brief The measure of one operation of one case
+ */
+struct result {
+    std::string name;    ///< The layer type
+    std::string variant; ///< static or dyn
+    std::string shape;   ///< The shape of the layer
+    size_t batch;        ///< The batch size
+    std::string op;      ///< forward, backward or gradients
+    double min_us;       ///< The fastest iteration, in microseconds
+    double mean_us;      ///< The mean of the iterations, in microseconds
+
+    /*!
+     * \brief Returns the key identifying the case in a baseline
+     */
+    std::string key() const {
+        return name + "/" + variant + "/" + shape + "/" + std::to_string(batch) + "/" + op;
+    }
+};
+
+/*!
+ * \brief The state of the benchmark suite
+ */
+struct suite {
+    size_t iterations = 10;      ///< The number of measured iterations of each operation
+    std::string filter;          ///< Only the layers whose name contains the filter are measured
+    std::vector<result> results; ///< The measures
+
+    bool selected(const std::string& name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+};
+
+/*!
+ * \brief A minimal network holding a single layer, enough to build its SGD
+ * contexts outside of a real network.
+ */
+template <typename Layer, size_t B>
+struct bench_network {
+    using weight = typename Layer::weight;
+
+    template <size_t N>
+    using layer_type = Layer;
+
+    static constexpr size_t layers     = 1;
+    static constexpr size_t batch_size = B;
+    static constexpr auto updater      = dll::updater_type::SGD;
+    static constexpr bool memory_plan  = false;
+};
+
+template <typename... Dims>
+std::string shape_of(size_t first, Dims... dims) {
+    std::string shape = std::to_string(first);
+    ((shape += "x" + std::to_string(dims)), ...);
+    return shape;
+}
+
+/*!
+ * \brief Measure the given functor, after one warmup iteration. The before
+ * functor is called, untimed, before each iteration.
+ */
+template <typename Before, typename Functor>
+void measure(suite& s, result r, Before before, Functor functor) {
+    before();
+    functor();
+
+    r.min_us  = std::numeric_limits<double>::max();
+    r.mean_us = 0.0;
+
+    for (size_t i = 0; i < s.iterations; ++i) {
+        before();
+
+        auto start = clock::now();
+        functor();
+        auto end = clock::now();
+
+        const double d = std::chrono::duration<double, std::micro>(end - start).count();
+
+        r.min_us = std::min(r.min_us, d);
+        r.mean_us += d;
+    }
+
+    r.mean_us /= s.iterations;
+
+    s.results.push_back(r);
+
+    std::cout << std::left << std::setw(46) << r.key() << std::right << std::fixed << std::setprecision(1)
+              << " min:" << std::setw(12) << r.min_us << "us mean:" << std::setw(12) << r.mean_us << "us" << std::endl;
+}
+
+const auto no_init = [](auto& /*layer*/) {};
+
+const auto uniform_fill = [](auto& input) {
+    input = etl::uniform_generator(-1.0, 1.0);
+};
+
+template <size_t V>
+void index_fill(auto& input) {
+    std::default_random_engine rng;
+    std::uniform_int_distribution<size_t> dist(0, V - 1);
+
+    for (size_t i = 0; i < etl::size(input); ++i) {
+        input[i] = dist(rng);
+    }
+}
+
+/*!
+ * \brief Measure the three operations of one layer.
+ *
+ * The backward operation is the adaptation and the propagation of the
+ * errors of an inner layer. The gradients operation is measured on the
+ * context of a first layer. The recurrent layers compute their gradients
+ * during the backpropagation through time, their backward operation
+ * therefore includes the gradients.
+ */
+template <size_t B, typename Layer, typename Init, typename Fill>
+void bench_layer(suite& s, const std::string& name, const std::string& variant, const std::string& shape, Init init, Fill fill) {
+    if (!s.selected(name)) {
+        return;
+    }
+
+    using network_t = bench_network<Layer, B>;
+
+    // The layers and the contexts may be too large for the stack
+    auto layer = std::make_unique<Layer>();
+    init(*layer);
+
+    auto ctx       = std::make_unique<dll::full_sgd_context<network_t, Layer, 1>>(*layer);
+    auto first_ctx = std::make_unique<dll::full_sgd_context<network_t, Layer, 0>>(*layer);
+
+    fill(ctx->input);
+    ctx->errors = etl::uniform_generator(-1.0, 1.0);
+
+    first_ctx->input = ctx->input;
+
+    auto errors       = ctx->errors;
+    auto input_errors = ctx->input;
+
+    auto& l = *layer;
+
+    measure(s, {name, variant, shape, B, "forward"}, [] {}, [&] {
+        l.train_forward_batch(ctx->output, ctx->input);
+    });
+
+    if constexpr (requires { l.backward_batch(input_errors, *ctx); }) {
+        measure(s, {name, variant, shape, B, "backward"},
+                [&] {
+                    l.train_forward_batch(ctx->output, ctx->input);
+                    ctx->errors = errors;
+                },
+                [&] {
+                    l.adapt_errors(*ctx);
+                    l.backward_batch(input_errors, *ctx);
+                });
+    }
+
+    measure(s, {name, variant, shape, B, "gradients"},
+            [&] {
+                l.train_forward_batch(first_ctx->output, first_ctx->input);
+                first_ctx->errors = errors;
+                l.adapt_errors(*first_ctx);
+            },
+            [&] {
+                l.compute_gradients(*first_ctx);
+            });
+}
+
+template <size_t B, size_t V, size_t H>
+void bench_dense(suite& s) {
+    bench_layer<B, dll::dense_layer<V, H>>(s, "dense", "static", shape_of(V, H), no_init, uniform_fill);
+    bench_layer<B, dll::dyn_dense_layer<>>(s, "dense", "dyn", shape_of(V, H), [](auto& l) { l.init_layer(V, H); }, uniform_fill);
+}
+
+template <size_t B, size_t NC, size_t NV, size_t K, size_t NW>
+void bench_conv(suite& s) {
+    const auto shape = shape_of(NC, NV, NV, K, NW, NW);
+
+    bench_layer<B, dll::conv_layer<NC, NV, NV, K, NW, NW>>(s, "conv", "static", shape, no_init, uniform_fill);
+    bench_layer<B, dll::dyn_conv_layer<>>(s, "conv", "dyn", shape, [](auto& l) { l.init_layer(NC, NV, NV, K, NW, NW); }, uniform_fill);
+}
+
+template <size_t B, size_t NC, size_t NV, size_t K, size_t NW>
+void bench_conv_same(suite& s) {
+    const auto shape = shape_of(NC, NV, NV, K, NW, NW);
+
+    bench_layer<B, dll::conv_same_layer<NC, NV, NV, K, NW, NW>>(s, "conv_same", "static", shape, no_init, uniform_fill);
+    bench_layer<B, dll::dyn_conv_same_desc<>::layer_t>(s, "conv_same", "dyn", shape, [](auto& l) { l.init_layer(NC, NV, NV, K, NW, NW); }, uniform_fill);
+}
+
+template <size_t B, size_t NC, size_t NV, size_t K, size_t NW>
+void bench_deconv(suite& s) {
+    const auto shape = shape_of(NC, NV, NV, K, NW, NW);
+
+    bench_layer<B, dll::deconv_layer<NC, NV, NV, K, NW, NW>>(s, "deconv", "static", shape, no_init, uniform_fill);
+    bench_layer<B, dll::dyn_deconv_layer<>>(s, "deconv", "dyn", shape, [](auto& l) { l.init_layer(NC, NV, NV, K, NW, NW); }, uniform_fill);
+}
+
+template <size_t B, size_t C, size_t W, size_t P>
+void bench_pooling(suite& s) {
+    const auto shape = shape_of(C, W, W, P, P);
+
+    bench_layer<B, dll::mp_2d_layer<C, W, W, P, P>>(s, "pooling", "static", shape, no_init, uniform_fill);
+    bench_layer<B, dll::dyn_mp_2d_layer<>>(s, "pooling", "dyn", shape, [](auto& l) { l.init_layer(C, W, W, P, P, P, P, 0, 0); }, uniform_fill);
+}
+
+template <size_t B, size_t I>
+void bench_bn_2d(suite& s) {
+    bench_layer<B, dll::batch_normalization_2d_layer<I>>(s, "bn", "static", shape_of(I), no_init, uniform_fill);
+    bench_layer<B, dll::dyn_batch_normalization_2d_layer<>>(s, "bn", "dyn", shape_of(I), [](auto& l) { l.init_layer(I); }, uniform_fill);
+}
+
+template <size_t B, size_t K, size_t W>
+void bench_bn_4d(suite& s) {
+    const auto shape = shape_of(K, W, W);
+
+    bench_layer<B, dll::batch_normalization_4d_layer<K, W, W>>(s, "bn", "static", shape, no_init, uniform_fill);
+    bench_layer<B, dll::dyn_batch_normalization_4d_layer<>>(s, "bn", "dyn", shape, [](auto& l) { l.init_layer(K, W, W); }, uniform_fill);
+}
+
+template <size_t B, size_t T, size_t SL, size_t H>
+void bench_lstm(suite& s) {
+    const auto shape = shape_of(T, SL, H);
+
+    bench_layer<B, dll::lstm_layer<T, SL, H>>(s, "lstm", "static", shape, no_init, uniform_fill);
+    bench_layer<B, dll::dyn_lstm_layer<>>(s, "lstm", "dyn", shape, [](auto& l) { l.init_layer(T, SL, H); }, uniform_fill);
+}
+
+template <size_t B, size_t T, size_t SL, size_t H>
+void bench_rnn(suite& s) {
+    const auto shape = shape_of(T, SL, H);
+
+    bench_layer<B, dll::rnn_layer<T, SL, H>>(s, "rnn", "static", shape, no_init, uniform_fill);
+    bench_layer<B, dll::dyn_rnn_layer<>>(s, "rnn", "dyn", shape, [](auto& l) { l.init_layer(T, SL, H); }, uniform_fill);
+}
+
+template <size_t B, size_t V, size_t I, size_t K>
+void bench_embedding(suite& s) {
+    const auto shape = shape_of(V, I, K);
+
+    bench_layer<B, dll::embedding_layer<V, I, K>>(s, "embedding", "static", shape, no_init, [](auto& input) { index_fill<V>(input); });
+    bench_layer<B, dll::dyn_embedding_layer<>>(s, "embedding", "dyn", shape, [](auto& l) { l.init_layer(V, I, K); }, [](auto& input) { index_fill<V>(input); });
+}
+
+template <size_t B, size_t V, size_t H>
+void bench_rbm(suite& s) {
+    bench_layer<B, dll::rbm<V, H>>(s, "rbm", "static", shape_of(V, H), no_init, uniform_fill);
+    bench_layer<B, dll::dyn_rbm_desc<>::layer_t>(s, "rbm", "dyn", shape_of(V, H), [](auto& l) { l.init_layer(V, H); }, uniform_fill);
+}
+
+template <size_t B, size_t NC, size_t NV, size_t K, size_t NW>
+void bench_crbm(suite& s) {
+    const auto shape = shape_of(NC, NV, NV, K, NW, NW);
+
+    bench_layer<B, dll::conv_rbm<NC, NV, NV, K, NW, NW>>(s, "crbm", "static", shape, no_init, uniform_fill);
+    bench_layer<B, dll::dyn_conv_rbm_desc<>::layer_t>(s, "crbm", "dyn", shape, [](auto& l) { l.init_layer(NC, NV, NV, K, NW, NW); }, uniform_fill);
+}
+
+/*!
+ * \brief The grid of shapes, for one batch size
+ */
+template <size_t B>
+void bench_batch(suite& s) {
+    bench_dense<B, 784, 500>(s);
+    bench_dense<B, 1000, 1000>(s);
+
+    bench_conv<B, 1, 28, 16, 5>(s);
+    bench_conv<B, 16, 12, 32, 3>(s);
+
+    bench_conv_same<B, 1, 28, 16, 5>(s);
+    bench_conv_same<B, 16, 14, 32, 3>(s);
+
+    bench_deconv<B, 16, 12, 1, 5>(s);
+    bench_deconv<B, 32, 10, 16, 3>(s);
+
+    bench_pooling<B, 16, 24, 2>(s);
+    bench_pooling<B, 32, 10, 2>(s);
+
+    bench_bn_2d<B, 500>(s);
+    bench_bn_4d<B, 16, 24>(s);
+
+    bench_lstm<B, 28, 28, 100>(s);
+    bench_lstm<B, 16, 64, 128>(s);
+
+    bench_rnn<B, 28, 28, 100>(s);
+    bench_rnn<B, 16, 64, 128>(s);
+
+    bench_embedding<B, 1000, 20, 50>(s);
+    bench_embedding<B, 10000, 50, 100>(s);
+
+    bench_rbm<B, 784, 500>(s);
+    bench_rbm<B, 1000, 1000>(s);
+
+    bench_crbm<B, 1, 28, 20, 5>(s);
+    bench_crbm<B, 20, 12, 40, 3>(s);
+}
+
+void write_json(const suite& s, const std::string& file) {
+    std::ofstream out(file);
+
+    if (!out) {
+        std::cerr << "Impossible to write the results to " << file << std::endl;
+        return;
+    }
+
+    out << "{\n";
+    out << "  \"iterations\": " << s.iterations << ",\n";
+    out << "  \"threads\": " << etl::threads << ",\n";
+    out << "  \"results\": [\n";
+
+    // One result per line, the baseline reader relies on it
+    for (size_t i = 0; i < s.results.size(); ++i) {
+        auto& r = s.results[i];
+
+        out << "    {\"name\": \"" << r.name << "\", \"variant\": \"" << r.variant << "\", \"shape\": \"" << r.shape << "\", \"batch\": " << r.batch
+            << ", \"op\": \"" << r.op << "\", \"min_us\": " << r.min_us << ", \"mean_us\": " << r.mean_us << "}"
+            << (i + 1 < s.results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n";
+    out << "}\n";
+}
+
+std::string json_value(const std::string& line, const std::string& key) {
+    auto pos = line.find("\"" + key + "\":");
+
+    if (pos == std::string::npos) {
+        return {};
+    }
+
+    pos = line.find_first_not_of(' ', pos + key.size() + 3);
+
+    if (line[pos] == '"') {
+        return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+    }
+
+    return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+
+/*!
+ * \brief Compare the results against a baseline written by this program.
+ *
+ * The fastest iterations are compared, they are much less noisy than the
+ * means.
+ *
+ * \return true if there is no regression
+ */
+bool compare(const suite& s, const std::string& file, double threshold) {
+    std::ifstream in(file);
+
+    if (!in) {
+        std::cerr << "Impossible to read the baseline " << file << std::endl;
+        return false;
+    }
+
+    std::map<std::string, double> baseline;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.find("\"name\"") == std::string::npos) {
+            continue;
+        }
+
+        result r{json_value(line, "name"), json_value(line, "variant"), json_value(line, "shape"),
+                 std::stoul(json_value(line, "batch")), json_value(line, "op"), 0.0, 0.0};
+
+        baseline[r.key()] = std::stod(json_value(line, "min_us"));
+    }
+
+    size_t regressions = 0;
+    size_t missing     = 0;
+
+    std::cout << "\nComparison against " << file << " (threshold " << threshold << "%)" << std::endl;
+
+    for (auto& r : s.results) {
+        auto it = baseline.find(r.key());
+
+        if (it == baseline.end()) {
+            ++missing;
+            continue;
+        }
+
+        const double change = 100.0 * (r.min_us - it->second) / it->second;
+
+        if (change > threshold) {
+            ++regressions;
+
+            std::cout << "REGRESSION " << r.key() << ": " << it->second << "us -> " << r.min_us << "us (+" << change << "%)" << std::endl;
+        }
+    }
+
+    std::cout << regressions << " regressions, " << missing << " cases not in the baseline" << std::endl;
+
+    return !regressions;
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    suite s;
+
+    std::string output;
+    std::string baseline;
+    double threshold = 10.0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+
+        if (arg == "--filter") {
+            s.filter = argv[i + 1];
+        } else if (arg == "--iterations") {
+            s.iterations = std::max(1UL, std::stoul(argv[i + 1]));
+        } else if (arg == "--output") {
+            output = argv[i + 1];
+        } else if (arg == "--baseline") {
+            baseline = argv[i + 1];
+        } else if (arg == "--threshold") {
+            threshold = std::stod(argv[i + 1]);
+        } else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << etl::threads << " maximum threads" << std::endl;
+
+    bench_batch<32>(s);
+    bench_batch<128>(s);
+
+    if (!output.empty()) {
+        write_json(s, output);
+    }
+
+    if (!baseline.empty()) {
+        return compare(s, baseline, threshold) ? 0 : 1;
+    }
+
+    return 0;
+}
@@ -42,15 +42,23 @@ int main(int /*argc*/, char* /*argv*/ []) {
     net->display_pretty();
     dataset.display_pretty();
 
+    // Record the trace of the training
+    dll::start_tracing();
+
     // Train the network
     net->train(dataset.train(), 5);
 
+    dll::stop_tracing();
+
     // Test the network on test set
     net->evaluate(dataset.test());
 
     // Show where the time was spent
     dll::dump_timers_pretty();
 
+    // Export the trace, to be opened in a trace viewer
+    dll::export_chrome_trace("mnist_cnn_perf.trace.json");
+
     // Show ETL performance counters
     etl::dump_counters_pretty();
 
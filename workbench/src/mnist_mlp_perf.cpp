@@ -50,6 +50,9 @@ int main(int /*argc*/, char* /*argv*/ []) {
     // Show where the time was spent
     dll::dump_timers_pretty();
 
+    // Show the achieved performance of the layers
+    net->display_roofline();
+
     // Show ETL performance counters
     etl::dump_counters_pretty();
 